@@ -0,0 +1,509 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define ALIGN_NEG (INT32_MIN / 4)       // minus infinity, room left for subtractions
+#define ALIGN_MAX_CELLS (1UL << 28)     // traceback matrix limit (1 byte per cell)
+#define ALIGN_SRC_DIAG  0
+#define ALIGN_SRC_E     1               // horizontal: target base against a query gap (D)
+#define ALIGN_SRC_F     2               // vertical: query base against a target gap (I)
+#define ALIGN_SRC_START 3               // local alignment start
+#define ALIGN_E_EXT     0x4             // E extended from the left cell E
+#define ALIGN_F_EXT     0x8             // F extended from the upper cell F
+
+const GeneticsAlignParams GeneticsAlignDefaults = {GENETICS_ALIGN_GLOBAL, 2, -3, 5, 2, 0, false, false};
+
+/**
+ * @brief sequences to align, 2 bit codes in reading direction
+ */
+typedef struct _AlignInput
+{
+    uint8_t *q;
+    size_t n;
+    uint8_t *t;
+    size_t m;
+} AlignInput;
+
+/**
+ * @brief cell ending the best alignment: i query bases and j target bases consumed
+ */
+typedef struct _AlignEnd
+{
+    int score;
+    size_t i;
+    size_t j;
+} AlignEnd;
+
+/**
+ * @brief copy a strand in reading direction, complement applied
+ */
+static uint8_t *GatherStrand(GeneticsObj *_this, const OutStrand *s)
+{
+    uint8_t *seq = Mem_Alloc(_this, s->size ? s->size : 1);
+    const uint8_t *q = View_Read(_this->kernels, s->seq, s->step, 0, s->size, s->complement, seq);
+    if (q != seq && s->size > 0)
+        memcpy(seq, q, s->size);
+    return seq;
+}
+
+/**
+ * @brief score of the first row and column: end gaps are free for local, and for the target in semi-global
+ */
+static inline int BorderScore(const GeneticsAlignParams *p, size_t k, bool target)
+{
+    if (k == 0 || p->mode == GENETICS_ALIGN_LOCAL || (target && p->mode == GENETICS_ALIGN_SEMI_GLOBAL))
+        return 0;
+    return -(p->gapOpen + (int)k * p->gapExtend);
+}
+
+/**
+ * @brief Gotoh affine gap dynamic programming, rows are query bases, columns target bases.
+ *        Only diagonals [lo, hi] (j - i) are computed. With tb the traceback byte of every computed
+ *        cell is stored at i * width + j - max(0, i + lo).
+ */
+static AlignEnd AlignScalar(GeneticsObj *_this, const AlignInput *in, const GeneticsAlignParams *p, long lo,
+                            long hi, uint8_t *tb, size_t width)
+{
+    const int oe = p->gapOpen + p->gapExtend, ext = p->gapExtend;
+    const bool local = p->mode == GENETICS_ALIGN_LOCAL;
+    int *H = Mem_Alloc(_this, 2 * (in->m + 1) * sizeof(int)), *F = H + in->m + 1;
+    for (size_t j = 0; j <= in->m; j++)
+    {
+        H[j] = (long)j <= hi ? BorderScore(p, j, true) : ALIGN_NEG;
+        F[j] = ALIGN_NEG;
+    }
+    AlignEnd end = {ALIGN_NEG, 0, 0};
+    if (local || in->n == 0)
+        end.score = local ? 0 : H[(long)in->m <= hi ? in->m : 0];
+    if (in->n == 0)
+        end.j = p->mode == GENETICS_ALIGN_GLOBAL ? in->m : 0;
+
+    for (size_t i = 1; i <= in->n; i++)
+    {
+        long b = (long)i + lo, e = (long)i + hi;
+        size_t jb = b > 0 ? (size_t)b : 0, je = e < (long)in->m ? (size_t)e : in->m;
+        uint8_t *row = tb ? tb + i * width - jb : NULL;
+        const uint8_t qi = in->q[i - 1];
+        int diag, left, E = ALIGN_NEG;
+        size_t j = jb;
+        if (jb == 0)
+        {
+            diag = H[0];
+            H[0] = F[0] = left = BorderScore(p, i, false);
+            j = 1;
+        }
+        else
+        {
+            diag = H[jb - 1];
+            left = ALIGN_NEG;
+        }
+        for (; j <= je; j++)
+        {
+            int eExt = E - ext, eOpen = left - oe;
+            int fExt = F[j] - ext, fOpen = H[j] - oe;
+            E = eExt > eOpen ? eExt : eOpen;
+            int f = fExt > fOpen ? fExt : fOpen;
+            int h = diag + (qi == in->t[j - 1] ? p->match : p->mismatch);
+            uint8_t src = ALIGN_SRC_DIAG;
+            if (E > h)
+            {
+                h = E;
+                src = ALIGN_SRC_E;
+            }
+            if (f > h)
+            {
+                h = f;
+                src = ALIGN_SRC_F;
+            }
+            if (local && h <= 0)
+            {
+                h = 0;
+                src = ALIGN_SRC_START;
+            }
+            diag = H[j];
+            H[j] = left = h;
+            F[j] = f;
+            if (row)
+                row[j] = src | (eExt > eOpen ? ALIGN_E_EXT : 0) | (fExt > fOpen ? ALIGN_F_EXT : 0);
+            if (local && h > end.score)
+            {
+                end.score = h;
+                end.i = i;
+                end.j = j;
+            }
+        }
+    }
+    if (in->n > 0 && p->mode == GENETICS_ALIGN_SEMI_GLOBAL)
+    {
+        long b = (long)in->n + lo, e = (long)in->n + hi;
+        for (size_t j = b > 0 ? b : 0; j <= (e < (long)in->m ? (size_t)e : in->m); j++)
+        {
+            if (H[j] > end.score)
+            {
+                end.score = H[j];
+                end.i = in->n;
+                end.j = j;
+            }
+        }
+    }
+    else if (in->n > 0 && p->mode == GENETICS_ALIGN_GLOBAL)
+    {
+        end.score = H[in->m];
+        end.i = in->n;
+        end.j = in->m;
+    }
+    Mem_Free(_this, H, 2 * (in->m + 1) * sizeof(int));
+    return end;
+}
+
+#ifdef __SSE2__
+#define ALIGN_LANES 8       // int16 lanes of a SSE2 register
+#define ALIGN_MAX_SCORE 30000
+
+static inline int16_t LaneMax(__m128i v)
+{
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epi16(v, _mm_srli_si128(v, 2));
+    return (int16_t)_mm_extract_epi16(v, 0);
+}
+
+static inline int16_t LaneGet(__m128i v, size_t lane)
+{
+    int16_t lanes[ALIGN_LANES];
+    _mm_storeu_si128((__m128i *)lanes, v);
+    return lanes[lane];
+}
+
+/**
+ * @brief striped (Farrar) score only alignment, 8 x int16 lanes. Query base i is in lane
+ *        i / segments of segment i % segments, so the vertical dependency is resolved by the
+ *        lazy F loop instead of inside the inner loop.
+ *
+ * @return false if scores could overflow 16 bits
+ */
+static bool AlignStriped(GeneticsObj *_this, const AlignInput *in, const GeneticsAlignParams *p, AlignEnd *end)
+{
+    int worst = p->match > -p->mismatch ? p->match : -p->mismatch;
+    if (p->gapExtend > worst)
+        worst = p->gapExtend;
+    if (in->n == 0 || (uint64_t)worst * (in->n + in->m) + 2 * (uint64_t)p->gapOpen > ALIGN_MAX_SCORE)
+        return false;
+
+    const bool local = p->mode == GENETICS_ALIGN_LOCAL;
+    const size_t segs = (in->n + ALIGN_LANES - 1) / ALIGN_LANES;
+    const int16_t neg = INT16_MIN; // below any score, saturated arithmetic keeps it there
+    size_t size = (4 + 3) * segs * sizeof(__m128i) + sizeof(__m128i);
+    void *block = Mem_Alloc(_this, size);
+    __m128i *profile = (__m128i *)(((uintptr_t)block + 15) & ~(uintptr_t)15); // 4 bases x segs
+    __m128i *hLoad = profile + 4 * segs, *hStore = hLoad + segs, *vE = hStore + segs;
+    int16_t *lanes = (int16_t *)profile;
+    for (int b = 0; b < 4; b++)
+        for (size_t s = 0; s < segs; s++)
+            for (size_t l = 0; l < ALIGN_LANES; l++)
+            {
+                size_t i = l * segs + s;
+                lanes[(b * segs + s) * ALIGN_LANES + l] = i < in->n ? (in->q[i] == b ? p->match : p->mismatch) : neg;
+            }
+    for (size_t s = 0; s < segs; s++)
+    {
+        int16_t h[ALIGN_LANES], e[ALIGN_LANES];
+        for (size_t l = 0; l < ALIGN_LANES; l++)
+        {
+            size_t i = l * segs + s;
+            h[l] = i < in->n ? BorderScore(p, i + 1, false) : neg;
+            e[l] = i < in->n ? h[l] - p->gapOpen - p->gapExtend : neg;
+        }
+        hLoad[s] = _mm_loadu_si128((__m128i *)h);
+        vE[s] = _mm_loadu_si128((__m128i *)e);
+    }
+
+    const __m128i vOpenExt = _mm_set1_epi16(p->gapOpen + p->gapExtend), vExt = _mm_set1_epi16(p->gapExtend);
+    const __m128i vNeg = _mm_set1_epi16(neg), vZero = _mm_setzero_si128();
+    const size_t lastSeg = (in->n - 1) % segs, lastLane = (in->n - 1) / segs;
+    end->score = local ? 0 : neg;
+    end->i = end->j = 0;
+    for (size_t j = 1; j <= in->m; j++)
+    {
+        const __m128i *vP = profile + in->t[j - 1] * segs;
+        __m128i vF = _mm_insert_epi16(vNeg, BorderScore(p, j, true) - p->gapOpen - p->gapExtend, 0);
+        __m128i vH = _mm_insert_epi16(_mm_slli_si128(hLoad[segs - 1], 2), BorderScore(p, j - 1, true), 0);
+        for (size_t s = 0; s < segs; s++)
+        {
+            vH = _mm_adds_epi16(vH, vP[s]);
+            vH = _mm_max_epi16(vH, vE[s]);
+            vH = _mm_max_epi16(vH, vF);
+            if (local)
+                vH = _mm_max_epi16(vH, vZero);
+            hStore[s] = vH;
+            __m128i vHo = _mm_subs_epi16(vH, vOpenExt);
+            vE[s] = _mm_max_epi16(_mm_subs_epi16(vE[s], vExt), vHo);
+            vF = _mm_max_epi16(_mm_subs_epi16(vF, vExt), vHo);
+            vH = hLoad[s];
+        }
+        for (int k = 0; k < ALIGN_LANES; k++) // lazy F: carry F across lanes until it changes nothing
+        {
+            vF = _mm_insert_epi16(_mm_slli_si128(vF, 2), neg, 0);
+            size_t s = 0;
+            for (; s < segs; s++)
+            {
+                vH = _mm_max_epi16(hStore[s], vF);
+                hStore[s] = vH;
+                __m128i vHo = _mm_subs_epi16(vH, vOpenExt);
+                vE[s] = _mm_max_epi16(vE[s], vHo);
+                vF = _mm_subs_epi16(vF, vExt);
+                if (!_mm_movemask_epi8(_mm_cmpgt_epi16(vF, vHo)))
+                    break;
+            }
+            if (s < segs)
+                break;
+        }
+        if (local)
+        {
+            __m128i vMax = hStore[0];
+            for (size_t s = 1; s < segs; s++)
+                vMax = _mm_max_epi16(vMax, hStore[s]);
+            int16_t best = LaneMax(vMax);
+            if (best > end->score)
+            {
+                end->score = best;
+                end->i = 0;
+                end->j = j;
+                for (size_t s = 0; s < segs && end->i == 0; s++)
+                    for (size_t l = 0; l < ALIGN_LANES; l++)
+                        if (LaneGet(hStore[s], l) == best && l * segs + s < in->n)
+                        {
+                            end->i = l * segs + s + 1;
+                            break;
+                        }
+            }
+        }
+        else if (p->mode == GENETICS_ALIGN_SEMI_GLOBAL || j == in->m)
+        {
+            int16_t h = LaneGet(hStore[lastSeg], lastLane); // last query base
+            if (p->mode == GENETICS_ALIGN_GLOBAL || h > end->score)
+            {
+                end->score = h;
+                end->i = in->n;
+                end->j = j;
+            }
+        }
+        __m128i *swap = hLoad;
+        hLoad = hStore;
+        hStore = swap;
+    }
+    if (in->m == 0 && !local)
+    {
+        end->score = BorderScore(p, in->n, false);
+        end->i = in->n;
+    }
+    Mem_Free(_this, block, size);
+    return true;
+}
+#endif
+
+/**
+ * @brief make room for size + 24 bytes of CIGAR in the object buffer
+ */
+static void CigarReserve(GeneticsObj *_this, size_t size)
+{
+    if (size + 24 > _this->alignCigarAlloc)
+    {
+        size_t alloc = 2 * _this->alignCigarAlloc + 256;
+        _this->alignCigar = Mem_Realloc(_this, _this->alignCigar, _this->alignCigarAlloc, alloc);
+        _this->alignCigarAlloc = alloc;
+    }
+}
+
+/**
+ * @brief append count op to the CIGAR of the object
+ */
+static void CigarAppend(GeneticsObj *_this, size_t *size, char op, size_t count)
+{
+    CigarReserve(_this, *size);
+    *size += snprintf(_this->alignCigar + *size, _this->alignCigarAlloc - *size, "%lu%c", count, op);
+}
+
+/**
+ * @brief follow the traceback from the end cell, fill the CIGAR and the counts
+ *
+ * @return first cell (query and target bases before the alignment)
+ */
+static AlignEnd Traceback(GeneticsObj *_this, const AlignInput *in, const GeneticsAlignParams *p, const uint8_t *tb,
+                          size_t width, long lo, const AlignEnd *end, GeneticsAlignment *a)
+{
+    char *ops = Mem_Alloc(_this, in->n + in->m + 1);
+    size_t count = 0, i = end->i, j = end->j;
+    int state = ALIGN_SRC_DIAG;
+    while (i > 0 || j > 0)
+    {
+        if (i == 0 || j == 0)
+        {
+            if (p->mode == GENETICS_ALIGN_LOCAL || (i == 0 && p->mode == GENETICS_ALIGN_SEMI_GLOBAL))
+                break;
+            for (; i > 0; i--)
+                ops[count++] = 'I';
+            for (; j > 0; j--)
+                ops[count++] = 'D';
+            break;
+        }
+        long b = (long)i + lo;
+        uint8_t cell = tb[i * width + j - (b > 0 ? b : 0)];
+        if (state == ALIGN_SRC_DIAG)
+        {
+            state = cell & 0x3;
+            if (state == ALIGN_SRC_START)
+                break;
+            if (state == ALIGN_SRC_DIAG)
+            {
+                ops[count++] = in->q[i - 1] == in->t[j - 1] ? '=' : 'X';
+                i--;
+                j--;
+            }
+        }
+        else if (state == ALIGN_SRC_E)
+        {
+            ops[count++] = 'D';
+            j--;
+            if (!(cell & ALIGN_E_EXT))
+                state = ALIGN_SRC_DIAG;
+        }
+        else
+        {
+            ops[count++] = 'I';
+            i--;
+            if (!(cell & ALIGN_F_EXT))
+                state = ALIGN_SRC_DIAG;
+        }
+    }
+    size_t size = 0;
+    CigarReserve(_this, size);
+    _this->alignCigar[0] = 0;
+    for (size_t k = count; k > 0;)
+    {
+        char op = ops[k - 1];
+        size_t run = 0;
+        for (; k > 0 && ops[k - 1] == op; k--)
+            run++;
+        CigarAppend(_this, &size, op, run);
+        if (op == '=')
+            a->matches += run;
+        else if (op == 'X')
+            a->mismatches += run;
+        else
+            a->gaps += run;
+    }
+    Mem_Free(_this, ops, in->n + in->m + 1);
+    a->cigar = _this->alignCigar;
+    AlignEnd first = {end->score, i, j};
+    return first;
+}
+
+static bool Align(GeneticsObj *_this, GeneticsObj *target, const GeneticsAlignParams *p, GeneticsAlignment *a)
+{
+    memset(a, 0, sizeof(GeneticsAlignment));
+    if (p->match <= 0 || p->mismatch >= 0 || p->gapOpen < 0 || p->gapExtend <= 0)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: align needs match > 0, mismatch < 0, gap open >= 0, gap extend > 0");
+        return false;
+    }
+    OutStrand qs, ts;
+    Out_OpenStrand(_this, p->reverse ? DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT : 0, &qs);
+    Out_OpenStrand(target, 0, &ts);
+    AlignInput in = {GatherStrand(_this, &qs), qs.size, GatherStrand(_this, &ts), ts.size};
+    long lo = -(long)in.n, hi = (long)in.m;
+    if (p->band > 0)
+    {
+        long diff = (long)in.m - (long)in.n;
+        if ((diff < 0 ? 0 : diff) + (long)p->band < hi)
+            hi = (diff < 0 ? 0 : diff) + (long)p->band;
+        if ((diff > 0 ? 0 : diff) - (long)p->band > lo)
+            lo = (diff > 0 ? 0 : diff) - (long)p->band;
+    }
+    size_t width = p->band > 0 ? (size_t)(hi - lo + 1) : in.m + 1;
+    bool ok = true;
+    AlignEnd end;
+    if (p->scoreOnly)
+    {
+        bool striped = false;
+#ifdef __SSE2__
+        striped = p->band == 0 && AlignStriped(_this, &in, p, &end);
+#endif
+        if (!striped)
+            end = AlignScalar(_this, &in, p, lo, hi, NULL, 0);
+    }
+    else if ((in.n + 1) > ALIGN_MAX_CELLS / width)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0,
+                  "ERROR: alignment of %lu x %lu bases is too large for a traceback, use a band or score only",
+                  in.n, in.m);
+        ok = false;
+    }
+    else
+    {
+        uint8_t *tb = Mem_Alloc(_this, (in.n + 1) * width);
+        end = AlignScalar(_this, &in, p, lo, hi, tb, width);
+        AlignEnd first = Traceback(_this, &in, p, tb, width, lo, &end, a);
+        Mem_Free(_this, tb, (in.n + 1) * width);
+        if (end.i > first.i)
+            a->queryBegin = Out_StrandOffset(&qs, first.i);
+        if (end.j > first.j)
+            a->targetBegin = Out_StrandOffset(&ts, first.j);
+    }
+    if (ok)
+    {
+        a->score = end.score;
+        if (end.i > 0)
+            a->queryEnd = Out_StrandOffset(&qs, end.i - 1);
+        if (end.j > 0)
+            a->targetEnd = Out_StrandOffset(&ts, end.j - 1);
+        if (p->scoreOnly && p->mode == GENETICS_ALIGN_GLOBAL && in.n > 0 && in.m > 0)
+        {
+            a->queryBegin = Out_StrandOffset(&qs, 0);
+            a->targetBegin = Out_StrandOffset(&ts, 0);
+        }
+    }
+    STATS_ADD(&_this->stats, bases, in.n + in.m);
+    Mem_Free(_this, in.q, in.n ? in.n : 1);
+    Mem_Free(_this, in.t, in.m ? in.m : 1);
+    Out_CloseStrand(_this, &qs);
+    Out_CloseStrand(target, &ts);
+    return ok;
+}
+
+/**
+ * @brief Pairwise alignment of the sequence of this object (query) against the sequence of another
+ *        object (target, can be the same object), affine gap scores (Gotoh).
+ *        Both sequences are read from codon_start with spliced introns removed, so a spliced CDS
+ *        can be checked against a transcript. The full mode keeps a 1 byte traceback per cell,
+ *        the banded mode only the diagonals within band of the main diagonal (long near identical
+ *        sequences), the score only mode linear memory with a striped SIMD kernel when available.
+ *
+ * @param _this     genetics object with the query sequence
+ * @param target    genetics object with the target sequence
+ * @param params    scores and mode, NULL for GeneticsAlignDefaults
+ * @param alignment filled with score, coordinates and CIGAR
+ * @return false on invalid parameters or if the traceback matrix is too large
+ */
+bool Genetics_Align(GeneticsObj *_this, GeneticsObj *target, const GeneticsAlignParams *params,
+                    GeneticsAlignment *alignment)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_ALIGN);
+    bool ok = Align(_this, target, params ? params : &GeneticsAlignDefaults, alignment);
+    STATS_END();
+    return ok;
+}
@@ -0,0 +1,239 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_ALIGN_SIZE(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct _ArenaBlock
+{
+    struct _ArenaBlock *next;
+    size_t size;    // usable bytes after the header
+    size_t used;
+} ArenaBlock;
+#define ARENA_BLOCK_HEADER ARENA_ALIGN_SIZE(sizeof(ArenaBlock))
+#define ARENA_BLOCK_DATA(block) ((uint8_t *)(block) + ARENA_BLOCK_HEADER)
+
+struct _GeneticsArena
+{
+    ArenaBlock *blocks;     // current block first
+    size_t blockSize;
+    void *last;             // last allocation, can be grown or released in place
+};
+
+static ArenaBlock *ArenaNewBlock(GeneticsArena *arena, size_t size)
+{
+    if (size < arena->blockSize)
+        size = arena->blockSize;
+    ArenaBlock *block = (ArenaBlock *)malloc(ARENA_BLOCK_HEADER + size);
+    if (!block)
+        return NULL;
+    block->size = size;
+    block->used = 0;
+    block->next = arena->blocks;
+    arena->blocks = block;
+    return block;
+}
+
+static void *ArenaAlloc(void *ctx, size_t size)
+{
+    GeneticsArena *arena = ctx;
+    size = ARENA_ALIGN_SIZE(size);
+    ArenaBlock *block = arena->blocks;
+    if (!block || block->size - block->used < size)
+    {
+        // reuse a block kept by Genetics_ArenaReset() if big enough, else get a new one
+        ArenaBlock *prev = block, *b = block ? block->next : NULL;
+        while (b && b->size - b->used < size)
+        {
+            prev = b;
+            b = b->next;
+        }
+        if (b)
+        {
+            prev->next = b->next;
+            b->next = arena->blocks;
+            arena->blocks = b;
+            block = b;
+        }
+        else if (!(block = ArenaNewBlock(arena, size)))
+        {
+            return NULL;
+        }
+    }
+    void *ptr = ARENA_BLOCK_DATA(block) + block->used;
+    block->used += size;
+    arena->last = ptr;
+    return ptr;
+}
+
+static void *ArenaRealloc(void *ctx, void *ptr, size_t oldSize, size_t size)
+{
+    GeneticsArena *arena = ctx;
+    if (!ptr)
+        return ArenaAlloc(ctx, size);
+    ArenaBlock *block = arena->blocks;
+    if (ptr == arena->last)
+    { // grow/shrink in place
+        size_t offset = (uint8_t *)ptr - ARENA_BLOCK_DATA(block);
+        if (offset + ARENA_ALIGN_SIZE(size) <= block->size)
+        {
+            block->used = offset + ARENA_ALIGN_SIZE(size);
+            return ptr;
+        }
+    }
+    if (size <= oldSize)
+        return ptr;
+    void *nptr = ArenaAlloc(ctx, size);
+    if (nptr)
+        memcpy(nptr, ptr, oldSize);
+    return nptr;
+}
+
+static void ArenaFree(void *ctx, void *ptr, size_t size)
+{
+    GeneticsArena *arena = ctx;
+    (void)size;
+    if (ptr && ptr == arena->last)
+    { // release the last allocation, everything else lives until reset
+        ArenaBlock *block = arena->blocks;
+        block->used = (uint8_t *)ptr - ARENA_BLOCK_DATA(block);
+        arena->last = NULL;
+    }
+}
+
+/**
+ * @brief Create a region allocator. Memory is bump allocated from blocks and released
+ *        all at once with Genetics_ArenaReset() or Genetics_ArenaDelete().
+ *        An arena is not thread safe, use one per thread.
+ *
+ * @param blockSize size of the blocks requested from malloc (0 for default 1MB)
+ * @return GeneticsArena* arena, NULL if out of memory
+ */
+GeneticsArena *Genetics_ArenaNew(size_t blockSize)
+{
+    GeneticsArena *arena = (GeneticsArena *)malloc(sizeof(GeneticsArena));
+    if (!arena)
+        return NULL;
+    memset(arena, 0, sizeof(GeneticsArena));
+    arena->blockSize = blockSize ? blockSize : 1024 * 1024;
+    return arena;
+}
+
+/**
+ * @brief Release all allocations. Blocks are kept for the next allocations.
+ *        Objects created with this arena must not be used after reset.
+ *
+ * @param arena arena created with Genetics_ArenaNew()
+ */
+void Genetics_ArenaReset(GeneticsArena *arena)
+{
+    for (ArenaBlock *block = arena->blocks; block; block = block->next)
+        block->used = 0;
+    arena->last = NULL;
+}
+
+/**
+ * @brief Delete an arena and all its blocks
+ *
+ * @param arena arena created with Genetics_ArenaNew(), NULL does nothing
+ */
+void Genetics_ArenaDelete(GeneticsArena *arena)
+{
+    if (!arena)
+        return;
+    ArenaBlock *block = arena->blocks;
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+/**
+ * @brief Get an allocator using the arena, to use with Genetics_NewWithAllocator()
+ *
+ * @param arena arena created with Genetics_ArenaNew()
+ * @return GeneticsAllocator allocator
+ */
+GeneticsAllocator Genetics_ArenaAllocator(GeneticsArena *arena)
+{
+    GeneticsAllocator allocator = {ArenaAlloc, ArenaRealloc, ArenaFree, arena};
+    return allocator;
+}
+
+static void *HeapAlloc(void *ctx, size_t size)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void *HeapRealloc(void *ctx, void *ptr, size_t oldSize, size_t size)
+{
+    (void)ctx;
+    (void)oldSize;
+    return realloc(ptr, size);
+}
+
+static void HeapFree(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+    (void)size;
+    free(ptr);
+}
+
+/**
+ * @brief default allocator (malloc/realloc/free)
+ */
+const GeneticsAllocator GeneticsHeapAllocator = {HeapAlloc, HeapRealloc, HeapFree, NULL};
+
+static void *LockedAlloc(void *ctx, size_t size)
+{
+    LockedAllocator *a = ctx;
+    pthread_mutex_lock(&a->lock);
+    void *ptr = a->inner->alloc(a->inner->ctx, size);
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+}
+
+static void *LockedRealloc(void *ctx, void *ptr, size_t oldSize, size_t size)
+{
+    LockedAllocator *a = ctx;
+    pthread_mutex_lock(&a->lock);
+    ptr = a->inner->realloc(a->inner->ctx, ptr, oldSize, size);
+    pthread_mutex_unlock(&a->lock);
+    return ptr;
+}
+
+static void LockedFree(void *ctx, void *ptr, size_t size)
+{
+    LockedAllocator *a = ctx;
+    if (!ptr)
+        return;
+    pthread_mutex_lock(&a->lock);
+    a->inner->free(a->inner->ctx, ptr, size);
+    pthread_mutex_unlock(&a->lock);
+}
+
+/**
+ * @brief allocator of worker threads sharing an object allocator (FASTA loader, repeat detector)
+ */
+GeneticsAllocator Mem_Locked(LockedAllocator *locked)
+{
+    GeneticsAllocator allocator = {LockedAlloc, LockedRealloc, LockedFree, locked};
+    return allocator;
+}
@@ -0,0 +1,314 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define USAGE_BLOCK         4096                // codon indexes computed per block
+#define USAGE_CHUNK_MIN     (4 * 1024 * 1024)   // min bases per thread
+#define USAGE_MAX_THREADS   16
+
+typedef struct _UsageChunk
+{
+    const uint8_t *seq;
+    size_t begin, end;          // codon end positions [begin, end) handled by this chunk
+    size_t fwdFirst, revLast;   // forward codons end at >= fwdFirst, reverse codons end at <= revLast
+    size_t fwdOrigin, revOrigin;
+    uint64_t counts[CODON_FRAMES][64];
+} UsageChunk;
+
+/**
+ * @brief histogram of codons ending at j in [begin, end).
+ *        Codon indexes of a block are computed first (vectorizable, no rolling dependency)
+ *        then scattered in one histogram per frame, unrolled by 3 so the frame needs no modulo.
+ */
+static void CountRange(UsageChunk *chunk, size_t begin, size_t end, bool reverse)
+{
+    uint8_t idx[USAGE_BLOCK + 2];
+    const uint8_t *seq = chunk->seq;
+    for (size_t b = begin; b < end; b += USAGE_BLOCK)
+    {
+        size_t n = end - b < USAGE_BLOCK ? end - b : USAGE_BLOCK;
+        const uint8_t *s = seq + b;
+        if (reverse)
+        {
+            for (size_t k = 0; k < n; k++)
+                idx[k] = COMPLEMENT_CODON(CODON(s[k], s[k - 1], s[k - 2]));
+        }
+        else
+        {
+            for (size_t k = 0; k < n; k++)
+                idx[k] = CODON(s[k - 2], s[k - 1], s[k]);
+        }
+        // frame of the first codon of the block
+        int f = reverse ? (chunk->revOrigin - b) % 3 : (b - 2 - chunk->fwdOrigin) % 3;
+        uint64_t *h0, *h1, *h2;
+        int base = reverse ? 3 : 0;
+        if (reverse)
+        { // frames decrease as positions increase on the reverse strand
+            h0 = chunk->counts[base + f];
+            h1 = chunk->counts[base + (f + 2) % 3];
+            h2 = chunk->counts[base + (f + 1) % 3];
+        }
+        else
+        {
+            h0 = chunk->counts[base + f];
+            h1 = chunk->counts[base + (f + 1) % 3];
+            h2 = chunk->counts[base + (f + 2) % 3];
+        }
+        size_t k = 0;
+        for (; k + 3 <= n; k += 3)
+        {
+            h0[idx[k]]++;
+            h1[idx[k + 1]]++;
+            h2[idx[k + 2]]++;
+        }
+        if (k < n)
+            h0[idx[k++]]++;
+        if (k < n)
+            h1[idx[k]]++;
+    }
+}
+
+static void *CountChunk(void *arg)
+{
+    UsageChunk *chunk = arg;
+    size_t b = chunk->begin > chunk->fwdFirst ? chunk->begin : chunk->fwdFirst;
+    if (b < chunk->end)
+        CountRange(chunk, b, chunk->end, false);
+    size_t e = chunk->end < chunk->revLast + 1 ? chunk->end : chunk->revLast + 1;
+    if (chunk->begin < e)
+        CountRange(chunk, chunk->begin, e, true);
+    return NULL;
+}
+
+static int UsageThreads(size_t size)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = size / USAGE_CHUNK_MIN;
+    if (cpus > 0 && threads > (size_t)cpus)
+        threads = cpus;
+    if (threads > USAGE_MAX_THREADS)
+        threads = USAGE_MAX_THREADS;
+    return threads < 1 ? 1 : threads;
+}
+
+/**
+ * @brief genetic code of the codon usage (standard code if not set)
+ */
+static const TranslTable *UsageTable(const GeneticsCodonUsage *cu)
+{
+    const TranslTable *transl = transl_table_get(cu->translTable);
+    return transl ? transl : transl_table_get(1);
+}
+
+/**
+ * @brief derive amino acid composition and RSCU from the primary frame
+ */
+static void UsageDerive(GeneticsCodonUsage *cu)
+{
+    const char *aas = UsageTable(cu)->transl;
+    const uint64_t *counts = cu->counts[cu->frame];
+    uint64_t aaCodons[27] = {};
+    int synonyms[27] = {};
+    memset(cu->aa, 0, sizeof(cu->aa));
+    cu->codons = 0;
+    for (int c = 0; c < 64; c++)
+    {
+        int a = aas[c] == '*' ? 26 : aas[c] - 'A';
+        synonyms[a]++;
+        aaCodons[a] += counts[c];
+        cu->aa[a] += counts[c];
+        cu->codons += counts[c];
+    }
+    for (int c = 0; c < 64; c++)
+    {
+        int a = aas[c] == '*' ? 26 : aas[c] - 'A';
+        cu->rscu[c] = aaCodons[a] ? (double)counts[c] * synonyms[a] / aaCodons[a] : 0;
+    }
+}
+
+static bool CodonUsage(GeneticsObj *_this, DNA_PRINT_FlAGS flags, GeneticsCodonUsage *cu)
+{
+    memset(cu, 0, sizeof(GeneticsCodonUsage));
+    cu->frame = (flags & DNA_PRINT_REVERSE) ? 3 : 0;
+    cu->translTable = _this->transl->n;
+    if (_this->dnaDir == DNA_DIR_3_TO_5)
+        cu->frame = 3 - cu->frame;
+    if (_this->dnaSize < 3)
+        return false;
+
+    // spliced sequence: only exons, gathered in a temporary buffer
+    const uint8_t *seq = _this->dna;
+    uint8_t *spliced = NULL;
+    size_t size = _this->dnaSize;
+    size_t fwdOrigin = _this->start_codon - 1, revOrigin = _this->dnaSize - _this->start_codon;
+    if (_this->spliceSize > 0)
+    {
+        GeneticsRange *exons = Mem_Alloc(_this, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+        size_t n = Splice_Exons(_this, exons);
+        spliced = Mem_Alloc(_this, _this->dnaSize);
+        size = Splice_Gather(_this, exons, n, spliced, &fwdOrigin, &revOrigin);
+        Mem_Free(_this, exons, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+        seq = spliced;
+    }
+
+    int threads = UsageThreads(size);
+    UsageChunk *chunks = Mem_Alloc(_this, threads * sizeof(UsageChunk));
+    pthread_t tid[USAGE_MAX_THREADS];
+    size_t step = (size - 2 + threads - 1) / threads;
+    for (int t = 0; t < threads; t++)
+    {
+        UsageChunk *chunk = &chunks[t];
+        memset(chunk->counts, 0, sizeof(chunk->counts));
+        chunk->seq = seq;
+        chunk->begin = 2 + t * step;
+        chunk->end = chunk->begin + step < size ? chunk->begin + step : size;
+        chunk->fwdOrigin = fwdOrigin;
+        chunk->revOrigin = revOrigin;
+        chunk->fwdFirst = fwdOrigin + 2;
+        chunk->revLast = revOrigin == SIZE_MAX ? 0 : revOrigin; // < 2 means no reverse codon
+    }
+    int started = 1;
+    for (int t = 1; t < threads; t++, started++)
+        if (pthread_create(&tid[t], NULL, CountChunk, &chunks[t]))
+            break;
+    CountChunk(&chunks[0]);
+    for (int t = started; t < threads; t++)
+        CountChunk(&chunks[t]); // thread creation failed: count here
+    for (int t = 1; t < started; t++)
+        pthread_join(tid[t], NULL);
+    for (int t = 0; t < threads; t++)
+    {
+        for (int f = 0; f < CODON_FRAMES; f++)
+            for (int c = 0; c < 64; c++)
+                cu->counts[f][c] += chunks[t].counts[f][c];
+    }
+    Mem_Free(_this, chunks, threads * sizeof(UsageChunk));
+    Mem_Free(_this, spliced, _this->dnaSize);
+
+    uint64_t total = 0;
+    for (int f = 0; f < CODON_FRAMES; f++)
+        for (int c = 0; c < 64; c++)
+            total += cu->counts[f][c];
+    STATS_ADD(&_this->stats, codons, total);
+
+    UsageDerive(cu);
+    cu->cai = Genetics_CodonCAI(cu, _this->codonReference);
+    return true;
+}
+
+/**
+ * @brief Codon usage of the loaded dna: counts of the 64 codons in the 3 frames of both strands
+ *        (frames relative to codon_start, introns removed), amino acid composition and
+ *        relative synonymous codon usage of the primary frame and CAI if a reference is set.
+ *
+ * @param _this genetics object
+ * @param flags DNA_PRINT_REVERSE: primary frame on the reverse strand
+ * @param cu    filled with codon usage
+ * @return false if there is no codon
+ */
+bool Genetics_CodonUsage(GeneticsObj *_this, DNA_PRINT_FlAGS flags, GeneticsCodonUsage *cu)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_CODON_USAGE);
+    bool ret = CodonUsage(_this, flags, cu);
+    STATS_END();
+    return ret;
+}
+
+/**
+ * @brief Set reference codon counts (e.g. highly expressed genes) for the codon adaptation index
+ *
+ * @param _this genetics object
+ * @param reference codon counts, NULL to remove the reference
+ */
+void Genetics_SetCodonReference(GeneticsObj *_this, const uint64_t reference[64])
+{
+    if (!reference)
+    {
+        Mem_Free(_this, _this->codonReference, 64 * sizeof(uint64_t));
+        _this->codonReference = NULL;
+        return;
+    }
+    if (!_this->codonReference)
+        _this->codonReference = Mem_Alloc(_this, 64 * sizeof(uint64_t));
+    memcpy(_this->codonReference, reference, 64 * sizeof(uint64_t));
+}
+
+/**
+ * @brief Codon adaptation index of the primary frame against reference codon counts.
+ *        Stop codons and amino acids with a single codon are not used.
+ *
+ * @param cu        codon usage
+ * @param reference reference codon counts
+ * @return double CAI (0..1) or 0 if no reference
+ */
+double Genetics_CodonCAI(const GeneticsCodonUsage *cu, const uint64_t reference[64])
+{
+    if (!reference)
+        return 0;
+    const char *aas = UsageTable(cu)->transl;
+    uint64_t best[27] = {};
+    int synonyms[27] = {};
+    for (int c = 0; c < 64; c++)
+    {
+        int a = aas[c] == '*' ? 26 : aas[c] - 'A';
+        synonyms[a]++;
+        if (reference[c] > best[a])
+            best[a] = reference[c];
+    }
+    double logSum = 0;
+    uint64_t n = 0;
+    const uint64_t *counts = cu->counts[cu->frame];
+    for (int c = 0; c < 64; c++)
+    {
+        int a = aas[c] == '*' ? 26 : aas[c] - 'A';
+        if (a == 26 || synonyms[a] < 2 || counts[c] == 0 || best[a] == 0)
+            continue;
+        // w = RSCU / max RSCU of the synonymous codons = count / max count; 0.5 pseudo count for unseen codons
+        double w = (reference[c] ? reference[c] : 0.5) / (double)best[a];
+        logSum += counts[c] * log(w);
+        n += counts[c];
+    }
+    return n ? exp(logSum / n) : 0;
+}
+
+/**
+ * @brief Print codon usage table (tab separated) and amino acid composition
+ *
+ * @param _this genetics object
+ * @param cu    codon usage from Genetics_CodonUsage()
+ */
+void Genetics_PrintCodonUsage(GeneticsObj *_this, const GeneticsCodonUsage *cu)
+{
+    Out_Puts(_this, "\ncodon\taa\t+1\t+2\t+3\t-1\t-2\t-3\trscu\n");
+    for (int c = 0; c < 64; c++)
+    {
+        Out_Printf(_this, "%s\t%c", _this->transl->dna[c], _this->transl->transl[c]);
+        for (int f = 0; f < CODON_FRAMES; f++)
+            Out_Printf(_this, "\t%lu", cu->counts[f][c]);
+        Out_Printf(_this, "\t%.3f\n", cu->rscu[c]);
+    }
+    Out_Printf(_this, "\nframe %c%d codons %lu", cu->frame < 3 ? '+' : '-', cu->frame % 3 + 1, cu->codons);
+    if (cu->cai > 0)
+        Out_Printf(_this, " cai %.4f", cu->cai);
+    Out_Puts(_this, "\naa\tcount\tpercent\n");
+    for (int a = 0; a < 27; a++)
+    {
+        if (cu->aa[a])
+            Out_Printf(_this, "%c\t%lu\t%.2f\n", a == 26 ? '*' : 'A' + a, cu->aa[a], 100.0 * cu->aa[a] / cu->codons);
+    }
+    Out_Flush(_this);
+}
@@ -0,0 +1,601 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief hot kernels in one variant per instruction set, selected at run time so one binary runs on
+ *        any x86-64 (and the scalar variants anywhere else). The SIMD variants are compiled with
+ *        target attributes, never called unless the cpu reports the instruction set.
+ */
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CPU_X86 1
+#include <immintrin.h>
+#define CPU_TARGET_SSE42  __attribute__((target("sse4.2")))
+#define CPU_TARGET_AVX2   __attribute__((target("avx2")))
+#define CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#endif
+
+#define CPU_ENV "GENETICS_CPU"
+
+static const char *CPU_NAMES[GENETICS_CPU_COUNT] = {"scalar", "sse4.2", "avx2", "avx512"};
+
+/**
+ * @brief base letter (any case) to code, 0xFF (NB) for any other character; one row per 16 characters
+ */
+#define NB 0xFF
+static const uint8_t ENCODE[256] = {
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB,  2, NB,  1, NB, NB, NB,  3, NB, NB, NB, NB, NB, NB, NB, NB,  // A C G
+    NB, NB, NB, NB,  0,  0, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,  // T U
+    NB,  2, NB,  1, NB, NB, NB,  3, NB, NB, NB, NB, NB, NB, NB, NB,  // a c g
+    NB, NB, NB, NB,  0,  0, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,  // t u
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+    NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB, NB,
+};
+#undef NB
+
+/**
+ * @brief vector encoding: the low nibble tells the only letter it can be (lower case) and its code
+ *        a 0x61 -> 1, c 0x63 -> 3, t 0x74 -> 4, u 0x75 -> 5, g 0x67 -> 7
+ */
+static const char ENCODE_LETTER[16] = {0, 'a', 0, 'c', 't', 'u', 0, 'g', 0, 0, 0, 0, 0, 0, 0, 0};
+static const char ENCODE_CODE[16] = {0, 2, 0, 1, 0, 0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0};
+
+/* scalar */
+
+static size_t EncodeScalar(uint8_t *dst, const char *src, size_t len, char lower)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t b = ENCODE[(uint8_t)src[i]];
+        if (b == 0xFF || (src[i] & 0x20) != lower)
+            return i;
+        dst[i] = b;
+    }
+    return len;
+}
+
+static void ComplementScalar(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    for (size_t k = 0; k < n; k++)
+        dst[k] = (src[k] ^ x) & 0x3;
+}
+
+static void ReverseComplementScalar(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    for (size_t k = 0; k < n; k++)
+        dst[k] = (src[n - 1 - k] ^ x) & 0x3;
+}
+
+static void CodonsScalar(uint8_t *dst, const uint8_t *dna, size_t n)
+{
+    for (size_t j = 0; j < n; j++)
+        dst[j] = CODON(dna[j], dna[j + 1], dna[j + 2]);
+}
+
+static void TranslateScalar(char *dst, const uint8_t *seq, size_t n, const char map[64])
+{
+    for (size_t c = 0; c < n; c++, seq += 3)
+        dst[c] = map[CODON(seq[0], seq[1], seq[2])];
+}
+
+static void CountScalar(uint64_t counts[4], const uint8_t *dna, size_t n)
+{
+    for (size_t j = 0; j < n; j++)
+        counts[dna[j] & 0x3]++;
+}
+
+#ifdef CPU_X86
+/**
+ * @brief stride 3 deinterleave of 48 bytes (3 registers) into the 16 first, second and third codon bases
+ */
+#define DEINTERLEAVE_MASKS                                                                                  \
+    static const int8_t S0[3][16] = {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},         \
+                                     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},        \
+                                     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}};       \
+    static const int8_t S1[3][16] = {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},        \
+                                     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},         \
+                                     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}};       \
+    static const int8_t S2[3][16] = {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},        \
+                                     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},        \
+                                     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}
+
+static const int8_t REVERSE_BYTES[16] = {15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0};
+
+/* SSE4.2 (SSSE3 shuffles, SSE4.1 blends), 16 bytes per step */
+
+CPU_TARGET_SSE42 static size_t EncodeSSE42(uint8_t *dst, const char *src, size_t len, char lower)
+{
+    const __m128i letter = _mm_loadu_si128((const __m128i *)ENCODE_LETTER);
+    const __m128i code = _mm_loadu_si128((const __m128i *)ENCODE_CODE);
+    const __m128i nibble = _mm_set1_epi8(0x0F), caseBit = _mm_set1_epi8(0x20), run = _mm_set1_epi8(lower);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i low = _mm_and_si128(v, nibble);
+        __m128i ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(v, caseBit), _mm_shuffle_epi8(letter, low)),
+                                   _mm_cmpeq_epi8(_mm_and_si128(v, caseBit), run));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(code, low));
+        unsigned mask = _mm_movemask_epi8(ok);
+        if (mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + EncodeScalar(dst + i, src + i, len - i, lower);
+}
+
+CPU_TARGET_SSE42 static void ComplementSSE42(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m128i vx = _mm_set1_epi8(x), m = _mm_set1_epi8(0x3);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + k));
+        _mm_storeu_si128((__m128i *)(dst + k), _mm_and_si128(_mm_xor_si128(v, vx), m));
+    }
+    ComplementScalar(dst + k, src + k, n - k, x);
+}
+
+CPU_TARGET_SSE42 static void ReverseComplementSSE42(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m128i vx = _mm_set1_epi8(x), m = _mm_set1_epi8(0x3);
+    const __m128i rev = _mm_loadu_si128((const __m128i *)REVERSE_BYTES);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + n - k - 16)), rev);
+        _mm_storeu_si128((__m128i *)(dst + k), _mm_and_si128(_mm_xor_si128(v, vx), m));
+    }
+    ReverseComplementScalar(dst + k, src, n - k, x);
+}
+
+CPU_TARGET_SSE42 static void CodonsSSE42(uint8_t *dst, const uint8_t *dna, size_t n)
+{
+    const __m128i m = _mm_set1_epi8(0x3);
+    size_t j = 0;
+    for (; j + 16 <= n; j += 16)
+    {
+        __m128i b1 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(dna + j)), m);
+        __m128i b2 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(dna + j + 1)), m);
+        __m128i b3 = _mm_and_si128(_mm_loadu_si128((const __m128i *)(dna + j + 2)), m);
+        __m128i c = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(b1, 4), _mm_slli_epi16(b2, 2)), b3);
+        _mm_storeu_si128((__m128i *)(dst + j), c);
+    }
+    CodonsScalar(dst + j, dna + j, n - j);
+}
+
+CPU_TARGET_SSE42 static void TranslateSSE42(char *dst, const uint8_t *seq, size_t n, const char map[64])
+{
+    DEINTERLEAVE_MASKS;
+    const __m128i m = _mm_set1_epi8(0x3), nibble = _mm_set1_epi8(0x0F);
+    __m128i s[3][3], t[4];
+    for (int k = 0; k < 3; k++)
+    {
+        s[0][k] = _mm_loadu_si128((const __m128i *)S0[k]);
+        s[1][k] = _mm_loadu_si128((const __m128i *)S1[k]);
+        s[2][k] = _mm_loadu_si128((const __m128i *)S2[k]);
+    }
+    for (int k = 0; k < 4; k++)
+        t[k] = _mm_loadu_si128((const __m128i *)(map + 16 * k));
+    size_t c = 0;
+    for (; c + 16 <= n; c += 16, seq += 48)
+    {
+        __m128i p[3], b[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = _mm_loadu_si128((const __m128i *)(seq + 16 * k));
+        for (int i = 0; i < 3; i++)
+            b[i] = _mm_and_si128(_mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(p[0], s[i][0]), _mm_shuffle_epi8(p[1], s[i][1])),
+                                              _mm_shuffle_epi8(p[2], s[i][2])), m);
+        __m128i codon = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(b[0], 4), _mm_slli_epi16(b[1], 2)), b[2]);
+        __m128i low = _mm_and_si128(codon, nibble), high = b[0];
+        __m128i r = _mm_shuffle_epi8(t[0], low);
+        for (int k = 1; k < 4; k++)
+            r = _mm_blendv_epi8(r, _mm_shuffle_epi8(t[k], low), _mm_cmpeq_epi8(high, _mm_set1_epi8(k)));
+        _mm_storeu_si128((__m128i *)(dst + c), r);
+    }
+    TranslateScalar(dst + c, seq, n - c, map);
+}
+
+CPU_TARGET_SSE42 static void CountSSE42(uint64_t counts[4], const uint8_t *dna, size_t n)
+{
+    const __m128i m = _mm_set1_epi8(0x3), zero = _mm_setzero_si128();
+    size_t j = 0;
+    while (j + 16 <= n)
+    {
+        // byte counters, summed before they can overflow
+        __m128i acc[3] = {zero, zero, zero};
+        size_t end = j + 255 * 16 < n ? j + 255 * 16 : n;
+        uint64_t block = 0;
+        for (; j + 16 <= end; j += 16, block += 16)
+        {
+            __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i *)(dna + j)), m);
+            for (int b = 0; b < 3; b++)
+                acc[b] = _mm_sub_epi8(acc[b], _mm_cmpeq_epi8(v, _mm_set1_epi8(b)));
+        }
+        uint64_t sum = 0;
+        for (int b = 0; b < 3; b++)
+        {
+            __m128i s = _mm_sad_epu8(acc[b], zero);
+            uint64_t c = (uint64_t)_mm_cvtsi128_si64(s) + (uint64_t)_mm_extract_epi64(s, 1);
+            counts[b] += c;
+            sum += c;
+        }
+        counts[3] += block - sum;
+    }
+    CountScalar(counts, dna + j, n - j);
+}
+
+/* AVX2, 32 bytes per step; shuffles work in 128 bit lanes */
+
+CPU_TARGET_AVX2 static size_t EncodeAVX2(uint8_t *dst, const char *src, size_t len, char lower)
+{
+    const __m256i letter = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ENCODE_LETTER));
+    const __m256i code = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)ENCODE_CODE));
+    const __m256i nibble = _mm256_set1_epi8(0x0F), caseBit = _mm256_set1_epi8(0x20), run = _mm256_set1_epi8(lower);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i low = _mm256_and_si256(v, nibble);
+        __m256i ok = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v, caseBit), _mm256_shuffle_epi8(letter, low)),
+                                      _mm256_cmpeq_epi8(_mm256_and_si256(v, caseBit), run));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(code, low));
+        uint32_t mask = _mm256_movemask_epi8(ok);
+        if (mask != 0xFFFFFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+    return i + EncodeScalar(dst + i, src + i, len - i, lower);
+}
+
+CPU_TARGET_AVX2 static void ComplementAVX2(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m256i vx = _mm256_set1_epi8(x), m = _mm256_set1_epi8(0x3);
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + k));
+        _mm256_storeu_si256((__m256i *)(dst + k), _mm256_and_si256(_mm256_xor_si256(v, vx), m));
+    }
+    ComplementScalar(dst + k, src + k, n - k, x);
+}
+
+CPU_TARGET_AVX2 static void ReverseComplementAVX2(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m256i vx = _mm256_set1_epi8(x), m = _mm256_set1_epi8(0x3);
+    const __m256i rev = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)REVERSE_BYTES));
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32)
+    {
+        __m256i v = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + n - k - 32)), rev);
+        v = _mm256_permute4x64_epi64(v, 0x4E); // swap the lanes
+        _mm256_storeu_si256((__m256i *)(dst + k), _mm256_and_si256(_mm256_xor_si256(v, vx), m));
+    }
+    ReverseComplementScalar(dst + k, src, n - k, x);
+}
+
+CPU_TARGET_AVX2 static void CodonsAVX2(uint8_t *dst, const uint8_t *dna, size_t n)
+{
+    const __m256i m = _mm256_set1_epi8(0x3);
+    size_t j = 0;
+    for (; j + 32 <= n; j += 32)
+    {
+        __m256i b1 = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(dna + j)), m);
+        __m256i b2 = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(dna + j + 1)), m);
+        __m256i b3 = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(dna + j + 2)), m);
+        __m256i c = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(b1, 4), _mm256_slli_epi16(b2, 2)), b3);
+        _mm256_storeu_si256((__m256i *)(dst + j), c);
+    }
+    CodonsScalar(dst + j, dna + j, n - j);
+}
+
+CPU_TARGET_AVX2 static void TranslateAVX2(char *dst, const uint8_t *seq, size_t n, const char map[64])
+{
+    DEINTERLEAVE_MASKS;
+    const __m256i m = _mm256_set1_epi8(0x3), nibble = _mm256_set1_epi8(0x0F);
+    __m256i s[3][3], t[4];
+    for (int k = 0; k < 3; k++)
+    {
+        s[0][k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)S0[k]));
+        s[1][k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)S1[k]));
+        s[2][k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)S2[k]));
+    }
+    for (int k = 0; k < 4; k++)
+        t[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(map + 16 * k)));
+    size_t c = 0;
+    for (; c + 32 <= n; c += 32, seq += 96)
+    {
+        // lane 0 codons 0..15 (bytes 0..47), lane 1 codons 16..31 (bytes 48..95)
+        __m256i p[3], b[3];
+        for (int k = 0; k < 3; k++)
+            p[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(seq + 16 * k))),
+                                           _mm_loadu_si128((const __m128i *)(seq + 48 + 16 * k)), 1);
+        for (int i = 0; i < 3; i++)
+            b[i] = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(p[0], s[i][0]),
+                                                                     _mm256_shuffle_epi8(p[1], s[i][1])),
+                                                    _mm256_shuffle_epi8(p[2], s[i][2])), m);
+        __m256i codon = _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi16(b[0], 4), _mm256_slli_epi16(b[1], 2)), b[2]);
+        __m256i low = _mm256_and_si256(codon, nibble), high = b[0];
+        __m256i r = _mm256_shuffle_epi8(t[0], low);
+        for (int k = 1; k < 4; k++)
+            r = _mm256_blendv_epi8(r, _mm256_shuffle_epi8(t[k], low), _mm256_cmpeq_epi8(high, _mm256_set1_epi8(k)));
+        _mm256_storeu_si256((__m256i *)(dst + c), r);
+    }
+    TranslateScalar(dst + c, seq, n - c, map);
+}
+
+CPU_TARGET_AVX2 static void CountAVX2(uint64_t counts[4], const uint8_t *dna, size_t n)
+{
+    const __m256i m = _mm256_set1_epi8(0x3), zero = _mm256_setzero_si256();
+    size_t j = 0;
+    while (j + 32 <= n)
+    {
+        __m256i acc[3] = {zero, zero, zero};
+        size_t end = j + 255 * 32 < n ? j + 255 * 32 : n;
+        uint64_t block = 0;
+        for (; j + 32 <= end; j += 32, block += 32)
+        {
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(dna + j)), m);
+            for (int b = 0; b < 3; b++)
+                acc[b] = _mm256_sub_epi8(acc[b], _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b)));
+        }
+        uint64_t sum = 0;
+        for (int b = 0; b < 3; b++)
+        {
+            __m256i s = _mm256_sad_epu8(acc[b], zero);
+            uint64_t c = (uint64_t)_mm256_extract_epi64(s, 0) + (uint64_t)_mm256_extract_epi64(s, 1) +
+                         (uint64_t)_mm256_extract_epi64(s, 2) + (uint64_t)_mm256_extract_epi64(s, 3);
+            counts[b] += c;
+            sum += c;
+        }
+        counts[3] += block - sum;
+    }
+    CountScalar(counts, dna + j, n - j);
+}
+
+/* AVX-512 (F + BW), 64 bytes per step, byte masks instead of blends */
+
+CPU_TARGET_AVX512 static size_t EncodeAVX512(uint8_t *dst, const char *src, size_t len, char lower)
+{
+    const __m512i letter = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)ENCODE_LETTER));
+    const __m512i code = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)ENCODE_CODE));
+    const __m512i nibble = _mm512_set1_epi8(0x0F), caseBit = _mm512_set1_epi8(0x20), run = _mm512_set1_epi8(lower);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64)
+    {
+        __m512i v = _mm512_loadu_si512(src + i);
+        __m512i low = _mm512_and_si512(v, nibble);
+        __mmask64 ok = _mm512_cmpeq_epi8_mask(_mm512_or_si512(v, caseBit), _mm512_shuffle_epi8(letter, low)) &
+                       _mm512_cmpeq_epi8_mask(_mm512_and_si512(v, caseBit), run);
+        _mm512_storeu_si512(dst + i, _mm512_shuffle_epi8(code, low));
+        if (ok != ~(__mmask64)0)
+            return i + __builtin_ctzll(~ok);
+    }
+    return i + EncodeScalar(dst + i, src + i, len - i, lower);
+}
+
+CPU_TARGET_AVX512 static void ComplementAVX512(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m512i vx = _mm512_set1_epi8(x), m = _mm512_set1_epi8(0x3);
+    size_t k = 0;
+    for (; k + 64 <= n; k += 64)
+        _mm512_storeu_si512(dst + k, _mm512_and_si512(_mm512_xor_si512(_mm512_loadu_si512(src + k), vx), m));
+    ComplementScalar(dst + k, src + k, n - k, x);
+}
+
+CPU_TARGET_AVX512 static void ReverseComplementAVX512(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x)
+{
+    const __m512i vx = _mm512_set1_epi8(x), m = _mm512_set1_epi8(0x3);
+    const __m512i rev = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)REVERSE_BYTES));
+    size_t k = 0;
+    for (; k + 64 <= n; k += 64)
+    {
+        __m512i v = _mm512_shuffle_epi8(_mm512_loadu_si512(src + n - k - 64), rev);
+        v = _mm512_shuffle_i64x2(v, v, 0x1B); // reverse the lanes
+        _mm512_storeu_si512(dst + k, _mm512_and_si512(_mm512_xor_si512(v, vx), m));
+    }
+    ReverseComplementScalar(dst + k, src, n - k, x);
+}
+
+CPU_TARGET_AVX512 static void CodonsAVX512(uint8_t *dst, const uint8_t *dna, size_t n)
+{
+    const __m512i m = _mm512_set1_epi8(0x3);
+    size_t j = 0;
+    for (; j + 64 <= n; j += 64)
+    {
+        __m512i b1 = _mm512_and_si512(_mm512_loadu_si512(dna + j), m);
+        __m512i b2 = _mm512_and_si512(_mm512_loadu_si512(dna + j + 1), m);
+        __m512i b3 = _mm512_and_si512(_mm512_loadu_si512(dna + j + 2), m);
+        __m512i c = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi16(b1, 4), _mm512_slli_epi16(b2, 2)), b3);
+        _mm512_storeu_si512(dst + j, c);
+    }
+    CodonsScalar(dst + j, dna + j, n - j);
+}
+
+CPU_TARGET_AVX512 static void TranslateAVX512(char *dst, const uint8_t *seq, size_t n, const char map[64])
+{
+    DEINTERLEAVE_MASKS;
+    const __m512i m = _mm512_set1_epi8(0x3), nibble = _mm512_set1_epi8(0x0F);
+    __m512i s[3][3], t[4];
+    for (int k = 0; k < 3; k++)
+    {
+        s[0][k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)S0[k]));
+        s[1][k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)S1[k]));
+        s[2][k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)S2[k]));
+    }
+    for (int k = 0; k < 4; k++)
+        t[k] = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(map + 16 * k)));
+    size_t c = 0;
+    for (; c + 64 <= n; c += 64, seq += 192)
+    {
+        // lane l codons 16 l .. 16 l + 15 (bytes 48 l .. 48 l + 47)
+        __m512i p[3], b[3];
+        for (int k = 0; k < 3; k++)
+        {
+            p[k] = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)(seq + 16 * k)));
+            p[k] = _mm512_inserti32x4(p[k], _mm_loadu_si128((const __m128i *)(seq + 48 + 16 * k)), 1);
+            p[k] = _mm512_inserti32x4(p[k], _mm_loadu_si128((const __m128i *)(seq + 96 + 16 * k)), 2);
+            p[k] = _mm512_inserti32x4(p[k], _mm_loadu_si128((const __m128i *)(seq + 144 + 16 * k)), 3);
+        }
+        for (int i = 0; i < 3; i++)
+            b[i] = _mm512_and_si512(_mm512_or_si512(_mm512_or_si512(_mm512_shuffle_epi8(p[0], s[i][0]),
+                                                                     _mm512_shuffle_epi8(p[1], s[i][1])),
+                                                    _mm512_shuffle_epi8(p[2], s[i][2])), m);
+        __m512i codon = _mm512_or_si512(_mm512_or_si512(_mm512_slli_epi16(b[0], 4), _mm512_slli_epi16(b[1], 2)), b[2]);
+        __m512i low = _mm512_and_si512(codon, nibble);
+        __m512i r = _mm512_shuffle_epi8(t[0], low);
+        for (int k = 1; k < 4; k++)
+            r = _mm512_mask_shuffle_epi8(r, _mm512_cmpeq_epi8_mask(b[0], _mm512_set1_epi8(k)), t[k], low);
+        _mm512_storeu_si512(dst + c, r);
+    }
+    TranslateScalar(dst + c, seq, n - c, map);
+}
+
+CPU_TARGET_AVX512 static void CountAVX512(uint64_t counts[4], const uint8_t *dna, size_t n)
+{
+    const __m512i m = _mm512_set1_epi8(0x3);
+    size_t j = 0;
+    for (; j + 64 <= n; j += 64)
+    {
+        __m512i v = _mm512_and_si512(_mm512_loadu_si512(dna + j), m);
+        uint64_t sum = 0;
+        for (int b = 0; b < 3; b++)
+        {
+            uint64_t c = __builtin_popcountll(_mm512_cmpeq_epi8_mask(v, _mm512_set1_epi8(b)));
+            counts[b] += c;
+            sum += c;
+        }
+        counts[3] += 64 - sum;
+    }
+    CountScalar(counts, dna + j, n - j);
+}
+#endif
+
+static const GeneticsKernels KERNELS[GENETICS_CPU_COUNT] = {
+    {GENETICS_CPU_SCALAR, EncodeScalar, ComplementScalar, ReverseComplementScalar, CodonsScalar, TranslateScalar,
+     CountScalar},
+#ifdef CPU_X86
+    {GENETICS_CPU_SSE42, EncodeSSE42, ComplementSSE42, ReverseComplementSSE42, CodonsSSE42, TranslateSSE42,
+     CountSSE42},
+    {GENETICS_CPU_AVX2, EncodeAVX2, ComplementAVX2, ReverseComplementAVX2, CodonsAVX2, TranslateAVX2, CountAVX2},
+    {GENETICS_CPU_AVX512, EncodeAVX512, ComplementAVX512, ReverseComplementAVX512, CodonsAVX512, TranslateAVX512,
+     CountAVX512},
+#endif
+};
+
+static GENETICS_CPU cpuSupported = GENETICS_CPU_SCALAR; // best level of this cpu
+static GENETICS_CPU cpuDefault = GENETICS_CPU_SCALAR;   // level of new objects (GENETICS_CPU applied)
+static pthread_once_t cpuOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief level named name (as in CPU_NAMES), -1 if unknown
+ */
+static GENETICS_CPU CpuByName(const char *name)
+{
+    for (int level = 0; level < GENETICS_CPU_COUNT; level++)
+        if (!strcmp(name, CPU_NAMES[level]))
+            return level;
+    return -1;
+}
+
+static void DetectCpu(void)
+{
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        cpuSupported = GENETICS_CPU_SSE42;
+        if (__builtin_cpu_supports("avx2"))
+        {
+            cpuSupported = GENETICS_CPU_AVX2;
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+                cpuSupported = GENETICS_CPU_AVX512;
+        }
+    }
+#endif
+    cpuDefault = cpuSupported;
+    const char *env = getenv(CPU_ENV);
+    GENETICS_CPU level = env ? CpuByName(env) : -1;
+    if (level >= 0 && level < cpuSupported)
+        cpuDefault = level; // a level above the cpu one is ignored
+}
+
+/**
+ * @brief kernels of a level, lowered to the best level of the cpu
+ */
+const GeneticsKernels *Cpu_Kernels(GENETICS_CPU level)
+{
+    pthread_once(&cpuOnce, DetectCpu);
+    if (level < 0 || level > cpuSupported)
+        level = cpuSupported;
+    return &KERNELS[level];
+}
+
+/**
+ * @brief Instruction set used by new objects: the best one of the cpu, detected once,
+ *        or a lower one named by the GENETICS_CPU environment variable
+ *        (scalar, sse4.2, avx2 or avx512) to test each path.
+ *
+ * @return GENETICS_CPU level
+ */
+GENETICS_CPU Genetics_CpuLevel(void)
+{
+    pthread_once(&cpuOnce, DetectCpu);
+    return cpuDefault;
+}
+
+/**
+ * @brief Best instruction set of the cpu, the highest level Genetics_SetCpu() can select
+ */
+GENETICS_CPU Genetics_CpuSupported(void)
+{
+    pthread_once(&cpuOnce, DetectCpu);
+    return cpuSupported;
+}
+
+/**
+ * @brief Name of a level ("scalar", "sse4.2", "avx2", "avx512"), NULL if invalid
+ */
+const char *Genetics_CpuName(GENETICS_CPU level)
+{
+    return level >= 0 && level < GENETICS_CPU_COUNT ? CPU_NAMES[level] : NULL;
+}
+
+/**
+ * @brief Instruction set of the kernels of an object (encoding, reverse complement, translation, scan).
+ *        All levels produce the same results.
+ *
+ * @param _this genetics object
+ * @param level GENETICS_CPU_xxx, lowered to Genetics_CpuSupported()
+ * @return GENETICS_CPU level selected
+ */
+GENETICS_CPU Genetics_SetCpu(GeneticsObj *_this, GENETICS_CPU level)
+{
+    _this->kernels = Cpu_Kernels(level);
+    return _this->kernels->level;
+}
+
+GENETICS_CPU Genetics_GetCpu(GeneticsObj *_this)
+{
+    return _this->kernels->level;
+}
@@ -0,0 +1,334 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief parallel whole file FASTA loader: the mapped file is cut in byte ranges of whole lines,
+ *        one per thread.
+ *        pass 1 (threads)   : split the range in segments at '>' headers and count bases, N's and lines
+ *        stitch (caller)    : in file order, select the records matching the search, print their headers
+ *                             and give every selected segment its place in the dna buffer (prefix sum)
+ *        pass 2 (threads)   : encode the selected segments in place, N and soft-mask ranges per thread
+ *        merge (caller)     : append the mask ranges in file order
+ *        The result is the one of the sequential loader (same bases, offsets, masks and messages).
+ */
+#define FASTA_CHUNK_MIN   (16 * 1024 * 1024)   // min bytes per thread (automatic thread count)
+#define FASTA_MAX_THREADS 16
+
+typedef struct _FastaSegment
+{
+    const char *header;     // '>' line starting the segment, NULL for the chunk lines before its first header
+    size_t headerSize;      // with the new line
+    bool headerEol;         // false for a header on the last line without new line
+    const char *body;       // lines after the header, up to the next segment or the chunk end
+    size_t bases;           // A C G T U
+    size_t ns;              // N
+    size_t leading;         // N before the first base
+    size_t lines;           // sequence lines
+    bool found;             // record selected by the search
+    bool fileBegin;         // no base loaded before the segment
+    size_t dest;            // dna index of the first encoded base
+    size_t units;           // bp encoded
+} FastaSegment;
+
+typedef struct _FastaChunk
+{
+    const char *begin, *end;    // whole lines
+    FastaSegment *segments;
+    size_t count, alloc;
+    GeneticsMaskList masks[MASK_LISTS];
+    const GeneticsAllocator *allocator; // shared, locked
+    const GeneticsKernels *kernels;
+    uint8_t *dna;
+} FastaChunk;
+
+static FastaSegment *NewSegment(FastaChunk *chunk, const char *header, size_t headerSize, bool headerEol)
+{
+    if (chunk->count == chunk->alloc)
+    {
+        size_t alloc = chunk->alloc ? 2 * chunk->alloc : 16;
+        chunk->segments = chunk->allocator->realloc(chunk->allocator->ctx, chunk->segments,
+                                                    chunk->alloc * sizeof(FastaSegment), alloc * sizeof(FastaSegment));
+        chunk->alloc = alloc;
+    }
+    FastaSegment *seg = &chunk->segments[chunk->count++];
+    memset(seg, 0, sizeof(FastaSegment));
+    seg->header = header;
+    seg->headerSize = headerSize;
+    seg->headerEol = headerEol;
+    seg->body = header ? header + headerSize : chunk->begin;
+    return seg;
+}
+
+static const char *SegmentEnd(const FastaChunk *chunk, size_t k)
+{
+    return k + 1 < chunk->count ? chunk->segments[k + 1].header : chunk->end;
+}
+
+/**
+ * @brief pass 1: segments of the chunk and their counts
+ */
+static void *CountChunk(void *arg)
+{
+    FastaChunk *chunk = arg;
+    FastaSegment *seg = NewSegment(chunk, NULL, 0, true);
+    bool base = false; // a base was counted in the segment
+    for (const char *p = chunk->begin, *end = chunk->end; p < end;)
+    {
+        const char *eol = memchr(p, '\n', end - p);
+        const char *lineEnd = eol ? eol + 1 : end;
+        if (*p == '>')
+        {
+            seg = NewSegment(chunk, p, lineEnd - p, eol != NULL);
+            base = false;
+        }
+        else if (*p != ';')
+        {
+            seg->lines++;
+            for (const char *q = p; q < lineEnd; q++)
+            {
+                switch (*q | 0x20)
+                {
+                case 'a': case 'c': case 'g': case 't': case 'u':
+                    seg->bases++;
+                    base = true;
+                    break;
+                case 'n':
+                    seg->ns++;
+                    seg->leading += !base;
+                    break;
+                }
+            }
+        }
+        p = lineEnd;
+    }
+    return NULL;
+}
+
+/**
+ * @brief pass 2: encode the selected segments of the chunk at their place
+ */
+static void *EncodeChunk(void *arg)
+{
+    FastaChunk *chunk = arg;
+    for (size_t k = 0; k < chunk->count; k++)
+    {
+        FastaSegment *seg = &chunk->segments[k];
+        if (!seg->found)
+            continue;
+        // maxbp keeps the kernel block stores inside the segment place, next one is written by another thread
+        bool fileBegin = seg->fileBegin;
+        size_t at = seg->dest, stop = seg->dest + seg->units, leading = 0;
+        for (const char *p = seg->body, *end = SegmentEnd(chunk, k); p < end;)
+        {
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol + 1 : end;
+            if (*p != ';')
+                at += Encode_Text(chunk->kernels, chunk->dna + at, at, p, lineEnd - p, stop - at, &fileBegin, &leading,
+                                  chunk->allocator, chunk->masks);
+            p = lineEnd;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief run fn on every chunk, chunk 0 on the calling thread
+ */
+static void RunChunks(FastaChunk *chunks, int threads, void *(*fn)(void *))
+{
+    pthread_t tid[FASTA_MAX_THREADS];
+    int started = 1;
+    for (int t = 1; t < threads; t++, started++)
+        if (pthread_create(&tid[t], NULL, fn, &chunks[t]))
+            break;
+    fn(&chunks[0]);
+    for (int t = started; t < threads; t++)
+        fn(&chunks[t]); // thread creation failed: run here
+    for (int t = 1; t < started; t++)
+        pthread_join(tid[t], NULL);
+}
+
+static int LoadThreads(GeneticsObj *_this, size_t size)
+{
+    if (_this->loadThreads > 0)
+        return _this->loadThreads;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = size / FASTA_CHUNK_MIN;
+    if (cpus > 0 && threads > (size_t)cpus)
+        threads = cpus;
+    if (threads > FASTA_MAX_THREADS)
+        threads = FASTA_MAX_THREADS;
+    return threads < 1 ? 1 : threads;
+}
+
+/**
+ * @brief in file order: select the records, print the headers and place the selected segments
+ *
+ * @return number of bp of the selected segments
+ */
+static size_t Stitch(GeneticsObj *_this, FastaChunk *chunks, int threads, const char *search, size_t *lines)
+{
+    bool found = false, fileBegin = true;
+    size_t dest = 0, headerAlloc = 0;
+    char *header = NULL;
+    for (int t = 0; t < threads; t++)
+    {
+        for (size_t k = 0; k < chunks[t].count; k++)
+        {
+            FastaSegment *seg = &chunks[t].segments[k];
+            if (seg->header)
+            {
+                if (headerAlloc < seg->headerSize + 1)
+                {
+                    header = Mem_Realloc(_this, header, headerAlloc, 2 * (seg->headerSize + 1));
+                    headerAlloc = 2 * (seg->headerSize + 1);
+                }
+                memcpy(header, seg->header, seg->headerSize);
+                header[seg->headerSize] = 0;
+                bool match = *search == 0 || NULL != strstr(header, search);
+                if (match)
+                    Out_Puts(_this, header);
+                if (seg->headerEol)
+                {
+                    found = match;
+                    if (found && !_this->seqName[0])
+                        sscanf(header + 1, "%63s", _this->seqName);
+                }
+            }
+            seg->found = found;
+            if (!found)
+                continue;
+            seg->fileBegin = fileBegin;
+            seg->dest = dest;
+            *lines += seg->lines;
+            seg->units = seg->bases + seg->ns;
+            if (fileBegin)
+            {
+                _this->inputFileOffset += seg->leading;
+                seg->units -= seg->leading;
+                fileBegin = seg->bases == 0;
+            }
+            dest += seg->units;
+        }
+    }
+    Mem_Free(_this, header, headerAlloc);
+    _this->fileBegin = fileBegin;
+    return dest;
+}
+
+/**
+ * @brief Load a whole FASTA file with threads (Genetics_LoadFASTA() without start and stop)
+ *
+ * @return false if the file can not be mapped or one thread is enough: load it with the reader
+ */
+bool Fasta_LoadParallel(GeneticsObj *_this, const char *filename, const char *search)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    int threads = 1;
+    const char *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (threads = LoadThreads(_this, st.st_size)) > 1)
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+    size_t size = st.st_size;
+    madvise((void *)data, size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    if (threads > FASTA_MAX_THREADS)
+        threads = FASTA_MAX_THREADS;
+
+    Out_Printf(_this, "Load FASTA file '%s' searching for '%s'\n", filename, search);
+    Genetics_StartDNA(_this, DNA_DIR_5_TO_3, "");
+    Obj_SetFastaPath(_this, filename);
+    STATS_ADD(&_this->stats, bytes_read, size);
+
+    LockedAllocator locked = {&_this->allocator, PTHREAD_MUTEX_INITIALIZER};
+    GeneticsAllocator allocator = Mem_Locked(&locked);
+    FastaChunk *chunks = Mem_Alloc(_this, threads * sizeof(FastaChunk));
+    memset(chunks, 0, threads * sizeof(FastaChunk));
+    const char *begin = data, *end = data + size;
+    for (int t = 0; t < threads; t++)
+    { // cut after the new line following the even split point
+        const char *cut = t + 1 < threads ? data + (t + 1) * (size / threads) : end;
+        if (cut < begin)
+            cut = begin;
+        const char *eol = cut < end && t + 1 < threads ? memchr(cut, '\n', end - cut) : NULL;
+        if (t + 1 < threads)
+            cut = eol ? eol + 1 : end;
+        chunks[t].begin = begin;
+        chunks[t].end = cut;
+        chunks[t].allocator = &allocator;
+        chunks[t].kernels = _this->kernels;
+        begin = cut;
+    }
+    RunChunks(chunks, threads, CountChunk);
+
+    size_t lines = 0, bp = Stitch(_this, chunks, threads, search, &lines);
+    if (_this->dnaAllocSize <= bp)
+    {
+        _this->dnaAllocBuffer = (uint8_t *)Mem_Realloc(_this, _this->dnaAllocBuffer, _this->dnaAllocSize, bp + 1);
+        _this->dnaAllocSize = bp + 1;
+        _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
+    }
+    for (int t = 0; t < threads; t++)
+        chunks[t].dna = _this->dna;
+    RunChunks(chunks, threads, EncodeChunk);
+    _this->dnaSize = bp;
+    STATS_ADD(&_this->stats, bases, bp);
+
+    for (int t = 0; t < threads; t++)
+    {
+        for (int list = 0; list < MASK_LISTS; list++)
+        {
+            GeneticsMaskList *l = &chunks[t].masks[list];
+            for (size_t k = 0; k < l->count; k++)
+                Mask_Add(_this, list, l->ranges[k].begin, l->ranges[k].end);
+            Mem_Free(_this, l->ranges, l->alloc * sizeof(GeneticsRange));
+        }
+        Mem_Free(_this, chunks[t].segments, chunks[t].alloc * sizeof(FastaSegment));
+    }
+    Mem_Free(_this, chunks, threads * sizeof(FastaChunk));
+    pthread_mutex_destroy(&locked.lock);
+    munmap((void *)data, size);
+
+    Genetics_StopDNA(_this);
+    Out_Printf(_this, "FASTA loaded. Found %lu bp on %lu lines.\n", _this->dnaSize, lines);
+    return true;
+}
+
+/**
+ * @brief Threads of Genetics_LoadFASTA() for whole files (start and stop 0) and of Genetics_TranslateGTF()
+ *
+ * @param _this   genetics object
+ * @param threads 0: one per 16 MB of file (1 M transcript bases) up to the cpu count, 1: sequential reader
+ *                (one thread), n: n threads (max 16)
+ */
+void Genetics_SetLoadThreads(GeneticsObj *_this, int threads)
+{
+    _this->loadThreads = threads < 0 ? 0 : threads > FASTA_MAX_THREADS ? FASTA_MAX_THREADS : threads;
+}
+
+int Genetics_GetLoadThreads(GeneticsObj *_this)
+{
+    return _this->loadThreads;
+}
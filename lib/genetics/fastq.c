@@ -0,0 +1,303 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief FASTQ base encoding: 0x10 | base code for A C G T(U), 0 for N and anything else.
+ *        Bases without 0x10 are stored as T with quality 0 so they are trimmed like any low quality base.
+ */
+static const uint8_t FASTQ_BASE[256] = {
+    ['T'] = 0x10, ['t'] = 0x10, ['U'] = 0x10, ['u'] = 0x10,
+    ['C'] = 0x11, ['c'] = 0x11,
+    ['A'] = 0x12, ['a'] = 0x12,
+    ['G'] = 0x13, ['g'] = 0x13,
+};
+#define FASTQ_PHRED_OFFSET 33
+
+#define FASTQ_LINE_HEADER 0
+#define FASTQ_LINE_SEQ    1
+#define FASTQ_LINE_PLUS   2
+#define FASTQ_LINE_QUAL   3
+
+/**
+ * @brief make sure dna and qual buffers can hold need bytes; grows geometrically
+ */
+static void ReserveFASTQ(GeneticsObj *_this, size_t need)
+{
+    if (_this->dnaAllocSize < need)
+    {
+        size_t size = 2 * _this->dnaAllocSize;
+        if (size < need + READER_BUFFER_SIZE)
+            size = need + READER_BUFFER_SIZE;
+        _this->dnaAllocBuffer = (uint8_t *)Mem_Realloc(_this, _this->dnaAllocBuffer, _this->dnaAllocSize, size);
+        _this->dnaAllocSize = size;
+        _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
+    }
+    if (_this->qualAllocSize < _this->dnaAllocSize)
+    {
+        _this->qual = (uint8_t *)Mem_Realloc(_this, _this->qual, _this->qualAllocSize, _this->dnaAllocSize);
+        _this->qualAllocSize = _this->dnaAllocSize;
+    }
+}
+
+/**
+ * @brief trim and filter the last read (from recStart to dnaSize) and keep it or drop it
+ */
+static bool EndRead(GeneticsObj *_this, size_t recStart, const GeneticsFastqFilter *filter)
+{
+    size_t b = recStart, e = _this->dnaSize;
+    const uint8_t *qual = _this->qual + DNA_BUFFER_START;
+    if (filter->trimQuality > 0)
+    {
+        while (b < e && qual[b] < filter->trimQuality)
+            b++;
+        while (e > b && qual[e - 1] < filter->trimQuality)
+            e--;
+    }
+    size_t size = e - b;
+    bool keep = size > 0 && size >= filter->minLength;
+    if (keep && filter->minMeanQuality > 0)
+    {
+        size_t sum = 0;
+        for (size_t i = b; i < e; i++)
+            sum += qual[i];
+        keep = sum >= (size_t)filter->minMeanQuality * size;
+    }
+    if (!keep)
+    {
+        _this->dnaSize = recStart;
+        return false;
+    }
+    if (b > recStart)
+    {
+        memmove(_this->dna + recStart, _this->dna + b, size);
+        memmove(_this->qual + DNA_BUFFER_START + recStart, qual + b, size);
+    }
+    _this->dnaSize = recStart + size;
+
+    if (_this->readCount == _this->readAlloc)
+    {
+        size_t alloc = _this->readAlloc ? 2 * _this->readAlloc : 4096;
+        _this->reads = (GeneticsRead *)Mem_Realloc(_this, _this->reads, _this->readAlloc * sizeof(GeneticsRead),
+                                                   alloc * sizeof(GeneticsRead));
+        _this->readAlloc = alloc;
+    }
+    _this->reads[_this->readCount].offset = recStart;
+    _this->reads[_this->readCount].size = size;
+    _this->readCount++;
+    return true;
+}
+
+static size_t LoadFASTQ(GeneticsObj *_this, const char *filename, const GeneticsFastqFilter *filter)
+{
+    static const GeneticsFastqFilter noFilter = {};
+    if (!filter)
+        filter = &noFilter;
+    GeneticsReader *reader = Obj_Reader(_this);
+    if (!reader || !Reader_Start(reader, filename))
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening fastq file '%s'", filename);
+        return 0;
+    }
+    Out_Printf(_this, "Load FASTQ file '%s'\n", filename);
+    Genetics_StartDNA(_this, DNA_DIR_5_TO_3, "");
+    _this->fileBegin = false;
+
+    int state = FASTQ_LINE_HEADER;
+    bool lineStart = true, inRecord = false;
+    size_t recStart = 0, seqSize = 0, qualSize = 0;
+    size_t total = 0, malformed = 0;
+    const char *chunk;
+    size_t size;
+    while (NULL != (chunk = Reader_Next(reader, &size)))
+    {
+        STATS_ADD(&_this->stats, bytes_read, size);
+        const char *p = chunk, *end = chunk + size;
+        while (p < end)
+        {
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol : end;
+            if (lineEnd > p && lineEnd[-1] == '\r')
+                lineEnd--;
+            switch (state)
+            {
+            case FASTQ_LINE_HEADER:
+                if (lineStart)
+                {
+                    inRecord = *p == '@';
+                    if (!inRecord && p < lineEnd)
+                        malformed++; // garbage between records, skip the line
+                }
+                if (inRecord && eol)
+                {
+                    state = FASTQ_LINE_SEQ;
+                    recStart = _this->dnaSize;
+                    seqSize = 0;
+                }
+                break;
+            case FASTQ_LINE_SEQ:
+            {
+                size_t n = lineEnd - p;
+                ReserveFASTQ(_this, _this->dnaSize + n);
+                uint8_t *dna = _this->dna + _this->dnaSize;
+                for (size_t i = 0; i < n; i++)
+                    dna[i] = FASTQ_BASE[(uint8_t)p[i]];
+                _this->dnaSize += n;
+                seqSize += n;
+                if (eol)
+                    state = FASTQ_LINE_PLUS;
+                break;
+            }
+            case FASTQ_LINE_PLUS:
+                if (lineStart && *p != '+')
+                {
+                    malformed++;
+                    _this->dnaSize = recStart;
+                    state = FASTQ_LINE_HEADER;
+                    continue; // reparse this line as a header
+                }
+                if (eol)
+                {
+                    state = FASTQ_LINE_QUAL;
+                    qualSize = 0;
+                }
+                break;
+            case FASTQ_LINE_QUAL:
+            {
+                // the whole quality length is counted, only the qualities of bases are stored
+                size_t n = lineEnd - p;
+                if (qualSize + n > seqSize)
+                    n = qualSize < seqSize ? seqSize - qualSize : 0;
+                uint8_t *dna = _this->dna + recStart + qualSize;
+                uint8_t *qual = _this->qual + DNA_BUFFER_START + recStart + qualSize;
+                for (size_t i = 0; i < n; i++)
+                {
+                    uint8_t q = (uint8_t)p[i] > FASTQ_PHRED_OFFSET ? (uint8_t)p[i] - FASTQ_PHRED_OFFSET : 0;
+                    qual[i] = (dna[i] & 0x10) ? q : 0;
+                    dna[i] &= 0x3;
+                }
+                qualSize += lineEnd - p;
+                if (eol)
+                {
+                    total++;
+                    if (qualSize == seqSize)
+                    {
+                        STATS_ADD(&_this->stats, bases, seqSize);
+                        EndRead(_this, recStart, filter);
+                    }
+                    else
+                    {
+                        malformed++;
+                        _this->dnaSize = recStart;
+                    }
+                    state = FASTQ_LINE_HEADER;
+                }
+                break;
+            }
+            }
+            lineStart = eol != NULL;
+            p = eol ? eol + 1 : end;
+        }
+    }
+    if (state == FASTQ_LINE_QUAL && qualSize == seqSize && seqSize > 0)
+    { // last record without new line
+        total++;
+        STATS_ADD(&_this->stats, bases, seqSize);
+        EndRead(_this, recStart, filter);
+    }
+    else if (state != FASTQ_LINE_HEADER)
+    { // record cut short by the end of the file
+        total += state == FASTQ_LINE_QUAL;
+        malformed++;
+        _this->dnaSize = recStart;
+    }
+    int error = Reader_Error(reader);
+    if (error)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error reading fastq file '%s'", filename);
+    if (malformed)
+        Obj_Error(_this, GENETICS_LEVEL_WARNING, 0, "Warning fastq file '%s' : %lu malformed lines/records skipped", filename,
+                  malformed);
+    Reader_Stop(reader);
+    Genetics_StopDNA(_this);
+    Out_Printf(_this, "FASTQ loaded. Kept %lu of %lu reads, %lu bp.\n", _this->readCount, total, _this->dnaSize);
+    return _this->readCount;
+}
+
+/**
+ * @brief Load a FASTQ file. Reads are stored back to back in the dna buffer, qualities in a
+ *        parallel array, trimmed and filtered while parsing. Use Genetics_SelectRead() to work on a read.
+ *
+ * @param _this genetics object
+ * @param filename FASTQ file name
+ * @param filter   quality trimming/filtering (NULL keeps all reads untrimmed)
+ * @return number of reads kept
+ */
+size_t Genetics_LoadFASTQ(GeneticsObj *_this, const char *filename, const GeneticsFastqFilter *filter)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_LOAD_FASTQ);
+    size_t reads = LoadFASTQ(_this, filename, filter);
+    Out_Flush(_this);
+    STATS_END();
+    return reads;
+}
+
+/**
+ * @brief Number of FASTQ reads loaded
+ *
+ * @param _this genetics object
+ * @return size_t reads
+ */
+size_t Genetics_ReadCount(GeneticsObj *_this)
+{
+    return _this->readCount;
+}
+
+/**
+ * @brief Select a FASTQ read; all operations (find_start, print...) will work on this read
+ *
+ * @param _this genetics object
+ * @param n     read index (0 based)
+ * @return false if n is out of range
+ */
+bool Genetics_SelectRead(GeneticsObj *_this, size_t n)
+{
+    if (n >= _this->readCount)
+        return false;
+    _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START + _this->reads[n].offset;
+    _this->dnaSize = _this->reads[n].size;
+    _this->dnaDir = DNA_DIR_5_TO_3;
+    _this->start_codon = 1;
+    _this->inputFileOffset = 0;
+    _this->dnaView = true;
+    return true;
+}
+
+/**
+ * @brief Phred qualities of the selected read (or of all reads if none was selected)
+ *
+ * @param _this genetics object
+ * @param size  filled with the number of qualities
+ * @return const uint8_t* qualities or NULL if no FASTQ was loaded
+ */
+const uint8_t *Genetics_ReadQuality(GeneticsObj *_this, size_t *size)
+{
+    if (_this->readCount == 0)
+    {
+        *size = 0;
+        return NULL;
+    }
+    *size = _this->dnaSize;
+    return _this->qual + (_this->dna - _this->dnaAllocBuffer);
+}
@@ -6,67 +6,101 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 #include <strings.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 #include "genetics.h"
 #include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
 
+/**
+ * @brief setup the translation table (genetic code) of the object. The default is 1.
+ *        Changing the table resets the incremental scan.
+ * 
+ * @param _this genetics object
+ * @param n translation table > 0
+ * @return false if the table is unknown or has no start codon (the current table is kept)
+ */
+bool Genetics_SetTranslationTable(GeneticsObj *_this, int n)
+{
+    const TranslTable *transl = transl_table_get(n);
+    if (!transl)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: unknown translation table %d", n);
+        return false;
+    }
+    if (transl->start == 0)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: translation table %d has no start codon", n);
+        return false;
+    }
+    if (transl != _this->transl)
+    {
+        _this->transl = transl;
+        Scan_Reset(_this);
+    }
+    return true;
+}
 
 /**
- * @brief Base Pair Encoding (1 byte per pair)
- * (U)T->0 00 
- *    C->1 01
- *    A->2 10
- *    G->3 11
+ * @brief set the callback receiving errors and warnings of the object.
+ *        Without a callback errors are only kept for Genetics_LastError().
+ * 
+ * @param _this genetics object
+ * @param callback error callback or NULL
+ * @param ctx passed to the callback
  */
-#define CODON(b1,b2,b3) (((b1 & 0x3)<<4)|((b2 & 0x3)<<2)|(b3 & 0x3))
-#define COMPLEMENT_CODON(codon) (codon ^ 0x2A)  // XOR 101010   T <-> A, C <-> G
-#define COMPLEMENT(b) (b ^ 0x2)                 // XOR     10   T <-> A, C <-> G
+void Genetics_SetErrorCallback(GeneticsObj *_this, GeneticsErrorCallback callback, void *ctx)
+{
+    _this->errorCallback = callback;
+    _this->errorCtx = ctx;
+}
 
-#define DNA_BUFFER_START 0
-struct _GeneticsObj
+/**
+ * @brief last error or warning reported by the object
+ * 
+ * @param _this genetics object
+ * @return const char* message or NULL if none since Genetics_ClearError()
+ */
+const char *Genetics_LastError(GeneticsObj *_this)
 {
-    uint8_t *dna;
-    DNA_DIR dnaDir;
-    size_t dnaSize;
-    uint8_t *dnaAllocBuffer;
-    size_t dnaAllocSize;
-    bool dnaInput;
-    FILE *out;
-    uint8_t start_codon;
-    size_t inputFileOffset;
-    bool fileBegin;
-    size_t* spliceData;
-    int spliceSize;
-};
+    return _this->lastError[0] ? _this->lastError : NULL;
+}
 
-static uint8_t START_CODON[3];
 /**
- * @brief static function that setup translation table
+ * @brief forget the last error
  * 
- * @param n translation table > 0
+ * @param _this genetics object
  */
-void Genetics_SetTranslationTable(int n)
+void Genetics_ClearError(GeneticsObj *_this)
+{
+    _this->lastError[0] = 0;
+}
+
+void Obj_Error(GeneticsObj *_this, GENETICS_LEVEL level, int errnum, const char *fmt, ...)
 {
-    static int transl_table = 0;
-    if (n > 0 && n != transl_table)
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(_this->lastError, ERROR_MESSAGE_SIZE, fmt, args);
+    va_end(args);
+    if (errnum && n >= 0 && n < ERROR_MESSAGE_SIZE - 3)
     {
-        transl_table = n;
-        int s = parse_transl_table(transl_table);
-        if(s == 0)
-        {
-            fputs("Translation tables have no start codons!!!\n",stderr);
-        }
-        else
-        {
-            START_CODON[0] = (s & (0x3 << 4)) >> 4;
-            START_CODON[1] = (s & (0x3 << 2)) >> 2;
-            START_CODON[2] = s & 0x3;
-        }
+        char buf[ERROR_MESSAGE_SIZE];
+#ifdef STRERROR_R_CHAR_P
+        const char *desc = strerror_r(errnum, buf, sizeof(buf));
+#else
+        const char *desc = strerror_r(errnum, buf, sizeof(buf)) ? "Unknown error" : buf;
+#endif
+        snprintf(_this->lastError + n, ERROR_MESSAGE_SIZE - n, " : %.*s", ERROR_MESSAGE_SIZE - n - 4, desc);
     }
+    if (_this->errorCallback)
+        _this->errorCallback(_this->errorCtx, level, _this->lastError);
 }
 
 
@@ -78,10 +112,37 @@ void Genetics_SetTranslationTable(int n)
  */
 GeneticsObj *Genetics_New()
 {
-    Genetics_SetTranslationTable(1);
-    GeneticsObj *_this = (GeneticsObj *)malloc(sizeof(GeneticsObj));
+    return Genetics_NewWithAllocator(&GeneticsHeapAllocator);
+}
+
+/**
+ * @brief Create a new genetics object using a custom allocator for the object and all its buffers.
+ *        Use Genetics_Delete() to delete. For an arena allocator the object can also be
+ *        dropped by resetting the arena.
+ * 
+ * @param allocator allocator (copied), e.g. Genetics_ArenaAllocator()
+ * @return GeneticsObj* newly created object
+ */
+GeneticsObj *Genetics_NewWithAllocator(const GeneticsAllocator *allocator)
+{
+    GeneticsObj *_this = (GeneticsObj *)allocator->alloc(allocator->ctx, sizeof(GeneticsObj));
+    if (!_this)
+        return NULL;
     memset(_this, 0, sizeof(GeneticsObj));
+    _this->allocator = *allocator;
     _this->out = stdout;
+    _this->fastaWidth = FASTA_DEFAULT_WIDTH;
+    _this->transl = transl_table_get(1);
+    _this->kernels = Cpu_Kernels(Genetics_CpuLevel());
+    _this->maskSkip = GENETICS_MASK_N;
+    if (!(_this->outBuffer = (char *)allocator->alloc(allocator->ctx, OUT_BUFFER_SIZE)))
+    {
+        allocator->free(allocator->ctx, _this, sizeof(GeneticsObj));
+        return NULL;
+    }
+    STATS_INIT(&_this->stats);
+    STATS_ADD(&_this->stats, allocs, 2);
+    Scan_Reset(_this);
     return _this;
 }
 
@@ -92,9 +153,26 @@ GeneticsObj *Genetics_New()
  */
 void Genetics_Delete(GeneticsObj *_this)
 {
-    if (_this->dnaAllocBuffer)
-        free(_this->dnaAllocBuffer);
-    free(_this);
+    Out_Flush(_this);
+    Variant_Delete(_this);
+    RefCache_Release(_this);
+    Mem_Free(_this, _this->outBuffer, OUT_BUFFER_SIZE);
+    if (_this->reader)
+        Reader_Delete(_this->reader);
+    Mem_Free(_this, _this->reads, _this->readAlloc * sizeof(GeneticsRead));
+    Mem_Free(_this, _this->qual, _this->qualAllocSize);
+    Mem_Free(_this, _this->spliceData, _this->spliceAlloc * sizeof(size_t));
+    Mem_Free(_this, _this->codonReference, 64 * sizeof(uint64_t));
+    Mem_Free(_this, (void *)_this->scan.orfs, _this->scanOrfAlloc * sizeof(GeneticsOrf));
+    Mem_Free(_this, _this->alignCigar, _this->alignCigarAlloc);
+    Index_Delete(_this);
+    Mask_Delete(_this);
+    Mem_Free(_this, _this->printPairs, sizeof(PrintPairs));
+    Genetics_SetLatencyHistograms(_this, false);
+    Mem_Free(_this, _this->fastaPath, _this->fastaPathAlloc);
+    Mem_Free(_this, _this->dnaAllocBuffer, _this->dnaAllocSize);
+    GeneticsAllocator allocator = _this->allocator;
+    allocator.free(allocator.ctx, _this, sizeof(GeneticsObj));
 }
 
 /**
@@ -105,42 +183,151 @@ void Genetics_Delete(GeneticsObj *_this)
  */
 void Genetics_SetOutput(GeneticsObj *_this, FILE *out)
 {
+    if (out != _this->out)
+        Out_Flush(_this);
     _this->out = out;
 }
 
+/**
+ * @brief Set FASTA output line width
+ * 
+ * @param _this genetics object
+ * @param width bases (or amino acids) per line, 0 for the whole sequence on one line
+ */
+void Genetics_SetFastaWidth(GeneticsObj *_this, size_t width)
+{
+    _this->fastaWidth = width;
+}
+
 /**
  * @brief Set start read frame base pair
  * 
  * @param _this 
  * @param n start codon 1(default), 2 or 3
  */
-void Genetics_SetCodonStart(GeneticsObj *_this, int n)
+void Genetics_SetCodonStart(GeneticsObj *_this, size_t n)
 {
     if(n >= 1 && n < _this->dnaSize)
         _this->start_codon = n;
 }
 
 /**
- * @brief Find Start Codon
- * 
- * @param _this genetics object
- * @param flags \n 
- *          DNA_PRINT_REVERSE: Find on Reverse strand; \n 
+ * @brief true if a base of a matching codon is in a skipped mask range (checked on matches only)
  */
-bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+static bool SkippedCodon(const GeneticsObj *_this, size_t i1, size_t i2, size_t i3)
+{
+    return Mask_Skipped(_this, i1, i1 + 1) || Mask_Skipped(_this, i2, i2 + 1) || Mask_Skipped(_this, i3, i3 + 1);
+}
+
+/**
+ * @brief exonic bases of the sequence in reading direction (see Splice_Exons()), the whole
+ *        sequence when it is not spliced; the generic print and find_start read codons with it
+ */
+typedef struct _ExonWalk
+{
+    GeneticsRange *exons;
+    size_t count;
+    size_t exon;    // exon of the last base returned
+    bool reverse;
+} ExonWalk;
+
+static void Walk_Open(GeneticsObj *_this, ExonWalk *w, bool reverse)
+{
+    w->exons = Mem_Alloc(_this, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+    w->count = Splice_Exons(_this, w->exons);
+    w->exon = 0;
+    w->reverse = reverse;
+}
+
+static void Walk_Close(GeneticsObj *_this, ExonWalk *w)
+{
+    Mem_Free(_this, w->exons, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+}
+
+/**
+ * @brief first exonic base from buffer index x in reading direction: x in an intron moves to the
+ *        next exon, as codon_start in Splice_Gather()
+ *
+ * @return buffer index, SIZE_MAX if none
+ */
+static size_t Walk_Seek(ExonWalk *w, size_t x)
+{
+    if (!w->reverse)
+    {
+        for (w->exon = 0; w->exon < w->count; w->exon++)
+            if (x < w->exons[w->exon].end)
+                return x > w->exons[w->exon].begin ? x : w->exons[w->exon].begin;
+        return SIZE_MAX;
+    }
+    for (w->exon = w->count; w->exon-- > 0;)
+        if (x >= w->exons[w->exon].begin)
+            return x < w->exons[w->exon].end ? x : w->exons[w->exon].end - 1;
+    return SIZE_MAX;
+}
+
+/**
+ * @brief exonic base after buffer index x in reading direction, *jump set when an intron is crossed
+ *
+ * @return buffer index, SIZE_MAX at the end of the sequence
+ */
+static size_t Walk_Next(ExonWalk *w, size_t x, bool *jump)
+{
+    const GeneticsRange *e = &w->exons[w->exon];
+    if (w->reverse ? x > e->begin : x + 1 < e->end)
+        return w->reverse ? x - 1 : x + 1;
+    if (w->reverse ? w->exon == 0 : w->exon + 1 >= w->count)
+        return SIZE_MAX;
+    *jump = true;
+    e = &w->exons[w->reverse ? --w->exon : ++w->exon];
+    return w->reverse ? e->end - 1 : e->begin;
+}
+
+#define FIND_BLOCK 4096
+
+/**
+ * @brief first start codon with no skipped base on a strand view of the sequence (read backward
+ *        when reverse, complemented with x), searched forward by blocks of codons at every base
+ *
+ * @return strand index of its first base, SIZE_MAX if none
+ */
+static size_t FindStartView(GeneticsObj *_this, bool reverse, uint8_t x)
+{
+    const uint8_t *seq = reverse ? _this->dna + _this->dnaSize - 1 : _this->dna;
+    ptrdiff_t step = reverse ? -1 : 1;
+    size_t positions = _this->dnaSize >= 3 ? _this->dnaSize - 2 : 0;
+    uint8_t bases[FIND_BLOCK + 2], codons[FIND_BLOCK];
+    for (size_t k = 0; k < positions; k += FIND_BLOCK)
+    {
+        size_t n = positions - k < FIND_BLOCK ? positions - k : FIND_BLOCK;
+        _this->kernels->codons(codons, View_Read(_this->kernels, seq, step, k, n + 2, x, bases), n);
+        for (size_t j = 0; j < n; j++)
+        {
+            size_t i = reverse ? _this->dnaSize - 1 - (k + j) : k + j;
+            if (codons[j] == _this->transl->start && !SkippedCodon(_this, i, i + step, i + 2 * step))
+            {
+                STATS_ADD(&_this->stats, codons, k + j + 1);
+                return k + j;
+            }
+        }
+    }
+    STATS_ADD(&_this->stats, codons, positions);
+    return SIZE_MAX;
+}
+
+static bool FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
 {
     uint8_t s1,s2,s3;
     if(flags&DNA_PRINT_COMPLEMENT)
     {
-        s1 = COMPLEMENT(START_CODON[0]);   
-        s2 = COMPLEMENT(START_CODON[1]);   
-        s3 = COMPLEMENT(START_CODON[2]); 
+        s1 = COMPLEMENT(_this->transl->startCodon[0]);   
+        s2 = COMPLEMENT(_this->transl->startCodon[1]);   
+        s3 = COMPLEMENT(_this->transl->startCodon[2]); 
     }
     else
     {
-        s1 = START_CODON[0];   
-        s2 = START_CODON[1];   
-        s3 = START_CODON[2];   
+        s1 = _this->transl->startCodon[0];   
+        s2 = _this->transl->startCodon[1];   
+        s3 = _this->transl->startCodon[2];   
     }
      
     if (_this->dnaDir == DNA_DIR_3_TO_5)
@@ -148,116 +335,65 @@ bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
         flags ^= DNA_PRINT_REVERSE;
     }
 
-    if (flags & DNA_PRINT_REVERSE)
-    {
-        size_t poffset = _this->inputFileOffset + _this->dnaSize;
-        int splice = _this->spliceSize - 1;
-        while(_this->spliceData && splice > 0 && poffset < _this->spliceData[splice]) 
-            splice--;
-        for (int r = _this->dnaSize; r >= 2; r--, poffset --)
-        {
-            uint8_t b1, b2, b3;
-            b1 = _this->dna[r];
-            b2 = _this->dna[r - 1];
-            b3 = _this->dna[r - 2];
-            int cut = 0;
-            if (_this->spliceData && splice > 0)
-            {
-                int s = _this->spliceData[splice] - poffset;
-                if (s >= -1) // could be -1, 0, 1
-                {
-                    cut = _this->spliceData[splice] - _this->spliceData[splice - 1];
-                    if (s == 1)
-                    {
-                        if (r - cut - 2 < 0)
-                            break;
-                        b1 = _this->dna[r - cut];
-                        b2 = _this->dna[r - cut - 1];
-                        b3 = _this->dna[r - cut - 2];
-                        if (s1 == b1 && s2 == b2 && s3 == b3)
-                        {
-                            _this->start_codon = _this->dnaSize - r - 2;
-                            return true;
-                        }
-                        r -= cut - 2;
-                        poffset -= cut - 2;
-                        splice -= 2;
-                        continue;
-                    }
-                    if (s == 0)
-                    {
-                        if (r - cut < 0)
-                            break;
-                        b2 = _this->dna[r - cut];
-                    }
-                    if (r - cut - 1 < 0)
-                        break;
-                    b3 = _this->dna[r - cut - 1];
-                }
-            }
-            if (s1 == b1 && s2 == b2 && s3 == b3)
-            {
-                _this->start_codon = _this->dnaSize - r;
-                return true;
-            }
-        }
+    const GeneticsScan *scan;
+    if (!(flags & (DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT | DNA_PRINT_GENERIC)) && _this->spliceSize == 0 &&
+        (scan = Scan_Update(_this)))
+    { // incremental: only the bases added since the previous call are scanned
+        if (scan->start == 0)
+            return false;
+        _this->start_codon = scan->start - _this->inputFileOffset;
+        return true;
     }
-    else
+
+    if (!(flags & DNA_PRINT_GENERIC) && _this->spliceSize == 0)
+    { // the strand start codon k gives codon_start k + 1 in both directions
+        size_t k = FindStartView(_this, flags & DNA_PRINT_REVERSE, (flags & DNA_PRINT_COMPLEMENT) ? 0x2 : 0);
+        if (k == SIZE_MAX)
+            return false;
+        _this->start_codon = k + 1;
+        return true;
+    }
+
+    // codon by codon, introns removed
+    bool reverse = flags & DNA_PRINT_REVERSE, found = false, jump;
+    ExonWalk w;
+    Walk_Open(_this, &w, reverse);
+    for (size_t i1 = Walk_Seek(&w, reverse ? _this->dnaSize - 1 : 0); i1 != SIZE_MAX; i1 = Walk_Next(&w, i1, &jump))
     {
-        size_t poffset = _this->inputFileOffset + 1;
-        int splice = 0;
-        while(_this->spliceData && splice < _this->spliceSize && poffset > _this->spliceData[splice]) 
-            splice++;
-        for (int i = 0; i < _this->dnaSize - 2; i++, poffset++)
+        ExonWalk ahead = w;
+        size_t i2 = Walk_Next(&ahead, i1, &jump), i3 = i2 != SIZE_MAX ? Walk_Next(&ahead, i2, &jump) : SIZE_MAX;
+        if (i3 == SIZE_MAX)
+            break;
+        STATS_ADD(&_this->stats, codons, 1);
+        if (s1 == _this->dna[i1] && s2 == _this->dna[i2] && s3 == _this->dna[i3] && !SkippedCodon(_this, i1, i2, i3))
         {
-            uint8_t b1, b2, b3;
-            b1 = _this->dna[i];
-            b2 = _this->dna[i + 1];
-            b3 = _this->dna[i + 2];
-            int cut = 0;
-            if (_this->spliceData && splice < _this->spliceSize)
-            {
-                int s = poffset - _this->spliceData[splice];
-                if (s >= -1) // could be -1, 0, 1
-                {
-                    cut = _this->spliceData[splice + 1] - _this->spliceData[splice];
-                    if (s == 1)
-                    {
-                        if (i + cut + 1 >= _this->dnaSize)
-                            break;
-                        b1 = _this->dna[i + cut -1];
-                        b2 = _this->dna[i + cut];
-                        b3 = _this->dna[i + cut + 1];
-                        if (s1 == b1 && s2 == b2 && s3 == b3)
-                        {
-                            _this->start_codon = i-2;
-                            return true;
-                        }
-                        i += cut - 2;
-                        poffset += cut - 2;
-                        splice += 2;
-                        continue;
-                    }
-                    if (s == 0)
-                    {
-                        if (i + cut >= _this->dnaSize)
-                            break;
-                        b2 = _this->dna[i + cut];
-                    }
-                    if (i + 1 + cut >= _this->dnaSize)
-                        break;
-                    b3 = _this->dna[i + 1 + cut];
-                }
-            }
-            if (s1 == b1 && s2 == b2 && s3 == b3)
-            {
-                _this->start_codon = i + 1;
-                return true;
-            }
+            _this->start_codon = reverse ? _this->dnaSize - i1 : i1 + 1;
+            found = true;
+            break;
         }
     }
+    Walk_Close(_this, &w);
+    return found;
+}
 
-    return false;
+/**
+ * @brief Find Start Codon
+ * 
+ * @param _this genetics object
+ * @param flags \n 
+ *          DNA_PRINT_REVERSE: Find on Reverse strand; \n 
+ *          DNA_PRINT_GENERIC: search codon by codon instead of using the incremental scan; \n 
+ *          DNA_PRINT_FORMAT_JSON, DNA_PRINT_FORMAT_TSV, DNA_PRINT_FORMAT_BINARY: print the result record; \n 
+ */
+bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_FIND_START);
+    bool found = FindStart(_this, flags);
+    if (flags & DNA_PRINT_FORMAT_MASK)
+        Format_PrintStart(_this, flags, found);
+    Out_Flush(_this);
+    STATS_END();
+    return found;
 }
 
 /**
@@ -273,90 +409,131 @@ bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
  */
 size_t Genetics_StartDNA(GeneticsObj *_this, DNA_DIR dir, const char *code)
 {
+    Variant_Delete(_this);
+    RefCache_Release(_this);
     _this->dnaInput = true;
     if (_this->dnaAllocSize == 0)
     {
         _this->dnaAllocSize = 102400;
-        _this->dnaAllocBuffer = (uint8_t *)malloc(_this->dnaAllocSize);
+        _this->dnaAllocBuffer = (uint8_t *)Mem_Alloc(_this, _this->dnaAllocSize);
         _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
     }
     _this->dnaDir = dir;
+    _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
+    _this->readCount = 0;
     _this->dnaSize = 0;
     _this->dna[0] = 0;
     _this->start_codon = 1;
     _this->inputFileOffset = 0;
     _this->fileBegin = true;
+    _this->seqName[0] = 0;
+    _this->dnaView = false;
+    if (_this->fastaPath)
+        _this->fastaPath[0] = 0;
+    Scan_Reset(_this);
+    Mask_Reset(_this);
+    Index_Delete(_this);
     return Genetics_AddDNA(_this, code);
 }
 
 /**
- * @brief Add DNA Input
- * 
- * @param _this genetics object
- * @param code DNA code: a string containing letters A T(U) G C
- * 
- * @return number of bp added
+ * @brief encode at most maxbp base pairs from code[0..len) to dst: bases, and a placeholder base per
+ *        N after the first base. N runs and lower case runs are pushed to masks at index at + k.
+ *        N's while *fileBegin (no base yet) are only counted in *leading.
+ *        Used by AddDNAn() and by the parallel FASTA loader threads on their own mask lists.
+ *
+ * @return number of bp written
  */
-size_t Genetics_AddDNA(GeneticsObj *_this, const char *code)
+size_t Encode_Text(const GeneticsKernels *kernels, uint8_t *dst, size_t at, const char *code, size_t len,
+                   size_t maxbp, bool *fileBegin, size_t *leading, const GeneticsAllocator *allocator,
+                   GeneticsMaskList masks[MASK_LISTS])
 {
-    if (*code == ';' || *code == '>')
-        return 0; //FASTA lines
     size_t bp = 0;
-    if (_this->dnaInput)
+    const char *end = code + len;
+    while (code < end && bp < maxbp)
     {
-        size_t codeSize = strlen(code);
-        if (_this->dnaAllocSize <= _this->dnaSize + codeSize)
+        // runs of bases of one case go through the kernel, it stops at any other character
+        size_t n = (size_t)(end - code) < maxbp - bp ? (size_t)(end - code) : maxbp - bp;
+        char lower = *code & 0x20;
+        n = kernels->encode(dst + bp, code, n, lower);
+        if (n > 0)
         {
-            _this->dnaAllocSize = 10 * _this->dnaAllocSize;
-            _this->dnaAllocBuffer = (uint8_t *)realloc(_this->dnaAllocBuffer, _this->dnaAllocSize);
-            _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
+            if (lower)
+                Mask_Push(allocator, &masks[MASK_SOFT], at + bp, at + bp + n);
+            *fileBegin = false;
+            bp += n;
+            code += n;
+            continue;
         }
-        while (*code)
+        if (*code == 'N' || *code == 'n')
         {
-            switch (*code)
+            // leading N's only move the file offset, later ones keep their place as an N block
+            size_t k = 1;
+            while (k < (size_t)(end - code) && k < maxbp - bp && code[k] == *code)
+                k++;
+            if (*fileBegin)
+                *leading += k;
+            else
             {
-            case 'T':
-            case 't':
-                _this->dna[_this->dnaSize++] = 0;
-                if(_this->fileBegin) _this->fileBegin = false; 
-                bp++;
-                break;
-            case 'U':
-            case 'u':
-                _this->dna[_this->dnaSize++] = 0;
-                if(_this->fileBegin) _this->fileBegin = false; 
-                bp++;
-                break;
-            case 'C':
-            case 'c':
-                _this->dna[_this->dnaSize++] = 1;
-                if(_this->fileBegin) _this->fileBegin = false; 
-                bp++;
-                break;
-            case 'A':
-            case 'a':
-                _this->dna[_this->dnaSize++] = 2;
-                if(_this->fileBegin) _this->fileBegin = false; 
-                bp++;
-                break;
-            case 'G':
-            case 'g':
-                _this->dna[_this->dnaSize++] = 3;
-                if(_this->fileBegin) _this->fileBegin = false; 
-                bp++;
-                break;
-            case 'N':
-            case 'n':
-                if(_this->fileBegin) _this->inputFileOffset++;
-                break;
+                memset(dst + bp, 0, k);
+                Mask_Push(allocator, &masks[MASK_N], at + bp, at + bp + k);
+                if (*code == 'n')
+                    Mask_Push(allocator, &masks[MASK_SOFT], at + bp, at + bp + k);
+                bp += k;
             }
-            code++;
+            code += k;
+            continue;
         }
+        code++;
     }
-    else
+    return bp;
+}
+
+/**
+ * @brief encode at most maxbp base pairs from code[0..len)
+ * 
+ * @return number of bp added
+ */
+static size_t AddDNAn(GeneticsObj *_this, const char *code, size_t len, size_t maxbp)
+{
+    if (_this->dnaAllocSize <= _this->dnaSize + len)
     {
-        fprintf(_this->out, "warning Genetics_AddDNA without DNA Start");
+        size_t size = _this->dnaAllocSize;
+        while (size <= _this->dnaSize + len)
+            size = 10 * size;
+        _this->dnaAllocBuffer = (uint8_t *)Mem_Realloc(_this, _this->dnaAllocBuffer, _this->dnaAllocSize, size);
+        _this->dnaAllocSize = size;
+        _this->dna = _this->dnaAllocBuffer + DNA_BUFFER_START;
     }
+    size_t leading = 0;
+    size_t bp = Encode_Text(_this->kernels, _this->dna + _this->dnaSize, _this->dnaSize, code, len, maxbp,
+                            &_this->fileBegin, &leading, &_this->allocator, _this->masks);
+    _this->inputFileOffset += leading;
+    _this->dnaSize += bp;
+    STATS_ADD(&_this->stats, bases, bp);
+    return bp;
+}
+
+/**
+ * @brief Add DNA Input
+ * 
+ * @param _this genetics object
+ * @param code DNA code: a string containing letters A T(U) G C
+ * 
+ * @return number of bp added
+ */
+size_t Genetics_AddDNA(GeneticsObj *_this, const char *code)
+{
+    if (*code == ';' || *code == '>')
+        return 0; //FASTA lines
+    if (!_this->dnaInput)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_WARNING, 0, "warning Genetics_AddDNA without DNA Start");
+        return 0;
+    }
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_ADD_DNA);
+    size_t bp = AddDNAn(_this, code, strlen(code), SIZE_MAX);
+    STATS_END();
     return bp;
 }
 
@@ -388,38 +565,48 @@ int Genetics_DNAInput(GeneticsObj *_this)
 #define CODONS_PER_LINE 20
 #define PROTEINS_BP_PER_LINE 210
 #define PROTEINS_LONG_BP_PER_LINE 60
-static void PrintCodon(FILE* out, size_t bufferOffset, uint8_t b1, uint8_t b2, uint8_t b3,
+#define CODON_N_BASES   0x7 // bit per base in an N block, printed as N
+#define CODON_SKIPPED   0x8 // a base is in a skipped mask: starts no reading frame, ends an open one
+
+static int CodonMask(const GeneticsObj *_this, size_t i1, size_t i2, size_t i3)
+{
+    int mask = Mask_In(_this, MASK_N, i1) | Mask_In(_this, MASK_N, i2) << 1 | Mask_In(_this, MASK_N, i3) << 2;
+    return SkippedCodon(_this, i1, i2, i3) ? mask | CODON_SKIPPED : mask;
+}
+
+static void PrintCodon(GeneticsObj *_this, size_t bufferOffset, uint8_t b1, uint8_t b2, uint8_t b3, int mask,
                        DNA_PRINT_FlAGS flags, int *pstate, size_t poffset, size_t printOffset)
 {
     uint8_t codon = CODON(b1,b2,b3);
+    STATS_ADD(&_this->stats, codons, 1);
     if (flags & DNA_PRINT_COMPLEMENT)
         codon = COMPLEMENT_CODON(codon);
     bool translChanged = false;
 
     if (flags & (DNA_PRINT_TRANSLATE | DNA_PRINT_TRANSLATE_LONG))
     {
-        if (*pstate == PSTATE_NA && STARTS_TABLE[codon] == 'M')
+        if (*pstate == PSTATE_NA && !(mask & CODON_SKIPPED) && _this->transl->starts[codon] == 'M')
         {
             if(flags&DNA_PRINT_TRANSLATE_CORRELATE)
             {
                 if (flags & DNA_PRINT_TRANSLATE)
-                    fputs("M   ",out);
+                    Out_Puts(_this, "M   ");
                 else
-                    fputs("Met-",out);
+                    Out_Puts(_this, "Met-");
             }
             else
             {
                 if (flags & DNA_PRINT_TRANSLATE)
-                    fprintf(out, START_LINE_FMT "M", poffset);
+                    Out_Printf(_this, START_LINE_FMT "M", poffset);
                 else
-                    fprintf(out, START_LINE_FMT "Met-", poffset);    
+                    Out_Printf(_this, START_LINE_FMT "Met-", poffset);    
             }
             translChanged = true;
             *pstate = bufferOffset;
         }
         else if (*pstate != PSTATE_NA)
         {
-            if (STARTS_TABLE[codon] == '*')
+            if ((mask & CODON_SKIPPED) || _this->transl->starts[codon] == '*')
             {
                 translChanged = true;
                 *pstate = PSTATE_NA;
@@ -432,7 +619,7 @@ static void PrintCodon(FILE* out, size_t bufferOffset, uint8_t b1, uint8_t b2, u
         if(!(flags&DNA_PRINT_TRANSLATE_CORRELATE))
         {
             if (!translChanged && *pstate != PSTATE_NA && printOffset % PROTEINS_BP_PER_LINE == 0)
-                fprintf(out, " ..." START_LINE_FMT, poffset);
+                Out_Printf(_this, " ..." START_LINE_FMT, poffset);
         }
     }
     else if (flags & DNA_PRINT_TRANSLATE_LONG)
@@ -440,18 +627,18 @@ static void PrintCodon(FILE* out, size_t bufferOffset, uint8_t b1, uint8_t b2, u
         if(!(flags&DNA_PRINT_TRANSLATE_CORRELATE))
         {
             if (!translChanged && *pstate != PSTATE_NA && printOffset % PROTEINS_LONG_BP_PER_LINE == 0)
-                fprintf(out, " ..." START_LINE_FMT, poffset);                
+                Out_Printf(_this, " ..." START_LINE_FMT, poffset);                
         }        
     }
     else
     {
         if (printOffset % CODONS_PER_LINE == 0)
         {
-            fprintf(out, START_LINE_FMT, poffset);
+            Out_Printf(_this, START_LINE_FMT, poffset);
         }
         else 
         {
-            fputc(' ', out);
+            Out_Putc(_this, ' ');
         }
     }
 
@@ -460,15 +647,15 @@ static void PrintCodon(FILE* out, size_t bufferOffset, uint8_t b1, uint8_t b2, u
         if (!translChanged){ 
             if(*pstate != PSTATE_NA)
             {
-                fputc(TRANSL_TABLE[codon], out);
+                Out_Putc(_this, _this->transl->transl[codon]);
                 if(flags&DNA_PRINT_TRANSLATE_CORRELATE)
-                    fputs("   ",out);
+                    Out_Puts(_this, "   ");
             }
             else if(flags&DNA_PRINT_TRANSLATE_CORRELATE)
-                fputs("    ",out);
+                Out_Puts(_this, "    ");
         }
         else if(translChanged && *pstate == PSTATE_NA && flags&DNA_PRINT_TRANSLATE_CORRELATE)
-            fputs("    ",out);
+            Out_Puts(_this, "    ");
     }
     else if (flags & DNA_PRINT_TRANSLATE_LONG)
     {
@@ -476,21 +663,23 @@ static void PrintCodon(FILE* out, size_t bufferOffset, uint8_t b1, uint8_t b2, u
         { 
             if(*pstate != PSTATE_NA)
             {
-                fputs(TRANSL_TABLE_LONG[codon], out);
-                fputc('-',out);
+                Out_Puts(_this, _this->transl->translLong[codon]);
+                Out_Putc(_this, '-');
             }
             else if(flags&DNA_PRINT_TRANSLATE_CORRELATE)
-                fputs("    ",out);
+                Out_Puts(_this, "    ");
         }
         else if(translChanged && *pstate == PSTATE_NA && flags&DNA_PRINT_TRANSLATE_CORRELATE)
-            fputs("    ",out);
+            Out_Puts(_this, "    ");
     }
     else
     {
-        if (flags & DNA_PRINT_RNA)
-            fputs(RNA_STRINGS[codon], out);
-        else
-            fputs(DNA_STRINGS[codon], out);
+        char bases[3];
+        memcpy(bases, (flags & DNA_PRINT_RNA) ? _this->transl->rna[codon] : _this->transl->dna[codon], 3);
+        for (int b = 0; b < 3; b++)
+            if (mask & (1 << b))
+                bases[b] = 'N';
+        Out_Write(_this, bases, 3);
     }
 }
 
@@ -499,9 +688,9 @@ static void PrintHeader(GeneticsObj *_this, bool begin, DNA_PRINT_FlAGS flags)
     if (flags & (DNA_PRINT_TRANSLATE | DNA_PRINT_TRANSLATE_LONG))
     {
         if (begin)
-            fputs("\nNH2", _this->out);
+            Out_Puts(_this, "\nNH2");
         else
-            fputs("\nCOOH", _this->out);
+            Out_Puts(_this, "\nCOOH");
     }
     else
     {
@@ -509,47 +698,61 @@ static void PrintHeader(GeneticsObj *_this, bool begin, DNA_PRINT_FlAGS flags)
             (!(flags & DNA_PRINT_COMPLEMENT) && !(flags & DNA_PRINT_REVERSE)))
         { //same order
             if ((begin && _this->dnaDir == DNA_DIR_5_TO_3) || (!begin && _this->dnaDir == DNA_DIR_3_TO_5))
-                fputs("\n5'", _this->out);
+                Out_Puts(_this, "\n5'");
             else
-                fputs("\n3'", _this->out);
+                Out_Puts(_this, "\n3'");
         }
         else
         { // reverse order
             if ((begin && _this->dnaDir == DNA_DIR_5_TO_3) || (!begin && _this->dnaDir == DNA_DIR_3_TO_5))
-                fputs("\n3'", _this->out);
+                Out_Puts(_this, "\n3'");
             else
-                fputs("\n5'", _this->out);
+                Out_Puts(_this, "\n5'");
         }
     }
     if (begin && _this->start_codon != 1)
     {
         if(flags & DNA_PRINT_REVERSE)
-            fprintf(_this->out, " /codon_start <%d (%lu)", _this->start_codon, _this->inputFileOffset + 1 +_this->dnaSize - _this->start_codon);
+            Out_Printf(_this, " /codon_start <%lu (%lu)", _this->start_codon, _this->inputFileOffset + 1 +_this->dnaSize - _this->start_codon);
         else
-            fprintf(_this->out, " /codon_start %d> (%lu)", _this->start_codon, _this->inputFileOffset + _this->start_codon);
+            Out_Printf(_this, " /codon_start %lu> (%lu)", _this->start_codon, _this->inputFileOffset + _this->start_codon);
     }
 }
 
 #define END_PRINT_STRING    "\n-------------------------\n\n"
 /**
- * @brief Print DNA Info
- * 
- * @param _this genetics object
- * @param flags \n 
- *          DNA_PRINT_REVERSE: Reverse order; \n 
- *          DNA_PRINT_COMPLEMENT: Print Complement pairs; \n 
- *          DNA_PRINT_RNA: DNA to RNA; \n 
- *          DNA_PRINT_TRANSLATE: Translate to protein (single letter); \n
- *          DNA_PRINT_TRANSLATE_LONG: Translate to protein (3 letters); \n
- *          DNA_PRINT_TRANSLATE_CORRELATE: Show BP and Translate;
+ * @brief codons of the exons from codon_start, codon_start in an intron moves to the next exon as in the
+ *        exon based formats. A line starts after each intron: at the first codon after it, or at the
+ *        codon following the one read across it.
  */
-void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+static void PrintSpliced(GeneticsObj *_this, DNA_PRINT_FlAGS flags, int *pstate)
+{
+    bool reverse = flags & DNA_PRINT_REVERSE;
+    ExonWalk w;
+    Walk_Open(_this, &w, reverse);
+    size_t printOffset = 0;
+    size_t i1 = Walk_Seek(&w, reverse ? _this->dnaSize - _this->start_codon : _this->start_codon - 1);
+    while (i1 != SIZE_MAX)
+    {
+        bool across = false, after = false;
+        size_t i2 = Walk_Next(&w, i1, &across), i3 = i2 != SIZE_MAX ? Walk_Next(&w, i2, &across) : SIZE_MAX;
+        if (i3 == SIZE_MAX)
+            break;
+        PrintCodon(_this, i1, _this->dna[i1], _this->dna[i2], _this->dna[i3], CodonMask(_this, i1, i2, i3), flags,
+                   pstate, _this->inputFileOffset + i1 + 1, printOffset);
+        i1 = Walk_Next(&w, i3, &after);
+        printOffset = across || after ? 0 : printOffset + 1;
+    }
+    Walk_Close(_this, &w);
+}
+
+static void PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
 {
     int pstate = PSTATE_NA;
     if(_this->dnaSize == 0) {
         PrintHeader(_this, true, flags);
         PrintHeader(_this, false, flags);
-        fputs(END_PRINT_STRING, _this->out);
+        Out_Puts(_this, END_PRINT_STRING);
         return;
     }
     if(_this->dnaDir == DNA_DIR_3_TO_5)
@@ -557,8 +760,16 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
         flags ^= DNA_PRINT_REVERSE;
     }
 
-    if(flags&DNA_PRINT_TRANSLATE_CORRELATE && _this->spliceData){
-        fprintf(stderr,"ERROR: Splice is not supported with correlate translation\n");
+    if(flags&DNA_PRINT_TRANSLATE_CORRELATE && _this->spliceSize > 0){
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: Splice is not supported with correlate translation");
+        return;
+    }
+    if (_this->spliceSize > 0)
+    {
+        PrintHeader(_this, true, flags);
+        PrintSpliced(_this, flags, &pstate);
+        PrintHeader(_this, false, flags);
+        Out_Puts(_this, END_PRINT_STRING);
         return;
     }
 
@@ -574,9 +785,6 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
         PrintHeader(_this, true, flags);
         size_t poffset = _this->inputFileOffset + 1 +_this->dnaSize - _this->start_codon;   
         size_t cor_r = _this->dnaSize - _this->start_codon, cor_poffset = poffset;
-        int splice = _this->spliceSize - 1;
-        while(_this->spliceData && splice > 0 && poffset < _this->spliceData[splice]) 
-            splice--;
         for (int r = cor_r; r >= 2; r-=3, poffset -= 3, printOffset++)
         {
             if(flags&DNA_PRINT_TRANSLATE_CORRELATE && printOffset > 0 && printOffset % CODONS_PER_LINE == 0 && !endCorrelation) 
@@ -586,7 +794,7 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
                 {
                     r = cor_r;
                     poffset = cor_poffset; 
-                    fputs(START_LINE_EMPTY,_this->out);
+                    Out_Puts(_this, START_LINE_EMPTY);
                     pflags = flags;
                 }
                 else
@@ -597,45 +805,12 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
                 }
             }
             uint8_t b1,b2,b3;
+            size_t i1 = r, i2 = r - 1, i3 = r - 2;
             b1 = _this->dna[r];
             b2 = _this->dna[r-1];
             b3 = _this->dna[r-2];
-            int cut = 0;
-            if(_this->spliceData && splice > 0)
-            {
-                int s = _this->spliceData[splice] - poffset;
-                if(s >= -1) // could be -1, 0, 1
-                {
-                    cut = _this->spliceData[splice] - _this->spliceData[splice-1];
-                    splice -= 2;
-                    if(s==1) {
-                        r -= cut - 4; 
-                        poffset -= cut - 4;
-                        printOffset = -1;
-                        continue;
-                    }
-                    if(s==0)
-                    {
-                        if(r - cut < 0) break;
-                        b2 = _this->dna[r - cut]; 
-                    }
-                    r--;
-                    poffset--; 
-                    if(r - cut < 0) break; 
-                    b3 = _this->dna[r - cut];  
-                    r--;
-                    poffset--;
-                }                
-            }
 
-            PrintCodon(_this->out, r, b1,b2,b3, pflags, &pstate, poffset, printOffset);
-
-            if(cut > 0)
-            {
-                r -= cut - 3; 
-                poffset -= cut - 3;
-                printOffset = -1;
-            }
+            PrintCodon(_this, r, b1,b2,b3, CodonMask(_this, i1, i2, i3), pflags, &pstate, poffset, printOffset);
 
             if(flags&DNA_PRINT_TRANSLATE_CORRELATE && !printCorrelation && r - 3 < 2) 
             {
@@ -643,7 +818,7 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
                 endCorrelation = true;
                 r = cor_r + 3;
                 poffset = cor_poffset + 3; 
-                fputs(START_LINE_EMPTY,_this->out);
+                Out_Puts(_this, START_LINE_EMPTY);
                 pflags = flags;
             }
         }
@@ -654,9 +829,6 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
         PrintHeader(_this, true, flags);
         size_t poffset = _this->inputFileOffset + _this->start_codon;
         size_t cor_i = _this->start_codon - 1, cor_poffset = poffset;
-        int splice = 0;
-        while(_this->spliceData && splice < _this->spliceSize && poffset > _this->spliceData[splice]) 
-            splice++;
         for (size_t i = cor_i; i < _this->dnaSize - 2; i+=3, poffset += 3, printOffset++)
         {
             if(flags&DNA_PRINT_TRANSLATE_CORRELATE && printOffset > 0 && printOffset % CODONS_PER_LINE == 0 && !endCorrelation) 
@@ -666,7 +838,7 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
                 {
                     i = cor_i;
                     poffset = cor_poffset; 
-                    fputs(START_LINE_EMPTY,_this->out);
+                    Out_Puts(_this, START_LINE_EMPTY);
                     pflags = flags;
                 }
                 else
@@ -677,51 +849,18 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
                 }
             }
             uint8_t b1,b2,b3;
+            size_t i1 = i, i2 = i + 1, i3 = i + 2;
             b1 = _this->dna[i];
             b2 = _this->dna[i+1];
             b3 = _this->dna[i+2];
-            int cut = 0;
-            if(_this->spliceData && splice < _this->spliceSize)
-            {
-                int s = poffset - _this->spliceData[splice];
-                if(s >= -1) // could be -1, 0, 1
-                {
-                    cut = _this->spliceData[splice+1] - _this->spliceData[splice];
-                    splice += 2;
-                    if(s==1) {
-                        i += cut - 4; 
-                        poffset += cut - 4;
-                        printOffset = -1;
-                        continue;
-                    }
-                    if(s==0)
-                    {
-                        if(i + cut >= _this->dnaSize) break;
-                        b2 = _this->dna[i + cut];   
-                    }
-                    i++;
-                    poffset++;
-                    if(i + cut >= _this->dnaSize) break;
-                    b3 = _this->dna[i + cut];
-                    i++;
-                    poffset++;
-                }                
-            }
             
-            PrintCodon(_this->out, i, b1,b2,b3, pflags, &pstate, poffset, printOffset);
+            PrintCodon(_this, i, b1,b2,b3, CodonMask(_this, i1, i2, i3), pflags, &pstate, poffset, printOffset);
             
-            if(cut > 0)
-            {
-                i += cut - 3; 
-                poffset += cut - 3;
-                printOffset = -1;
-            }
-
             if(flags&DNA_PRINT_TRANSLATE_CORRELATE && !printCorrelation && i + 3 >= _this->dnaSize - 2) 
             {
                 printCorrelation = true;
                 endCorrelation = true;
-                fputs(START_LINE_EMPTY,_this->out);
+                Out_Puts(_this, START_LINE_EMPTY);
                 i = cor_i - 3;
                 poffset = cor_poffset - 3; 
                 pflags = flags;
@@ -729,81 +868,449 @@ void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
         }
         PrintHeader(_this, false, flags);
     }
-    fputs(END_PRINT_STRING, _this->out);
+    Out_Puts(_this, END_PRINT_STRING);
 }
 
 /**
- * @brief Load a FASTA file
+ * @brief specialized print kernels for the plain cases (no splice, no correlate).
+ *        Flags are resolved once into lookup tables (complement applied, dna/rna/protein symbols)
+ *        and a kernel per output kind, so the inner loops test no flags. The kernels read the strand
+ *        view in blocks in reading order (View_Read()) and loop forward whatever the direction.
+ *        PrintDNA() above is the generic reference loop, forced with DNA_PRINT_GENERIC.
+ */
+#define PRINT_LINE_MAX (32 + 4 * CODONS_PER_LINE)
+#define PRINT_BLOCK_CODONS (CODONS_PER_LINE * 1024)
+
+typedef struct _PrintKernel
+{
+    const uint8_t *first;   // first base of the first codon
+    size_t origin;          // its buffer index
+    ptrdiff_t step;         // 1, or -1 reading the reverse strand
+    uint8_t *block;         // 3 * PRINT_BLOCK_CODONS bases of the reverse strand in reading order
+    size_t codons;
+    size_t poffset;         // file offset of the first codon
+    char bases[64][4];      // " xyz" codon bases with leading separator
+    char symbols[64][4];    // amino acid symbol ("M" or "Met-")
+    size_t symbolSize;
+    char starts[64];        // starts table
+    const char *startMark;  // printed after the line header at a start codon
+    size_t wrap;            // codons per protein line
+    bool nBlocks;           // the sequence has N blocks to print as N
+    const uint64_t *pairs;  // codon pair c1 << 6 | c2: " xyz xyz" or both symbols, see PrintPairsOf()
+} PrintKernel;
+
+/**
+ * @brief write 'N' over the bases of a printed line that are in an N block;
+ *        the line holds the codons of bases from buffer index first in direction dir, codon j base t at 4j + t
+ */
+static void PatchN(const GeneticsObj *_this, char *line, size_t first, size_t bases, int dir)
+{
+    size_t lo = dir > 0 ? first : first + 1 - bases, hi = lo + bases, end;
+    for (size_t b = Mask_NextIn(_this, MASK_N, lo, &end); b < hi; b = Mask_NextIn(_this, MASK_N, end, &end))
+    {
+        for (size_t x = b > lo ? b : lo; x < end && x < hi; x++)
+        {
+            size_t d = dir > 0 ? x - first : first - x;
+            line[4 * (d / 3) + d % 3] = 'N';
+        }
+    }
+}
+
+#define KERNEL_CODON(p) CODON((p)[0], (p)[1], (p)[2])
+
+#define KERNEL_PAIR(p) (KERNEL_CODON(p) << 6 | KERNEL_CODON((p) + 3))
+
+/**
+ * @brief codons [c, c + n) of the kernel strand in reading order (n <= PRINT_BLOCK_CODONS)
+ */
+static inline const uint8_t *KernelRead(const GeneticsObj *_this, const PrintKernel *k, size_t c, size_t n)
+{
+    return View_Read(_this->kernels, k->first, k->step, 3 * c, 3 * n, 0, k->block);
+}
+
+/**
+ * @brief buffer index of the first base of codon c
+ */
+static inline size_t KernelIndex(const PrintKernel *k, size_t c)
+{
+    return k->step > 0 ? k->origin + 3 * c : k->origin - 3 * c;
+}
+
+// the line header ends with a space: codons are written with their separator over it
+static void PrintBases(GeneticsObj *_this, const PrintKernel *k)
+{
+    size_t poffset = k->poffset;
+    for (size_t b = 0; b < k->codons; b += PRINT_BLOCK_CODONS)
+    {
+        size_t blockEnd = k->codons - b < PRINT_BLOCK_CODONS ? k->codons : b + PRINT_BLOCK_CODONS;
+        const uint8_t *p = KernelRead(_this, k, b, blockEnd - b);
+        for (size_t c = b; c < blockEnd; c += CODONS_PER_LINE)
+        {
+            size_t n = blockEnd - c < CODONS_PER_LINE ? blockEnd - c : CODONS_PER_LINE;
+            char *o = Out_Reserve(_this, PRINT_LINE_MAX);
+            size_t len0 = snprintf(o, PRINT_LINE_MAX, START_LINE_FMT, poffset);
+            char *q = o + len0 - 1;
+            for (size_t j = 1; j < n; j += 2, p += 6, q += 8)
+                memcpy(q, &k->pairs[KERNEL_PAIR(p)], 8);
+            if (n % 2)
+            {
+                memcpy(q, k->bases[KERNEL_CODON(p)], 4);
+                p += 3;
+                q += 4;
+            }
+            if (k->nBlocks)
+                PatchN(_this, o + len0, KernelIndex(k, c), 3 * n, (int)k->step);
+            Out_Commit(_this, q - o);
+            poffset += k->step * 3 * CODONS_PER_LINE;
+        }
+    }
+}
+
+/**
+ * @brief codons after codon c at p (in a reading frame) whose bases are not skipped, see Mask_SkipCursor()
+ */
+static inline size_t UnskippedAfter(const GeneticsRange *skip, size_t i, int dir)
+{
+    if (dir > 0)
+        return skip->begin == SIZE_MAX ? SIZE_MAX : (skip->begin - i - 3) / 3;
+    return i >= skip->end + 2 ? (i - 2 - skip->end) / 3 : 0;
+}
+
+static void PrintProteins(GeneticsObj *_this, const PrintKernel *k)
+{
+    int dir = (int)k->step;
+    const uint8_t *p = NULL;
+    bool orf = false;
+    size_t wrap = 0, blockEnd = 0;
+    GeneticsRange skip = Mask_SkipStart(dir);
+    for (size_t c = 0; c < k->codons; c++, p += 3)
+    {
+        if (c == blockEnd)
+        {
+            blockEnd = k->codons - c < PRINT_BLOCK_CODONS ? k->codons : c + PRINT_BLOCK_CODONS;
+            p = KernelRead(_this, k, c, blockEnd - c);
+        }
+        uint8_t codon = KERNEL_CODON(p);
+        size_t i = KernelIndex(k, c);
+        bool newLine = c == wrap;
+        wrap += newLine ? k->wrap : 0;
+        if (Mask_SkipCursor(_this, &skip, i, dir))
+        {
+            orf = false;
+            continue;
+        }
+        if (!orf)
+        {
+            if (k->starts[codon] == 'M')
+            {
+                Out_Printf(_this, START_LINE_FMT "%s", k->poffset + dir * 3 * c, k->startMark);
+                orf = true;
+            }
+            continue;
+        }
+        if (k->starts[codon] == '*')
+        {
+            orf = false;
+            continue;
+        }
+        if (newLine)
+            Out_Printf(_this, " ..." START_LINE_FMT, k->poffset + dir * 3 * c);
+        // then codon pairs up to the line end, the block end, a skipped base or a stop
+        size_t n = (wrap < blockEnd ? wrap : blockEnd) - c - 1;
+        size_t unskipped = UnskippedAfter(&skip, i, dir);
+        n = n < unskipped ? n : unskipped;
+        char *o = Out_Reserve(_this, n * k->symbolSize + 8), *q = o;
+        memcpy(q, k->symbols[codon], 4);
+        q += k->symbolSize;
+        for (; n >= 2; n -= 2, c += 2, p += 6, q += 2 * k->symbolSize)
+        {
+            if (k->starts[KERNEL_CODON(p + 3)] == '*' || k->starts[KERNEL_CODON(p + 6)] == '*')
+                break;
+            memcpy(q, &k->pairs[KERNEL_PAIR(p + 3)], 8);
+        }
+        Out_Commit(_this, q - o);
+    }
+}
+
+typedef void (*PrintKernelFn)(GeneticsObj *_this, const PrintKernel *k);
+static const PrintKernelFn PRINT_KERNELS[2] = {PrintBases, PrintProteins};
+
+/**
+ * @brief two codon chunks of the kernel tables, cached in the object for the genetic code and symbol flags
+ */
+static const uint64_t *PrintPairsOf(GeneticsObj *_this, const PrintKernel *k, bool proteins, DNA_PRINT_FlAGS flags)
+{
+    DNA_PRINT_FlAGS key = flags & (DNA_PRINT_RNA | DNA_PRINT_TRANSLATE | DNA_PRINT_TRANSLATE_LONG | DNA_PRINT_COMPLEMENT);
+    PrintPairs *pp = _this->printPairs;
+    if (!pp)
+    {
+        pp = _this->printPairs = Mem_Alloc(_this, sizeof(PrintPairs));
+        pp->transl = NULL;
+    }
+    if (pp->transl == _this->transl && pp->key == key)
+        return pp->pairs;
+    pp->transl = _this->transl;
+    pp->key = key;
+    size_t size = proteins ? k->symbolSize : 4;
+    for (int c1 = 0; c1 < 64; c1++)
+    {
+        for (int c2 = 0; c2 < 64; c2++)
+        {
+            char chunk[8] = {0};
+            memcpy(chunk, proteins ? k->symbols[c1] : k->bases[c1], size);
+            memcpy(chunk + size, proteins ? k->symbols[c2] : k->bases[c2], size);
+            memcpy(&pp->pairs[c1 << 6 | c2], chunk, 8);
+        }
+    }
+    return pp->pairs;
+}
+
+/**
+ * @brief resolve the flags into the kernel tables and run the kernel (dnaSize > 0, no splice, no correlate)
+ */
+static void PrintDNAKernel(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+{
+    if (_this->dnaDir == DNA_DIR_3_TO_5)
+        flags ^= DNA_PRINT_REVERSE;
+    const TranslTable *transl = _this->transl;
+    bool reverse = flags & DNA_PRINT_REVERSE;
+    bool proteins = flags & (DNA_PRINT_TRANSLATE | DNA_PRINT_TRANSLATE_LONG);
+    uint8_t cx = (flags & DNA_PRINT_COMPLEMENT) ? 0x2A : 0;
+    PrintKernel k;
+    if (reverse)
+    {
+        size_t r = _this->start_codon <= _this->dnaSize ? _this->dnaSize - _this->start_codon : 0;
+        k.origin = r;
+        k.step = -1;
+        k.codons = r >= 2 ? (r - 2) / 3 + 1 : 0;
+        k.poffset = _this->inputFileOffset + 1 + r;
+    }
+    else
+    {
+        k.origin = _this->start_codon - 1;
+        k.step = 1;
+        k.codons = _this->dnaSize >= k.origin + 3 ? (_this->dnaSize - k.origin - 3) / 3 + 1 : 0;
+        k.poffset = _this->inputFileOffset + _this->start_codon;
+    }
+    k.first = _this->dna + k.origin;
+    k.block = reverse ? Mem_Alloc(_this, 3 * PRINT_BLOCK_CODONS) : NULL;
+    for (int c = 0; c < 64; c++)
+    {
+        k.bases[c][0] = ' ';
+        memcpy(k.bases[c] + 1, (flags & DNA_PRINT_RNA) ? transl->rna[c ^ cx] : transl->dna[c ^ cx], 3);
+        k.starts[c] = transl->starts[c ^ cx];
+        if (flags & DNA_PRINT_TRANSLATE)
+        {
+            k.symbols[c][0] = transl->transl[c ^ cx];
+        }
+        else
+        {
+            memcpy(k.symbols[c], transl->translLong[c ^ cx], 3);
+            k.symbols[c][3] = '-';
+        }
+    }
+    k.symbolSize = (flags & DNA_PRINT_TRANSLATE) ? 1 : 4;
+    k.startMark = (flags & DNA_PRINT_TRANSLATE) ? "M" : "Met-";
+    k.wrap = (flags & DNA_PRINT_TRANSLATE) ? PROTEINS_BP_PER_LINE : PROTEINS_LONG_BP_PER_LINE;
+    k.nBlocks = Mask_List(_this, MASK_N) != NULL;
+    k.pairs = PrintPairsOf(_this, &k, proteins, flags);
+
+    PrintHeader(_this, true, flags);
+    PRINT_KERNELS[proteins](_this, &k);
+    Mem_Free(_this, k.block, 3 * PRINT_BLOCK_CODONS);
+    STATS_ADD(&_this->stats, codons, k.codons);
+    PrintHeader(_this, false, flags);
+    Out_Puts(_this, END_PRINT_STRING);
+}
+
+/**
+ * @brief Print DNA Info
  * 
  * @param _this genetics object
- * @param start dna bp start
- * @param stop  dna bp stop
- * @param filename   FASTA file name
- * @param search    string to search for in ^> lines. when found will load dna from next line to the next ^> line
+ * @param flags \n 
+ *          DNA_PRINT_REVERSE: Reverse order; \n 
+ *          DNA_PRINT_COMPLEMENT: Print Complement pairs; \n 
+ *          DNA_PRINT_RNA: DNA to RNA; \n 
+ *          DNA_PRINT_TRANSLATE: Translate to protein (single letter); \n
+ *          DNA_PRINT_TRANSLATE_LONG: Translate to protein (3 letters); \n
+ *          DNA_PRINT_TRANSLATE_CORRELATE: Show BP and Translate; \n
+ *          DNA_PRINT_FORMAT_xxx: machine readable output instead of text, see Format_PrintDNA(); \n
+ *          DNA_PRINT_GENERIC: use the generic print loop instead of the specialized kernels
  */
-void Genetics_LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const char *filename, const char *search)
+void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
 {
-    size_t len = 0;
-    char *input = NULL;
-    ssize_t insize;
-    FILE *fInput = NULL;
-    fInput = fopen(filename, "r");
-    size_t lines = 0;
-    if (!fInput)
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_PRINT);
+    if (flags & DNA_PRINT_FORMAT_MASK)
+        Format_PrintDNA(_this, flags);
+    else if (!(flags & (DNA_PRINT_TRANSLATE_CORRELATE | DNA_PRINT_GENERIC)) && _this->spliceSize == 0 &&
+             _this->dnaSize > 0)
+        PrintDNAKernel(_this, flags);
+    else
+        PrintDNA(_this, flags);
+    Out_Flush(_this);
+    STATS_END();
+}
+
+/**
+ * @brief remember the loaded FASTA file, the default index file is stored next to it
+ */
+void Obj_SetFastaPath(GeneticsObj *_this, const char *filename)
+{
+    size_t size = strlen(filename) + 1;
+    if (_this->fastaPathAlloc < size)
     {
-        fprintf(stderr, "Error fopening fasta file '%s' : %s\n", filename, strerror(errno));
-        return;
+        _this->fastaPath = Mem_Realloc(_this, _this->fastaPath, _this->fastaPathAlloc, size);
+        _this->fastaPathAlloc = size;
     }
+    memcpy(_this->fastaPath, filename, size);
+}
+
+#define FASTA_LINE_START   0
+#define FASTA_LINE_SEQ     1
+#define FASTA_LINE_HEADER  2
+#define FASTA_LINE_COMMENT 3
+static void LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const char *filename, const char *search)
+{
     if(start > 0 && stop <= start)
     {
-        fprintf(stderr, "Error fopening fasta file '%s' : stop %lu is less then start %lu\n", filename, stop,start);
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "Error fopening fasta file '%s' : stop %lu is less then start %lu", filename, stop,
+                  start);
         return;
     }
-    fprintf(_this->out, "Load FASTA file '%s' searching for '%s'\n", filename, search);
-    bool bFound = false;
+    if (start == 0 && stop == 0 && Fasta_LoadParallel(_this, filename, search))
+        return; // whole file, split between threads
+    GeneticsReader *reader = Obj_Reader(_this);
+    if (!reader || !Reader_Start(reader, filename))
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening fasta file '%s'", filename);
+        return;
+    }
+    Out_Printf(_this, "Load FASTA file '%s' searching for '%s'\n", filename, search);
     Genetics_StartDNA(_this, DNA_DIR_5_TO_3, "");
-    size_t read;
-    while (-1 != (read = (insize = getline(&input, &len, fInput))))
+    Obj_SetFastaPath(_this, filename);
+
+    size_t skip = start > 0 ? start - 1 : 0;      // sequence chars to skip before region start
+    size_t limit = stop > 0 ? stop - skip : SIZE_MAX; // bp to load
+    _this->inputFileOffset = skip;
+
+    char *header = NULL;
+    size_t headerSize = 0, headerAlloc = 0;
+    int state = FASTA_LINE_START;
+    bool bFound = false, lineCounted = false, done = false;
+    size_t lines = 0;
+    const char *chunk;
+    size_t size;
+    // the reader thread fills the next buffers while this one is encoded
+    while (!done && NULL != (chunk = Reader_Next(reader, &size)))
     {
-        if (*input == ';')
-        { //fasta commented line
-            continue;
-        }
-        if (*input == '>')
-        { //fasta genome description line
-            bFound = *search == 0 || NULL != strstr(input, search);
-            if (bFound)
-                fputs(input, _this->out);
-            continue;
-        }
-        if (bFound)
+        STATS_ADD(&_this->stats, bytes_read, size);
+        const char *p = chunk, *end = chunk + size;
+        while (p < end && !done)
         {
-            if(start > 0){
-                if(_this->inputFileOffset == 0)
+            if (state == FASTA_LINE_START)
+            {
+                if (*p == ';')
+                { //fasta commented line
+                    state = FASTA_LINE_COMMENT;
+                }
+                else if (*p == '>')
+                { //fasta genome description line
+                    state = FASTA_LINE_HEADER;
+                    headerSize = 0;
+                }
+                else
+                {
+                    state = FASTA_LINE_SEQ;
+                    lineCounted = false;
+                }
+            }
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol + 1 : end;
+            if (state == FASTA_LINE_HEADER)
+            {
+                size_t n = lineEnd - p;
+                if (headerAlloc < headerSize + n + 1)
                 {
-                    start--;
-                    _this->inputFileOffset = start;
-                    fseek(fInput, _this->inputFileOffset + _this->inputFileOffset / (read - 1) - read,SEEK_CUR);
-                    continue;
+                    header = Mem_Realloc(_this, header, headerAlloc, 2 * (headerSize + n + 1));
+                    headerAlloc = 2 * (headerSize + n + 1);
                 }
-                else if(start + read - 1 > stop)
+                memcpy(header + headerSize, p, n);
+                headerSize += n;
+                header[headerSize] = 0;
+                if (eol)
                 {
-                    input[stop - start] = 0;
-                }   
+                    bFound = *search == 0 || NULL != strstr(header, search);
+                    if (bFound)
+                    {
+                        Out_Puts(_this, header);
+                        if (!_this->seqName[0])
+                            sscanf(header + 1, "%63s", _this->seqName);
+                    }
+                }
             }
-            start += Genetics_AddDNA(_this, input);
-            lines++;
-
-            if(start == stop)
+            else if (state == FASTA_LINE_SEQ && bFound)
             {
-                break;
+                const char *q = p;
+                if (skip > 0)
+                {
+                    size_t n = lineEnd - q - (eol ? 1 : 0);
+                    if (n > skip)
+                        n = skip;
+                    if (!memchr(q, '\r', n))
+                    {
+                        q += n;
+                        skip -= n;
+                    }
+                    else
+                    {
+                        for (; n > 0; n--, q++)
+                            if (*q != '\r')
+                                skip--;
+                    }
+                }
+                if (skip == 0 && q < lineEnd)
+                {
+                    if (!lineCounted)
+                    {
+                        lines++;
+                        lineCounted = true;
+                    }
+                    limit -= AddDNAn(_this, q, lineEnd - q, limit);
+                    done = limit == 0;
+                }
             }
+            if (eol)
+                state = FASTA_LINE_START;
+            p = lineEnd;
         }
     }
+    if (state == FASTA_LINE_HEADER && headerSize > 0 && (*search == 0 || NULL != strstr(header, search)))
+        Out_Puts(_this, header); // header on last line without new line
+    int error = Reader_Error(reader);
+    if (error)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error reading fasta file '%s'", filename);
+    Reader_Stop(reader);
+    Mem_Free(_this, header, headerAlloc);
     Genetics_StopDNA(_this);
-    fprintf(_this->out, "FASTA loaded. Found %lu bp on %lu lines.\n", _this->dnaSize, lines);
-    fclose(fInput);
-    free(input);
+    Out_Printf(_this, "FASTA loaded. Found %lu bp on %lu lines.\n", _this->dnaSize, lines);
+}
+
+/**
+ * @brief Load a FASTA file
+ * 
+ * @param _this genetics object
+ * @param start dna bp start
+ * @param stop  dna bp stop
+ * @param filename   FASTA file name
+ * @param search    string to search for in ^> lines. when found will load dna from next line to the next ^> line
+ */
+void Genetics_LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const char *filename, const char *search)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_LOAD_FASTA);
+    if (!_this->refCache || !RefCache_LoadFASTA(_this, start, stop, filename, search))
+        LoadFASTA(_this, start, stop, filename, search);
+    Out_Flush(_this);
+    STATS_END();
 }
 
 /**
@@ -811,27 +1318,29 @@ void Genetics_LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const cha
  * 
  * @param _this genetics object
  * @param n     size of data
- * @param data  data (splice offsets)
+ * @param data  data (splice offsets), reference offsets while a haplotype is selected
  */
 void Genetics_Splice(GeneticsObj *_this, int n, size_t* data)
 {
     if(n % 2 == 1)
     {
-        fprintf(stderr,"ERROR: Splice data must have even size\n");
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: Splice data must have even size");
         return;
     }
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_SPLICE);
     if(n == 0)
     {
-        if(_this->spliceData) 
-            free(_this->spliceData);
         _this->spliceSize = 0;
     }
     else
     {
-        if(_this->spliceData) 
-            free(_this->spliceData);
         _this->spliceSize = 0;
-        _this->spliceData = malloc(n * sizeof(size_t));
+        if(_this->spliceAlloc < n)
+        { // keep the buffer between calls, grow only
+            Mem_Free(_this, _this->spliceData, _this->spliceAlloc * sizeof(size_t));
+            _this->spliceData = Mem_Alloc(_this, n * sizeof(size_t));
+            _this->spliceAlloc = n;
+        }
         for(int i=0; i<n;i++)
         {
             int k=0;
@@ -846,4 +1355,271 @@ void Genetics_Splice(GeneticsObj *_this, int n, size_t* data)
         }
         
     }
-}
\ No newline at end of file
+    if (_this->haplotype)
+        Variant_Splice(_this); // data is in reference offsets
+    STATS_END();
+}
+
+/**
+ * @brief Use the sequence of another object without copying it (codon_start and splice data are
+ *        copied). Many objects, e.g. one per client session, can work on a reference loaded once.
+ *        The source must outlive this object and must not change while it is shared; reading it
+ *        from several threads is safe. Genetics_StartDNA() and the loaders switch this object back
+ *        to its own buffer.
+ *
+ * @param _this  genetics object
+ * @param source object with a loaded FASTA or dna sequence (not FASTQ reads)
+ * @return false if the source has no sequence to share
+ */
+bool Genetics_ShareDNA(GeneticsObj *_this, const GeneticsObj *source)
+{
+    if (source->dnaView || source->readCount || source->dnaInput || source->haplotype || !source->dna)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: no loaded sequence to share");
+        return false;
+    }
+    Variant_Delete(_this);
+    Genetics_StopDNA(_this);
+    GeneticsRefEntry *reference = RefCache_Acquire(source->reference); // before the release: may be the same
+    RefCache_Release(_this);
+    _this->reference = reference;
+    _this->dna = source->dna;
+    _this->dnaSize = source->dnaSize;
+    _this->dnaDir = source->dnaDir;
+    _this->readCount = 0;
+    _this->start_codon = source->start_codon;
+    _this->inputFileOffset = source->inputFileOffset;
+    _this->fileBegin = false;
+    _this->dnaView = false;
+    memcpy(_this->seqName, source->seqName, sizeof(_this->seqName));
+    if (source->fastaPath)
+        Obj_SetFastaPath(_this, source->fastaPath);
+    else if (_this->fastaPath)
+        _this->fastaPath[0] = 0;
+    Scan_Reset(_this);
+    Mask_Copy(_this, source);
+    Index_Delete(_this);
+    Genetics_Splice(_this, source->spliceSize, source->spliceData);
+    return true;
+}
+
+/**
+ * @brief exons of the loaded dna as buffer index ranges (introns removed by Genetics_Splice)
+ * 
+ * @param _this genetics object
+ * @param exons filled with exons, must have room for spliceSize / 2 + 1 ranges
+ * @return number of exons
+ */
+size_t Splice_Exons(GeneticsObj *_this, GeneticsRange *exons)
+{
+    size_t n = 0, begin = 0;
+    for (int k = 0; k + 1 < _this->spliceSize; k += 2)
+    {
+        // splice points are 1 based file offsets; both are kept, bases between them are removed
+        size_t a = _this->spliceData[k], b = _this->spliceData[k + 1];
+        if (a < _this->inputFileOffset + 1 + begin)
+            a = _this->inputFileOffset + begin; // intron starts before the loaded region or the previous exon
+        size_t end = a - _this->inputFileOffset;
+        if (end > _this->dnaSize)
+            end = _this->dnaSize;
+        if (end > begin)
+        {
+            exons[n].begin = begin;
+            exons[n].end = end;
+            n++;
+        }
+        if (b > _this->inputFileOffset + 1 + begin)
+            begin = b - _this->inputFileOffset - 1;
+        if (begin < end)
+            begin = end; // empty intron (a == b), the kept point is already in the exon
+        if (begin >= _this->dnaSize)
+            return n;
+    }
+    exons[n].begin = begin;
+    exons[n].end = _this->dnaSize;
+    return n + 1;
+}
+
+/**
+ * @brief copy exons back to back and map codon_start of both strands in the copy.
+ *        codon_start in an intron moves to the next exonic base in reading direction.
+ * 
+ * @param _this     genetics object
+ * @param exons     exons from Splice_Exons()
+ * @param n         number of exons
+ * @param seq       filled with the exons, must have room for dnaSize bases
+ * @param fwdOrigin filled with the copy index of codon_start (copy size if none)
+ * @param revOrigin filled with the copy index of the reverse strand codon_start (SIZE_MAX if none)
+ * @return size_t copy size
+ */
+size_t Splice_Gather(GeneticsObj *_this, const GeneticsRange *exons, size_t n, uint8_t *seq,
+                     size_t *fwdOrigin, size_t *revOrigin)
+{
+    size_t fwdStart = _this->start_codon - 1, revStart = _this->dnaSize - _this->start_codon;
+    size_t size = 0;
+    *fwdOrigin = *revOrigin = SIZE_MAX;
+    for (size_t e = 0; e < n; e++)
+    {
+        size_t begin = exons[e].begin, end = exons[e].end;
+        if (*fwdOrigin == SIZE_MAX && fwdStart < end)
+            *fwdOrigin = size + (fwdStart > begin ? fwdStart - begin : 0);
+        if (revStart >= begin)
+            *revOrigin = size + (revStart < end ? revStart : end - 1) - begin;
+        memcpy(seq + size, _this->dna + begin, end - begin);
+        size += end - begin;
+    }
+    if (*fwdOrigin == SIZE_MAX)
+        *fwdOrigin = size;
+    return size;
+}
+
+/**
+ * @brief Get instrumentation counters of a command
+ * 
+ * @param _this genetics object
+ * @param cmd   GENETICS_STAT_xxx command
+ * @param stat  filled with command counters
+ * @return false if cmd is invalid or the library was built without stats
+ */
+bool Genetics_GetStats(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsStat *stat)
+{
+    memset(stat, 0, sizeof(GeneticsStat));
+#ifdef GENETICS_STATS
+    if (cmd < 0 || cmd >= GENETICS_STAT_COUNT)
+        return false;
+    *stat = _this->stats.cmd[cmd];
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Reset all instrumentation counters
+ * 
+ * @param _this genetics object
+ */
+void Genetics_ResetStats(GeneticsObj *_this)
+{
+    STATS_INIT(&_this->stats);
+}
+
+/**
+ * @brief Print instrumentation counters report in JSON format
+ * 
+ * @param _this genetics object
+ * @param out filestream for the report
+ */
+void Genetics_PrintStats(GeneticsObj *_this, FILE *out)
+{
+    Stats_PrintJSON(&_this->stats, out);
+}
+
+/**
+ * @brief Set the callback called when a command begins and ends (load_fasta, splice, find_start,
+ *        print, scan, align, index ...: the GENETICS_STAT_xxx commands). Not called in a build
+ *        without stats.
+ *
+ * @param _this    genetics object
+ * @param callback trace callback or NULL
+ * @param ctx      passed to the callback
+ */
+void Genetics_SetTraceCallback(GeneticsObj *_this, GeneticsTraceCallback callback, void *ctx)
+{
+    _this->stats.trace = callback;
+    _this->stats.traceCtx = ctx;
+}
+
+/**
+ * @brief Enable or disable the latency histograms of the commands: every call duration is
+ *        recorded in a log-linear histogram (6.25% buckets), cleared by Genetics_ResetStats()
+ *
+ * @param _this  genetics object
+ * @param enable true to record, false to free the histograms
+ * @return false if the library was built without stats
+ */
+bool Genetics_SetLatencyHistograms(GeneticsObj *_this, bool enable)
+{
+#ifdef GENETICS_STATS
+    if (enable && !_this->stats.latency)
+    {
+        _this->stats.latency = Mem_Alloc(_this, GENETICS_STAT_COUNT * sizeof(StatsHistogram));
+        memset(_this->stats.latency, 0, GENETICS_STAT_COUNT * sizeof(StatsHistogram));
+    }
+    else if (!enable)
+    {
+        Mem_Free(_this, _this->stats.latency, GENETICS_STAT_COUNT * sizeof(StatsHistogram));
+        _this->stats.latency = NULL;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Get the latency summary of a command
+ *
+ * @param _this   genetics object
+ * @param cmd     GENETICS_STAT_xxx command
+ * @param latency filled with the number of calls, min, max and percentiles in ns
+ * @return false if cmd is invalid or the histograms are disabled
+ */
+bool Genetics_GetLatency(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsLatency *latency)
+{
+    memset(latency, 0, sizeof(GeneticsLatency));
+#ifdef GENETICS_STATS
+    if (cmd < 0 || cmd >= GENETICS_STAT_COUNT || !_this->stats.latency)
+        return false;
+    const StatsHistogram *h = &_this->stats.latency[cmd];
+    latency->count = h->count;
+    latency->min_ns = h->min;
+    latency->max_ns = h->max;
+    latency->p50_ns = Stats_Percentile(h, 50);
+    latency->p90_ns = Stats_Percentile(h, 90);
+    latency->p99_ns = Stats_Percentile(h, 99);
+    latency->p999_ns = Stats_Percentile(h, 99.9);
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Latency percentile of a command
+ *
+ * @param _this      genetics object
+ * @param cmd        GENETICS_STAT_xxx command
+ * @param percentile 0 to 100
+ * @return duration in ns (upper bound of its bucket), 0 if no call was recorded
+ */
+uint64_t Genetics_LatencyPercentile(GeneticsObj *_this, GENETICS_STAT cmd, double percentile)
+{
+#ifdef GENETICS_STATS
+    if (cmd < 0 || cmd >= GENETICS_STAT_COUNT || !_this->stats.latency)
+        return 0;
+    return Stats_Percentile(&_this->stats.latency[cmd], percentile);
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @brief Export the histogram of a command, e.g. to merge the histograms of several objects
+ *
+ * @param _this   genetics object
+ * @param cmd     GENETICS_STAT_xxx command
+ * @param buckets filled with the non empty buckets in increasing durations
+ * @param max     size of buckets, 0 to get the count only
+ * @return number of non empty buckets (may be > max)
+ */
+size_t Genetics_LatencyBuckets(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsLatencyBucket *buckets, size_t max)
+{
+#ifdef GENETICS_STATS
+    if (cmd < 0 || cmd >= GENETICS_STAT_COUNT || !_this->stats.latency)
+        return 0;
+    return Stats_Buckets(&_this->stats.latency[cmd], buckets, max);
+#else
+    return 0;
+#endif
+}
@@ -1,21 +1,81 @@
 #pragma once
+/**
+ * @brief Concurrency: the library has no mutable global state. Objects are independent, so
+ *        different objects can be used from different threads at the same time without locking.
+ *        One object must not be used by two threads at the same time. Shared read only data
+ *        (translation tables, GeneticsHeapAllocator) is initialized once and safe to use from any thread.
+ *        An arena allocator can be shared only by objects used from the same thread.
+ */
 typedef struct _GeneticsObj GeneticsObj;
+
+/**
+ * @brief memory allocator used by a genetics object for all its buffers.
+ *        realloc/free get the size of the block so region allocators need no headers.
+ */
+typedef struct _GeneticsAllocator
+{
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t oldSize, size_t size);
+    void (*free)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+} GeneticsAllocator;
+extern const GeneticsAllocator GeneticsHeapAllocator;
+
+typedef struct _GeneticsArena GeneticsArena;
+GeneticsArena *Genetics_ArenaNew(size_t blockSize);
+void Genetics_ArenaReset(GeneticsArena *arena);
+void Genetics_ArenaDelete(GeneticsArena *arena);
+GeneticsAllocator Genetics_ArenaAllocator(GeneticsArena *arena);
+
 GeneticsObj *Genetics_New();
+GeneticsObj *Genetics_NewWithAllocator(const GeneticsAllocator *allocator);
 void Genetics_Delete(GeneticsObj *_this);
 
+#define GENETICS_LEVEL_ERROR   0
+#define GENETICS_LEVEL_WARNING 1
+typedef int GENETICS_LEVEL;
+
+/**
+ * @brief error/warning callback, called on the thread using the object.
+ *        message has no trailing new line and is valid only during the call.
+ */
+typedef void (*GeneticsErrorCallback)(void *ctx, GENETICS_LEVEL level, const char *message);
+void Genetics_SetErrorCallback(GeneticsObj *_this, GeneticsErrorCallback callback, void *ctx);
+const char *Genetics_LastError(GeneticsObj *_this);
+void Genetics_ClearError(GeneticsObj *_this);
+
 #define DNA_DIR_NONE   0
 #define DNA_DIR_5_TO_3 1
 #define DNA_DIR_3_TO_5 2
 typedef char DNA_DIR;
 
-void Genetics_SetTranslationTable(int n);
+bool Genetics_SetTranslationTable(GeneticsObj *_this, int n);
 
 size_t Genetics_StartDNA(GeneticsObj *_this, DNA_DIR dir, const char *code);
 size_t Genetics_AddDNA(GeneticsObj *_this, const char *code);
 void Genetics_StopDNA(GeneticsObj *_this);
 int Genetics_DNAInput(GeneticsObj *_this);
 void Genetics_LoadFASTA(GeneticsObj *_this, size_t start,size_t stop, const char *filename, const char *search);
+void Genetics_SetLoadThreads(GeneticsObj *_this, int threads);
+int Genetics_GetLoadThreads(GeneticsObj *_this);
+void Genetics_SetReferenceCache(GeneticsObj *_this, bool enable);
+bool Genetics_GetReferenceCache(GeneticsObj *_this);
+void Genetics_ClearReferenceCache(void);
+void Genetics_PrintReferenceCache(GeneticsObj *_this);
 void Genetics_Splice(GeneticsObj *_this, int n, size_t* data);
+bool Genetics_ShareDNA(GeneticsObj *_this, const GeneticsObj *source);
+
+typedef struct _GeneticsFastqFilter
+{
+    int trimQuality;    // trim read ends with phred quality below this (0 no trim)
+    int minMeanQuality; // drop reads with mean phred quality below this (0 keep all)
+    size_t minLength;   // drop reads shorter than this after trimming
+} GeneticsFastqFilter;
+
+size_t Genetics_LoadFASTQ(GeneticsObj *_this, const char *filename, const GeneticsFastqFilter *filter);
+size_t Genetics_ReadCount(GeneticsObj *_this);
+bool Genetics_SelectRead(GeneticsObj *_this, size_t n);
+const uint8_t *Genetics_ReadQuality(GeneticsObj *_this, size_t *size);
 
 
 #define DNA_PRINT_REVERSE 0x0001
@@ -24,9 +84,282 @@ void Genetics_Splice(GeneticsObj *_this, int n, size_t* data);
 #define DNA_PRINT_TRANSLATE 0x0008
 #define DNA_PRINT_TRANSLATE_LONG 0x0010
 #define DNA_PRINT_TRANSLATE_CORRELATE 0x0020
+#define DNA_PRINT_GENERIC 0x0040  // generic print / find loop (reference for the specialized kernels)
+#define DNA_PRINT_FORMAT_TEXT   0x0000  // human readable (default)
+#define DNA_PRINT_FORMAT_FASTA  0x0100  // FASTA, see Genetics_SetFastaWidth()
+#define DNA_PRINT_FORMAT_BINARY 0x0200  // GeneticsBinaryHeader records
+#define DNA_PRINT_FORMAT_JSON   0x0300  // one JSON object per command
+#define DNA_PRINT_FORMAT_TSV    0x0400  // tab separated with a header line
+#define DNA_PRINT_FORMAT_MASK   0x0F00
 typedef uint32_t DNA_PRINT_FlAGS;
 
+/**
+ * @brief DNA_PRINT_FORMAT_BINARY record header (host byte order) followed by the payload:
+ *        GENETICS_BINARY_DNA     : (length + 3) / 4 bytes, 2 bits per base (T0 C1 A2 G3), first base in low bits
+ *        GENETICS_BINARY_PROTEIN : length amino acid letters
+ *        GENETICS_BINARY_START   : no payload, length is codon_start (0 if not found)
+ */
+#define GENETICS_BINARY_MAGIC   "GNB1"
+#define GENETICS_BINARY_DNA     1
+#define GENETICS_BINARY_PROTEIN 2
+#define GENETICS_BINARY_START   3
+typedef struct _GeneticsBinaryHeader
+{
+    char magic[4];      // GENETICS_BINARY_MAGIC
+    uint8_t kind;       // GENETICS_BINARY_xxx
+    uint8_t strand;     // '+' or '-' (reading direction)
+    uint16_t reserved;
+    uint64_t offset;    // file offset (1 based) of the first base read
+    uint64_t length;    // bases or amino acids
+} GeneticsBinaryHeader;
+
+#define FASTA_DEFAULT_WIDTH 60
+
 void Genetics_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags);
 void Genetics_SetOutput(GeneticsObj *_this, FILE *out);
-void Genetics_SetCodonStart(GeneticsObj *_this, int n);
-bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags);
\ No newline at end of file
+void Genetics_SetFastaWidth(GeneticsObj *_this, size_t width);
+void Genetics_SetCodonStart(GeneticsObj *_this, size_t n);
+bool Genetics_FindStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags);
+
+#define GENETICS_REGION_PRINT      0
+#define GENETICS_REGION_FIND_START 1
+typedef int GENETICS_REGION_OP;
+
+bool Genetics_PrintRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags);
+bool Genetics_FindStartInRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags, size_t *offset);
+size_t Genetics_RegionsBED(GeneticsObj *_this, const char *filename, GENETICS_REGION_OP op, DNA_PRINT_FlAGS flags);
+size_t Genetics_TranslateGTF(GeneticsObj *_this, const char *filename);
+
+#define CODON_FRAMES 6  // +1 +2 +3 on the strand, -1 -2 -3 on the reverse strand
+typedef struct _GeneticsCodonUsage
+{
+    uint64_t counts[CODON_FRAMES][64];  // codon counts per frame, frames start at codon_start
+    int frame;                          // primary frame: 0 or 3 (reverse strand)
+    uint64_t codons;                    // codons in primary frame
+    uint64_t aa[27];                    // primary frame amino acids 'A'..'Z', stop at 26
+    double rscu[64];                    // primary frame relative synonymous codon usage
+    double cai;                         // primary frame codon adaptation index (0 if no reference)
+    int translTable;                    // genetic code used to group synonymous codons
+} GeneticsCodonUsage;
+
+bool Genetics_CodonUsage(GeneticsObj *_this, DNA_PRINT_FlAGS flags, GeneticsCodonUsage *cu);
+void Genetics_SetCodonReference(GeneticsObj *_this, const uint64_t reference[64]);
+double Genetics_CodonCAI(const GeneticsCodonUsage *cu, const uint64_t reference[64]);
+void Genetics_PrintCodonUsage(GeneticsObj *_this, const GeneticsCodonUsage *cu);
+bool Genetics_CodonUsageInRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags,
+                                 GeneticsCodonUsage *cu);
+
+typedef struct _GeneticsOrf
+{
+    size_t begin;       // file offset of the start codon first base
+    size_t end;         // file offset of the stop codon last base (last scanned base if not complete)
+    int frame;          // start codon buffer index modulo 3
+    bool complete;
+} GeneticsOrf;
+
+typedef struct _GeneticsScan
+{
+    size_t bases;               // bases scanned
+    size_t start;               // file offset of the first start codon, 0 if none
+    uint64_t codons[3][64];     // codon counts per frame
+    uint64_t composition[4];    // base counts T C A G
+    const GeneticsOrf *orfs;    // reading frames ended by a stop codon or a skipped mask, in end order
+    size_t orfCount;
+    GeneticsOrf open[3];        // open reading frame without stop codon yet per frame (begin 0 if none)
+} GeneticsScan;
+
+const GeneticsScan *Genetics_Scan(GeneticsObj *_this);
+void Genetics_ResetScan(GeneticsObj *_this);
+
+#define PEPTIDE_MAX_LENGTH 64   // query amino acids, one bit each in the matcher state
+typedef struct _GeneticsPeptideHit
+{
+    int frame;              // +1 +2 +3 on the strand, -1 -2 -3 on the reverse strand, from codon_start
+    size_t begin;           // file offset of the first base of the first codon
+    size_t end;             // file offset of the last base of the last codon (begin > end on the reverse strand)
+    int mismatches;
+    const char *peptide;    // matched translation, query length, not null terminated
+} GeneticsPeptideHit;
+
+/**
+ * @brief peptide hit callback, hit is valid only during the call
+ */
+typedef void (*GeneticsPeptideCallback)(void *ctx, const GeneticsPeptideHit *hit);
+size_t Genetics_SearchPeptide(GeneticsObj *_this, const char *peptide, int mismatches, DNA_PRINT_FlAGS flags,
+                              GeneticsPeptideCallback callback, void *ctx);
+
+#define GENETICS_ALIGN_GLOBAL      0    // both sequences end to end (Needleman-Wunsch)
+#define GENETICS_ALIGN_LOCAL       1    // best matching parts (Smith-Waterman)
+#define GENETICS_ALIGN_SEMI_GLOBAL 2    // whole query inside the target, target end gaps are free
+typedef int GENETICS_ALIGN_MODE;
+
+typedef struct _GeneticsAlignParams
+{
+    GENETICS_ALIGN_MODE mode;
+    int match;          // score of identical bases (> 0)
+    int mismatch;       // score of different bases (< 0)
+    int gapOpen;        // penalty to open a gap, a gap of k bases costs gapOpen + k * gapExtend
+    int gapExtend;      // penalty per gap base (> 0)
+    size_t band;        // 0 full matrix, otherwise diagonals kept around the main diagonal
+    bool scoreOnly;     // score and end coordinates only, no CIGAR (linear memory, SIMD)
+    bool reverse;       // align the reverse complement of the query
+} GeneticsAlignParams;
+extern const GeneticsAlignParams GeneticsAlignDefaults;
+
+typedef struct _GeneticsAlignment
+{
+    int score;
+    size_t queryBegin;  // file offsets of the first and last aligned bases, 0 if unknown (score only)
+    size_t queryEnd;
+    size_t targetBegin;
+    size_t targetEnd;
+    size_t matches;     // counts are 0 in score only mode
+    size_t mismatches;
+    size_t gaps;        // gap bases
+    const char *cigar;  // extended CIGAR (= X I D) of the query against the target, NULL in score only mode,
+                        // valid until the next Genetics_Align() with the same query object
+} GeneticsAlignment;
+
+bool Genetics_Align(GeneticsObj *_this, GeneticsObj *target, const GeneticsAlignParams *params,
+                    GeneticsAlignment *alignment);
+
+typedef struct _GeneticsIndexHit
+{
+    char strand;            // '+' or '-'
+    size_t begin;           // file offset of the first base read (begin > end on the reverse strand)
+    size_t end;             // file offset of the last base read
+} GeneticsIndexHit;
+
+/**
+ * @brief index hit callback, hit is valid only during the call
+ */
+typedef void (*GeneticsIndexCallback)(void *ctx, const GeneticsIndexHit *hit);
+bool Genetics_BuildIndex(GeneticsObj *_this);
+bool Genetics_SaveIndex(GeneticsObj *_this, const char *filename);
+bool Genetics_LoadIndex(GeneticsObj *_this, const char *filename);
+size_t Genetics_IndexCount(GeneticsObj *_this, const char *pattern, size_t counts[2]);
+size_t Genetics_IndexLocate(GeneticsObj *_this, const char *pattern, size_t max, DNA_PRINT_FlAGS flags,
+                            GeneticsIndexCallback callback, void *ctx);
+
+#define GENETICS_SAMPLE_ALT SIZE_MAX    // Genetics_SelectHaplotype() sample: first alternate allele of every record
+size_t Genetics_LoadVCF(GeneticsObj *_this, const char *filename);
+size_t Genetics_VCFSamples(GeneticsObj *_this);
+const char *Genetics_VCFSampleName(GeneticsObj *_this, size_t sample);
+bool Genetics_SelectHaplotype(GeneticsObj *_this, size_t sample, int haplotype, size_t begin, size_t end,
+                              size_t *variants);
+void Genetics_SelectReference(GeneticsObj *_this);
+size_t Genetics_HaplotypeToReference(GeneticsObj *_this, size_t offset);
+size_t Genetics_ReferenceToHaplotype(GeneticsObj *_this, size_t offset);
+
+/**
+ * @brief instruction set of the encoding, reverse complement, translation and scan kernels,
+ *        detected once; all levels produce the same results
+ */
+#define GENETICS_CPU_SCALAR 0
+#define GENETICS_CPU_SSE42  1
+#define GENETICS_CPU_AVX2   2
+#define GENETICS_CPU_AVX512 3   // AVX-512 F + BW
+#define GENETICS_CPU_COUNT  4
+typedef int GENETICS_CPU;
+
+GENETICS_CPU Genetics_CpuLevel(void);
+GENETICS_CPU Genetics_CpuSupported(void);
+const char *Genetics_CpuName(GENETICS_CPU level);
+GENETICS_CPU Genetics_SetCpu(GeneticsObj *_this, GENETICS_CPU level);
+GENETICS_CPU Genetics_GetCpu(GeneticsObj *_this);
+
+/**
+ * @brief masked intervals recorded while loading: N runs keep their place as placeholder bases
+ *        (leading N's only move the file offset), lower case runs are soft-masked;
+ *        repeats are found on request by Genetics_MaskRepeats()
+ */
+#define GENETICS_MASK_N      0x1
+#define GENETICS_MASK_SOFT   0x2
+#define GENETICS_MASK_REPEAT 0x4
+typedef int GENETICS_MASK;
+
+typedef struct _GeneticsInterval
+{
+    size_t begin;   // file offset of the first base
+    size_t end;     // file offset of the last base
+} GeneticsInterval;
+
+size_t Genetics_MaskCount(GeneticsObj *_this, GENETICS_MASK mask);
+bool Genetics_MaskInterval(GeneticsObj *_this, GENETICS_MASK mask, size_t n, GeneticsInterval *interval);
+void Genetics_PrintMasks(GeneticsObj *_this, GENETICS_MASK masks, DNA_PRINT_FlAGS flags);
+void Genetics_SetMaskSkip(GeneticsObj *_this, GENETICS_MASK masks);
+GENETICS_MASK Genetics_GetMaskSkip(GeneticsObj *_this);
+
+/**
+ * @brief repeat detection defaults, see Genetics_MaskRepeats()
+ */
+#define GENETICS_DUST_WINDOW        64  // bases scored at once
+#define GENETICS_DUST_LEVEL         20  // windows scoring above are low complexity
+#define GENETICS_REPEAT_MIN_LENGTH  12  // shortest tandem repeat masked (3 copies at least)
+#define GENETICS_REPEAT_MAX_PERIOD  6   // microsatellite unit lengths 1..6
+
+size_t Genetics_MaskRepeats(GeneticsObj *_this, unsigned dustLevel, size_t minLength);
+
+#define GENETICS_STAT_OTHER      0
+#define GENETICS_STAT_LOAD_FASTA 1
+#define GENETICS_STAT_SPLICE     2
+#define GENETICS_STAT_FIND_START 3
+#define GENETICS_STAT_PRINT      4
+#define GENETICS_STAT_LOAD_FASTQ 5
+#define GENETICS_STAT_CODON_USAGE 6
+#define GENETICS_STAT_SCAN       7
+#define GENETICS_STAT_PEPTIDE    8
+#define GENETICS_STAT_ALIGN      9
+#define GENETICS_STAT_INDEX      10
+#define GENETICS_STAT_VARIANT    11
+#define GENETICS_STAT_ADD_DNA    12
+#define GENETICS_STAT_TRANSLATE_GTF 13
+#define GENETICS_STAT_MASK_REPEATS 14
+#define GENETICS_STAT_COUNT      15
+typedef int GENETICS_STAT;
+
+typedef struct _GeneticsStat
+{
+    uint64_t calls;
+    uint64_t wall_ns;
+    uint64_t bytes_read;
+    uint64_t bases;
+    uint64_t codons;
+    uint64_t out_bytes;
+    uint64_t allocs;
+} GeneticsStat;
+
+bool Genetics_GetStats(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsStat *stat);
+void Genetics_ResetStats(GeneticsObj *_this);
+void Genetics_PrintStats(GeneticsObj *_this, FILE *out);
+const char *Genetics_StatName(GENETICS_STAT cmd);
+
+/**
+ * @brief trace callback, called on the thread using the object when a command begins (ns 0)
+ *        and ends (ns its duration); commands called by a command are traced nested
+ */
+typedef void (*GeneticsTraceCallback)(void *ctx, GENETICS_STAT cmd, bool begin, uint64_t ns);
+void Genetics_SetTraceCallback(GeneticsObj *_this, GeneticsTraceCallback callback, void *ctx);
+
+typedef struct _GeneticsLatency
+{
+    uint64_t count;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} GeneticsLatency;
+
+typedef struct _GeneticsLatencyBucket
+{
+    uint64_t low_ns;    // durations low_ns..high_ns
+    uint64_t high_ns;
+    uint64_t count;
+} GeneticsLatencyBucket;
+
+bool Genetics_SetLatencyHistograms(GeneticsObj *_this, bool enable);
+bool Genetics_GetLatency(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsLatency *latency);
+uint64_t Genetics_LatencyPercentile(GeneticsObj *_this, GENETICS_STAT cmd, double percentile);
+size_t Genetics_LatencyBuckets(GeneticsObj *_this, GENETICS_STAT cmd, GeneticsLatencyBucket *buckets, size_t max);
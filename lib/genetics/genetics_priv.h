@@ -0,0 +1,329 @@
+#pragma once
+/**
+ * @brief genetics object internals shared by the library modules
+ *        include after genetics.h, transl_table.h, stats.h and reader.h
+ */
+#include <pthread.h>
+
+/**
+ * @brief Base Pair Encoding (1 byte per pair)
+ * (U)T->0 00 
+ *    C->1 01
+ *    A->2 10
+ *    G->3 11
+ */
+#define CODON(b1,b2,b3) (((b1 & 0x3)<<4)|((b2 & 0x3)<<2)|(b3 & 0x3))
+#define COMPLEMENT_CODON(codon) (codon ^ 0x2A)  // XOR 101010   T <-> A, C <-> G
+#define COMPLEMENT(b) (b ^ 0x2)                 // XOR     10   T <-> A, C <-> G
+
+#define DNA_BUFFER_START 0
+
+#define OUT_BUFFER_SIZE (64 * 1024)
+#define OUT_CHUNK (OUT_BUFFER_SIZE / 2)  // symbols generated per Out_Reserve()
+#define STRAND_BLOCK (3 * OUT_CHUNK)     // bases read at once from a strand, see Out_StrandRead()
+#define ERROR_MESSAGE_SIZE 256
+
+typedef struct _GeneticsRange
+{
+    size_t begin;   // dna buffer index, inclusive
+    size_t end;     // dna buffer index, exclusive
+} GeneticsRange;
+
+/**
+ * @brief masked intervals of the loaded sequence, see mask.c
+ *        list n is skipped by the scans if bit (1 << n) of maskSkip is set (GENETICS_MASK_xxx)
+ */
+#define MASK_N      0   // N runs, stored as placeholder bases
+#define MASK_SOFT   1   // lower case runs
+#define MASK_REPEAT 2   // tandem repeats and low complexity, see Genetics_MaskRepeats()
+#define MASK_LISTS  3
+
+typedef struct _GeneticsMaskList
+{
+    GeneticsRange *ranges;  // sorted, disjoint
+    size_t count;
+    size_t alloc;
+} GeneticsMaskList;
+
+/**
+ * @brief two codon output chunks of the print kernels, see PrintDNAKernel();
+ *        built for one genetic code and symbol kind, kept until they change
+ */
+typedef struct _PrintPairs
+{
+    const TranslTable *transl;
+    DNA_PRINT_FlAGS key;        // DNA_PRINT_RNA, TRANSLATE, TRANSLATE_LONG and COMPLEMENT flags
+    uint64_t pairs[64 * 64];    // codon pair c1 << 6 | c2
+} PrintPairs;
+
+typedef struct _GeneticsRefEntry GeneticsRefEntry; // shared reference, see refcache.c
+typedef struct _GeneticsIndex GeneticsIndex; // FM-index, see index.c
+typedef struct _GeneticsVariants GeneticsVariants; // VCF variants and selected haplotype, see variant.c
+
+/**
+ * @brief hot kernels of one instruction set, see cpu.c
+ */
+typedef struct _GeneticsKernels
+{
+    GENETICS_CPU level;
+    // leading run of A C G T U whose case bit (0x20) is lower, returns its length
+    size_t (*encode)(uint8_t *dst, const char *src, size_t len, char lower);
+    void (*complement)(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x);        // dst[k] = (src[k] ^ x) & 3
+    void (*reverseComplement)(uint8_t *dst, const uint8_t *src, size_t n, uint8_t x); // dst[k] = (src[n - 1 - k] ^ x) & 3
+    void (*codons)(uint8_t *dst, const uint8_t *dna, size_t n); // codon starting at every base, reads n + 2 bases
+    void (*translate)(char *dst, const uint8_t *seq, size_t n, const char map[64]); // n codons of 3 bases
+    void (*count)(uint64_t counts[4], const uint8_t *dna, size_t n);               // base composition
+} GeneticsKernels;
+
+const GeneticsKernels *Cpu_Kernels(GENETICS_CPU level);
+
+typedef struct _GeneticsRead
+{
+    size_t offset;  // offset in dnaAllocBuffer / qual
+    size_t size;
+} GeneticsRead;
+
+struct _GeneticsObj
+{
+    GeneticsAllocator allocator;
+    uint8_t *dna;
+    DNA_DIR dnaDir;
+    size_t dnaSize;
+    uint8_t *dnaAllocBuffer;
+    size_t dnaAllocSize;
+    bool dnaInput;
+    FILE *out;
+    char *outBuffer;        // OUT_BUFFER_SIZE bytes, flushed to out at the end of each command
+    size_t outSize;
+    size_t fastaWidth;
+    size_t start_codon;
+    size_t inputFileOffset;
+    bool fileBegin;
+    size_t* spliceData;
+    int spliceSize;
+    int spliceAlloc;
+    GeneticsStats stats;
+    uint8_t *qual;          // phred qualities, same layout as dnaAllocBuffer (FASTQ only)
+    size_t qualAllocSize;
+    GeneticsRead *reads;    // FASTQ reads stored back to back in dnaAllocBuffer
+    size_t readCount;
+    size_t readAlloc;
+    GeneticsReader *reader; // file reader, kept between loads
+    uint64_t *codonReference; // reference codon counts for CAI
+    char seqName[64];       // first word of the loaded FASTA header
+    GeneticsScan scan;      // incremental analysis, see Genetics_Scan()
+    size_t scanOrfAlloc;
+    bool dnaView;           // dna is a region or a FASTQ read, not the loaded sequence
+    const TranslTable *transl; // genetic code, see Genetics_SetTranslationTable()
+    GeneticsErrorCallback errorCallback;
+    void *errorCtx;
+    char lastError[ERROR_MESSAGE_SIZE]; // empty if no error since Genetics_ClearError()
+    char *alignCigar;       // CIGAR of the last Genetics_Align()
+    size_t alignCigarAlloc;
+    GeneticsIndex *fmIndex; // see Genetics_BuildIndex(), NULL if none
+    char *fastaPath;        // last loaded FASTA file (empty if none), default index file name
+    size_t fastaPathAlloc;
+    GeneticsVariants *variants; // see Genetics_LoadVCF(), NULL if none
+    bool haplotype;         // dna is a haplotype of the variants, see Genetics_SelectHaplotype()
+    const GeneticsKernels *kernels; // see Genetics_SetCpu()
+    GeneticsMaskList masks[MASK_LISTS];
+    GENETICS_MASK maskSkip; // see Genetics_SetMaskSkip()
+    int loadThreads;        // see Genetics_SetLoadThreads()
+    PrintPairs *printPairs; // see PrintDNAKernel(), NULL until the first kernel print
+    bool refCache;          // see Genetics_SetReferenceCache()
+    GeneticsRefEntry *reference; // cached reference whose sequence dna is, NULL if none
+};
+
+/**
+ * @brief report an error or warning: kept as last error and passed to the error callback.
+ *        A non zero errnum appends " : " and its description to the message.
+ */
+void Obj_Error(GeneticsObj *_this, GENETICS_LEVEL level, int errnum, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+
+/**
+ * @brief output helpers; all library output goes through the object buffer so it can be
+ *        measured and written with few stdio calls. Public commands call Out_Flush() before returning.
+ */
+void Out_Flush(GeneticsObj *_this);
+void Out_Write(GeneticsObj *_this, const void *data, size_t size);
+void Out_Printf(GeneticsObj *_this, const char *fmt, ...);
+void Scan_Reset(GeneticsObj *_this);
+void Index_Delete(GeneticsObj *_this);
+void Variant_Delete(GeneticsObj *_this);
+void Variant_Splice(GeneticsObj *_this);
+const GeneticsScan *Scan_Update(GeneticsObj *_this);
+void Mask_Add(GeneticsObj *_this, int list, size_t begin, size_t end);
+void Mask_Push(const GeneticsAllocator *allocator, GeneticsMaskList *l, size_t begin, size_t end);
+void Mask_Reset(GeneticsObj *_this);
+void Mask_Delete(GeneticsObj *_this);
+void Mask_Copy(GeneticsObj *_this, const GeneticsObj *source);
+const GeneticsMaskList *Mask_List(const GeneticsObj *_this, int list);
+size_t Mask_NextSkip(const GeneticsObj *_this, size_t i, size_t *end);
+size_t Mask_PrevSkip(const GeneticsObj *_this, size_t i, size_t *begin);
+bool Mask_Skipped(const GeneticsObj *_this, size_t begin, size_t end);
+bool Mask_In(const GeneticsObj *_this, int list, size_t i);
+size_t Mask_NextIn(const GeneticsObj *_this, int list, size_t i, size_t *end);
+
+/**
+ * @brief skipped mask cursor for codons read in one direction, see Mask_SkipStart():
+ *        true if the codon of bases i..i+2 (dir > 0) or i-2..i (dir < 0) has a skipped base
+ */
+static inline GeneticsRange Mask_SkipStart(int dir)
+{
+    GeneticsRange skip = {dir > 0 ? 0 : SIZE_MAX, dir > 0 ? 0 : SIZE_MAX};
+    return skip;
+}
+
+static inline bool Mask_SkipCursor(const GeneticsObj *_this, GeneticsRange *skip, size_t i, int dir)
+{
+    if (dir > 0)
+    {
+        if (i >= skip->end)
+            skip->begin = Mask_NextSkip(_this, i, &skip->end);
+        return skip->begin < i + 3;
+    }
+    if (i < skip->begin)
+        skip->end = Mask_PrevSkip(_this, i + 1, &skip->begin);
+    return skip->end > i - 2;
+}
+void Format_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags);
+void Format_PrintStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags, bool found);
+void Obj_SetFastaPath(GeneticsObj *_this, const char *filename);
+size_t Encode_Text(const GeneticsKernels *kernels, uint8_t *dst, size_t at, const char *code, size_t len,
+                   size_t maxbp, bool *fileBegin, size_t *leading, const GeneticsAllocator *allocator,
+                   GeneticsMaskList masks[MASK_LISTS]);
+bool Fasta_LoadParallel(GeneticsObj *_this, const char *filename, const char *search);
+bool RefCache_LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const char *filename, const char *search);
+GeneticsRefEntry *RefCache_Acquire(GeneticsRefEntry *e);
+void RefCache_Release(GeneticsObj *_this);
+
+/**
+ * @brief get room for size bytes (size <= OUT_BUFFER_SIZE), fill it then Out_Commit()
+ */
+static inline char *Out_Reserve(GeneticsObj *_this, size_t size)
+{
+    if (_this->outSize + size > OUT_BUFFER_SIZE)
+        Out_Flush(_this);
+    return _this->outBuffer + _this->outSize;
+}
+
+static inline void Out_Commit(GeneticsObj *_this, size_t size)
+{
+    STATS_ADD(&_this->stats, out_bytes, size);
+    _this->outSize += size;
+}
+
+static inline void Out_Puts(GeneticsObj *_this, const char *str)
+{
+    Out_Write(_this, str, strlen(str));
+}
+
+static inline void Out_Putc(GeneticsObj *_this, int c)
+{
+    *Out_Reserve(_this, 1) = c;
+    Out_Commit(_this, 1);
+}
+
+/**
+ * @brief one strand of the loaded dna in reading direction from codon_start, introns removed
+ */
+typedef struct _OutStrand
+{
+    const uint8_t *seq;     // first base read
+    ptrdiff_t step;         // 1 or -1
+    size_t size;            // bases in reading direction
+    uint8_t complement;     // 0 or 2, XOR-ed to the bases
+    char strand;            // '+' or '-' reading direction
+    uint8_t *spliced;       // exons copy, NULL if seq points in dna
+    GeneticsRange *exons;
+    size_t exonCount;
+    size_t origin;          // exons copy index of seq[0]
+    size_t inputFileOffset;
+    GeneticsRange *nRanges; // N blocks in strand base indexes, printed as N
+    size_t nCount;
+    GeneticsRange *skipRanges; // skipped masks in strand base indexes, codons translated as X
+    size_t skipCount;
+    size_t maskShift;       // base k is base k + maskShift of the ranges (frames after the first)
+    uint8_t *block;         // STRAND_BLOCK bases in reading order of a reverse strand, NULL forward
+} OutStrand;
+
+void Out_OpenStrand(GeneticsObj *_this, DNA_PRINT_FlAGS flags, OutStrand *s);
+void Out_CloseStrand(GeneticsObj *_this, OutStrand *s);
+size_t Out_StrandOffset(const OutStrand *s, size_t k);
+void Out_PatchMasks(const OutStrand *s, char *o, bool codons, size_t first, size_t n);
+
+/**
+ * @brief bases [k, k + n) of a strand view (first base seq, step 1 or -1) in reading order, XOR-ed
+ *        with x: seq itself forward with x 0, else copied to buf by the complement kernels.
+ *        Scans over a view are forward loops over such blocks whatever the direction.
+ */
+static inline const uint8_t *View_Read(const GeneticsKernels *kernels, const uint8_t *seq, ptrdiff_t step, size_t k,
+                                       size_t n, uint8_t x, uint8_t *buf)
+{
+    if (step > 0 && x == 0)
+        return seq + k;
+    if (step > 0)
+        kernels->complement(buf, seq + k, n, x);
+    else if (n > 0)
+        kernels->reverseComplement(buf, seq - (k + n - 1), n, x);
+    return buf;
+}
+
+/**
+ * @brief bases [k, k + n) of the strand in reading order (n <= STRAND_BLOCK), complement not applied:
+ *        the symbol maps of the strand apply it
+ */
+static inline const uint8_t *Out_StrandRead(const GeneticsObj *_this, const OutStrand *s, size_t k, size_t n)
+{
+    return View_Read(_this->kernels, s->seq, s->step, k, n, 0, s->block);
+}
+
+size_t Splice_Exons(GeneticsObj *_this, GeneticsRange *exons);
+size_t Splice_Gather(GeneticsObj *_this, const GeneticsRange *exons, size_t n, uint8_t *seq,
+                     size_t *fwdOrigin, size_t *revOrigin);
+
+/**
+ * @brief memory helpers; all object buffers are allocated with the object allocator
+ */
+static inline void *Mem_Alloc(GeneticsObj *_this, size_t size)
+{
+    STATS_ADD(&_this->stats, allocs, 1);
+    return _this->allocator.alloc(_this->allocator.ctx, size);
+}
+
+static inline void *Mem_Realloc(GeneticsObj *_this, void *ptr, size_t oldSize, size_t size)
+{
+    STATS_ADD(&_this->stats, allocs, 1);
+    return _this->allocator.realloc(_this->allocator.ctx, ptr, oldSize, size);
+}
+
+static inline void Mem_Free(GeneticsObj *_this, void *ptr, size_t size)
+{
+    if (ptr)
+        _this->allocator.free(_this->allocator.ctx, ptr, size);
+}
+
+/**
+ * @brief object allocator shared by worker threads, see Mem_Locked()
+ */
+typedef struct _LockedAllocator
+{
+    const GeneticsAllocator *inner;
+    pthread_mutex_t lock;
+} LockedAllocator;
+
+GeneticsAllocator Mem_Locked(LockedAllocator *locked);
+
+/**
+ * @brief file reader of the object, created on first use
+ */
+static inline GeneticsReader *Obj_Reader(GeneticsObj *_this)
+{
+    if (!_this->reader)
+    {
+        STATS_ADD(&_this->stats, allocs, 2);
+        _this->reader = Reader_New(&_this->allocator, READER_BUFFER_SIZE, READER_BUFFERS);
+    }
+    return _this->reader;
+}
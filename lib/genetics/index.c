@@ -0,0 +1,721 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define INDEX_MAGIC       "GENFMI01"
+#define INDEX_BYTE_ORDER  0x01020304
+#define INDEX_SAMPLE_RATE 32            // suffix array kept for text positions multiple of this
+#define INDEX_BLOCK_ROWS  64            // BWT rows per occurrence block
+#define INDEX_MAX_SIZE    (INT32_MAX - 1) // suffix array is built with 32 bit positions
+#define INDEX_FILE_SUFFIX ".fmi"
+
+/**
+ * @brief index file header, followed by the blocks and the samples (native byte order)
+ */
+typedef struct _IndexHeader
+{
+    char magic[8];              // INDEX_MAGIC
+    uint32_t byteOrder;         // INDEX_BYTE_ORDER
+    uint32_t sampleRate;
+    uint64_t size;              // indexed bases, the text has size + 1 rows with the sentinel
+    uint64_t checksum;          // of the indexed bases, see Checksum()
+    uint64_t inputFileOffset;
+    uint64_t primary;           // BWT row of the whole text (suffix array 0), its BWT symbol is the sentinel
+    uint64_t C[4];              // rows before the suffixes starting with each base
+    uint64_t blockCount;
+    uint64_t sampleCount;
+} IndexHeader;
+
+/**
+ * @brief 64 BWT rows in one cache line: counts before the block, the 2 bit planes of the
+ *        symbols (the sentinel is stored as 0) and the rows with a suffix array sample
+ */
+typedef struct _IndexBlock
+{
+    uint64_t count[4];
+    uint64_t lo;
+    uint64_t hi;
+    uint64_t mark;
+    uint64_t markRank;          // samples before the block
+} IndexBlock;
+
+struct _GeneticsIndex
+{
+    IndexHeader *header;        // start of the single allocation, laid out as the file
+    IndexBlock *blocks;
+    uint32_t *samples;
+    size_t memorySize;
+};
+
+/**
+ * @brief hit positions for one pattern, sorted before they are reported
+ */
+typedef struct _IndexHits
+{
+    GeneticsIndexHit *hits;
+    size_t count;
+    size_t alloc;
+} IndexHits;
+
+static size_t IndexMemorySize(size_t blockCount, size_t sampleCount)
+{
+    return sizeof(IndexHeader) + blockCount * sizeof(IndexBlock) + sampleCount * sizeof(uint32_t);
+}
+
+static GeneticsIndex *IndexNew(GeneticsObj *_this, size_t blockCount, size_t sampleCount)
+{
+    GeneticsIndex *index = Mem_Alloc(_this, sizeof(GeneticsIndex));
+    index->memorySize = IndexMemorySize(blockCount, sampleCount);
+    index->header = Mem_Alloc(_this, index->memorySize);
+    index->blocks = (IndexBlock *)(index->header + 1);
+    index->samples = (uint32_t *)(index->blocks + blockCount);
+    return index;
+}
+
+/**
+ * @brief drop the index of the object (sequence reloaded or object deleted)
+ */
+void Index_Delete(GeneticsObj *_this)
+{
+    GeneticsIndex *index = _this->fmIndex;
+    if (!index)
+        return;
+    Mem_Free(_this, index->header, index->memorySize);
+    Mem_Free(_this, index, sizeof(GeneticsIndex));
+    _this->fmIndex = NULL;
+}
+
+/**
+ * @brief FNV-1a over 8 bases at a time, detects an index file of another sequence
+ */
+static uint64_t Checksum(const uint8_t *dna, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, dna + i, 8);
+        h = (h ^ (w & 0x0303030303030303ULL)) * 0x100000001b3ULL;
+    }
+    for (; i < size; i++)
+        h = (h ^ (dna[i] & 0x3)) * 0x100000001b3ULL;
+    return h ^ size;
+}
+
+/*
+ * SA-IS suffix array construction (Nong, Zhang, Chan): linear time, the text must end with a
+ * unique smallest symbol. Level 0 text is 1 byte per symbol, reduced texts are int32_t.
+ */
+typedef struct _Sais
+{
+    const void *s;
+    int cs;             // symbol size, 1 or sizeof(int32_t)
+    uint8_t *t;         // type bits, 1 for S type
+    int32_t *bkt;
+    int32_t n;
+    int32_t K;          // largest symbol
+} Sais;
+
+#define SAIS_CHR(a, i) ((a)->cs == 1 ? ((const uint8_t *)(a)->s)[i] : ((const int32_t *)(a)->s)[i])
+#define SAIS_TGET(a, i) (((a)->t[(i) >> 3] >> ((i) & 7)) & 1)
+#define SAIS_TSET(a, i) ((a)->t[(i) >> 3] |= (uint8_t)(1 << ((i) & 7)))
+#define SAIS_LMS(a, i) ((i) > 0 && SAIS_TGET(a, i) && !SAIS_TGET(a, (i) - 1))
+
+static void SaisBuckets(Sais *a, bool end)
+{
+    int32_t sum = 0;
+    memset(a->bkt, 0, (a->K + 1) * sizeof(int32_t));
+    for (int32_t i = 0; i < a->n; i++)
+        a->bkt[SAIS_CHR(a, i)]++;
+    for (int32_t c = 0; c <= a->K; c++)
+    {
+        sum += a->bkt[c];
+        a->bkt[c] = end ? sum : sum - a->bkt[c];
+    }
+}
+
+static void SaisInduce(Sais *a, int32_t *SA)
+{
+    SaisBuckets(a, false);
+    for (int32_t i = 0; i < a->n; i++)
+    {
+        int32_t j = SA[i] - 1;
+        if (j >= 0 && !SAIS_TGET(a, j))
+            SA[a->bkt[SAIS_CHR(a, j)]++] = j;
+    }
+    SaisBuckets(a, true);
+    for (int32_t i = a->n - 1; i >= 0; i--)
+    {
+        int32_t j = SA[i] - 1;
+        if (j >= 0 && SAIS_TGET(a, j))
+            SA[--a->bkt[SAIS_CHR(a, j)]] = j;
+    }
+}
+
+static void SaisBuild(GeneticsObj *_this, const void *s, int32_t *SA, int32_t n, int32_t K, int cs)
+{
+    Sais a = {s, cs, Mem_Alloc(_this, n / 8 + 1), Mem_Alloc(_this, (K + 1) * sizeof(int32_t)), n, K};
+    memset(a.t, 0, n / 8 + 1);
+    SAIS_TSET(&a, n - 1);
+    for (int32_t i = n - 3; i >= 0; i--)
+    {
+        int32_t c = SAIS_CHR(&a, i), d = SAIS_CHR(&a, i + 1);
+        if (c < d || (c == d && SAIS_TGET(&a, i + 1)))
+            SAIS_TSET(&a, i);
+    }
+
+    // sort the LMS substrings
+    SaisBuckets(&a, true);
+    for (int32_t i = 0; i < n; i++)
+        SA[i] = -1;
+    for (int32_t i = 1; i < n; i++)
+        if (SAIS_LMS(&a, i))
+            SA[--a.bkt[SAIS_CHR(&a, i)]] = i;
+    SaisInduce(&a, SA);
+
+    // name them, equal substrings get the same name
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i++)
+        if (SAIS_LMS(&a, SA[i]))
+            SA[n1++] = SA[i];
+    for (int32_t i = n1; i < n; i++)
+        SA[i] = -1;
+    int32_t name = 0, prev = -1;
+    for (int32_t i = 0; i < n1; i++)
+    {
+        int32_t pos = SA[i];
+        bool diff = false;
+        for (int32_t d = 0; d < n; d++)
+        {
+            if (prev == -1 || SAIS_CHR(&a, pos + d) != SAIS_CHR(&a, prev + d) ||
+                SAIS_TGET(&a, pos + d) != SAIS_TGET(&a, prev + d))
+            {
+                diff = true;
+                break;
+            }
+            if (d > 0 && (SAIS_LMS(&a, pos + d) || SAIS_LMS(&a, prev + d)))
+                break;
+        }
+        if (diff)
+        {
+            name++;
+            prev = pos;
+        }
+        SA[n1 + pos / 2] = name - 1;
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= n1; i--)
+        if (SA[i] >= 0)
+            SA[j--] = SA[i];
+
+    // sort the LMS suffixes from the reduced text, recursively if names are not unique
+    int32_t *SA1 = SA, *s1 = SA + n - n1;
+    if (name < n1)
+        SaisBuild(_this, s1, SA1, n1, name - 1, sizeof(int32_t));
+    else
+        for (int32_t i = 0; i < n1; i++)
+            SA1[s1[i]] = i;
+
+    // induce the suffix array from the sorted LMS suffixes
+    SaisBuckets(&a, true);
+    for (int32_t i = 1, j = 0; i < n; i++)
+        if (SAIS_LMS(&a, i))
+            s1[j++] = i;
+    for (int32_t i = 0; i < n1; i++)
+        SA1[i] = s1[SA1[i]];
+    for (int32_t i = n1; i < n; i++)
+        SA[i] = -1;
+    for (int32_t i = n1 - 1; i >= 0; i--)
+    {
+        int32_t j = SA[i];
+        SA[i] = -1;
+        SA[--a.bkt[SAIS_CHR(&a, j)]] = j;
+    }
+    SaisInduce(&a, SA);
+    Mem_Free(_this, a.bkt, (K + 1) * sizeof(int32_t));
+    Mem_Free(_this, a.t, n / 8 + 1);
+}
+
+/**
+ * @brief rows in [0, i) with BWT symbol c
+ */
+static inline uint64_t Occ(const GeneticsIndex *index, int c, uint64_t i)
+{
+    const IndexBlock *b = &index->blocks[i / INDEX_BLOCK_ROWS];
+    uint64_t bits = (c & 1 ? b->lo : ~b->lo) & (c & 2 ? b->hi : ~b->hi);
+    uint64_t n = b->count[c] + __builtin_popcountll(bits & ((1ULL << (i % INDEX_BLOCK_ROWS)) - 1));
+    uint64_t primary = index->header->primary;
+    if (c == 0 && primary < i && primary / INDEX_BLOCK_ROWS == i / INDEX_BLOCK_ROWS)
+        n--; // sentinel stored as 0
+    return n;
+}
+
+static inline int Symbol(const GeneticsIndex *index, uint64_t row)
+{
+    const IndexBlock *b = &index->blocks[row / INDEX_BLOCK_ROWS];
+    int r = row % INDEX_BLOCK_ROWS;
+    return (int)((b->lo >> r) & 1) | (int)(((b->hi >> r) & 1) << 1);
+}
+
+/**
+ * @brief text position of the suffix of a row: LF steps until a sampled row
+ */
+static uint64_t Locate(const GeneticsIndex *index, uint64_t row)
+{
+    uint64_t steps = 0;
+    for (;;)
+    {
+        const IndexBlock *b = &index->blocks[row / INDEX_BLOCK_ROWS];
+        uint64_t below = (1ULL << (row % INDEX_BLOCK_ROWS)) - 1;
+        if ((b->mark >> (row % INDEX_BLOCK_ROWS)) & 1)
+            return index->samples[b->markRank + __builtin_popcountll(b->mark & below)] + steps;
+        int c = Symbol(index, row); // never the sentinel row: suffix array 0 is sampled
+        row = index->header->C[c] + Occ(index, c, row);
+        steps++;
+    }
+}
+
+static bool BuildIndex(GeneticsObj *_this)
+{
+    if (_this->dnaView || _this->readCount)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: index is only available on a loaded fasta or dna sequence");
+        return false;
+    }
+    if (_this->dnaSize == 0 || _this->dnaSize > INDEX_MAX_SIZE)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: index needs 1 to %d bases, sequence has %lu",
+                  INDEX_MAX_SIZE, _this->dnaSize);
+        return false;
+    }
+    Index_Delete(_this);
+    size_t size = _this->dnaSize, rows = size + 1;
+    uint8_t *text = Mem_Alloc(_this, rows);
+    for (size_t i = 0; i < size; i++)
+        text[i] = (_this->dna[i] & 0x3) + 1;
+    text[size] = 0; // sentinel
+    int32_t *SA = Mem_Alloc(_this, rows * sizeof(int32_t));
+    SaisBuild(_this, text, SA, (int32_t)rows, 4, 1);
+
+    size_t blockCount = rows / INDEX_BLOCK_ROWS + 1, sampleCount = size / INDEX_SAMPLE_RATE + 1;
+    GeneticsIndex *index = IndexNew(_this, blockCount, sampleCount);
+    IndexHeader *h = index->header;
+    memset(h, 0, sizeof(IndexHeader));
+    memcpy(h->magic, INDEX_MAGIC, sizeof(h->magic));
+    h->byteOrder = INDEX_BYTE_ORDER;
+    h->sampleRate = INDEX_SAMPLE_RATE;
+    h->size = size;
+    h->checksum = Checksum(_this->dna, size);
+    h->inputFileOffset = _this->inputFileOffset;
+    h->blockCount = blockCount;
+    h->sampleCount = sampleCount;
+
+    uint64_t count[4] = {0, 0, 0, 0}, marks = 0;
+    memset(index->blocks, 0, blockCount * sizeof(IndexBlock));
+    for (size_t i = 0; i < rows; i++)
+    {
+        IndexBlock *b = &index->blocks[i / INDEX_BLOCK_ROWS];
+        int r = i % INDEX_BLOCK_ROWS;
+        if (r == 0)
+        {
+            memcpy(b->count, count, sizeof(count));
+            b->markRank = marks;
+        }
+        int32_t pos = SA[i];
+        if (pos == 0)
+            h->primary = i;
+        else
+        {
+            int c = text[pos - 1] - 1;
+            b->lo |= (uint64_t)(c & 1) << r;
+            b->hi |= (uint64_t)(c >> 1) << r;
+            count[c]++;
+        }
+        if (pos % INDEX_SAMPLE_RATE == 0)
+        {
+            b->mark |= 1ULL << r;
+            index->samples[marks++] = pos;
+        }
+    }
+    if (rows % INDEX_BLOCK_ROWS == 0)
+    { // block of the row past the end, read by Occ(c, rows)
+        memcpy(index->blocks[blockCount - 1].count, count, sizeof(count));
+        index->blocks[blockCount - 1].markRank = marks;
+    }
+    h->C[0] = 1;
+    for (int c = 1; c < 4; c++)
+        h->C[c] = h->C[c - 1] + count[c - 1];
+    Mem_Free(_this, SA, rows * sizeof(int32_t));
+    Mem_Free(_this, text, rows);
+    STATS_ADD(&_this->stats, bases, size);
+    _this->fmIndex = index;
+    Out_Printf(_this, "index built: %lu bp, %lu bytes\n", size, index->memorySize);
+    return true;
+}
+
+/**
+ * @brief index file name: the given one or the loaded FASTA file name + INDEX_FILE_SUFFIX
+ */
+static const char *IndexFileName(GeneticsObj *_this, const char *filename, char *buffer, size_t size)
+{
+    if (filename && *filename)
+        return filename;
+    if (!_this->fastaPath || !_this->fastaPath[0])
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: index file name is needed, no fasta file loaded");
+        return NULL;
+    }
+    if ((size_t)snprintf(buffer, size, "%s" INDEX_FILE_SUFFIX, _this->fastaPath) >= size)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: index file name of '%s' is too long", _this->fastaPath);
+        return NULL;
+    }
+    return buffer;
+}
+
+static bool SaveIndex(GeneticsObj *_this, const char *filename)
+{
+    char path[FILENAME_MAX];
+    const GeneticsIndex *index = _this->fmIndex;
+    if (!index)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: no index to save, build it first");
+        return false;
+    }
+    if (!(filename = IndexFileName(_this, filename, path, sizeof(path))))
+        return false;
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening index file '%s'", filename);
+        return false;
+    }
+    bool ok = fwrite(index->header, 1, index->memorySize, f) == index->memorySize;
+    int error = errno;
+    if (fclose(f) != 0 && ok)
+    {
+        ok = false;
+        error = errno;
+    }
+    if (!ok)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error writing index file '%s'", filename);
+        return false;
+    }
+    Out_Printf(_this, "index saved to '%s'\n", filename);
+    return true;
+}
+
+static bool LoadIndex(GeneticsObj *_this, const char *filename)
+{
+    char path[FILENAME_MAX];
+    if (!(filename = IndexFileName(_this, filename, path, sizeof(path))))
+        return false;
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening index file '%s'", filename);
+        return false;
+    }
+    IndexHeader h;
+    const char *problem = NULL;
+    if (fread(&h, 1, sizeof(h), f) != sizeof(h) || memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) ||
+        h.byteOrder != INDEX_BYTE_ORDER || h.sampleRate != INDEX_SAMPLE_RATE ||
+        h.blockCount != (h.size + 1) / INDEX_BLOCK_ROWS + 1 || h.sampleCount != h.size / INDEX_SAMPLE_RATE + 1)
+        problem = "not an index file of this version";
+    else if (_this->dnaView || h.size != _this->dnaSize || h.inputFileOffset != _this->inputFileOffset ||
+             h.checksum != Checksum(_this->dna, _this->dnaSize))
+        problem = "index of another sequence";
+    if (problem)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "Error loading index file '%s' : %s", filename, problem);
+        fclose(f);
+        return false;
+    }
+    Index_Delete(_this);
+    GeneticsIndex *index = IndexNew(_this, h.blockCount, h.sampleCount);
+    *index->header = h;
+    size_t rest = index->memorySize - sizeof(h);
+    STATS_ADD(&_this->stats, bytes_read, index->memorySize);
+    if (fread(index->header + 1, 1, rest, f) != rest)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, ferror(f) ? errno : 0, "Error reading index file '%s'", filename);
+        fclose(f);
+        _this->fmIndex = index;
+        Index_Delete(_this);
+        return false;
+    }
+    fclose(f);
+    _this->fmIndex = index;
+    Out_Printf(_this, "index loaded from '%s': %lu bp\n", filename, _this->dnaSize);
+    return true;
+}
+
+/**
+ * @brief the index must cover the current sequence
+ */
+static const GeneticsIndex *IndexReady(GeneticsObj *_this)
+{
+    const GeneticsIndex *index = _this->fmIndex;
+    if (!index)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: no index, build or load it first");
+    else if (_this->dnaView || index->header->size != _this->dnaSize)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: index does not match the sequence, build it again");
+    else
+        return index;
+    return NULL;
+}
+
+/**
+ * @brief encode the pattern and its reverse complement (2 bit codes)
+ */
+static bool EncodePattern(GeneticsObj *_this, const char *pattern, uint8_t *fwd, uint8_t *rev, size_t m)
+{
+    if (m == 0)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: empty pattern");
+        return false;
+    }
+    for (size_t k = 0; k < m; k++)
+    {
+        uint8_t b;
+        switch (pattern[k])
+        {
+        case 'T': case 't': case 'U': case 'u': b = 0; break;
+        case 'C': case 'c': b = 1; break;
+        case 'A': case 'a': b = 2; break;
+        case 'G': case 'g': b = 3; break;
+        default:
+            Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: invalid base '%c' in pattern", pattern[k]);
+            return false;
+        }
+        fwd[k] = b;
+        rev[m - 1 - k] = COMPLEMENT(b);
+    }
+    return true;
+}
+
+/**
+ * @brief backward search: BWT rows [*lo, *hi) of the suffixes starting with the pattern
+ */
+static void BackwardSearch(const GeneticsIndex *index, const uint8_t *p, size_t m, uint64_t *lo, uint64_t *hi)
+{
+    uint64_t l = 0, h = index->header->size + 1;
+    for (size_t k = m; k-- > 0 && l < h;)
+    {
+        int c = p[k];
+        l = index->header->C[c] + Occ(index, c, l);
+        h = index->header->C[c] + Occ(index, c, h);
+    }
+    *lo = l;
+    *hi = l < h ? h : l;
+}
+
+static size_t CountPattern(GeneticsObj *_this, const char *pattern, size_t counts[2])
+{
+    size_t n[2] = {0, 0}, m = strlen(pattern);
+    const GeneticsIndex *index = IndexReady(_this);
+    uint8_t *p = Mem_Alloc(_this, 2 * m + 2);
+    if (index && EncodePattern(_this, pattern, p, p + m, m))
+    {
+        for (int strand = 0; strand < 2; strand++)
+        {
+            uint64_t lo, hi;
+            BackwardSearch(index, p + strand * m, m, &lo, &hi);
+            n[strand] = hi - lo;
+        }
+    }
+    Mem_Free(_this, p, 2 * m + 2);
+    STATS_ADD(&_this->stats, bases, 2 * m);
+    if (counts)
+    {
+        counts[0] = n[0];
+        counts[1] = n[1];
+    }
+    return n[0] + n[1];
+}
+
+static int CompareHits(const void *a, const void *b)
+{
+    const GeneticsIndexHit *x = a, *y = b;
+    size_t px = x->strand == '+' ? x->begin : x->end, py = y->strand == '+' ? y->begin : y->end;
+    if (px != py)
+        return px < py ? -1 : 1;
+    return (x->strand == '-') - (y->strand == '-');
+}
+
+static void PrintIndexHit(GeneticsObj *_this, int format, const GeneticsIndexHit *hit, bool first)
+{
+    switch (format)
+    {
+    case DNA_PRINT_FORMAT_JSON:
+        Out_Printf(_this, "%s{\"strand\":\"%c\",\"begin\":%lu,\"end\":%lu}", first ? "" : ",", hit->strand,
+                   hit->begin, hit->end);
+        break;
+    case DNA_PRINT_FORMAT_TSV:
+        Out_Printf(_this, "%c\t%lu\t%lu\n", hit->strand, hit->begin, hit->end);
+        break;
+    default:
+        Out_Printf(_this, "%c %lu-%lu\n", hit->strand, hit->begin, hit->end);
+        break;
+    }
+}
+
+static size_t LocatePattern(GeneticsObj *_this, const char *pattern, size_t max, DNA_PRINT_FlAGS flags,
+                            GeneticsIndexCallback callback, void *ctx)
+{
+    const GeneticsIndex *index = IndexReady(_this);
+    size_t m = strlen(pattern);
+    if (!index)
+        return 0;
+    uint8_t *p = Mem_Alloc(_this, 2 * m + 2);
+    bool ok = EncodePattern(_this, pattern, p, p + m, m);
+    IndexHits hits = {NULL, 0, 0};
+    uint64_t lo[2] = {0, 0}, hi[2] = {0, 0};
+    for (int strand = 0; ok && strand < 2; strand++)
+    {
+        BackwardSearch(index, p + strand * m, m, &lo[strand], &hi[strand]);
+        hits.alloc += hi[strand] - lo[strand];
+    }
+    Mem_Free(_this, p, 2 * m + 2);
+    if (!ok)
+        return 0;
+    if (max == 0 || max > hits.alloc)
+        max = hits.alloc;
+    hits.hits = Mem_Alloc(_this, (hits.alloc ? hits.alloc : 1) * sizeof(GeneticsIndexHit));
+    size_t offset = index->header->inputFileOffset;
+    for (int strand = 0; strand < 2; strand++)
+    {
+        for (uint64_t row = lo[strand]; row < hi[strand]; row++)
+        {
+            size_t pos = Locate(index, row);
+            GeneticsIndexHit *hit = &hits.hits[hits.count++];
+            hit->strand = strand ? '-' : '+';
+            hit->begin = strand ? offset + pos + m : offset + pos + 1;
+            hit->end = strand ? offset + pos + 1 : offset + pos + m;
+        }
+    }
+    qsort(hits.hits, hits.count, sizeof(GeneticsIndexHit), CompareHits);
+
+    int format = flags & DNA_PRINT_FORMAT_MASK;
+    if (!callback && format == DNA_PRINT_FORMAT_JSON)
+        Out_Printf(_this, "{\"type\":\"index\",\"pattern\":\"%s\",\"count\":%lu,\"hits\":[", pattern, hits.count);
+    else if (!callback && format == DNA_PRINT_FORMAT_TSV)
+        Out_Puts(_this, "strand\tbegin\tend\n");
+    for (size_t i = 0; i < max; i++)
+    {
+        if (callback)
+            callback(ctx, &hits.hits[i]);
+        else
+            PrintIndexHit(_this, format, &hits.hits[i], i == 0);
+    }
+    if (!callback && format == DNA_PRINT_FORMAT_JSON)
+        Out_Puts(_this, "]}\n");
+    else if (!callback && format != DNA_PRINT_FORMAT_TSV)
+        Out_Printf(_this, "index %s: %lu hits, %lu shown\n", pattern, hits.count, max);
+    Mem_Free(_this, hits.hits, (hits.alloc ? hits.alloc : 1) * sizeof(GeneticsIndexHit));
+    STATS_ADD(&_this->stats, bases, 2 * m);
+    return hits.count;
+}
+
+/**
+ * @brief Build a full-text index (FM-index) of the loaded sequence for repeated pattern lookups.
+ *        The suffix array is built in linear time (SA-IS), then only the BWT with occurrence
+ *        counts every 64 rows and one suffix array sample every 32 bases are kept (about 1.1 byte
+ *        per base). The index is dropped when a new sequence is started or loaded and must be built
+ *        again after Genetics_AddDNA().
+ *
+ * @param _this genetics object with a FASTA or dna sequence (not a FASTQ read or region)
+ * @return false if the sequence is empty or longer than 2^31 - 2 bases
+ */
+bool Genetics_BuildIndex(GeneticsObj *_this)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_INDEX);
+    bool ok = BuildIndex(_this);
+    Out_Flush(_this);
+    STATS_END();
+    return ok;
+}
+
+/**
+ * @brief Save the index so the next session can load it instead of building it
+ *
+ * @param _this    genetics object
+ * @param filename index file, NULL for the loaded FASTA file name + ".fmi"
+ * @return false on file error or if there is no index
+ */
+bool Genetics_SaveIndex(GeneticsObj *_this, const char *filename)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_INDEX);
+    bool ok = SaveIndex(_this, filename);
+    Out_Flush(_this);
+    STATS_END();
+    return ok;
+}
+
+/**
+ * @brief Load an index saved with Genetics_SaveIndex(). The file must have been built from the same
+ *        bases (length, start offset and checksum are verified).
+ *
+ * @param _this    genetics object with the sequence loaded
+ * @param filename index file, NULL for the loaded FASTA file name + ".fmi"
+ * @return false on file error or if the index belongs to another sequence
+ */
+bool Genetics_LoadIndex(GeneticsObj *_this, const char *filename)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_INDEX);
+    bool ok = LoadIndex(_this, filename);
+    Out_Flush(_this);
+    STATS_END();
+    return ok;
+}
+
+/**
+ * @brief Count the occurrences of a pattern on both strands in O(pattern length)
+ *
+ * @param _this   genetics object with an index
+ * @param pattern bases A C G T(U)
+ * @param counts  filled with the forward and reverse strand counts (can be NULL)
+ * @return occurrences on both strands
+ */
+size_t Genetics_IndexCount(GeneticsObj *_this, const char *pattern, size_t counts[2])
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_INDEX);
+    size_t n = CountPattern(_this, pattern, counts);
+    STATS_END();
+    return n;
+}
+
+/**
+ * @brief Locate the occurrences of a pattern on both strands: O(pattern length) for the search,
+ *        then at most 31 LF steps per occurrence. Hits are reported sorted by position.
+ *
+ * @param _this    genetics object with an index
+ * @param pattern  bases A C G T(U)
+ * @param max      hits reported, 0 for all
+ * @param flags    DNA_PRINT_FORMAT_JSON or DNA_PRINT_FORMAT_TSV to print hits as records (text otherwise)
+ * @param callback called for every hit instead of printing (can be NULL)
+ * @param ctx      passed to the callback
+ * @return occurrences on both strands (including the ones not reported)
+ */
+size_t Genetics_IndexLocate(GeneticsObj *_this, const char *pattern, size_t max, DNA_PRINT_FlAGS flags,
+                            GeneticsIndexCallback callback, void *ctx)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_INDEX);
+    size_t n = LocatePattern(_this, pattern, max, flags, callback, ctx);
+    Out_Flush(_this);
+    STATS_END();
+    return n;
+}
@@ -0,0 +1,360 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief masked intervals of the loaded sequence, recorded by the encoder as sorted lists of buffer
+ *        index ranges: N runs (placeholder bases) and soft-masked (lower case) runs, and the repeats
+ *        of Genetics_MaskRepeats().
+ *        Scans skip the lists of _this->maskSkip by range, never by base.
+ */
+
+/**
+ * @brief append [begin, end) to a list, merged with the last range when adjacent
+ *
+ * @return false if the list is full
+ */
+static bool Append(GeneticsMaskList *l, size_t begin, size_t end)
+{
+    if (l->count > 0 && l->ranges[l->count - 1].end == begin)
+    {
+        l->ranges[l->count - 1].end = end;
+        return true;
+    }
+    if (l->count == l->alloc)
+        return false;
+    l->ranges[l->count].begin = begin;
+    l->ranges[l->count].end = end;
+    l->count++;
+    return true;
+}
+
+static size_t Grown(const GeneticsMaskList *l)
+{
+    return l->alloc ? 2 * l->alloc : 64;
+}
+
+void Mask_Add(GeneticsObj *_this, int list, size_t begin, size_t end)
+{
+    GeneticsMaskList *l = &_this->masks[list];
+    if (Append(l, begin, end))
+        return;
+    l->ranges = Mem_Realloc(_this, l->ranges, l->alloc * sizeof(GeneticsRange), Grown(l) * sizeof(GeneticsRange));
+    l->alloc = Grown(l);
+    Append(l, begin, end);
+}
+
+/**
+ * @brief Mask_Add() on a list of another owner, grown with allocator (encoder threads)
+ */
+void Mask_Push(const GeneticsAllocator *allocator, GeneticsMaskList *l, size_t begin, size_t end)
+{
+    if (Append(l, begin, end))
+        return;
+    l->ranges = allocator->realloc(allocator->ctx, l->ranges, l->alloc * sizeof(GeneticsRange),
+                                   Grown(l) * sizeof(GeneticsRange));
+    l->alloc = Grown(l);
+    Append(l, begin, end);
+}
+
+void Mask_Reset(GeneticsObj *_this)
+{
+    for (int list = 0; list < MASK_LISTS; list++)
+        _this->masks[list].count = 0;
+}
+
+void Mask_Delete(GeneticsObj *_this)
+{
+    for (int list = 0; list < MASK_LISTS; list++)
+    {
+        Mem_Free(_this, _this->masks[list].ranges, _this->masks[list].alloc * sizeof(GeneticsRange));
+        memset(&_this->masks[list], 0, sizeof(GeneticsMaskList));
+    }
+}
+
+/**
+ * @brief copy the lists of another object sharing the same sequence
+ */
+void Mask_Copy(GeneticsObj *_this, const GeneticsObj *source)
+{
+    Mask_Reset(_this);
+    for (int list = 0; list < MASK_LISTS; list++)
+        for (size_t k = 0; k < source->masks[list].count; k++)
+            Mask_Add(_this, list, source->masks[list].ranges[k].begin, source->masks[list].ranges[k].end);
+}
+
+/**
+ * @brief a list of the loaded sequence, NULL if empty or if dna is a region, a read or a haplotype
+ */
+const GeneticsMaskList *Mask_List(const GeneticsObj *_this, int list)
+{
+    if (_this->dnaView || _this->haplotype || _this->readCount || _this->masks[list].count == 0)
+        return NULL;
+    return &_this->masks[list];
+}
+
+/**
+ * @brief first range of the list with end > i
+ */
+static size_t Lower(const GeneticsMaskList *l, size_t i)
+{
+    size_t lo = 0, hi = l->count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (l->ranges[mid].end <= i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * @brief number of ranges of the list with begin < i
+ */
+static size_t Upper(const GeneticsMaskList *l, size_t i)
+{
+    size_t lo = 0, hi = l->count;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (l->ranges[mid].begin < i)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static const GeneticsMaskList *SkipList(const GeneticsObj *_this, int list)
+{
+    return (_this->maskSkip & (1 << list)) ? Mask_List(_this, list) : NULL;
+}
+
+/**
+ * @brief first skipped range (lists of maskSkip, touching ranges joined) ending after i
+ *
+ * @param end filled with the range end, SIZE_MAX if none
+ * @return range begin (<= i if i is skipped), SIZE_MAX if none
+ */
+size_t Mask_NextSkip(const GeneticsObj *_this, size_t i, size_t *end)
+{
+    size_t begin = SIZE_MAX;
+    *end = SIZE_MAX;
+    for (int list = 0; list < MASK_LISTS; list++)
+    {
+        const GeneticsMaskList *l = SkipList(_this, list);
+        size_t k = l ? Lower(l, i) : 0;
+        if (l && k < l->count && l->ranges[k].begin < begin)
+        {
+            begin = l->ranges[k].begin;
+            *end = l->ranges[k].end;
+        }
+    }
+    for (bool joined = begin != SIZE_MAX; joined;)
+    {
+        joined = false;
+        for (int list = 0; list < MASK_LISTS; list++)
+        {
+            const GeneticsMaskList *l = SkipList(_this, list);
+            size_t k = l ? Lower(l, *end) : 0;
+            if (l && k < l->count && l->ranges[k].begin <= *end)
+            {
+                *end = l->ranges[k].end;
+                joined = true;
+            }
+        }
+    }
+    return begin;
+}
+
+/**
+ * @brief last skipped range (touching ranges joined) beginning before i
+ *
+ * @param begin filled with the range begin
+ * @return range end (> i if i - 1 is skipped), 0 if none
+ */
+size_t Mask_PrevSkip(const GeneticsObj *_this, size_t i, size_t *begin)
+{
+    size_t end = 0;
+    *begin = 0;
+    for (int list = 0; list < MASK_LISTS; list++)
+    {
+        const GeneticsMaskList *l = SkipList(_this, list);
+        size_t k = l ? Upper(l, i) : 0;
+        if (k > 0 && l->ranges[k - 1].end > end)
+        {
+            end = l->ranges[k - 1].end;
+            *begin = l->ranges[k - 1].begin;
+        }
+    }
+    for (bool joined = end > 0; joined;)
+    {
+        joined = false;
+        for (int list = 0; list < MASK_LISTS; list++)
+        {
+            const GeneticsMaskList *l = SkipList(_this, list);
+            size_t k = l ? Upper(l, *begin) : 0;
+            if (k > 0 && l->ranges[k - 1].end >= *begin)
+            {
+                *begin = l->ranges[k - 1].begin;
+                joined = true;
+            }
+        }
+    }
+    return end;
+}
+
+/**
+ * @brief true if a base of [begin, end) is skipped
+ */
+bool Mask_Skipped(const GeneticsObj *_this, size_t begin, size_t end)
+{
+    size_t e;
+    return Mask_NextSkip(_this, begin, &e) < end;
+}
+
+/**
+ * @brief true if base i is in a range of the list
+ */
+bool Mask_In(const GeneticsObj *_this, int list, size_t i)
+{
+    const GeneticsMaskList *l = Mask_List(_this, list);
+    size_t k = l ? Lower(l, i) : 0;
+    return l && k < l->count && l->ranges[k].begin <= i;
+}
+
+/**
+ * @brief first range of the list ending after i
+ *
+ * @param end filled with the range end
+ * @return range begin, SIZE_MAX if none
+ */
+size_t Mask_NextIn(const GeneticsObj *_this, int list, size_t i, size_t *end)
+{
+    const GeneticsMaskList *l = Mask_List(_this, list);
+    size_t k = l ? Lower(l, i) : 0;
+    if (!l || k == l->count)
+        return *end = SIZE_MAX;
+    *end = l->ranges[k].end;
+    return l->ranges[k].begin;
+}
+
+static int ListOf(GENETICS_MASK mask)
+{
+    switch (mask)
+    {
+    case GENETICS_MASK_N:
+        return MASK_N;
+    case GENETICS_MASK_SOFT:
+        return MASK_SOFT;
+    case GENETICS_MASK_REPEAT:
+        return MASK_REPEAT;
+    }
+    return -1;
+}
+
+/**
+ * @brief Number of intervals of a mask of the loaded sequence (0 for a region, a FASTQ read or a haplotype)
+ *
+ * @param _this genetics object
+ * @param mask  GENETICS_MASK_N, GENETICS_MASK_SOFT or GENETICS_MASK_REPEAT
+ * @return size_t intervals
+ */
+size_t Genetics_MaskCount(GeneticsObj *_this, GENETICS_MASK mask)
+{
+    int list = ListOf(mask);
+    const GeneticsMaskList *l = list < 0 ? NULL : Mask_List(_this, list);
+    return l ? l->count : 0;
+}
+
+/**
+ * @brief Interval n of a mask in file offsets
+ *
+ * @param _this    genetics object
+ * @param mask     GENETICS_MASK_N, GENETICS_MASK_SOFT or GENETICS_MASK_REPEAT
+ * @param n        interval number, < Genetics_MaskCount()
+ * @param interval filled with the first and last base of the interval
+ * @return false if n is out of range
+ */
+bool Genetics_MaskInterval(GeneticsObj *_this, GENETICS_MASK mask, size_t n, GeneticsInterval *interval)
+{
+    int list = ListOf(mask);
+    const GeneticsMaskList *l = list < 0 ? NULL : Mask_List(_this, list);
+    if (!l || n >= l->count)
+        return false;
+    interval->begin = _this->inputFileOffset + l->ranges[n].begin + 1;
+    interval->end = _this->inputFileOffset + l->ranges[n].end;
+    return true;
+}
+
+/**
+ * @brief Masks skipped by the scans: Genetics_Scan() and Genetics_FindStart() do not read codons
+ *        with a skipped base and end open reading frames there, translations print them as 'X'
+ *        and the peptide search does not match them. N runs are skipped by default.
+ *
+ * @param _this genetics object
+ * @param masks GENETICS_MASK_xxx combination, 0 reads the placeholder bases of N runs as T
+ */
+void Genetics_SetMaskSkip(GeneticsObj *_this, GENETICS_MASK masks)
+{
+    if (masks != _this->maskSkip)
+        Scan_Reset(_this);
+    _this->maskSkip = masks;
+}
+
+GENETICS_MASK Genetics_GetMaskSkip(GeneticsObj *_this)
+{
+    return _this->maskSkip;
+}
+
+/**
+ * @brief Print the intervals of masks (flags DNA_PRINT_FORMAT_JSON or TSV, text otherwise)
+ *
+ * @param _this genetics object
+ * @param masks GENETICS_MASK_xxx combination
+ * @param flags output format
+ */
+void Genetics_PrintMasks(GeneticsObj *_this, GENETICS_MASK masks, DNA_PRINT_FlAGS flags)
+{
+    static const char *NAMES[MASK_LISTS] = {"N", "soft", "repeat"};
+    int format = flags & DNA_PRINT_FORMAT_MASK;
+    if (format == DNA_PRINT_FORMAT_JSON)
+        Out_Puts(_this, "{\"type\":\"masks\",\"masks\":[");
+    else if (format == DNA_PRINT_FORMAT_TSV)
+        Out_Puts(_this, "mask\tbegin\tend\n");
+    bool first = true;
+    for (int list = 0; list < MASK_LISTS; list++)
+    {
+        const GeneticsMaskList *l = (masks & (1 << list)) ? Mask_List(_this, list) : NULL;
+        size_t bases = 0;
+        for (size_t k = 0; l && k < l->count; k++, first = false)
+        {
+            size_t begin = _this->inputFileOffset + l->ranges[k].begin + 1, end = _this->inputFileOffset + l->ranges[k].end;
+            bases += end - begin + 1;
+            if (format == DNA_PRINT_FORMAT_JSON)
+                Out_Printf(_this, "%s{\"mask\":\"%s\",\"begin\":%lu,\"end\":%lu}", first ? "" : ",", NAMES[list], begin, end);
+            else if (format == DNA_PRINT_FORMAT_TSV)
+                Out_Printf(_this, "%s\t%lu\t%lu\n", NAMES[list], begin, end);
+            else
+                Out_Printf(_this, "%s %lu-%lu\n", NAMES[list], begin, end);
+        }
+        if (format != DNA_PRINT_FORMAT_JSON && format != DNA_PRINT_FORMAT_TSV && (masks & (1 << list)))
+            Out_Printf(_this, "mask %s: %lu intervals, %lu bases\n", NAMES[list], l ? l->count : 0, bases);
+    }
+    if (format == DNA_PRINT_FORMAT_JSON)
+        Out_Puts(_this, "]}\n");
+    Out_Flush(_this);
+}
@@ -0,0 +1,522 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+
+/**
+ * @brief write the buffered output to the output stream
+ */
+void Out_Flush(GeneticsObj *_this)
+{
+    if (_this->outSize > 0)
+    {
+        fwrite(_this->outBuffer, 1, _this->outSize, _this->out);
+        _this->outSize = 0;
+    }
+}
+
+/**
+ * @brief buffered write, blocks bigger than the buffer are written directly
+ */
+void Out_Write(GeneticsObj *_this, const void *data, size_t size)
+{
+    if (_this->outSize + size > OUT_BUFFER_SIZE)
+    {
+        Out_Flush(_this);
+        if (size > OUT_BUFFER_SIZE)
+        {
+            STATS_ADD(&_this->stats, out_bytes, size);
+            fwrite(data, 1, size, _this->out);
+            return;
+        }
+    }
+    memcpy(_this->outBuffer + _this->outSize, data, size);
+    Out_Commit(_this, size);
+}
+
+/**
+ * @brief buffered formatted output, see Out_Write()
+ */
+void Out_Printf(GeneticsObj *_this, const char *fmt, ...)
+{
+    va_list args;
+    size_t room = OUT_BUFFER_SIZE - _this->outSize;
+    va_start(args, fmt);
+    int n = vsnprintf(_this->outBuffer + _this->outSize, room, fmt, args);
+    va_end(args);
+    if (n < 0)
+        return;
+    if ((size_t)n >= room)
+    {
+        Out_Flush(_this);
+        va_start(args, fmt);
+        if (n >= OUT_BUFFER_SIZE)
+        {
+            n = vfprintf(_this->out, fmt, args);
+            va_end(args);
+            if (n > 0)
+                STATS_ADD(&_this->stats, out_bytes, n);
+            return;
+        }
+        vsnprintf(_this->outBuffer, OUT_BUFFER_SIZE, fmt, args);
+        va_end(args);
+    }
+    Out_Commit(_this, n);
+}
+
+static size_t NextMask(const GeneticsObj *_this, int list, size_t i, size_t *end)
+{
+    return list < 0 ? Mask_NextSkip(_this, i, end) : Mask_NextIn(_this, list, i, end);
+}
+
+/**
+ * @brief ranges of a mask list (skipped masks if list < 0) in strand base indexes, in strand order
+ */
+static GeneticsRange *StrandMasks(GeneticsObj *_this, const OutStrand *s, int list, size_t *count)
+{
+    GeneticsRange *ranges = NULL;
+    size_t alloc = 0, g = 0; // g: exons copy index of the exon begin
+    *count = 0;
+    for (size_t e = 0; e < s->exonCount; g += s->exons[e].end - s->exons[e].begin, e++)
+    {
+        size_t eb = s->exons[e].begin, ee = s->exons[e].end, end;
+        for (size_t b = NextMask(_this, list, eb, &end); b < ee; b = NextMask(_this, list, end, &end))
+        {
+            size_t gb = g + (b > eb ? b : eb) - eb, ge = g + (end < ee ? end : ee) - eb, kb, ke;
+            if (s->step > 0)
+            {
+                kb = gb > s->origin ? gb - s->origin : 0;
+                ke = ge > s->origin ? ge - s->origin : 0;
+            }
+            else
+            {
+                kb = ge <= s->origin ? s->origin + 1 - ge : 0;
+                ke = gb <= s->origin ? s->origin + 1 - gb : 0;
+            }
+            if (kb >= ke)
+                continue;
+            if (*count > 0 && s->step > 0 && ranges[*count - 1].end == kb)
+                ranges[*count - 1].end = ke;
+            else if (*count > 0 && s->step < 0 && ranges[*count - 1].begin == ke)
+                ranges[*count - 1].begin = kb;
+            else
+            {
+                if (*count == alloc)
+                {
+                    ranges = Mem_Realloc(_this, ranges, alloc * sizeof(GeneticsRange), (alloc ? 2 * alloc : 16) * sizeof(GeneticsRange));
+                    alloc = alloc ? 2 * alloc : 16;
+                }
+                ranges[*count].begin = kb;
+                ranges[(*count)++].end = ke;
+            }
+            if (end >= ee)
+                break;
+        }
+    }
+    for (size_t a = 0, z = *count; s->step < 0 && a + 1 < z; a++, z--)
+    { // reverse strand ranges were found in decreasing order
+        GeneticsRange t = ranges[a];
+        ranges[a] = ranges[z - 1];
+        ranges[z - 1] = t;
+    }
+    if (*count == 0)
+        Mem_Free(_this, ranges, alloc * sizeof(GeneticsRange));
+    else if (*count < alloc)
+        ranges = Mem_Realloc(_this, ranges, alloc * sizeof(GeneticsRange), *count * sizeof(GeneticsRange));
+    return *count ? ranges : NULL;
+}
+
+/**
+ * @brief strand in reading direction (flags DNA_PRINT_REVERSE / DNA_PRINT_COMPLEMENT) from codon_start
+ */
+void Out_OpenStrand(GeneticsObj *_this, DNA_PRINT_FlAGS flags, OutStrand *s)
+{
+    memset(s, 0, sizeof(OutStrand));
+    if (_this->dnaDir == DNA_DIR_3_TO_5)
+        flags ^= DNA_PRINT_REVERSE;
+    s->complement = (flags & DNA_PRINT_COMPLEMENT) ? 0x2 : 0;
+    s->strand = (flags & DNA_PRINT_REVERSE) ? '-' : '+';
+    s->step = (flags & DNA_PRINT_REVERSE) ? -1 : 1;
+    s->inputFileOffset = _this->inputFileOffset;
+    if (_this->dnaSize == 0)
+        return;
+
+    s->exons = Mem_Alloc(_this, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+    s->exonCount = Splice_Exons(_this, s->exons);
+    const uint8_t *dna = _this->dna;
+    size_t size = _this->dnaSize;
+    size_t fwdOrigin = _this->start_codon - 1, revOrigin = _this->dnaSize - _this->start_codon;
+    if (_this->spliceSize > 0)
+    {
+        s->spliced = Mem_Alloc(_this, _this->dnaSize);
+        size = Splice_Gather(_this, s->exons, s->exonCount, s->spliced, &fwdOrigin, &revOrigin);
+        dna = s->spliced;
+    }
+    if (s->step < 0)
+    {
+        if (revOrigin >= size)
+            return;
+        s->origin = revOrigin;
+        s->size = revOrigin + 1;
+    }
+    else
+    {
+        s->origin = fwdOrigin;
+        s->size = size - fwdOrigin;
+    }
+    s->seq = dna + s->origin;
+    if (s->step < 0)
+        s->block = Mem_Alloc(_this, STRAND_BLOCK);
+    s->nRanges = StrandMasks(_this, s, MASK_N, &s->nCount);
+    s->skipRanges = StrandMasks(_this, s, -1, &s->skipCount);
+}
+
+void Out_CloseStrand(GeneticsObj *_this, OutStrand *s)
+{
+    Mem_Free(_this, s->nRanges, s->nCount * sizeof(GeneticsRange));
+    Mem_Free(_this, s->skipRanges, s->skipCount * sizeof(GeneticsRange));
+    Mem_Free(_this, s->block, STRAND_BLOCK);
+    Mem_Free(_this, s->spliced, _this->dnaSize);
+    Mem_Free(_this, s->exons, (_this->spliceSize / 2 + 1) * sizeof(GeneticsRange));
+}
+
+/**
+ * @brief file offset (1 based) of base k of the strand
+ */
+size_t Out_StrandOffset(const OutStrand *s, size_t k)
+{
+    size_t g = s->step > 0 ? s->origin + k : s->origin - k;
+    for (size_t e = 0; e < s->exonCount; e++)
+    {
+        size_t len = s->exons[e].end - s->exons[e].begin;
+        if (g < len)
+            return s->inputFileOffset + s->exons[e].begin + g + 1;
+        g -= len;
+    }
+    return 0;
+}
+
+static void PatchRanges(const GeneticsRange *ranges, size_t count, size_t shift, char *o, bool codons,
+                        size_t first, size_t n, char c)
+{
+    size_t lo = 0, hi = count, from = (codons ? 3 * first : first) + shift;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (ranges[mid].end <= from)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (; lo < count; lo++)
+    {
+        size_t rb = ranges[lo].begin > shift ? ranges[lo].begin - shift : 0, re = ranges[lo].end - shift;
+        size_t b = codons ? rb / 3 : rb, e = codons ? (re + 2) / 3 : re;
+        if (b >= first + n)
+            break;
+        for (size_t k = b > first ? b : first; k < e && k < first + n; k++)
+            o[k - first] = c;
+    }
+}
+
+/**
+ * @brief overwrite the symbols [first, first + n) written for the strand: bases of N blocks
+ *        as 'N', codons with a skipped base as 'X'
+ */
+void Out_PatchMasks(const OutStrand *s, char *o, bool codons, size_t first, size_t n)
+{
+    if (codons)
+        PatchRanges(s->skipRanges, s->skipCount, s->maskShift, o, true, first, n, 'X');
+    else
+        PatchRanges(s->nRanges, s->nCount, s->maskShift, o, false, first, n, 'N');
+}
+
+/**
+ * @brief symbol lookup tables with complement applied, so the writers only index
+ */
+static void BaseSymbols(const OutStrand *s, DNA_PRINT_FlAGS flags, char map[4])
+{
+    static const char DNA_BASES[4] = {'T', 'C', 'A', 'G'};
+    static const char RNA_BASES[4] = {'U', 'C', 'A', 'G'};
+    const char *bases = (flags & DNA_PRINT_RNA) ? RNA_BASES : DNA_BASES;
+    for (int b = 0; b < 4; b++)
+        map[b] = bases[b ^ s->complement];
+}
+
+static void CodonSymbols(const OutStrand *s, const char table[64], char map[64])
+{
+    uint8_t cx = s->complement ? 0x2A : 0;
+    for (int c = 0; c < 64; c++)
+        map[c] = table[c ^ cx];
+}
+
+/**
+ * @brief four bases b0 | b1 << 2 | b2 << 4 | b3 << 6 to their four symbols
+ */
+static void BaseQuads(const char map[4], char quads[256][4])
+{
+    for (int q = 0; q < 256; q++)
+        for (int b = 0; b < 4; b++)
+            quads[q][b] = map[(q >> 2 * b) & 0x3];
+}
+
+/**
+ * @brief write count bases (or codons) from first as symbols through the output buffer.
+ *        With newline, a new line is written every width symbols and at the end.
+ */
+static void WriteSymbols(GeneticsObj *_this, const OutStrand *s, bool codons, const char *map,
+                         size_t first, size_t count, size_t width, bool newline)
+{
+    if (!newline || width == 0)
+        width = SIZE_MAX;
+    char quads[256][4];
+    if (!codons)
+        BaseQuads(map, quads);
+    size_t col = 0;
+    for (size_t k = first, end = first + count; k < end;)
+    {
+        size_t n = end - k;
+        if (n > OUT_CHUNK)
+            n = OUT_CHUNK;
+        if (n > width - col)
+            n = width - col;
+        char *o = Out_Reserve(_this, n + 1);
+        if (codons)
+        {
+            _this->kernels->translate(o, Out_StrandRead(_this, s, 3 * k, 3 * n), n, map);
+            STATS_ADD(&_this->stats, codons, n);
+        }
+        else
+        {
+            const uint8_t *q = Out_StrandRead(_this, s, k, n);
+            size_t j = 0;
+            for (; j + 4 <= n; j += 4, q += 4)
+                memcpy(o + j, quads[q[0] | q[1] << 2 | q[2] << 4 | q[3] << 6], 4);
+            for (; j < n; j++, q++)
+                o[j] = map[*q];
+        }
+        Out_PatchMasks(s, o, codons, k, n);
+        k += n;
+        col += n;
+        if (newline && (col == width || k == end))
+        {
+            o[n++] = '\n';
+            col = 0;
+        }
+        Out_Commit(_this, n);
+    }
+}
+
+/**
+ * @brief write bases packed 2 bits per base, first base in the low bits
+ */
+static void WritePacked(GeneticsObj *_this, const OutStrand *s)
+{
+    uint8_t cx = s->complement ? 0xAA : 0;
+    for (size_t k = 0; k < s->size;)
+    {
+        size_t n = s->size - k;
+        if (n > STRAND_BLOCK)
+            n = STRAND_BLOCK;
+        size_t bytes = (n + 3) / 4;
+        uint8_t *o = (uint8_t *)Out_Reserve(_this, bytes);
+        const uint8_t *q = Out_StrandRead(_this, s, k, n);
+        size_t j = 0;
+        for (; j < n / 4; j++, q += 4)
+            o[j] = ((q[0] & 0x3) | (q[1] & 0x3) << 2 | (q[2] & 0x3) << 4 | (q[3] & 0x3) << 6) ^ cx;
+        if (j < bytes)
+        { // last partial byte, padding bits are 0
+            uint8_t byte = 0;
+            for (size_t b = 0; b < n % 4; b++)
+                byte |= ((q[b] & 0x3) ^ (cx & 0x3)) << (2 * b);
+            o[j] = byte;
+        }
+        Out_Commit(_this, bytes);
+        k += n;
+    }
+}
+
+static void WriteBinaryHeader(GeneticsObj *_this, uint8_t kind, char strand, size_t offset, size_t length)
+{
+    GeneticsBinaryHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GENETICS_BINARY_MAGIC, sizeof(header.magic));
+    header.kind = kind;
+    header.strand = strand;
+    header.offset = offset;
+    header.length = length;
+    Out_Write(_this, &header, sizeof(header));
+}
+
+/**
+ * @brief JSON or TSV record of an open reading frame: codons first (start) to stop (last coding codon if !complete)
+ */
+static void PrintORF(GeneticsObj *_this, const OutStrand *s, bool json, const char *aa, size_t first, size_t stop,
+                     bool complete, bool more)
+{
+    size_t last = complete ? stop : stop + 1; // coding codons are [first, last)
+    size_t begin = Out_StrandOffset(s, 3 * first), end = Out_StrandOffset(s, 3 * stop + 2);
+    if (json)
+        Out_Printf(_this, "%s{\"begin\":%lu,\"end\":%lu,\"length\":%lu,\"complete\":%s,\"protein\":\"M",
+                   more ? "," : "", begin, end, last - first, complete ? "true" : "false");
+    else
+        Out_Printf(_this, "%c\t%lu\t%lu\t%lu\t%d\tM", s->strand, begin, end, last - first, complete);
+    WriteSymbols(_this, s, true, aa, first + 1, last - first - 1, 0, false);
+    Out_Puts(_this, json ? "\"}" : "\n");
+}
+
+/**
+ * @brief open reading frames (start codon to stop codon) of the strand in codon_start frame
+ */
+static void PrintORFs(GeneticsObj *_this, const OutStrand *s, bool json)
+{
+    char starts[64], aa[64];
+    CodonSymbols(s, _this->transl->starts, starts);
+    CodonSymbols(s, _this->transl->transl, aa);
+    if (json)
+        Out_Printf(_this, "{\"type\":\"orfs\",\"strand\":\"%c\",\"orfs\":[", s->strand);
+    else
+        Out_Puts(_this, "strand\tbegin\tend\tlength\tcomplete\tprotein\n");
+    size_t codons = s->size / 3, orf = SIZE_MAX, found = 0, r = 0;
+    const uint8_t *q = NULL;
+    size_t blockBegin = 0, blockEnd = 0; // codons in q; PrintORF() reads the strand block too
+    for (size_t i = 0; i < codons; i++)
+    {
+        while (r < s->skipCount && s->skipRanges[r].end <= 3 * i)
+            r++;
+        if (r < s->skipCount && s->skipRanges[r].begin < 3 * i + 3)
+        { // a skipped mask ends the reading frame
+            if (orf != SIZE_MAX)
+                PrintORF(_this, s, json, aa, orf, i - 1, false, found++ > 0);
+            orf = SIZE_MAX;
+            blockEnd = 0;
+            continue;
+        }
+        if (i >= blockEnd)
+        {
+            blockBegin = i;
+            blockEnd = codons - i < OUT_CHUNK ? codons : i + OUT_CHUNK;
+            q = Out_StrandRead(_this, s, 3 * i, 3 * (blockEnd - i));
+        }
+        const uint8_t *p = q + 3 * (i - blockBegin);
+        char c = starts[CODON(p[0], p[1], p[2])];
+        if (orf == SIZE_MAX)
+        {
+            if (c == 'M')
+                orf = i;
+        }
+        else if (c == '*')
+        {
+            PrintORF(_this, s, json, aa, orf, i, true, found++ > 0);
+            orf = SIZE_MAX;
+            blockEnd = 0;
+        }
+    }
+    STATS_ADD(&_this->stats, codons, codons);
+    if (orf != SIZE_MAX)
+        PrintORF(_this, s, json, aa, orf, codons - 1, false, found++ > 0);
+    if (json)
+        Out_Puts(_this, "]}\n");
+}
+
+/**
+ * @brief Print DNA in a machine readable format (flags & DNA_PRINT_FORMAT_MASK):
+ *        DNA_PRINT_FORMAT_FASTA  : sequence or translation (all codons, stops as '*')
+ *        DNA_PRINT_FORMAT_BINARY : one GeneticsBinaryHeader record, packed bases or translation
+ *        DNA_PRINT_FORMAT_JSON/TSV : sequence, or open reading frames when translating
+ *        Reading starts at codon_start, spliced introns are removed. Translation is single letter,
+ *        DNA_PRINT_TRANSLATE_CORRELATE is ignored.
+ */
+void Format_PrintDNA(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+{
+    OutStrand s;
+    Out_OpenStrand(_this, flags, &s);
+    bool translate = flags & (DNA_PRINT_TRANSLATE | DNA_PRINT_TRANSLATE_LONG);
+    size_t count = translate ? s.size / 3 : s.size;
+    size_t first = count ? Out_StrandOffset(&s, 0) : 0;
+    size_t last = count ? Out_StrandOffset(&s, translate ? 3 * count - 1 : count - 1) : 0;
+    char bases[4], aa[64];
+    BaseSymbols(&s, flags, bases);
+    CodonSymbols(&s, _this->transl->transl, aa);
+    const char *map = translate ? aa : bases;
+    switch (flags & DNA_PRINT_FORMAT_MASK)
+    {
+    case DNA_PRINT_FORMAT_FASTA:
+        Out_Printf(_this, ">%s:%lu-%lu(%c)\n", translate ? "protein" : "dna", first, last, s.strand);
+        WriteSymbols(_this, &s, translate, map, 0, count, _this->fastaWidth, true);
+        break;
+    case DNA_PRINT_FORMAT_BINARY:
+        WriteBinaryHeader(_this, translate ? GENETICS_BINARY_PROTEIN : GENETICS_BINARY_DNA, s.strand, first, count);
+        if (translate)
+            WriteSymbols(_this, &s, true, aa, 0, count, 0, false);
+        else
+            WritePacked(_this, &s);
+        break;
+    case DNA_PRINT_FORMAT_JSON:
+    case DNA_PRINT_FORMAT_TSV:
+    {
+        bool json = (flags & DNA_PRINT_FORMAT_MASK) == DNA_PRINT_FORMAT_JSON;
+        if (translate)
+        {
+            PrintORFs(_this, &s, json);
+            break;
+        }
+        if (json)
+            Out_Printf(_this, "{\"type\":\"dna\",\"strand\":\"%c\",\"begin\":%lu,\"end\":%lu,\"length\":%lu,\"sequence\":\"",
+                       s.strand, first, last, count);
+        else
+            Out_Printf(_this, "strand\tbegin\tend\tlength\tsequence\n%c\t%lu\t%lu\t%lu\t", s.strand, first, last, count);
+        WriteSymbols(_this, &s, false, bases, 0, count, 0, false);
+        Out_Puts(_this, json ? "\"}\n" : "\n");
+        break;
+    }
+    default:
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: unknown print format 0x%x", flags & DNA_PRINT_FORMAT_MASK);
+        break;
+    }
+    Out_CloseStrand(_this, &s);
+}
+
+/**
+ * @brief Print Genetics_FindStart() result as JSON, TSV or a binary GENETICS_BINARY_START record
+ */
+void Format_PrintStart(GeneticsObj *_this, DNA_PRINT_FlAGS flags, bool found)
+{
+    if (_this->dnaDir == DNA_DIR_3_TO_5)
+        flags ^= DNA_PRINT_REVERSE;
+    char strand = (flags & DNA_PRINT_REVERSE) ? '-' : '+';
+    size_t offset = 0, codon_start = 0;
+    if (found)
+    {
+        codon_start = _this->start_codon;
+        if (flags & DNA_PRINT_REVERSE)
+            offset = _this->inputFileOffset + 1 + _this->dnaSize - _this->start_codon;
+        else
+            offset = _this->inputFileOffset + _this->start_codon;
+    }
+    switch (flags & DNA_PRINT_FORMAT_MASK)
+    {
+    case DNA_PRINT_FORMAT_BINARY:
+        WriteBinaryHeader(_this, GENETICS_BINARY_START, strand, offset, codon_start);
+        break;
+    case DNA_PRINT_FORMAT_JSON:
+        Out_Printf(_this, "{\"type\":\"start\",\"found\":%s,\"strand\":\"%c\",\"codon_start\":%lu,\"offset\":%lu}\n",
+                   found ? "true" : "false", strand, codon_start, offset);
+        break;
+    case DNA_PRINT_FORMAT_TSV:
+        Out_Printf(_this, "found\tstrand\tcodon_start\toffset\n%d\t%c\t%lu\t%lu\n", found, strand, codon_start, offset);
+        break;
+    }
+}
@@ -0,0 +1,236 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define PEPTIDE_CHUNK 4096  // codons translated per chunk
+#define PEPTIDE_LETTERS 27  // 'A'..'Z', stop at 26
+
+/**
+ * @brief bit-parallel (shift-and) matcher with up to k substitutions.
+ *        Bit i of state[j] is set when the query prefix of length i + 1 ends at the last letter
+ *        with at most j mismatches.
+ */
+typedef struct _PeptideMatcher
+{
+    uint64_t mask[PEPTIDE_LETTERS]; // bit i set if query letter i matches the letter
+    uint64_t state[PEPTIDE_MAX_LENGTH];
+    uint64_t accept;                // bit of the last query letter
+    size_t length;
+    int mismatches;
+} PeptideMatcher;
+
+typedef struct _PeptideSearch
+{
+    GeneticsPeptideCallback callback;
+    void *ctx;
+    int format;         // DNA_PRINT_FORMAT_TEXT, JSON or TSV
+    size_t hits;
+} PeptideSearch;
+
+static inline int PeptideLetter(char c)
+{
+    return c == '*' ? 26 : c - 'A';
+}
+
+/**
+ * @brief build the letter masks; 'X' in the query matches any amino acid
+ *
+ * @return false if the query is not a valid peptide
+ */
+static bool Matcher_Init(GeneticsObj *_this, PeptideMatcher *m, const char *peptide, int mismatches)
+{
+    memset(m, 0, sizeof(PeptideMatcher));
+    m->length = strlen(peptide);
+    m->mismatches = mismatches;
+    if (m->length == 0 || m->length > PEPTIDE_MAX_LENGTH)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: peptide length must be 1 to %d", PEPTIDE_MAX_LENGTH);
+        return false;
+    }
+    if (mismatches < 0 || (size_t)mismatches >= m->length)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: peptide mismatches must be 0 to %lu", m->length - 1);
+        return false;
+    }
+    for (size_t i = 0; i < m->length; i++)
+    {
+        char c = toupper((unsigned char)peptide[i]);
+        if (c == 'X')
+        {
+            for (int a = 0; a < PEPTIDE_LETTERS; a++)
+                m->mask[a] |= 1ULL << i;
+        }
+        else if (c == '*' || (c >= 'A' && c <= 'Z'))
+            m->mask[PeptideLetter(c)] |= 1ULL << i;
+        else
+        {
+            Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: invalid amino acid '%c' in peptide", peptide[i]);
+            return false;
+        }
+    }
+    m->accept = 1ULL << (m->length - 1);
+    return true;
+}
+
+/**
+ * @brief feed one letter
+ *
+ * @return mismatches of the query ending at this letter, -1 if no match
+ */
+static inline int Matcher_Step(PeptideMatcher *m, char c)
+{
+    uint64_t mask = m->mask[PeptideLetter(c)];
+    uint64_t prev = m->state[0];
+    m->state[0] = ((prev << 1) | 1) & mask;
+    int found = (m->state[0] & m->accept) ? 0 : -1;
+    for (int j = 1; j <= m->mismatches; j++)
+    {
+        uint64_t cur = m->state[j];
+        m->state[j] = (((cur << 1) | 1) & mask) | ((prev << 1) | 1); // match or substitution
+        if (found < 0 && (m->state[j] & m->accept))
+            found = j;
+        prev = cur;
+    }
+    return found;
+}
+
+static void PrintHit(GeneticsObj *_this, PeptideSearch *search, const GeneticsPeptideHit *hit, size_t length)
+{
+    switch (search->format)
+    {
+    case DNA_PRINT_FORMAT_JSON:
+        Out_Printf(_this, "%s{\"frame\":%d,\"begin\":%lu,\"end\":%lu,\"mismatches\":%d,\"peptide\":\"%.*s\"}",
+                   search->hits ? "," : "", hit->frame, hit->begin, hit->end, hit->mismatches, (int)length,
+                   hit->peptide);
+        break;
+    case DNA_PRINT_FORMAT_TSV:
+        Out_Printf(_this, "%+d\t%lu\t%lu\t%d\t%.*s\n", hit->frame, hit->begin, hit->end, hit->mismatches,
+                   (int)length, hit->peptide);
+        break;
+    default:
+        Out_Printf(_this, "frame %+d %lu-%lu mismatches %d %.*s\n", hit->frame, hit->begin, hit->end,
+                   hit->mismatches, (int)length, hit->peptide);
+        break;
+    }
+}
+
+/**
+ * @brief translate a frame in chunks and run the matcher over the translation.
+ *        The last length - 1 letters of a chunk are kept in front of the next one for the hit text.
+ */
+static void SearchFrame(GeneticsObj *_this, PeptideSearch *search, PeptideMatcher *m, const OutStrand *s,
+                        const char map[64], int frame, char *buffer)
+{
+    memset(m->state, 0, sizeof(m->state));
+    size_t codons = s->size / 3, keep = 0;
+    for (size_t first = 0; first < codons; first += PEPTIDE_CHUNK)
+    {
+        size_t n = codons - first < PEPTIDE_CHUNK ? codons - first : PEPTIDE_CHUNK;
+        char *text = buffer + keep;
+        _this->kernels->translate(text, Out_StrandRead(_this, s, 3 * first, 3 * n), n, map);
+        Out_PatchMasks(s, text, true, first, n);
+        for (size_t i = 0; i < n; i++)
+        {
+            if (text[i] == 'X')
+            { // skipped mask (translation tables have no X): no hit spans it
+                memset(m->state, 0, sizeof(m->state));
+                continue;
+            }
+            int mismatches = Matcher_Step(m, text[i]);
+            if (mismatches < 0)
+                continue;
+            size_t last = first + i;
+            GeneticsPeptideHit hit = {frame, Out_StrandOffset(s, 3 * (last + 1 - m->length)),
+                                      Out_StrandOffset(s, 3 * last + 2), mismatches,
+                                      text + i + 1 - m->length};
+            if (search->callback)
+                search->callback(search->ctx, &hit);
+            else
+                PrintHit(_this, search, &hit, m->length);
+            search->hits++;
+        }
+        size_t tail = keep + n < m->length - 1 ? keep + n : m->length - 1;
+        memmove(buffer, buffer + keep + n - tail, tail);
+        keep = tail;
+    }
+    STATS_ADD(&_this->stats, codons, codons);
+}
+
+static size_t SearchPeptide(GeneticsObj *_this, const char *peptide, int mismatches, DNA_PRINT_FlAGS flags,
+                            GeneticsPeptideCallback callback, void *ctx)
+{
+    PeptideMatcher m;
+    if (!Matcher_Init(_this, &m, peptide, mismatches))
+        return 0;
+    PeptideSearch search = {callback, ctx, flags & DNA_PRINT_FORMAT_MASK, 0};
+    if (search.format != DNA_PRINT_FORMAT_JSON && search.format != DNA_PRINT_FORMAT_TSV)
+        search.format = DNA_PRINT_FORMAT_TEXT;
+    if (!callback && search.format == DNA_PRINT_FORMAT_JSON)
+        Out_Printf(_this, "{\"type\":\"peptide\",\"query\":\"%s\",\"mismatches\":%d,\"hits\":[", peptide, mismatches);
+    else if (!callback && search.format == DNA_PRINT_FORMAT_TSV)
+        Out_Puts(_this, "frame\tbegin\tend\tmismatches\tpeptide\n");
+
+    char *buffer = Mem_Alloc(_this, PEPTIDE_CHUNK + PEPTIDE_MAX_LENGTH);
+    for (int strand = 0; strand < 2; strand++)
+    {
+        OutStrand s;
+        Out_OpenStrand(_this, strand ? DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT : 0, &s);
+        char map[64];
+        uint8_t cx = s.complement ? 0x2A : 0;
+        for (int c = 0; c < 64; c++)
+            map[c] = _this->transl->transl[c ^ cx];
+        for (int f = 0; f < 3 && (size_t)f < s.size; f++)
+        {
+            OutStrand fs = s; // frame f starts f bases after codon_start
+            fs.seq += f * s.step;
+            fs.origin += f * s.step;
+            fs.size -= f;
+            fs.maskShift = f;
+            SearchFrame(_this, &search, &m, &fs, map, strand ? -(f + 1) : f + 1, buffer);
+        }
+        Out_CloseStrand(_this, &s);
+    }
+    Mem_Free(_this, buffer, PEPTIDE_CHUNK + PEPTIDE_MAX_LENGTH);
+
+    if (!callback && search.format == DNA_PRINT_FORMAT_JSON)
+        Out_Puts(_this, "]}\n");
+    else if (!callback && search.format == DNA_PRINT_FORMAT_TEXT)
+        Out_Printf(_this, "peptide %s: %lu hits with at most %d mismatches\n", peptide, search.hits, mismatches);
+    return search.hits;
+}
+
+/**
+ * @brief Search a peptide in the six frame translation of the loaded sequence (frames start at
+ *        codon_start, spliced introns are removed) with up to mismatches amino acid substitutions.
+ *        The translation is produced in chunks and scanned with a bit-parallel matcher.
+ *        'X' in the query matches any amino acid, '*' matches a stop codon.
+ *
+ * @param _this      genetics object
+ * @param peptide    query, 1 to PEPTIDE_MAX_LENGTH amino acid letters
+ * @param mismatches maximum substitutions, less than the query length
+ * @param flags      DNA_PRINT_FORMAT_JSON or DNA_PRINT_FORMAT_TSV to print hits as records (text otherwise)
+ * @param callback   called for every hit instead of printing (can be NULL)
+ * @param ctx        passed to the callback
+ * @return number of hits
+ */
+size_t Genetics_SearchPeptide(GeneticsObj *_this, const char *peptide, int mismatches, DNA_PRINT_FlAGS flags,
+                              GeneticsPeptideCallback callback, void *ctx)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_PEPTIDE);
+    size_t hits = SearchPeptide(_this, peptide, mismatches, flags, callback, ctx);
+    Out_Flush(_this);
+    STATS_END();
+    return hits;
+}
@@ -0,0 +1,241 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "reader.h"
+
+#define READER_ALIGN 4096
+
+typedef struct _ReaderBuffer
+{
+    char *data;
+    size_t size;
+} ReaderBuffer;
+
+struct _GeneticsReader
+{
+    GeneticsAllocator allocator;
+    size_t ringSize;
+    int fd;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t freed;
+    ReaderBuffer *ring;
+    int buffers;
+    size_t bufferSize;
+    int head;       // next buffer filled by the reader thread
+    int tail;       // next buffer consumed by Reader_Next()
+    int count;      // filled buffers not yet released by the consumer
+    bool holding;   // consumer holds ring[tail - 1] until next call
+    bool eof;
+    bool cancel;
+    int error;
+};
+
+static void *ReaderThread(void *arg)
+{
+    GeneticsReader *reader = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&reader->lock);
+        while (!reader->cancel && reader->count == reader->buffers)
+            pthread_cond_wait(&reader->freed, &reader->lock);
+        bool cancel = reader->cancel;
+        pthread_mutex_unlock(&reader->lock);
+        if (cancel)
+            break;
+
+        // the slot at head is not visible to the consumer until count is incremented
+        ReaderBuffer *buf = &reader->ring[reader->head];
+        size_t size = 0;
+        int error = 0;
+        while (size < reader->bufferSize)
+        {
+            ssize_t n = read(reader->fd, buf->data + size, reader->bufferSize - size);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                error = errno;
+                break;
+            }
+            if (n == 0)
+                break;
+            size += n;
+        }
+        buf->size = size;
+
+        pthread_mutex_lock(&reader->lock);
+        if (size > 0)
+        {
+            reader->head = (reader->head + 1) % reader->buffers;
+            reader->count++;
+        }
+        if (size < reader->bufferSize)
+        {
+            reader->eof = true;
+            reader->error = error;
+        }
+        bool eof = reader->eof;
+        pthread_cond_signal(&reader->filled);
+        pthread_mutex_unlock(&reader->lock);
+        if (eof)
+            break;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Create a reader. Ring buffers are allocated once and reused by every Reader_Start()
+ *
+ * @param allocator  allocator for the reader and its buffers
+ * @param bufferSize size of each ring buffer (rounded up to page size)
+ * @param buffers    number of ring buffers (at least 2)
+ * @return GeneticsReader* reader or NULL if out of memory
+ */
+GeneticsReader *Reader_New(const GeneticsAllocator *allocator, size_t bufferSize, int buffers)
+{
+    if (buffers < 2)
+        buffers = 2;
+    bufferSize = (bufferSize + READER_ALIGN - 1) & ~(size_t)(READER_ALIGN - 1);
+
+    GeneticsReader *reader = (GeneticsReader *)allocator->alloc(allocator->ctx, sizeof(GeneticsReader));
+    if (!reader)
+        return NULL;
+    memset(reader, 0, sizeof(GeneticsReader));
+    reader->allocator = *allocator;
+    reader->fd = -1;
+    reader->buffers = buffers;
+    reader->bufferSize = bufferSize;
+    reader->ringSize = buffers * sizeof(ReaderBuffer) + buffers * bufferSize + READER_ALIGN;
+    reader->ring = (ReaderBuffer *)allocator->alloc(allocator->ctx, reader->ringSize);
+    if (!reader->ring)
+    {
+        allocator->free(allocator->ctx, reader, sizeof(GeneticsReader));
+        return NULL;
+    }
+    uintptr_t data = (uintptr_t)(reader->ring + buffers);
+    data = (data + READER_ALIGN - 1) & ~(uintptr_t)(READER_ALIGN - 1);
+    for (int i = 0; i < buffers; i++)
+        reader->ring[i].data = (char *)data + i * bufferSize;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->filled, NULL);
+    pthread_cond_init(&reader->freed, NULL);
+    return reader;
+}
+
+/**
+ * @brief Open a file and start the reader thread
+ *
+ * @param reader   reader created with Reader_New()
+ * @param filename file name
+ * @return false on error (errno is set)
+ */
+bool Reader_Start(GeneticsReader *reader, const char *filename)
+{
+    if (reader->fd >= 0)
+        Reader_Stop(reader);
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    reader->fd = fd;
+    reader->head = reader->tail = reader->count = 0;
+    reader->holding = reader->eof = reader->cancel = false;
+    reader->error = 0;
+    int err = pthread_create(&reader->thread, NULL, ReaderThread, reader);
+    if (err)
+    {
+        close(fd);
+        reader->fd = -1;
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Get next filled buffer. The previous buffer is released back to the reader thread.
+ *
+ * @param reader reader opened with Reader_Open()
+ * @param size   filled with the buffer size
+ * @return const char* buffer data or NULL at end of file or error
+ */
+const char *Reader_Next(GeneticsReader *reader, size_t *size)
+{
+    pthread_mutex_lock(&reader->lock);
+    if (reader->holding)
+    {
+        reader->holding = false;
+        reader->count--;
+        pthread_cond_signal(&reader->freed);
+    }
+    while (reader->count == 0 && !reader->eof)
+        pthread_cond_wait(&reader->filled, &reader->lock);
+    const char *data = NULL;
+    if (reader->count > 0)
+    {
+        ReaderBuffer *buf = &reader->ring[reader->tail];
+        reader->tail = (reader->tail + 1) % reader->buffers;
+        reader->holding = true;
+        data = buf->data;
+        *size = buf->size;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return data;
+}
+
+/**
+ * @brief Get read error
+ *
+ * @return int 0 or errno of the failed read
+ */
+int Reader_Error(GeneticsReader *reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    int error = reader->error;
+    pthread_mutex_unlock(&reader->lock);
+    return error;
+}
+
+/**
+ * @brief Stop the reader thread (even if the file was not read entirely) and close the file
+ */
+void Reader_Stop(GeneticsReader *reader)
+{
+    if (reader->fd < 0)
+        return;
+    pthread_mutex_lock(&reader->lock);
+    reader->cancel = true;
+    pthread_cond_signal(&reader->freed);
+    pthread_mutex_unlock(&reader->lock);
+    pthread_join(reader->thread, NULL);
+    close(reader->fd);
+    reader->fd = -1;
+}
+
+/**
+ * @brief Stop reading and free the reader
+ */
+void Reader_Delete(GeneticsReader *reader)
+{
+    Reader_Stop(reader);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->filled);
+    pthread_cond_destroy(&reader->freed);
+    GeneticsAllocator allocator = reader->allocator;
+    allocator.free(allocator.ctx, reader->ring, reader->ringSize);
+    allocator.free(allocator.ctx, reader, sizeof(GeneticsReader));
+}
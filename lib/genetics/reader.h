@@ -0,0 +1,19 @@
+#pragma once
+
+/**
+ * @brief Asynchronous file reader (internal)
+ *        A reader thread fills a bounded ring of large aligned buffers
+ *        while the caller consumes the previously filled one.
+ *        A reader is reused for many files: Reader_Start() ... Reader_Next() ... Reader_Stop()
+ */
+typedef struct _GeneticsReader GeneticsReader;
+
+#define READER_BUFFER_SIZE (4 * 1024 * 1024)
+#define READER_BUFFERS     4
+
+GeneticsReader *Reader_New(const GeneticsAllocator *allocator, size_t bufferSize, int buffers);
+bool Reader_Start(GeneticsReader *reader, const char *filename);
+const char *Reader_Next(GeneticsReader *reader, size_t *size);
+int Reader_Error(GeneticsReader *reader);
+void Reader_Stop(GeneticsReader *reader);
+void Reader_Delete(GeneticsReader *reader);
@@ -0,0 +1,277 @@
+#include <config.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief process wide cache of loaded FASTA references: objects with the cache enabled that
+ *        load the same file (path, device, inode, size and mtime), record search and region
+ *        share one read only sequence (Genetics_ShareDNA()) instead of parsing their own copy.
+ *        Entries are reference counted by the objects using them; unused entries are kept
+ *        for the next load, the least recently used ones are freed past REFCACHE_UNUSED_MAX.
+ *        An entry whose load failed is freed once the loads waiting for it are done.
+ */
+#define REFCACHE_UNUSED_MAX 4
+
+struct _GeneticsRefEntry
+{
+    GeneticsRefEntry *next;
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char *search;
+    size_t start, stop;
+    GeneticsObj *obj;   // owner of the sequence, not changed once loaded
+    char *log;          // loader output, replayed to every object using the entry
+    size_t logSize;
+    int refs;           // objects using the entry, loads waiting for it included
+    bool loading;
+    bool failed;        // the load reported an error, objects load the file themselves
+    uint64_t lastUse;
+};
+
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t loaded;
+    GeneticsRefEntry *entries;
+    uint64_t clock;
+} Cache = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0};
+
+static bool Matches(const GeneticsRefEntry *e, const char *path, const struct stat *st, size_t start, size_t stop,
+                    const char *search)
+{
+    return !e->failed && e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec && e->start == start &&
+           e->stop == stop && !strcmp(e->path, path) && !strcmp(e->search, search);
+}
+
+static void FreeEntry(GeneticsRefEntry *e)
+{
+    if (e->obj)
+        Genetics_Delete(e->obj);
+    free(e->path);
+    free(e->search);
+    free(e->log);
+    free(e);
+}
+
+/**
+ * @brief unlink and free the unused entries: all, or the least recently used ones past keep (lock held)
+ */
+static void Trim(int keep)
+{
+    for (;;)
+    {
+        int unused = 0;
+        GeneticsRefEntry **oldest = NULL;
+        for (GeneticsRefEntry **pe = &Cache.entries; *pe; pe = &(*pe)->next)
+        {
+            if ((*pe)->refs > 0)
+                continue;
+            unused++;
+            if (!oldest || (*pe)->lastUse < (*oldest)->lastUse)
+                oldest = pe;
+        }
+        if (unused <= keep)
+            return;
+        GeneticsRefEntry *e = *oldest;
+        *oldest = e->next;
+        FreeEntry(e);
+    }
+}
+
+/**
+ * @brief drop a reference (lock held): a failed entry is freed with its last one, it never matches again
+ */
+static void Unref(GeneticsRefEntry *e)
+{
+    if (--e->refs > 0)
+        return;
+    if (e->failed)
+    {
+        GeneticsRefEntry **pe = &Cache.entries;
+        while (*pe != e)
+            pe = &(*pe)->next;
+        *pe = e->next;
+        FreeEntry(e);
+        return;
+    }
+    e->lastUse = ++Cache.clock;
+    Trim(REFCACHE_UNUSED_MAX);
+}
+
+/**
+ * @brief load the entry sequence into its own object, output kept as log (lock not held: only the
+ *        loading thread uses obj and log until loading is cleared)
+ *
+ * @return false if the load failed, the caller sets failed under the lock
+ */
+static bool LoadEntry(GeneticsRefEntry *e, const GeneticsObj *user)
+{
+    FILE *log = open_memstream(&e->log, &e->logSize);
+    e->obj = Genetics_New();
+    if (!log || !e->obj)
+    {
+        if (log)
+            fclose(log);
+        return false;
+    }
+    Genetics_SetOutput(e->obj, log);
+    Genetics_SetLoadThreads(e->obj, user->loadThreads);
+    Genetics_LoadFASTA(e->obj, e->start, e->stop, e->path, e->search);
+    Genetics_SetOutput(e->obj, NULL);
+    fclose(log);
+    return Genetics_LastError(e->obj) == NULL;
+}
+
+/**
+ * @brief Genetics_LoadFASTA() through the cache
+ *
+ * @return false if the file can not be cached (missing, or its load reports an error): load it directly
+ */
+bool RefCache_LoadFASTA(GeneticsObj *_this, size_t start, size_t stop, const char *filename, const char *search)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    pthread_mutex_lock(&Cache.lock);
+    GeneticsRefEntry *e = Cache.entries;
+    while (e && !Matches(e, filename, &st, start, stop, search))
+        e = e->next;
+    if (e)
+    {
+        e->refs++;
+        while (e->loading)
+            pthread_cond_wait(&Cache.loaded, &Cache.lock);
+    }
+    else if ((e = calloc(1, sizeof(GeneticsRefEntry))) && (e->path = strdup(filename)) && (e->search = strdup(search)))
+    {
+        e->dev = st.st_dev;
+        e->ino = st.st_ino;
+        e->size = st.st_size;
+        e->mtime = st.st_mtim;
+        e->start = start;
+        e->stop = stop;
+        e->refs = 1;
+        e->loading = true;
+        e->next = Cache.entries;
+        Cache.entries = e;
+        pthread_mutex_unlock(&Cache.lock); // other files load meanwhile, the same one waits
+        bool loaded = LoadEntry(e, _this);
+        pthread_mutex_lock(&Cache.lock);
+        e->failed = !loaded;
+        e->loading = false;
+        pthread_cond_broadcast(&Cache.loaded);
+    }
+    else
+    {
+        if (e)
+            FreeEntry(e);
+        pthread_mutex_unlock(&Cache.lock);
+        return false;
+    }
+    if (e->failed)
+    {
+        Unref(e);
+        pthread_mutex_unlock(&Cache.lock);
+        return false;
+    }
+    pthread_mutex_unlock(&Cache.lock);
+    Genetics_ShareDNA(_this, e->obj);
+    _this->reference = e; // the reference taken above
+    Out_Write(_this, e->log, e->logSize);
+    return true;
+}
+
+/**
+ * @brief one more reference to the entry of an object, see Genetics_ShareDNA()
+ */
+GeneticsRefEntry *RefCache_Acquire(GeneticsRefEntry *e)
+{
+    if (e)
+    {
+        pthread_mutex_lock(&Cache.lock);
+        e->refs++;
+        pthread_mutex_unlock(&Cache.lock);
+    }
+    return e;
+}
+
+/**
+ * @brief drop the entry used by the object (its sequence is replaced or the object deleted)
+ */
+void RefCache_Release(GeneticsObj *_this)
+{
+    if (!_this->reference)
+        return;
+    pthread_mutex_lock(&Cache.lock);
+    Unref(_this->reference);
+    pthread_mutex_unlock(&Cache.lock);
+    _this->reference = NULL;
+}
+
+/**
+ * @brief Load FASTA files through the process wide reference cache: objects loading the same
+ *        file, search and region share one read only sequence; codon_start, splice data and
+ *        the other settings stay per object. An entry is reloaded when the file size or mtime changes.
+ *
+ * @param _this  genetics object
+ * @param enable true to use the cache for the next Genetics_LoadFASTA()
+ */
+void Genetics_SetReferenceCache(GeneticsObj *_this, bool enable)
+{
+    _this->refCache = enable;
+}
+
+bool Genetics_GetReferenceCache(GeneticsObj *_this)
+{
+    return _this->refCache;
+}
+
+/**
+ * @brief Free the cached references no object uses
+ */
+void Genetics_ClearReferenceCache(void)
+{
+    pthread_mutex_lock(&Cache.lock);
+    Trim(0);
+    pthread_mutex_unlock(&Cache.lock);
+}
+
+/**
+ * @brief Print the cached references: file, search, region, objects using it and size
+ *
+ * @param _this genetics object
+ */
+void Genetics_PrintReferenceCache(GeneticsObj *_this)
+{
+    size_t entries = 0, bp = 0;
+    pthread_mutex_lock(&Cache.lock);
+    for (GeneticsRefEntry *e = Cache.entries; e; e = e->next)
+    {
+        if (e->loading || e->failed)
+            continue;
+        Out_Printf(_this, "reference '%s' search '%s' region %lu-%lu: %d users, %lu bp\n", e->path, e->search,
+                   e->start, e->stop, e->refs, e->obj->dnaSize);
+        entries++;
+        bp += e->obj->dnaSize;
+    }
+    pthread_mutex_unlock(&Cache.lock);
+    Out_Printf(_this, "reference cache: %lu entries, %lu bp\n", entries, bp);
+    Out_Flush(_this);
+}
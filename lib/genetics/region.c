@@ -0,0 +1,351 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief object state replaced while working on a region
+ */
+typedef struct _RegionView
+{
+    uint8_t *dna;
+    size_t dnaSize;
+    size_t inputFileOffset;
+    size_t start_codon;
+    bool dnaView;
+} RegionView;
+
+/**
+ * @brief restrict the object to the loaded bases with file offsets [begin, end] (1 based, inclusive).
+ *        The region is clipped to the loaded sequence. codon_start is 1 in the region.
+ *
+ * @return false if the region has no loaded base
+ */
+static bool Region_Enter(GeneticsObj *_this, size_t begin, size_t end, RegionView *saved)
+{
+    size_t first = _this->inputFileOffset + 1, last = _this->inputFileOffset + _this->dnaSize;
+    if (begin < first)
+        begin = first;
+    if (end > last)
+        end = last;
+    if (_this->dnaSize == 0 || begin > end)
+        return false;
+    saved->dna = _this->dna;
+    saved->dnaSize = _this->dnaSize;
+    saved->inputFileOffset = _this->inputFileOffset;
+    saved->start_codon = _this->start_codon;
+    saved->dnaView = _this->dnaView;
+    _this->dnaView = true;
+    _this->dna += begin - first;
+    _this->dnaSize = end - begin + 1;
+    _this->inputFileOffset = begin - 1;
+    _this->start_codon = 1;
+    return true;
+}
+
+static void Region_Leave(GeneticsObj *_this, const RegionView *saved)
+{
+    _this->dna = saved->dna;
+    _this->dnaSize = saved->dnaSize;
+    _this->inputFileOffset = saved->inputFileOffset;
+    _this->start_codon = saved->start_codon;
+    _this->dnaView = saved->dnaView;
+}
+
+/**
+ * @brief file offset of the first base of the start codon after Genetics_FindStart()
+ */
+static size_t StartOffset(GeneticsObj *_this, DNA_PRINT_FlAGS flags)
+{
+    if (((flags & DNA_PRINT_REVERSE) != 0) != (_this->dnaDir == DNA_DIR_3_TO_5))
+        return _this->inputFileOffset + 1 + _this->dnaSize - _this->start_codon;
+    return _this->inputFileOffset + _this->start_codon;
+}
+
+static void RegionError(GeneticsObj *_this, size_t begin, size_t end)
+{
+    Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: region %lu-%lu is outside the loaded sequence %lu-%lu", begin,
+              end, _this->inputFileOffset + 1, _this->inputFileOffset + _this->dnaSize);
+}
+
+/**
+ * @brief Print a region of the loaded sequence, see Genetics_PrintDNA()
+ *
+ * @param _this genetics object
+ * @param begin first base file offset (1 based)
+ * @param end   last base file offset (inclusive)
+ * @param flags print flags
+ * @return false if the region is outside the loaded sequence
+ */
+bool Genetics_PrintRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags)
+{
+    RegionView saved;
+    if (!Region_Enter(_this, begin, end, &saved))
+    {
+        RegionError(_this, begin, end);
+        return false;
+    }
+    Genetics_PrintDNA(_this, flags);
+    Region_Leave(_this, &saved);
+    return true;
+}
+
+/**
+ * @brief Find the first start codon of a region, see Genetics_FindStart(). codon_start is not changed.
+ *
+ * @param _this  genetics object
+ * @param begin  first base file offset (1 based)
+ * @param end    last base file offset (inclusive)
+ * @param flags  find flags
+ * @param offset filled with the file offset of the first base of the start codon (can be NULL)
+ * @return true if found
+ */
+bool Genetics_FindStartInRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags, size_t *offset)
+{
+    RegionView saved;
+    if (!Region_Enter(_this, begin, end, &saved))
+    {
+        RegionError(_this, begin, end);
+        return false;
+    }
+    bool found = Genetics_FindStart(_this, flags);
+    if (found && offset)
+        *offset = StartOffset(_this, flags);
+    Region_Leave(_this, &saved);
+    return found;
+}
+
+/**
+ * @brief Codon usage of a region, see Genetics_CodonUsage()
+ *
+ * @param _this genetics object
+ * @param begin first base file offset (1 based)
+ * @param end   last base file offset (inclusive)
+ * @param flags DNA_PRINT_REVERSE: primary frame on the reverse strand
+ * @param cu    filled with codon usage
+ * @return false if the region is outside the loaded sequence or has no codon
+ */
+bool Genetics_CodonUsageInRegion(GeneticsObj *_this, size_t begin, size_t end, DNA_PRINT_FlAGS flags,
+                                 GeneticsCodonUsage *cu)
+{
+    RegionView saved;
+    if (!Region_Enter(_this, begin, end, &saved))
+    {
+        RegionError(_this, begin, end);
+        return false;
+    }
+    bool ret = Genetics_CodonUsage(_this, flags, cu);
+    Region_Leave(_this, &saved);
+    return ret;
+}
+
+typedef struct _BedRegion
+{
+    size_t begin;   // file offset, 1 based
+    size_t end;     // inclusive
+    size_t name;    // offset in the names pool
+} BedRegion;
+
+typedef struct _BedRegions
+{
+    BedRegion *regions;
+    size_t count;
+    size_t alloc;
+    char *names;
+    size_t namesSize;
+    size_t namesAlloc;
+    size_t skipped;
+} BedRegions;
+
+static int CompareBedRegions(const void *a, const void *b)
+{
+    const BedRegion *ra = a, *rb = b;
+    if (ra->begin != rb->begin)
+        return ra->begin < rb->begin ? -1 : 1;
+    if (ra->end != rb->end)
+        return ra->end < rb->end ? -1 : 1;
+    return 0;
+}
+
+/**
+ * @brief parse a BED line [p, end): chrom chromStart chromEnd [name ...], 0 based half open coordinates.
+ *        Lines of other chromosomes than the loaded sequence are skipped.
+ */
+static void ParseBEDLine(GeneticsObj *_this, BedRegions *bed, const char *p, const char *end)
+{
+    while (end > p && (end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    if (p == end || *p == '#' || (end - p >= 5 && (!strncmp(p, "track", 5) || !strncmp(p, "brows", 5))))
+        return;
+    const char *field[4];
+    size_t length[4];
+    int n = 0;
+    while (n < 4 && p < end)
+    {
+        field[n] = p;
+        while (p < end && *p != '\t' && *p != ' ')
+            p++;
+        length[n] = p - field[n];
+        n++;
+        while (p < end && (*p == '\t' || *p == ' '))
+            p++;
+    }
+    if (n < 3 || !isdigit((unsigned char)*field[1]) || !isdigit((unsigned char)*field[2]))
+    {
+        bed->skipped++;
+        return;
+    }
+    if (_this->seqName[0] && (strlen(_this->seqName) != length[0] || strncmp(_this->seqName, field[0], length[0])))
+        return; // other chromosome
+    size_t begin = strtoul(field[1], NULL, 10), stop = strtoul(field[2], NULL, 10);
+    if (stop <= begin)
+    {
+        bed->skipped++;
+        return;
+    }
+    if (bed->count == bed->alloc)
+    {
+        size_t alloc = bed->alloc ? 2 * bed->alloc : 1024;
+        bed->regions = Mem_Realloc(_this, bed->regions, bed->alloc * sizeof(BedRegion), alloc * sizeof(BedRegion));
+        bed->alloc = alloc;
+    }
+    size_t nameSize = n > 3 ? length[3] : 0;
+    if (bed->namesSize + nameSize + 1 > bed->namesAlloc)
+    {
+        size_t alloc = 2 * (bed->namesSize + nameSize + 1) + 4096;
+        bed->names = Mem_Realloc(_this, bed->names, bed->namesAlloc, alloc);
+        bed->namesAlloc = alloc;
+    }
+    BedRegion *region = &bed->regions[bed->count++];
+    region->begin = begin + 1;
+    region->end = stop;
+    region->name = bed->namesSize;
+    if (nameSize)
+        memcpy(bed->names + bed->namesSize, field[3], nameSize);
+    bed->names[bed->namesSize + nameSize] = 0;
+    bed->namesSize += nameSize + 1;
+}
+
+static bool LoadBED(GeneticsObj *_this, const char *filename, BedRegions *bed)
+{
+    GeneticsReader *reader = Obj_Reader(_this);
+    if (!reader || !Reader_Start(reader, filename))
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening bed file '%s'", filename);
+        return false;
+    }
+    char *line = NULL; // line split between buffers
+    size_t lineSize = 0, lineAlloc = 0;
+    const char *chunk;
+    size_t size;
+    while (NULL != (chunk = Reader_Next(reader, &size)))
+    {
+        STATS_ADD(&_this->stats, bytes_read, size);
+        const char *p = chunk, *end = chunk + size;
+        while (p < end)
+        {
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol : end;
+            if (eol && lineSize == 0)
+            {
+                ParseBEDLine(_this, bed, p, lineEnd);
+            }
+            else
+            {
+                size_t n = lineEnd - p;
+                if (lineSize + n > lineAlloc)
+                {
+                    line = Mem_Realloc(_this, line, lineAlloc, 2 * (lineSize + n));
+                    lineAlloc = 2 * (lineSize + n);
+                }
+                memcpy(line + lineSize, p, n);
+                lineSize += n;
+                if (eol)
+                {
+                    ParseBEDLine(_this, bed, line, line + lineSize);
+                    lineSize = 0;
+                }
+            }
+            p = eol ? eol + 1 : end;
+        }
+    }
+    if (lineSize)
+        ParseBEDLine(_this, bed, line, line + lineSize);
+    Mem_Free(_this, line, lineAlloc);
+    int error = Reader_Error(reader);
+    if (error)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error reading bed file '%s'", filename);
+    Reader_Stop(reader);
+    return true;
+}
+
+/**
+ * @brief Run a command on every region of a BED file (chrom chromStart chromEnd [name]).
+ *        Regions of other chromosomes than the loaded FASTA sequence are ignored.
+ *        Regions are sorted by position and processed in one pass over the loaded sequence.
+ *
+ * @param _this    genetics object
+ * @param filename BED file name
+ * @param op       GENETICS_REGION_PRINT or GENETICS_REGION_FIND_START
+ * @param flags    print / find flags; in text format each region is preceded by a "region" line
+ * @return number of regions processed
+ */
+size_t Genetics_RegionsBED(GeneticsObj *_this, const char *filename, GENETICS_REGION_OP op, DNA_PRINT_FlAGS flags)
+{
+    BedRegions bed;
+    memset(&bed, 0, sizeof(bed));
+    if (!LoadBED(_this, filename, &bed))
+        return 0;
+    qsort(bed.regions, bed.count, sizeof(BedRegion), CompareBedRegions);
+
+    bool text = !(flags & DNA_PRINT_FORMAT_MASK);
+    size_t done = 0, outside = 0;
+    for (size_t i = 0; i < bed.count; i++)
+    {
+        const BedRegion *region = &bed.regions[i];
+        const char *name = bed.names + region->name;
+        RegionView saved;
+        if (!Region_Enter(_this, region->begin, region->end, &saved))
+        {
+            outside++;
+            continue;
+        }
+        if (op == GENETICS_REGION_FIND_START)
+        {
+            bool found = Genetics_FindStart(_this, flags);
+            if (text && found)
+                Out_Printf(_this, "region %s %lu-%lu start %lu\n", name, region->begin, region->end,
+                           StartOffset(_this, flags));
+            else if (text)
+                Out_Printf(_this, "region %s %lu-%lu no start\n", name, region->begin, region->end);
+        }
+        else
+        {
+            if (text)
+                Out_Printf(_this, "\nregion %s %lu-%lu", name, region->begin, region->end);
+            Genetics_PrintDNA(_this, flags);
+        }
+        Region_Leave(_this, &saved);
+        done++;
+    }
+    Out_Flush(_this);
+    if (outside || bed.skipped)
+        Obj_Error(_this, GENETICS_LEVEL_WARNING, 0,
+                  "Warning bed file '%s' : %lu regions outside the loaded sequence, %lu malformed lines skipped",
+                  filename, outside, bed.skipped);
+    Mem_Free(_this, bed.regions, bed.alloc * sizeof(BedRegion));
+    Mem_Free(_this, bed.names, bed.namesAlloc);
+    return done;
+}
@@ -0,0 +1,259 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief tandem repeats and low complexity regions of the loaded sequence, recorded as the repeat mask.
+ *        dust  : windows of GENETICS_DUST_WINDOW bases scored from their triplet counts, updated by one
+ *                triplet in and one out when the window moves, so the cost per base does not depend
+ *                on the window; windows scoring above the level are masked
+ *        tandem: runs of bases equal to the base one period (1..GENETICS_REPEAT_MAX_PERIOD) before
+ *        The sequence is cut in one range per thread; a thread reports the windows and runs beginning
+ *        in its range (reading past its end to finish them), the ranges are merged in order.
+ *        N runs are never read: windows and runs stop at them.
+ */
+#define REPEAT_THREAD_MIN  (1024 * 1024)    // min bases per thread (automatic thread count)
+#define REPEAT_MAX_THREADS 16
+#define DUST_TRIPLETS      (GENETICS_DUST_WINDOW - 2)
+
+typedef struct _RepeatChunk
+{
+    const GeneticsObj *obj;
+    size_t begin, end;                  // windows and runs beginning here
+    unsigned dustLevel;
+    size_t minLength;
+    GeneticsMaskList ranges;            // by detector and period, not sorted
+    const GeneticsAllocator *allocator; // shared, locked
+} RepeatChunk;
+
+/**
+ * @brief DUST windows [i, i + GENETICS_DUST_WINDOW) with from <= i < to ending by stop:
+ *        score sum c (c - 1) / 2 over the triplet counts c, masked above level * (triplets - 1).
+ *        The triplets entering and leaving the window are rolled one base at a time.
+ */
+static void Dust(RepeatChunk *c, size_t from, size_t to, size_t stop)
+{
+    const uint8_t *dna = c->obj->dna;
+    if (c->dustLevel == 0 || stop - from < GENETICS_DUST_WINDOW)
+        return;
+    if (to > stop - GENETICS_DUST_WINDOW + 1)
+        to = stop - GENETICS_DUST_WINDOW + 1;
+    uint16_t counts[64] = {0};
+    size_t sum = 0, threshold = (size_t)c->dustLevel * (DUST_TRIPLETS - 1);
+    unsigned in = CODON(0, dna[from], dna[from + 1]), out = CODON(0, dna[from], dna[from + 1]);
+    for (size_t k = from + 2; k < from + GENETICS_DUST_WINDOW; k++)
+    {
+        in = ((in << 2) | (dna[k] & 0x3)) & 0x3F;
+        sum += counts[in]++;
+    }
+    size_t open = SIZE_MAX, openEnd = 0;
+    for (size_t i = from;; i++)
+    {
+        if (sum > threshold)
+        {
+            if (open != SIZE_MAX && i > openEnd)
+            {
+                Mask_Push(c->allocator, &c->ranges, open, openEnd);
+                open = SIZE_MAX;
+            }
+            if (open == SIZE_MAX)
+                open = i;
+            openEnd = i + GENETICS_DUST_WINDOW;
+        }
+        if (i + 1 == to)
+            break;
+        out = ((out << 2) | (dna[i + 2] & 0x3)) & 0x3F;
+        sum -= --counts[out];
+        in = ((in << 2) | (dna[i + GENETICS_DUST_WINDOW] & 0x3)) & 0x3F;
+        sum += counts[in]++;
+    }
+    if (open != SIZE_MAX)
+        Mask_Push(c->allocator, &c->ranges, open, openEnd);
+}
+
+#define SAME(i, p) (!((dna[i] ^ dna[(i) + (p)]) & 0x3))
+
+/**
+ * @brief tandem repeats of period p beginning in [from, to), read up to stop: runs of bases equal to the
+ *        base p before, masked with the first copy when they have 3 copies and minLength bases.
+ *        A masked run has at least need = length - p equal bases, so one base in need is probed and
+ *        runs are only measured around the equal ones.
+ *        A run going on at from belongs to the chunk before (inside: from - 1 is a base of the same run of bases).
+ */
+static void Tandem(RepeatChunk *c, size_t p, size_t from, size_t to, size_t stop, bool inside)
+{
+    const uint8_t *dna = c->obj->dna;
+    size_t min = c->minLength > 3 * p ? c->minLength : 3 * p, need = min - p;
+    if (stop - from <= p)
+        return;
+    size_t last = stop - p; // dna[i] has a base p after for i < last
+    size_t i = from;
+    if (inside && i - 1 < last && SAME(i - 1, p))
+        while (i < last && SAME(i, p))
+            i++;
+    for (size_t probe = i + need - 1; probe < last && probe < to + need - 1;)
+    {
+        if (!SAME(probe, p))
+        {
+            i = probe + 1;
+            probe += need;
+            continue;
+        }
+        size_t run = probe, end = probe + 1;
+        while (run > i && SAME(run - 1, p))
+            run--;
+        if (run >= to)
+            return;
+        while (end < last && SAME(end, p))
+            end++;
+        if (end - run >= need)
+            Mask_Push(c->allocator, &c->ranges, run, end + p);
+        i = end;
+        probe = i + need - 1;
+    }
+}
+
+static void *RepeatChunkMain(void *arg)
+{
+    RepeatChunk *c = arg;
+    const GeneticsObj *_this = c->obj;
+    for (size_t i = c->begin; i < c->end;)
+    { // runs of bases between the N runs
+        size_t nEnd, nBegin = Mask_NextIn(_this, MASK_N, i, &nEnd);
+        if (nBegin <= i)
+        {
+            i = nEnd;
+            continue;
+        }
+        size_t stop = nBegin < _this->dnaSize ? nBegin : _this->dnaSize;
+        size_t to = stop < c->end ? stop : c->end;
+        bool inside = i == c->begin && i > 0 && !Mask_In(_this, MASK_N, i - 1);
+        Dust(c, i, to, stop);
+        for (size_t p = 1; c->minLength > 0 && p <= GENETICS_REPEAT_MAX_PERIOD; p++)
+            Tandem(c, p, i, to, stop, inside);
+        i = stop;
+    }
+    return NULL;
+}
+
+/**
+ * @brief run every chunk, chunk 0 on the calling thread
+ */
+static void RunChunks(RepeatChunk *chunks, int threads)
+{
+    pthread_t tid[REPEAT_MAX_THREADS];
+    int started = 1;
+    for (int t = 1; t < threads; t++, started++)
+        if (pthread_create(&tid[t], NULL, RepeatChunkMain, &chunks[t]))
+            break;
+    RepeatChunkMain(&chunks[0]);
+    for (int t = started; t < threads; t++)
+        RepeatChunkMain(&chunks[t]); // thread creation failed: run here
+    for (int t = 1; t < started; t++)
+        pthread_join(tid[t], NULL);
+}
+
+static int RepeatThreads(GeneticsObj *_this)
+{
+    if (_this->loadThreads > 0)
+        return _this->loadThreads < REPEAT_MAX_THREADS ? _this->loadThreads : REPEAT_MAX_THREADS;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = _this->dnaSize / REPEAT_THREAD_MIN;
+    if (cpus > 0 && threads > (size_t)cpus)
+        threads = cpus;
+    if (threads > REPEAT_MAX_THREADS)
+        threads = REPEAT_MAX_THREADS;
+    return threads < 1 ? 1 : threads;
+}
+
+static int CompareRanges(const void *a, const void *b)
+{
+    const GeneticsRange *x = a, *y = b;
+    return x->begin < y->begin ? -1 : x->begin > y->begin;
+}
+
+/**
+ * @brief Find the tandem repeats (microsatellites) and the low complexity regions of the loaded
+ *        FASTA sequence and record them as the GENETICS_MASK_REPEAT intervals, replacing the previous
+ *        ones. Select the mask with Genetics_SetMaskSkip() to step over them in find_start, scan,
+ *        translations and the peptide search. N runs are never part of a repeat.
+ *        Low complexity: windows of GENETICS_DUST_WINDOW bases whose triplet counts c give
+ *        sum c (c - 1) / 2 > dustLevel * (GENETICS_DUST_WINDOW - 3) (DUST score above dustLevel).
+ *        Tandem repeats: at least 3 copies and minLength bases of a unit of 1 to GENETICS_REPEAT_MAX_PERIOD
+ *        bases. The sequence is scanned in parallel (see Genetics_SetLoadThreads()).
+ *
+ * @param _this     genetics object
+ * @param dustLevel score threshold (GENETICS_DUST_LEVEL), 0 for no low complexity regions
+ * @param minLength shortest tandem repeat (GENETICS_REPEAT_MIN_LENGTH), 0 for no tandem repeats
+ * @return number of intervals
+ */
+size_t Genetics_MaskRepeats(GeneticsObj *_this, unsigned dustLevel, size_t minLength)
+{
+    if (_this->dnaView || _this->haplotype || _this->readCount)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: repeats are found on the loaded fasta sequence only");
+        return 0;
+    }
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_MASK_REPEATS);
+    int threads = RepeatThreads(_this);
+    LockedAllocator locked = {&_this->allocator, PTHREAD_MUTEX_INITIALIZER};
+    GeneticsAllocator allocator = Mem_Locked(&locked);
+    RepeatChunk chunks[REPEAT_MAX_THREADS];
+    for (int t = 0; t < threads; t++)
+    {
+        memset(&chunks[t], 0, sizeof(RepeatChunk));
+        chunks[t].obj = _this;
+        chunks[t].begin = _this->dnaSize / threads * t;
+        chunks[t].end = t + 1 < threads ? _this->dnaSize / threads * (t + 1) : _this->dnaSize;
+        chunks[t].dustLevel = dustLevel;
+        chunks[t].minLength = minLength;
+        chunks[t].allocator = &allocator;
+    }
+    RunChunks(chunks, threads);
+
+    size_t count = 0;
+    for (int t = 0; t < threads; t++)
+        count += chunks[t].ranges.count;
+    GeneticsRange *ranges = Mem_Alloc(_this, (count + 1) * sizeof(GeneticsRange));
+    count = 0;
+    for (int t = 0; t < threads; t++)
+    {
+        if (chunks[t].ranges.count > 0)
+            memcpy(ranges + count, chunks[t].ranges.ranges, chunks[t].ranges.count * sizeof(GeneticsRange));
+        count += chunks[t].ranges.count;
+        Mem_Free(_this, chunks[t].ranges.ranges, chunks[t].ranges.alloc * sizeof(GeneticsRange));
+    }
+    qsort(ranges, count, sizeof(GeneticsRange), CompareRanges);
+    GeneticsMaskList *l = &_this->masks[MASK_REPEAT];
+    l->count = 0;
+    for (size_t k = 0; k < count;)
+    { // overlapping ranges joined
+        GeneticsRange r = ranges[k++];
+        while (k < count && ranges[k].begin <= r.end)
+        {
+            r.end = ranges[k].end > r.end ? ranges[k].end : r.end;
+            k++;
+        }
+        Mask_Add(_this, MASK_REPEAT, r.begin, r.end);
+    }
+    Mem_Free(_this, ranges, (count + 1) * sizeof(GeneticsRange));
+    pthread_mutex_destroy(&locked.lock);
+    if (_this->maskSkip & GENETICS_MASK_REPEAT)
+        Scan_Reset(_this);
+    STATS_ADD(&_this->stats, bases, _this->dnaSize);
+    STATS_END();
+    return l->count;
+}
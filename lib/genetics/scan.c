@@ -0,0 +1,173 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+#define SCAN_BLOCK 1024 // codons computed per kernel call
+
+/**
+ * @brief forget the scan state, next Genetics_Scan() starts from the first base
+ */
+void Scan_Reset(GeneticsObj *_this)
+{
+    GeneticsScan *scan = &_this->scan;
+    const GeneticsOrf *orfs = scan->orfs;
+    memset(scan, 0, sizeof(GeneticsScan));
+    scan->orfs = orfs;
+    for (int f = 0; f < 3; f++)
+        scan->open[f].frame = f;
+}
+
+static void AddOrf(GeneticsObj *_this, const GeneticsOrf *orf)
+{
+    GeneticsScan *scan = &_this->scan;
+    if (scan->orfCount == _this->scanOrfAlloc)
+    {
+        size_t alloc = _this->scanOrfAlloc ? 2 * _this->scanOrfAlloc : 256;
+        scan->orfs = Mem_Realloc(_this, (void *)scan->orfs, _this->scanOrfAlloc * sizeof(GeneticsOrf),
+                                 alloc * sizeof(GeneticsOrf));
+        _this->scanOrfAlloc = alloc;
+    }
+    ((GeneticsOrf *)scan->orfs)[scan->orfCount++] = *orf;
+}
+
+/**
+ * @brief scan the codons ending at j in [j, end), their bases are not skipped
+ */
+static void ScanCodons(GeneticsObj *_this, size_t j, size_t end)
+{
+    GeneticsScan *scan = &_this->scan;
+    const uint8_t *dna = _this->dna;
+    const TranslTable *transl = _this->transl;
+    uint8_t startCodon = transl->start;
+    int f = (j - 2) % 3;    // frame of the codon ending at j
+    uint8_t codons[SCAN_BLOCK];
+    for (size_t b = SCAN_BLOCK; j < end; j++, b++, f = f == 2 ? 0 : f + 1)
+    {
+        if (b == SCAN_BLOCK)
+        { // codons of the next block at once
+            _this->kernels->codons(codons, dna + j - 2, end - j < SCAN_BLOCK ? end - j : SCAN_BLOCK);
+            b = 0;
+        }
+        uint8_t codon = codons[b];
+        scan->codons[f][codon]++;
+        if (scan->start == 0 && codon == startCodon)
+            scan->start = _this->inputFileOffset + j - 1;
+        GeneticsOrf *open = &scan->open[f];
+        char s = transl->starts[codon];
+        if (open->begin == 0)
+        {
+            if (s == 'M')
+                open->begin = _this->inputFileOffset + j - 1;
+        }
+        else if (s == '*')
+        {
+            open->end = _this->inputFileOffset + j + 1;
+            open->complete = true;
+            AddOrf(_this, open);
+            open->begin = 0;
+            open->complete = false;
+        }
+    }
+}
+
+/**
+ * @brief scan bases [scan->bases, dnaSize); codons ending in the new bases read the 2 previous ones.
+ *        Skipped mask ranges are stepped over whole: the open reading frames end before them.
+ */
+static void ScanTail(GeneticsObj *_this)
+{
+    GeneticsScan *scan = &_this->scan;
+    size_t from = scan->bases, size = _this->dnaSize, codons = 0;
+    size_t begin, segment = Mask_PrevSkip(_this, from, &begin); // first base of the unskipped segment of pos
+    for (size_t pos = from; pos < size;)
+    {
+        size_t skipEnd, skip = Mask_NextSkip(_this, pos, &skipEnd);
+        if (skip <= pos)
+        {
+            for (int f = 0; f < 3; f++)
+            {
+                GeneticsOrf *open = &scan->open[f];
+                if (open->begin)
+                {
+                    open->end = _this->inputFileOffset + skip; // last base before the range
+                    AddOrf(_this, open);
+                    open->begin = 0;
+                }
+            }
+            pos = segment = skipEnd < size ? skipEnd : size;
+            continue;
+        }
+        size_t end = skip < size ? skip : size, j = segment + 2 > pos ? segment + 2 : pos;
+        _this->kernels->count(scan->composition, _this->dna + pos, end - pos);
+        if (j < end)
+        {
+            ScanCodons(_this, j, end);
+            codons += end - j;
+        }
+        pos = end;
+    }
+    for (int f = 0; f < 3; f++)
+    {
+        if (scan->open[f].begin)
+            scan->open[f].end = _this->inputFileOffset + size; // last scanned base
+    }
+    STATS_ADD(&_this->stats, codons, codons);
+    STATS_ADD(&_this->stats, bases, size - from);
+    scan->bases = size;
+}
+
+/**
+ * @brief scan the bases added since the last call and return the scan state
+ *        (NULL while working on a region or a FASTQ read selection)
+ */
+const GeneticsScan *Scan_Update(GeneticsObj *_this)
+{
+    if (_this->dnaView)
+        return NULL;
+    if (_this->dnaSize < _this->scan.bases)
+        Scan_Reset(_this);
+    if (_this->dnaSize > _this->scan.bases)
+        ScanTail(_this);
+    return &_this->scan;
+}
+
+/**
+ * @brief Incremental analysis of the sequence in input order, 3 frames (splicing is ignored):
+ *        first start codon, open reading frames, codon counts and base composition.
+ *        Only the bases added with Genetics_AddDNA() since the previous call are scanned,
+ *        so a growing sequence can be analysed after every append in linear total time.
+ *        The state is reset by Genetics_StartDNA() and by loading files.
+ *        Genetics_FindStart() on this strand uses the scan too.
+ *        Changing the translation table resets the state.
+ *
+ * @param _this genetics object
+ * @return const GeneticsScan* scan state, valid until the next call (NULL while a FASTQ read is selected)
+ */
+const GeneticsScan *Genetics_Scan(GeneticsObj *_this)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_SCAN);
+    const GeneticsScan *scan = Scan_Update(_this);
+    STATS_END();
+    return scan;
+}
+
+/**
+ * @brief Forget the incremental analysis, next Genetics_Scan() rescans the whole sequence
+ *
+ * @param _this genetics object
+ */
+void Genetics_ResetScan(GeneticsObj *_this)
+{
+    Scan_Reset(_this);
+}
@@ -0,0 +1,186 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "genetics.h"
+#include "stats.h"
+
+static const char *STAT_NAMES[GENETICS_STAT_COUNT] = {
+    "other",
+    "load_fasta",
+    "splice",
+    "find_start",
+    "print",
+    "load_fastq",
+    "codon_usage",
+    "scan",
+    "peptide",
+    "align",
+    "index",
+    "variant",
+    "add_dna",
+    "translate_gtf",
+    "mask_repeats",
+};
+
+/**
+ * @brief Name of a command of the counters (as in Genetics_PrintStats())
+ *
+ * @param cmd GENETICS_STAT_xxx command
+ * @return name, NULL if cmd is invalid
+ */
+const char *Genetics_StatName(GENETICS_STAT cmd)
+{
+    return cmd >= 0 && cmd < GENETICS_STAT_COUNT ? STAT_NAMES[cmd] : NULL;
+}
+
+#ifdef GENETICS_STATS
+
+/**
+ * @brief clear the counters and the histograms; histograms and trace callback stay enabled
+ */
+void Stats_Init(GeneticsStats *stats)
+{
+    memset(stats->cmd, 0, sizeof(stats->cmd));
+    stats->current = &stats->cmd[GENETICS_STAT_OTHER];
+    if (stats->latency)
+        memset(stats->latency, 0, GENETICS_STAT_COUNT * sizeof(StatsHistogram));
+}
+
+static size_t BucketOf(uint64_t ns)
+{
+    if (ns >= 1ull << STATS_MAX_BITS)
+        return STATS_BUCKETS - 1;
+    if (ns < STATS_SUB)
+        return ns;
+    int msb = 63 - __builtin_clzll(ns);
+    return (size_t)(msb - STATS_SUB_BITS + 1) * STATS_SUB + (ns >> (msb - STATS_SUB_BITS)) - STATS_SUB;
+}
+
+static uint64_t BucketLow(size_t b)
+{
+    if (b < STATS_SUB)
+        return b;
+    int octave = b / STATS_SUB;
+    return (uint64_t)(STATS_SUB + b % STATS_SUB) << (octave - 1);
+}
+
+static uint64_t BucketHigh(size_t b)
+{
+    return b < STATS_SUB ? b : BucketLow(b) + (1ull << (b / STATS_SUB - 1)) - 1;
+}
+
+static void Record(StatsHistogram *h, uint64_t ns)
+{
+    if (h->count == 0 || ns < h->min)
+        h->min = ns;
+    if (ns > h->max)
+        h->max = ns;
+    h->count++;
+    h->buckets[BucketOf(ns)]++;
+}
+
+/**
+ * @brief highest duration of the bucket holding the percentile (0..100) value, clamped to min..max
+ */
+uint64_t Stats_Percentile(const StatsHistogram *h, double percentile)
+{
+    if (h->count == 0)
+        return 0;
+    uint64_t rank = (uint64_t)(percentile / 100.0 * h->count + 0.5), seen = 0;
+    rank = rank < 1 ? 1 : rank > h->count ? h->count : rank;
+    for (size_t b = 0; b < STATS_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= rank)
+        {
+            uint64_t high = BucketHigh(b);
+            return high < h->min ? h->min : high > h->max ? h->max : high;
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief copy the non empty buckets (at most max)
+ *
+ * @return number of non empty buckets
+ */
+size_t Stats_Buckets(const StatsHistogram *h, GeneticsLatencyBucket *buckets, size_t max)
+{
+    size_t n = 0;
+    for (size_t b = 0; b < STATS_BUCKETS; b++)
+    {
+        if (h->buckets[b] == 0)
+            continue;
+        if (n < max)
+        {
+            buckets[n].low_ns = BucketLow(b);
+            buckets[n].high_ns = b == STATS_BUCKETS - 1 ? UINT64_MAX : BucketHigh(b);
+            buckets[n].count = h->buckets[b];
+        }
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @brief start measuring a command; counters added until Stats_End() go to this command
+ */
+void Stats_Begin(GeneticsStatsScope *scope, GeneticsStats *stats, GENETICS_STAT cmd)
+{
+    scope->stats = stats;
+    scope->prev = stats->current;
+    scope->cmd = cmd;
+    stats->current = &stats->cmd[cmd];
+    stats->current->calls++;
+    if (stats->trace)
+        stats->trace(stats->traceCtx, cmd, true, 0);
+    clock_gettime(CLOCK_MONOTONIC, &scope->begin);
+}
+
+void Stats_End(GeneticsStatsScope *scope)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    GeneticsStats *stats = scope->stats;
+    uint64_t ns = (uint64_t)(end.tv_sec - scope->begin.tv_sec) * 1000000000ull + end.tv_nsec - scope->begin.tv_nsec;
+    stats->current->wall_ns += ns;
+    stats->current = scope->prev;
+    if (stats->latency)
+        Record(&stats->latency[scope->cmd], ns);
+    if (stats->trace)
+        stats->trace(stats->traceCtx, scope->cmd, false, ns);
+}
+#endif
+
+/**
+ * @brief print all command counters as a JSON object
+ */
+void Stats_PrintJSON(const GeneticsStats *stats, FILE *out)
+{
+    fputs("{\"stats\":{", out);
+#ifdef GENETICS_STATS
+    for (int i = 0; i < GENETICS_STAT_COUNT; i++)
+    {
+        const GeneticsStat *s = &stats->cmd[i];
+        fprintf(out, "%s\n  \"%s\":{\"calls\":%lu,\"wall_ns\":%lu,\"bytes_read\":%lu,\"bases\":%lu,"
+                     "\"codons\":%lu,\"out_bytes\":%lu,\"allocs\":%lu",
+                i ? "," : "", STAT_NAMES[i], s->calls, s->wall_ns, s->bytes_read, s->bases,
+                s->codons, s->out_bytes, s->allocs);
+        const StatsHistogram *h = stats->latency ? &stats->latency[i] : NULL;
+        if (h && h->count)
+        {
+            fprintf(out, ",\"latency\":{\"count\":%lu,\"min_ns\":%lu,\"p50_ns\":%lu,\"p90_ns\":%lu,"
+                         "\"p99_ns\":%lu,\"p999_ns\":%lu,\"max_ns\":%lu}",
+                    h->count, h->min, Stats_Percentile(h, 50), Stats_Percentile(h, 90), Stats_Percentile(h, 99),
+                    Stats_Percentile(h, 99.9), h->max);
+        }
+        fputc('}', out);
+    }
+#endif
+    fputs("\n}}\n", out);
+}
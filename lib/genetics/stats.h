@@ -0,0 +1,65 @@
+#pragma once
+
+/**
+ * @brief Hot path instrumentation (internal)
+ *        Counters are kept per genetics object, one slot per command.
+ *        Latency histograms and the trace callback are optional: a disabled one costs a test
+ *        per command. Build with --disable-stats to compile all the macros out.
+ */
+typedef struct _StatsHistogram StatsHistogram;
+
+typedef struct _GeneticsStats
+{
+    GeneticsStat cmd[GENETICS_STAT_COUNT];
+    GeneticsStat *current;
+    StatsHistogram *latency;        // GENETICS_STAT_COUNT histograms, NULL if disabled
+    GeneticsTraceCallback trace;    // NULL if disabled
+    void *traceCtx;
+} GeneticsStats;
+
+#ifdef GENETICS_STATS
+#include <time.h>
+
+/**
+ * @brief log-linear (HDR style) histogram of durations in ns: values below STATS_SUB are exact,
+ *        every power of two above is split in STATS_SUB buckets (6.25% wide), up to 2^STATS_MAX_BITS ns
+ */
+#define STATS_SUB_BITS 4
+#define STATS_SUB (1 << STATS_SUB_BITS)
+#define STATS_MAX_BITS 44   // 4.9 hours, longer durations go to the last bucket
+#define STATS_BUCKETS ((STATS_MAX_BITS - STATS_SUB_BITS + 1) * STATS_SUB)
+
+struct _StatsHistogram
+{
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+};
+
+typedef struct _GeneticsStatsScope
+{
+    GeneticsStats *stats;
+    GeneticsStat *prev;
+    GENETICS_STAT cmd;
+    struct timespec begin;
+} GeneticsStatsScope;
+
+void Stats_Init(GeneticsStats *stats);
+void Stats_Begin(GeneticsStatsScope *scope, GeneticsStats *stats, GENETICS_STAT cmd);
+void Stats_End(GeneticsStatsScope *scope);
+uint64_t Stats_Percentile(const StatsHistogram *h, double percentile);
+size_t Stats_Buckets(const StatsHistogram *h, GeneticsLatencyBucket *buckets, size_t max);
+
+#define STATS_INIT(stats)        Stats_Init(stats)
+#define STATS_BEGIN(stats, cmd)  GeneticsStatsScope _stats_scope; Stats_Begin(&_stats_scope, stats, cmd)
+#define STATS_END()              Stats_End(&_stats_scope)
+#define STATS_ADD(stats, field, n) ((stats)->current->field += (n))
+#else
+#define STATS_INIT(stats)        ((void)0)
+#define STATS_BEGIN(stats, cmd)  ((void)0)
+#define STATS_END()              ((void)0)
+#define STATS_ADD(stats, field, n) ((void)0)
+#endif
+
+void Stats_PrintJSON(const GeneticsStats *stats, FILE *out);
@@ -0,0 +1,599 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief batch translation of the transcripts of a GTF / GFF3 annotation on the loaded sequence.
+ *        parse (caller)     : CDS and exon features grouped by transcript id (hash table)
+ *        group (caller)     : per transcript its features sorted by position, CDS ones if any,
+ *                             then transcripts sorted by position for sequential reads of the sequence
+ *        translate (threads): batches of transcripts cut in one range per thread; every thread gathers
+ *                             the bases of a transcript in reading order, translates them with the
+ *                             kernels and writes the FASTA record in its part of the batch buffer
+ *        write (caller)     : the parts in order
+ */
+#define TRANSCRIPT_BATCH       (8 * 1024 * 1024)   // output bytes (upper bound) per batch
+#define TRANSCRIPT_THREAD_MIN  (1024 * 1024)       // min bases per thread (automatic thread count)
+#define TRANSCRIPT_MAX_THREADS 16
+
+typedef struct _GtfFeature
+{
+    size_t begin;       // file offset, 1 based
+    size_t end;         // inclusive
+    size_t transcript;
+    uint8_t phase;      // CDS bases before the first codon
+    bool cds;           // CDS, exon otherwise
+} GtfFeature;
+
+typedef struct _Transcript
+{
+    size_t name;        // offset in the names pool
+    size_t nameSize;
+    char strand;        // '+' or '-'
+    size_t first;       // features of the transcript in the sorted features
+    size_t count;
+    bool cds;           // translated from its CDS features, from the first start codon of its exons otherwise
+    uint8_t phase;      // of the first CDS in reading order
+    size_t begin;       // first and last base of the features used
+    size_t end;
+    size_t bases;
+    size_t out;         // output bytes upper bound
+} Transcript;
+
+typedef struct _Annotation
+{
+    GtfFeature *features;
+    size_t featureCount, featureAlloc;
+    Transcript *transcripts;
+    size_t count, alloc;
+    size_t *hash;       // transcript index + 1 by id, 0 empty
+    size_t hashSize;    // power of 2, at most half full
+    char *names;
+    size_t namesSize, namesAlloc;
+    size_t skipped;     // malformed lines
+} Annotation;
+
+static size_t HashId(const char *id, size_t size)
+{
+    uint64_t h = 14695981039346656037ull; // FNV-1a
+    for (size_t i = 0; i < size; i++)
+        h = (h ^ (uint8_t)id[i]) * 1099511628211ull;
+    return h;
+}
+
+static void GrowHash(GeneticsObj *_this, Annotation *a)
+{
+    size_t size = a->hashSize ? 2 * a->hashSize : 4096;
+    size_t *hash = Mem_Alloc(_this, size * sizeof(size_t));
+    memset(hash, 0, size * sizeof(size_t));
+    for (size_t t = 0; t < a->count; t++)
+    {
+        size_t k = HashId(a->names + a->transcripts[t].name, a->transcripts[t].nameSize) & (size - 1);
+        while (hash[k])
+            k = (k + 1) & (size - 1);
+        hash[k] = t + 1;
+    }
+    Mem_Free(_this, a->hash, a->hashSize * sizeof(size_t));
+    a->hash = hash;
+    a->hashSize = size;
+}
+
+/**
+ * @brief index of the transcript with this id, created if new
+ */
+static size_t TranscriptOf(GeneticsObj *_this, Annotation *a, const char *id, size_t size, char strand)
+{
+    if (2 * (a->count + 1) > a->hashSize)
+        GrowHash(_this, a);
+    size_t k = HashId(id, size) & (a->hashSize - 1);
+    for (; a->hash[k]; k = (k + 1) & (a->hashSize - 1))
+    {
+        const Transcript *t = &a->transcripts[a->hash[k] - 1];
+        if (t->nameSize == size && !memcmp(a->names + t->name, id, size))
+            return a->hash[k] - 1;
+    }
+    if (a->count == a->alloc)
+    {
+        size_t alloc = a->alloc ? 2 * a->alloc : 1024;
+        a->transcripts = Mem_Realloc(_this, a->transcripts, a->alloc * sizeof(Transcript), alloc * sizeof(Transcript));
+        a->alloc = alloc;
+    }
+    if (a->namesSize + size + 1 > a->namesAlloc)
+    {
+        size_t alloc = 2 * (a->namesSize + size + 1) + 4096;
+        a->names = Mem_Realloc(_this, a->names, a->namesAlloc, alloc);
+        a->namesAlloc = alloc;
+    }
+    Transcript *t = &a->transcripts[a->count];
+    memset(t, 0, sizeof(Transcript));
+    t->name = a->namesSize;
+    t->nameSize = size;
+    t->strand = strand;
+    memcpy(a->names + a->namesSize, id, size);
+    a->names[a->namesSize + size] = 0;
+    a->namesSize += size + 1;
+    a->hash[k] = a->count + 1;
+    return a->count++;
+}
+
+/**
+ * @brief transcript id of the attributes [p, end): GTF transcript_id "id", GFF3 first Parent=id
+ *
+ * @return false if none
+ */
+static bool TranscriptId(const char *p, const char *end, const char **id, size_t *size)
+{
+    while (p < end)
+    {
+        while (p < end && *p == ' ')
+            p++;
+        const char *semi = memchr(p, ';', end - p), *stop = semi ? semi : end;
+        if (stop - p > 14 && !strncmp(p, "transcript_id ", 14))
+        {
+            const char *v = p + 14, *e = stop;
+            while (v < e && (*v == ' ' || *v == '"'))
+                v++;
+            while (e > v && (e[-1] == ' ' || e[-1] == '"'))
+                e--;
+            *id = v;
+            *size = e - v;
+            return *size > 0;
+        }
+        if (stop - p > 7 && !strncmp(p, "Parent=", 7))
+        {
+            const char *v = p + 7, *comma = memchr(v, ',', stop - v);
+            *id = v;
+            *size = (comma ? comma : stop) - v;
+            return *size > 0;
+        }
+        p = stop + 1;
+    }
+    return false;
+}
+
+/**
+ * @brief parse a GTF / GFF3 line [p, end): seqname source feature start end score strand frame attributes,
+ *        1 based inclusive coordinates. Only CDS and exon features are kept, lines of other
+ *        chromosomes than the loaded sequence are skipped.
+ */
+static void ParseGTFLine(GeneticsObj *_this, Annotation *a, const char *p, const char *end)
+{
+    while (end > p && (end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    if (p == end || *p == '#')
+        return;
+    const char *field[9];
+    size_t length[9];
+    int n = 0;
+    while (n < 9)
+    {
+        const char *tab = n < 8 ? memchr(p, '\t', end - p) : NULL;
+        field[n] = p;
+        length[n++] = (tab ? tab : end) - p;
+        if (!tab)
+            break;
+        p = tab + 1;
+    }
+    if (n < 9)
+    {
+        a->skipped++;
+        return;
+    }
+    bool cds = length[2] == 3 && !strncmp(field[2], "CDS", 3);
+    if (!cds && !(length[2] == 4 && !strncmp(field[2], "exon", 4)))
+        return; // gene, UTR, start_codon ...
+    if (!isdigit((unsigned char)*field[3]) || !isdigit((unsigned char)*field[4]) ||
+        (*field[6] != '+' && *field[6] != '-'))
+    {
+        a->skipped++;
+        return;
+    }
+    if (_this->seqName[0] && (strlen(_this->seqName) != length[0] || strncmp(_this->seqName, field[0], length[0])))
+        return; // other chromosome
+    size_t begin = strtoul(field[3], NULL, 10), stop = strtoul(field[4], NULL, 10), idSize;
+    const char *id;
+    if (begin == 0 || stop < begin || !TranscriptId(field[8], field[8] + length[8], &id, &idSize))
+    {
+        a->skipped++;
+        return;
+    }
+    if (a->featureCount == a->featureAlloc)
+    {
+        size_t alloc = a->featureAlloc ? 2 * a->featureAlloc : 4096;
+        a->features = Mem_Realloc(_this, a->features, a->featureAlloc * sizeof(GtfFeature), alloc * sizeof(GtfFeature));
+        a->featureAlloc = alloc;
+    }
+    GtfFeature *f = &a->features[a->featureCount++];
+    f->begin = begin;
+    f->end = stop;
+    f->transcript = TranscriptOf(_this, a, id, idSize, *field[6]);
+    f->phase = *field[7] >= '0' && *field[7] <= '2' ? *field[7] - '0' : 0;
+    f->cds = cds;
+}
+
+static bool LoadGTF(GeneticsObj *_this, const char *filename, Annotation *a)
+{
+    GeneticsReader *reader = Obj_Reader(_this);
+    if (!reader || !Reader_Start(reader, filename))
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening gtf file '%s'", filename);
+        return false;
+    }
+    char *line = NULL; // line split between buffers
+    size_t lineSize = 0, lineAlloc = 0;
+    const char *chunk;
+    size_t size;
+    while (NULL != (chunk = Reader_Next(reader, &size)))
+    {
+        STATS_ADD(&_this->stats, bytes_read, size);
+        const char *p = chunk, *end = chunk + size;
+        while (p < end)
+        {
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol : end;
+            if (eol && lineSize == 0)
+            {
+                ParseGTFLine(_this, a, p, lineEnd);
+            }
+            else
+            {
+                size_t n = lineEnd - p;
+                if (lineSize + n > lineAlloc)
+                {
+                    line = Mem_Realloc(_this, line, lineAlloc, 2 * (lineSize + n));
+                    lineAlloc = 2 * (lineSize + n);
+                }
+                memcpy(line + lineSize, p, n);
+                lineSize += n;
+                if (eol)
+                {
+                    ParseGTFLine(_this, a, line, line + lineSize);
+                    lineSize = 0;
+                }
+            }
+            p = eol ? eol + 1 : end;
+        }
+    }
+    if (lineSize)
+        ParseGTFLine(_this, a, line, line + lineSize);
+    Mem_Free(_this, line, lineAlloc);
+    int error = Reader_Error(reader);
+    if (error)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error reading gtf file '%s'", filename);
+    Reader_Stop(reader);
+    return true;
+}
+
+static int CompareFeatures(const void *a, const void *b)
+{
+    const GtfFeature *fa = a, *fb = b;
+    if (fa->transcript != fb->transcript)
+        return fa->transcript < fb->transcript ? -1 : 1;
+    if (fa->begin != fb->begin)
+        return fa->begin < fb->begin ? -1 : 1;
+    return 0;
+}
+
+static int CompareTranscripts(const void *a, const void *b)
+{
+    const Transcript *ta = a, *tb = b;
+    if (ta->begin != tb->begin)
+        return ta->begin < tb->begin ? -1 : 1;
+    if (ta->end != tb->end)
+        return ta->end < tb->end ? -1 : 1;
+    return ta->name < tb->name ? -1 : ta->name > tb->name;
+}
+
+/**
+ * @brief features, span and output bound of every transcript
+ */
+static void Group(GeneticsObj *_this, Annotation *a)
+{
+    qsort(a->features, a->featureCount, sizeof(GtfFeature), CompareFeatures);
+    size_t width = _this->fastaWidth;
+    for (size_t k = 0; k < a->featureCount;)
+    {
+        Transcript *t = &a->transcripts[a->features[k].transcript];
+        t->first = k;
+        while (k < a->featureCount && a->features[k].transcript == a->features[t->first].transcript)
+            t->cds |= a->features[k++].cds;
+        t->count = k - t->first;
+        t->begin = SIZE_MAX;
+        for (size_t i = t->first; i < k; i++)
+        {
+            const GtfFeature *f = &a->features[i];
+            if (f->cds != t->cds)
+                continue;
+            if (t->begin == SIZE_MAX || t->strand == '-')
+                t->phase = f->phase; // first one in reading order
+            t->begin = t->begin < f->begin ? t->begin : f->begin;
+            t->end = t->end > f->end ? t->end : f->end;
+            t->bases += f->end - f->begin + 1;
+        }
+        size_t aa = t->bases / 3 + 1;
+        t->out = t->nameSize + 64 + aa + (width ? aa / width + 1 : 1);
+    }
+}
+
+typedef struct _TranslateChunk
+{
+    const GeneticsObj *obj;     // read only in the threads
+    const GtfFeature *features;
+    const Transcript *transcripts;
+    const char *names;
+    size_t from, to;            // transcripts
+    uint8_t *bases;             // scratch: bases, skipped flags and codons of one transcript, its protein
+    uint8_t *skipped;
+    uint8_t *codons;
+    char *protein;
+    char *out;                  // part of the batch buffer
+    size_t outSize;
+    size_t translated;
+    size_t noStart;
+    size_t codonCount;
+} TranslateChunk;
+
+/**
+ * @brief bases of the used features of t in reading order, skipped flags set if a base is in a skipped mask
+ *
+ * @return true if a base is skipped
+ */
+static bool Gather(TranslateChunk *c, const Transcript *t)
+{
+    const GeneticsObj *_this = c->obj;
+    bool masked = false;
+    size_t n = 0;
+    for (size_t k = 0; k < t->count; k++)
+    {
+        const GtfFeature *f = &c->features[t->strand == '+' ? t->first + k : t->first + t->count - 1 - k];
+        if (f->cds != t->cds)
+            continue;
+        size_t b = f->begin - 1 - _this->inputFileOffset, e = f->end - _this->inputFileOffset; // buffer [b, e)
+        if (t->strand == '+')
+            _this->kernels->complement(c->bases + n, _this->dna + b, e - b, 0);
+        else
+            _this->kernels->reverseComplement(c->bases + n, _this->dna + b, e - b, 0x2);
+        size_t se;
+        for (size_t s = Mask_NextSkip(_this, b, &se); s < e; s = Mask_NextSkip(_this, se, &se))
+        {
+            if (!masked)
+                memset(c->skipped, 0, t->bases);
+            masked = true;
+            for (size_t x = s > b ? s : b; x < se && x < e; x++)
+                c->skipped[t->strand == '+' ? n + x - b : n + e - 1 - x] = 1;
+        }
+        n += e - b;
+    }
+    return masked;
+}
+
+/**
+ * @brief translate t and write its FASTA record; codons with a skipped base are translated as X
+ */
+static void TranslateTranscript(TranslateChunk *c, const Transcript *t)
+{
+    const GeneticsObj *_this = c->obj;
+    const TranslTable *transl = _this->transl;
+    bool masked = Gather(c, t);
+    size_t first = t->phase;
+    if (!t->cds)
+    { // exons: from the first start codon to the first stop
+        size_t positions = t->bases >= 3 ? t->bases - 2 : 0;
+        _this->kernels->codons(c->codons, c->bases, positions);
+        for (first = 0; first < positions; first++)
+        {
+            if (c->codons[first] == transl->start &&
+                !(masked && (c->skipped[first] | c->skipped[first + 1] | c->skipped[first + 2])))
+                break;
+        }
+        if (first == positions)
+        {
+            c->noStart++;
+            return;
+        }
+    }
+    size_t aa = t->bases > first ? (t->bases - first) / 3 : 0;
+    _this->kernels->translate(c->protein, c->bases + first, aa, transl->transl);
+    c->codonCount += aa;
+    for (size_t i = 0; masked && i < aa; i++)
+    {
+        const uint8_t *s = c->skipped + first + 3 * i;
+        if (s[0] | s[1] | s[2])
+            c->protein[i] = 'X';
+    }
+    if (!t->cds)
+    {
+        const char *stop = memchr(c->protein, '*', aa);
+        aa = stop ? (size_t)(stop - c->protein) : aa;
+    }
+    else if (aa > 0 && c->protein[aa - 1] == '*')
+        aa--;
+    char *o = c->out + c->outSize;
+    o += sprintf(o, ">%s %lu-%lu %c %s\n", c->names + t->name, t->begin, t->end, t->strand, t->cds ? "cds" : "exons");
+    size_t width = _this->fastaWidth ? _this->fastaWidth : aa;
+    for (size_t i = 0; i < aa; i += width)
+    {
+        size_t n = aa - i < width ? aa - i : width;
+        memcpy(o, c->protein + i, n);
+        o += n;
+        *o++ = '\n';
+    }
+    c->outSize = o - c->out;
+    c->translated++;
+}
+
+static void *TranslateChunkMain(void *arg)
+{
+    TranslateChunk *c = arg;
+    for (size_t i = c->from; i < c->to; i++)
+        TranslateTranscript(c, &c->transcripts[i]);
+    return NULL;
+}
+
+/**
+ * @brief run every chunk, chunk 0 on the calling thread
+ */
+static void RunChunks(TranslateChunk *chunks, int threads)
+{
+    pthread_t tid[TRANSCRIPT_MAX_THREADS];
+    int started = 1;
+    for (int t = 1; t < threads; t++, started++)
+        if (pthread_create(&tid[t], NULL, TranslateChunkMain, &chunks[t]))
+            break;
+    TranslateChunkMain(&chunks[0]);
+    for (int t = started; t < threads; t++)
+        TranslateChunkMain(&chunks[t]); // thread creation failed: run here
+    for (int t = 1; t < started; t++)
+        pthread_join(tid[t], NULL);
+}
+
+static int TranslateThreads(GeneticsObj *_this, size_t bases)
+{
+    if (_this->loadThreads > 0)
+        return _this->loadThreads < TRANSCRIPT_MAX_THREADS ? _this->loadThreads : TRANSCRIPT_MAX_THREADS;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = bases / TRANSCRIPT_THREAD_MIN;
+    if (cpus > 0 && threads > (size_t)cpus)
+        threads = cpus;
+    if (threads > TRANSCRIPT_MAX_THREADS)
+        threads = TRANSCRIPT_MAX_THREADS;
+    return threads < 1 ? 1 : threads;
+}
+
+/**
+ * @brief translate the transcripts [from, to) with threads and write their records in order
+ */
+static void TranslateBatch(GeneticsObj *_this, TranslateChunk *chunks, int threads, const Transcript *transcripts,
+                           size_t from, size_t to, char *buffer)
+{
+    size_t bound = 0;
+    for (size_t i = from; i < to; i++)
+        bound += transcripts[i].out;
+    if ((size_t)threads > to - from)
+        threads = to - from;
+    size_t part = 0, i = from;
+    for (int t = 0; t < threads; t++)
+    { // ranges of about the same output bound
+        chunks[t].from = i;
+        chunks[t].out = buffer + part;
+        chunks[t].outSize = 0;
+        size_t stop = bound * (t + 1) / threads;
+        while (i < to && (part < stop || t == threads - 1))
+            part += transcripts[i++].out;
+        chunks[t].to = i;
+    }
+    RunChunks(chunks, threads);
+    for (int t = 0; t < threads; t++)
+        Out_Write(_this, chunks[t].out, chunks[t].outSize);
+}
+
+/**
+ * @brief Translate the transcripts of a GTF or GFF3 annotation on the loaded sequence and print
+ *        them in FASTA: ">id begin-end strand cds|exons" and the protein (see Genetics_SetFastaWidth()).
+ *        A transcript is the CDS features sharing a transcript_id (GTF) or a Parent (GFF3), translated
+ *        from the phase of the first one in reading order without the final stop; a transcript without
+ *        CDS features is translated from the first start codon of its exons to the first stop codon.
+ *        Transcripts are sorted by position and translated in parallel (see Genetics_SetLoadThreads()).
+ *        Codons with a base in a skipped mask are translated as X. Transcripts of other chromosomes
+ *        than the loaded FASTA sequence are ignored.
+ *
+ * @param _this    genetics object
+ * @param filename GTF or GFF3 file name
+ * @return number of transcripts translated
+ */
+size_t Genetics_TranslateGTF(GeneticsObj *_this, const char *filename)
+{
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_TRANSLATE_GTF);
+    Annotation a;
+    memset(&a, 0, sizeof(a));
+    size_t translated = 0;
+    if (_this->dnaDir == DNA_DIR_3_TO_5)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: gtf translation needs a 5'3' sequence");
+    else if (LoadGTF(_this, filename, &a))
+    {
+        Group(_this, &a);
+        size_t first = _this->inputFileOffset + 1, last = _this->inputFileOffset + _this->dnaSize, used = 0;
+        size_t maxBases = 0, totalBases = 0;
+        for (size_t t = 0; t < a.count; t++)
+        {
+            if (a.transcripts[t].begin >= first && a.transcripts[t].end <= last)
+            {
+                a.transcripts[used++] = a.transcripts[t];
+                maxBases = maxBases > a.transcripts[t].bases ? maxBases : a.transcripts[t].bases;
+                totalBases += a.transcripts[t].bases;
+            }
+        }
+        size_t outside = a.count - used;
+        qsort(a.transcripts, used, sizeof(Transcript), CompareTranscripts);
+
+        int threads = TranslateThreads(_this, totalBases);
+        TranslateChunk chunks[TRANSCRIPT_MAX_THREADS];
+        size_t scratch = 3 * (maxBases + 1) + maxBases / 3 + 1;
+        for (int t = 0; t < threads; t++)
+        {
+            memset(&chunks[t], 0, sizeof(TranslateChunk));
+            chunks[t].obj = _this;
+            chunks[t].features = a.features;
+            chunks[t].transcripts = a.transcripts;
+            chunks[t].names = a.names;
+            chunks[t].bases = Mem_Alloc(_this, scratch);
+            chunks[t].skipped = chunks[t].bases + maxBases + 1;
+            chunks[t].codons = chunks[t].skipped + maxBases + 1;
+            chunks[t].protein = (char *)chunks[t].codons + maxBases + 1;
+        }
+        char *buffer = NULL;
+        size_t bufferSize = 0;
+        for (size_t from = 0; from < used;)
+        {
+            size_t to = from, bound = 0;
+            while (to < used && (to == from || bound + a.transcripts[to].out <= TRANSCRIPT_BATCH))
+                bound += a.transcripts[to++].out;
+            if (bound > bufferSize)
+            {
+                Mem_Free(_this, buffer, bufferSize);
+                buffer = Mem_Alloc(_this, bound);
+                bufferSize = bound;
+            }
+            TranslateBatch(_this, chunks, threads, a.transcripts, from, to, buffer);
+            from = to;
+        }
+        size_t noStart = 0, codons = 0;
+        for (int t = 0; t < threads; t++)
+        {
+            translated += chunks[t].translated;
+            noStart += chunks[t].noStart;
+            codons += chunks[t].codonCount;
+            Mem_Free(_this, chunks[t].bases, scratch);
+        }
+        Mem_Free(_this, buffer, bufferSize);
+        STATS_ADD(&_this->stats, bases, totalBases);
+        STATS_ADD(&_this->stats, codons, codons);
+        Out_Flush(_this);
+        if (outside || noStart || a.skipped)
+            Obj_Error(_this, GENETICS_LEVEL_WARNING, 0,
+                      "Warning gtf file '%s' : %lu transcripts outside the loaded sequence, %lu without start codon, "
+                      "%lu malformed lines skipped",
+                      filename, outside, noStart, a.skipped);
+    }
+    Mem_Free(_this, a.features, a.featureAlloc * sizeof(GtfFeature));
+    Mem_Free(_this, a.transcripts, a.alloc * sizeof(Transcript));
+    Mem_Free(_this, a.hash, a.hashSize * sizeof(size_t));
+    Mem_Free(_this, a.names, a.namesAlloc);
+    STATS_END();
+    return translated;
+}
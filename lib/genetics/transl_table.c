@@ -1,19 +1,21 @@
 #include <config.h>
 
+#include <stdint.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include "transl_table.h"
 
 // https://www.ncbi.nlm.nih.gov/Taxonomy/Utils/wprintgc.cgi#SG1
-const char *transl_tables[] = {
+static const char *transl_tables[] = {
     " AAs   = FFLLSSSSYY**CC*WLLLLPPPPHHQQRRRRIIIMTTTTNNKKSSRRVVVVAAAADDEEGGGG"
     "Starts = ---m------**--*----m---------------M----------------------------"
     "Base1  = TTTTTTTTTTTTTTTTCCCCCCCCCCCCCCCCAAAAAAAAAAAAAAAAGGGGGGGGGGGGGGGG"
     "Base2  = TTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGGTTTTCCCCAAAAGGGG"
     "Base3  = TCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAGTCAG"};
 
-const char *AAS_LONG[] = {
+static const char *AAS_LONG[] = {
     "Ala", //A Alanine
     "---", //B ----
     "Cys", //C Cysteine
@@ -42,73 +44,93 @@ const char *AAS_LONG[] = {
     "---"  //Z -----
 };
 
-char TRANSL_TABLE[64];
-char STARTS_TABLE[64];
-const char *TRANSL_TABLE_LONG[64];
-char DNA_STRINGS[64][4];
-char RNA_STRINGS[64][4];
+#define TRANSL_TABLES (sizeof(transl_tables) / sizeof(char *))
+
+static TranslTable TABLES[TRANSL_TABLES];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
 
 /**
  * @brief prepare translation table for a specific genetic code
  * 
- * @param n translation table number (default 1)
- * @return int start codon index
+ * @param n translation table number
+ * @param table filled with the parsed table
  */
-int parse_transl_table(int n)
+static void parse_transl_table(int n, TranslTable *table)
 {
-    if( n < 1 || n > sizeof(transl_tables)/sizeof(char*) )
-        n = 1;
-
     const char *tbl = transl_tables[n - 1];
-    char *aas = 2 + strchr(tbl, '=');
-    char *starts = 2 + strchr(aas, '=');
-    char *base1 = 2 + strchr(starts, '=');
-    char *base2 = 2 + strchr(base1, '=');
-    char *base3 = 2 + strchr(base2, '=');
+    const char *aas = 2 + strchr(tbl, '=');
+    const char *starts = 2 + strchr(aas, '=');
+    const char *base1 = 2 + strchr(starts, '=');
+    const char *base2 = 2 + strchr(base1, '=');
+    const char *base3 = 2 + strchr(base2, '=');
     int s = 0;
 
+    table->n = n;
     for (int i = 0; i < 64; i++)
     {
-        STARTS_TABLE[i] = starts[i];
+        table->starts[i] = starts[i];
         if(starts[i] == 'M')
             s = i;
-        TRANSL_TABLE[i] = aas[i];
-        TRANSL_TABLE_LONG[i] = AAS_LONG[aas[i] - 'A'];
+        table->transl[i] = aas[i];
+        table->translLong[i] = aas[i] == '*' ? "Ter" : AAS_LONG[aas[i] - 'A'];
         if (base1[i] == 'T')
         {
-            DNA_STRINGS[i][0] = 't';
-            RNA_STRINGS[i][0] = 'u';
+            table->dna[i][0] = 't';
+            table->rna[i][0] = 'u';
         }
         else
         {
-            DNA_STRINGS[i][0] = tolower(base1[i]);
-            RNA_STRINGS[i][0] = tolower(base1[i]);
+            table->dna[i][0] = tolower(base1[i]);
+            table->rna[i][0] = tolower(base1[i]);
         }
 
         if (base2[i] == 'T')
         {
-            DNA_STRINGS[i][1] = 't';
-            RNA_STRINGS[i][1] = 'u';
+            table->dna[i][1] = 't';
+            table->rna[i][1] = 'u';
         }
         else
         {
-            DNA_STRINGS[i][1] = tolower(base2[i]);
-            RNA_STRINGS[i][1] = tolower(base2[i]);
+            table->dna[i][1] = tolower(base2[i]);
+            table->rna[i][1] = tolower(base2[i]);
         }
 
         if (base3[i] == 'T')
         {
-            DNA_STRINGS[i][2] = 't';
-            RNA_STRINGS[i][2] = 'u';
+            table->dna[i][2] = 't';
+            table->rna[i][2] = 'u';
         }
         else
         {
-            DNA_STRINGS[i][2] = tolower(base3[i]);
-            RNA_STRINGS[i][2] = tolower(base3[i]);
+            table->dna[i][2] = tolower(base3[i]);
+            table->rna[i][2] = tolower(base3[i]);
         }
-        DNA_STRINGS[i][3] = 0;
-        RNA_STRINGS[i][3] = 0;
+        table->dna[i][3] = 0;
+        table->rna[i][3] = 0;
     }
 
-    return s;
-}
\ No newline at end of file
+    table->start = s;
+    table->startCodon[0] = (s & (0x3 << 4)) >> 4;
+    table->startCodon[1] = (s & (0x3 << 2)) >> 2;
+    table->startCodon[2] = s & 0x3;
+}
+
+static void parse_transl_tables(void)
+{
+    for (int n = 1; n <= (int)TRANSL_TABLES; n++)
+        parse_transl_table(n, &TABLES[n - 1]);
+}
+
+/**
+ * @brief parsed translation table, thread safe (tables are parsed once on first use)
+ * 
+ * @param n translation table number
+ * @return const TranslTable* table or NULL if n is not a known table
+ */
+const TranslTable *transl_table_get(int n)
+{
+    if (n < 1 || n > (int)TRANSL_TABLES)
+        return NULL;
+    pthread_once(&tablesOnce, parse_transl_tables);
+    return &TABLES[n - 1];
+}
@@ -1,9 +1,18 @@
 #pragma once
 
-extern char TRANSL_TABLE[64];
-extern char STARTS_TABLE[64];
-extern const char *TRANSL_TABLE_LONG[64];
-extern char DNA_STRINGS[64][4];
-extern char RNA_STRINGS[64][4];
+/**
+ * @brief parsed genetic code, built once and never modified (shared by all objects and threads)
+ */
+typedef struct _TranslTable
+{
+    int n;                      // NCBI translation table number
+    int start;                  // start codon index, 0 if the code has no 'M' start
+    uint8_t startCodon[3];      // start codon bases
+    char transl[64];            // amino acid per codon, '*' for stop
+    char starts[64];            // 'M' start, 'm' alternative start, '*' stop, '-' other
+    const char *translLong[64]; // 3 letter amino acid per codon, "Ter" for stop
+    char dna[64][4];
+    char rna[64][4];
+} TranslTable;
 
-int parse_transl_table(int n);
\ No newline at end of file
+const TranslTable *transl_table_get(int n);
@@ -0,0 +1,789 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "genetics.h"
+#include "transl_table.h"
+#include "stats.h"
+#include "reader.h"
+#include "genetics_priv.h"
+
+/**
+ * @brief VCF base encoding: 0x10 | base code for A C G T(U), 0 for N and anything else
+ */
+static const uint8_t VCF_BASE[256] = {
+    ['T'] = 0x10, ['t'] = 0x10, ['U'] = 0x10, ['u'] = 0x10,
+    ['C'] = 0x11, ['c'] = 0x11,
+    ['A'] = 0x12, ['a'] = 0x12,
+    ['G'] = 0x13, ['g'] = 0x13,
+};
+#define VCF_FIXED_FIELDS 9      // CHROM POS ID REF ALT QUAL FILTER INFO FORMAT
+#define VCF_MAX_ALLELES  254    // alternate alleles per record, others are ignored
+#define VCF_MISSING      0xFF   // missing or unknown genotype allele, the reference is kept
+
+/**
+ * @brief one alternate allele as a reference edit, REF/ALT common prefix and suffix trimmed
+ */
+typedef struct _VariantEdit
+{
+    size_t pos;         // dna index of the first replaced reference base (insertions go before it)
+    size_t refLength;   // replaced reference bases, 0 for an insertion
+    size_t bases;       // offset of the alternate bases in the bases pool
+    size_t length;      // alternate bases, 0 for a deletion (0 and refLength 0: nothing to apply)
+} VariantEdit;
+
+typedef struct _VariantRecord
+{
+    size_t edit;        // edit of the first alternate allele, the others follow
+    uint8_t alleles;    // alternate alleles
+} VariantRecord;
+
+/**
+ * @brief piece table entry: haplotype bases [hapBegin, hapBegin + length) come from the
+ *        reference at refBegin, or from an edit replacing refLength reference bases
+ */
+typedef struct _HaplotypePiece
+{
+    size_t hapBegin;
+    size_t refBegin;
+    size_t length;
+    size_t refLength;
+    const uint8_t *alt; // alternate bases, NULL for reference bases
+} HaplotypePiece;
+
+struct _GeneticsVariants
+{
+    VariantRecord *records;
+    size_t recordCount;
+    size_t recordAlloc;
+    VariantEdit *edits;
+    size_t editCount;
+    size_t editAlloc;
+    uint8_t *bases;         // alternate bases of all edits
+    size_t basesSize;
+    size_t basesAlloc;
+    uint8_t *genotypes;     // 2 allele indexes (0 reference) per record and sample
+    size_t genotypesAlloc;
+    char *names;            // sample names, null terminated back to back
+    size_t namesSize;
+    size_t namesAlloc;
+    size_t *nameOffsets;
+    size_t sampleCount;
+    size_t sampleAlloc;
+    size_t skipped;         // malformed lines
+    size_t mismatched;      // REF differs from the loaded sequence
+    size_t outside;         // REF not in the loaded sequence
+    // reference replaced while a haplotype is selected
+    uint8_t *refDna;
+    size_t refSize;
+    size_t refInputFileOffset;
+    size_t refStartCodon;
+    size_t *refSplice;      // splice data in reference file offsets
+    int refSpliceSize;
+    size_t refSpliceAlloc;
+    // selected haplotype
+    size_t windowBegin;     // reference dna index range of the haplotype
+    size_t windowEnd;
+    size_t hapSize;
+    const VariantEdit **applied;
+    size_t appliedAlloc;
+    HaplotypePiece *pieces;
+    size_t pieceCount;
+    size_t pieceAlloc;
+    uint8_t *buffer;        // haplotype bases, reused by all selections
+    size_t bufferAlloc;
+};
+
+/**
+ * @brief make room for need elements of size bytes; grows geometrically
+ */
+static void *Reserve(GeneticsObj *_this, void *ptr, size_t *alloc, size_t need, size_t size)
+{
+    if (need <= *alloc)
+        return ptr;
+    size_t n = 2 * *alloc;
+    if (n < need)
+        n = need;
+    if (n < 256)
+        n = 256;
+    ptr = Mem_Realloc(_this, ptr, *alloc * size, n * size);
+    *alloc = n;
+    return ptr;
+}
+
+/**
+ * @brief sample names from the #CHROM header line (fields after FORMAT)
+ */
+static void ParseVCFSamples(GeneticsObj *_this, GeneticsVariants *v, const char *p, const char *end)
+{
+    if (v->sampleCount || v->recordCount)
+        return;
+    for (int n = 0; p < end; n++)
+    {
+        const char *field = p;
+        p = memchr(p, '\t', end - p);
+        if (!p)
+            p = end;
+        if (n >= VCF_FIXED_FIELDS)
+        {
+            size_t length = p - field;
+            v->names = Reserve(_this, v->names, &v->namesAlloc, v->namesSize + length + 1, 1);
+            v->nameOffsets = Reserve(_this, v->nameOffsets, &v->sampleAlloc, v->sampleCount + 1, sizeof(size_t));
+            v->nameOffsets[v->sampleCount++] = v->namesSize;
+            memcpy(v->names + v->namesSize, field, length);
+            v->names[v->namesSize + length] = 0;
+            v->namesSize += length + 1;
+        }
+        if (p < end)
+            p++;
+    }
+}
+
+/**
+ * @brief add the edit of an alternate allele [alt, alt + altLength) of ref[0..refLength) at dna index pos
+ */
+static void AddEdit(GeneticsObj *_this, GeneticsVariants *v, size_t pos, const char *ref, size_t refLength,
+                    const char *alt, size_t altLength)
+{
+    v->edits = Reserve(_this, v->edits, &v->editAlloc, v->editCount + 1, sizeof(VariantEdit));
+    VariantEdit *e = &v->edits[v->editCount++];
+    memset(e, 0, sizeof(VariantEdit));
+    for (size_t k = 0; k < altLength; k++)
+        if (!VCF_BASE[(unsigned char)alt[k]])
+            return; // symbolic allele (<DEL>, *, .) or N: nothing to apply
+    while (refLength && altLength &&
+           (VCF_BASE[(unsigned char)ref[refLength - 1]] == VCF_BASE[(unsigned char)alt[altLength - 1]]))
+    {
+        refLength--;
+        altLength--;
+    }
+    while (refLength && altLength && VCF_BASE[(unsigned char)*ref] == VCF_BASE[(unsigned char)*alt])
+    {
+        ref++;
+        alt++;
+        pos++;
+        refLength--;
+        altLength--;
+    }
+    e->pos = pos;
+    e->refLength = refLength;
+    e->length = altLength;
+    e->bases = v->basesSize;
+    v->bases = Reserve(_this, v->bases, &v->basesAlloc, v->basesSize + altLength, 1);
+    for (size_t k = 0; k < altLength; k++)
+        v->bases[v->basesSize++] = VCF_BASE[(unsigned char)alt[k]] & 0x3;
+}
+
+/**
+ * @brief allele indexes of a GT value (0|1, 1/2, ./., 1 ...); a haploid call is used for both haplotypes
+ */
+static void ParseGenotype(const char *p, const char *end, uint8_t alleles, uint8_t *gt)
+{
+    int n = 0;
+    while (p < end && n < 2)
+    {
+        uint8_t allele = VCF_MISSING;
+        if (isdigit((unsigned char)*p))
+        {
+            unsigned a = 0;
+            for (; p < end && isdigit((unsigned char)*p); p++)
+                a = a < VCF_MISSING ? 10 * a + *p - '0' : VCF_MISSING;
+            if (a <= alleles)
+                allele = a;
+        }
+        else if (*p == '.')
+            p++;
+        else
+            break;
+        gt[n++] = allele;
+        if (p < end && (*p == '/' || *p == '|'))
+            p++;
+        else
+            break;
+    }
+    if (n == 1)
+        gt[1] = gt[0];
+}
+
+/**
+ * @brief parse a VCF line [p, end). Records of other chromosomes than the loaded sequence are skipped.
+ */
+static void ParseVCFLine(GeneticsObj *_this, GeneticsVariants *v, const char *p, const char *end)
+{
+    while (end > p && (end[-1] == '\r' || end[-1] == '\n'))
+        end--;
+    if (p == end)
+        return;
+    if (*p == '#')
+    {
+        if (end - p > 6 && !strncmp(p, "#CHROM", 6))
+            ParseVCFSamples(_this, v, p, end);
+        return;
+    }
+    const char *field[VCF_FIXED_FIELDS];
+    size_t length[VCF_FIXED_FIELDS];
+    int n = 0;
+    while (n < VCF_FIXED_FIELDS && p < end)
+    {
+        field[n] = p;
+        p = memchr(p, '\t', end - p);
+        if (!p)
+            p = end;
+        length[n] = p - field[n];
+        n++;
+        if (p < end)
+            p++;
+    }
+    if (n < 5 || !isdigit((unsigned char)*field[1]) || length[3] == 0)
+    {
+        v->skipped++;
+        return;
+    }
+    if (_this->seqName[0] && (strlen(_this->seqName) != length[0] || strncmp(_this->seqName, field[0], length[0])))
+        return; // other chromosome
+    const char *ref = field[3];
+    size_t refLength = length[3], position = strtoul(field[1], NULL, 10);
+    for (size_t k = 0; k < refLength; k++)
+    {
+        if (!VCF_BASE[(unsigned char)ref[k]])
+        {
+            v->skipped++;
+            return;
+        }
+    }
+    if (position <= v->refInputFileOffset || position - v->refInputFileOffset - 1 + refLength > v->refSize)
+    {
+        v->outside++;
+        return;
+    }
+    size_t pos = position - v->refInputFileOffset - 1;
+    for (size_t k = 0; k < refLength; k++)
+    {
+        if ((VCF_BASE[(unsigned char)ref[k]] & 0x3) != (v->refDna[pos + k] & 0x3))
+        {
+            v->mismatched++;
+            return;
+        }
+    }
+
+    v->records = Reserve(_this, v->records, &v->recordAlloc, v->recordCount + 1, sizeof(VariantRecord));
+    VariantRecord *record = &v->records[v->recordCount];
+    record->edit = v->editCount;
+    record->alleles = 0;
+    for (const char *a = field[4], *aend = field[4] + length[4]; a < aend && record->alleles < VCF_MAX_ALLELES;)
+    {
+        const char *comma = memchr(a, ',', aend - a);
+        if (!comma)
+            comma = aend;
+        AddEdit(_this, v, pos, ref, refLength, a, comma - a);
+        record->alleles++;
+        a = comma + 1;
+    }
+
+    size_t row = 2 * v->sampleCount;
+    if (row)
+    {
+        size_t need = (v->recordCount + 1) * row;
+        v->genotypes = Reserve(_this, v->genotypes, &v->genotypesAlloc, need, 1);
+        uint8_t *gt = v->genotypes + v->recordCount * row;
+        memset(gt, VCF_MISSING, row);
+        int key = -1; // GT position in FORMAT
+        if (n == VCF_FIXED_FIELDS)
+        {
+            const char *f = field[8], *fend = field[8] + length[8];
+            for (int k = 0; f < fend && key < 0; k++)
+            {
+                const char *colon = memchr(f, ':', fend - f);
+                if (!colon)
+                    colon = fend;
+                if (colon - f == 2 && !strncmp(f, "GT", 2))
+                    key = k;
+                f = colon + 1;
+            }
+        }
+        for (size_t s = 0; key >= 0 && s < v->sampleCount && p < end; s++)
+        {
+            const char *sample = p, *send = memchr(p, '\t', end - p);
+            if (!send)
+                send = end;
+            p = send < end ? send + 1 : end;
+            for (int k = 0; k < key && sample < send; k++)
+            {
+                const char *colon = memchr(sample, ':', send - sample);
+                sample = colon ? colon + 1 : send;
+            }
+            const char *colon = memchr(sample, ':', send - sample);
+            ParseGenotype(sample, colon ? colon : send, record->alleles, gt + 2 * s);
+        }
+    }
+    v->recordCount++;
+}
+
+static bool LoadVCF(GeneticsObj *_this, const char *filename, GeneticsVariants *v)
+{
+    GeneticsReader *reader = Obj_Reader(_this);
+    if (!reader || !Reader_Start(reader, filename))
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, errno, "Error fopening vcf file '%s'", filename);
+        return false;
+    }
+    char *line = NULL; // line split between buffers
+    size_t lineSize = 0, lineAlloc = 0;
+    const char *chunk;
+    size_t size;
+    while (NULL != (chunk = Reader_Next(reader, &size)))
+    {
+        STATS_ADD(&_this->stats, bytes_read, size);
+        const char *p = chunk, *end = chunk + size;
+        while (p < end)
+        {
+            const char *eol = memchr(p, '\n', end - p);
+            const char *lineEnd = eol ? eol : end;
+            if (eol && lineSize == 0)
+            {
+                ParseVCFLine(_this, v, p, lineEnd);
+            }
+            else
+            {
+                size_t n = lineEnd - p;
+                if (lineSize + n > lineAlloc)
+                {
+                    line = Mem_Realloc(_this, line, lineAlloc, 2 * (lineSize + n));
+                    lineAlloc = 2 * (lineSize + n);
+                }
+                memcpy(line + lineSize, p, n);
+                lineSize += n;
+                if (eol)
+                {
+                    ParseVCFLine(_this, v, line, line + lineSize);
+                    lineSize = 0;
+                }
+            }
+            p = eol ? eol + 1 : end;
+        }
+    }
+    if (lineSize)
+        ParseVCFLine(_this, v, line, line + lineSize);
+    Mem_Free(_this, line, lineAlloc);
+    int error = Reader_Error(reader);
+    if (error)
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, error, "Error reading vcf file '%s'", filename);
+    Reader_Stop(reader);
+    return true;
+}
+
+/**
+ * @brief haplotype index of reference index r in [windowBegin, windowEnd);
+ *        a deleted base maps to the next haplotype base
+ */
+static size_t RefToHap(const GeneticsVariants *v, size_t r)
+{
+    size_t lo = 0, hi = v->pieceCount; // last piece with refBegin <= r
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (v->pieces[mid].refBegin <= r)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const HaplotypePiece *piece = &v->pieces[lo];
+    size_t k = r - piece->refBegin;
+    if (piece->alt && k > piece->length)
+        k = piece->length;
+    return piece->hapBegin + k;
+}
+
+/**
+ * @brief reference index of haplotype index h (< haplotype size), SIZE_MAX for an inserted base
+ */
+static size_t HapToRef(const GeneticsVariants *v, size_t h)
+{
+    size_t lo = 0, hi = v->pieceCount; // last piece with hapBegin <= h
+    while (hi - lo > 1)
+    {
+        size_t mid = (lo + hi) / 2;
+        if (v->pieces[mid].hapBegin <= h)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const HaplotypePiece *piece = &v->pieces[lo];
+    size_t k = h - piece->hapBegin;
+    if (piece->alt && k >= piece->refLength)
+        return SIZE_MAX;
+    return piece->refBegin + k;
+}
+
+
+/**
+ * @brief haplotype file offset of reference file offset o, offsets outside the window keep their
+ *        distance to it. For the last base of an exon (exonEnd) the bases inserted after it stay in the exon.
+ */
+static size_t MapOffset(const GeneticsVariants *v, size_t o, bool exonEnd)
+{
+    size_t first = v->refInputFileOffset + 1 + v->windowBegin; // same offset in both coordinates
+    if (o < first)
+        return o;
+    size_t r = o - v->refInputFileOffset - 1 + exonEnd;
+    if (r >= v->windowEnd)
+        return first + v->hapSize + (r - v->windowEnd) - exonEnd;
+    return first + RefToHap(v, r) - exonEnd;
+}
+
+static void SaveSplice(GeneticsObj *_this, GeneticsVariants *v)
+{
+    v->refSplice = Reserve(_this, v->refSplice, &v->refSpliceAlloc, _this->spliceSize, sizeof(size_t));
+    if (_this->spliceSize)
+        memcpy(v->refSplice, _this->spliceData, _this->spliceSize * sizeof(size_t));
+    v->refSpliceSize = _this->spliceSize;
+}
+
+static void MapSplice(GeneticsObj *_this, const GeneticsVariants *v)
+{
+    for (int k = 0; k < v->refSpliceSize; k++)
+        _this->spliceData[k] = MapOffset(v, v->refSplice[k], k % 2 == 0);
+    _this->spliceSize = v->refSpliceSize;
+}
+
+/**
+ * @brief back to the reference sequence, codon_start and splice data
+ */
+static void Haplotype_Leave(GeneticsObj *_this)
+{
+    GeneticsVariants *v = _this->variants;
+    if (!_this->haplotype)
+        return;
+    _this->dna = v->refDna;
+    _this->dnaSize = v->refSize;
+    _this->inputFileOffset = v->refInputFileOffset;
+    _this->start_codon = v->refStartCodon;
+    if (v->refSpliceSize)
+        memcpy(_this->spliceData, v->refSplice, v->refSpliceSize * sizeof(size_t));
+    _this->spliceSize = v->refSpliceSize;
+    _this->haplotype = false;
+    Scan_Reset(_this);
+    Index_Delete(_this);
+}
+
+static int CompareEdits(const void *a, const void *b)
+{
+    const VariantEdit *ea = *(const VariantEdit **)a, *eb = *(const VariantEdit **)b;
+    if (ea->pos != eb->pos)
+        return ea->pos < eb->pos ? -1 : 1;
+    if (ea->refLength != eb->refLength)
+        return ea->refLength < eb->refLength ? -1 : 1; // insertions before the base they precede
+    return ea < eb ? -1 : ea > eb;
+}
+
+static void AddPiece(GeneticsVariants *v, size_t refBegin, size_t length, size_t refLength, const uint8_t *alt)
+{
+    HaplotypePiece *piece = &v->pieces[v->pieceCount++];
+    piece->hapBegin = v->hapSize;
+    piece->refBegin = refBegin;
+    piece->length = length;
+    piece->refLength = refLength;
+    piece->alt = alt;
+    v->hapSize += length;
+}
+
+/**
+ * @brief piece table of the window from the sorted applied edits; an edit overlapping the previous one is skipped
+ *
+ * @return number of edits applied
+ */
+static size_t BuildPieces(GeneticsObj *_this, GeneticsVariants *v, size_t n, size_t *conflicts)
+{
+    size_t cursor = v->windowBegin, applied = 0;
+    v->pieces = Reserve(_this, v->pieces, &v->pieceAlloc, 2 * n + 1, sizeof(HaplotypePiece));
+    v->pieceCount = 0;
+    v->hapSize = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const VariantEdit *e = v->applied[i];
+        if (e->pos < cursor)
+        {
+            (*conflicts)++;
+            continue;
+        }
+        if (e->pos > cursor)
+            AddPiece(v, cursor, e->pos - cursor, e->pos - cursor, NULL);
+        AddPiece(v, e->pos, e->length, e->refLength, v->bases + e->bases);
+        cursor = e->pos + e->refLength;
+        applied++;
+    }
+    if (cursor < v->windowEnd)
+        AddPiece(v, cursor, v->windowEnd - cursor, v->windowEnd - cursor, NULL);
+    return applied;
+}
+
+/**
+ * @brief haplotype bases: the reference itself if the window has no edit, otherwise the pieces
+ *        gathered in the buffer shared by all selections
+ */
+static uint8_t *Gather(GeneticsObj *_this, GeneticsVariants *v)
+{
+    if (v->pieceCount == 1 && !v->pieces[0].alt)
+        return v->refDna + v->windowBegin;
+    v->buffer = Reserve(_this, v->buffer, &v->bufferAlloc, v->hapSize + 1, 1);
+    for (size_t i = 0; i < v->pieceCount; i++)
+    {
+        const HaplotypePiece *piece = &v->pieces[i];
+        memcpy(v->buffer + piece->hapBegin, piece->alt ? piece->alt : v->refDna + piece->refBegin, piece->length);
+    }
+    STATS_ADD(&_this->stats, bases, v->hapSize);
+    return v->buffer;
+}
+
+/**
+ * @brief Load the SNVs and indels of a VCF file for the loaded FASTA sequence.
+ *        Records of other chromosomes are ignored, records whose REF differs from the loaded sequence
+ *        are skipped with a warning. Symbolic alleles (<DEL>, *) are not applied.
+ *        Genotypes (GT) of all samples are kept, see Genetics_SelectHaplotype().
+ *        The variants are dropped when another sequence is loaded.
+ *
+ * @param _this    genetics object
+ * @param filename VCF file name (uncompressed)
+ * @return number of variant records kept
+ */
+size_t Genetics_LoadVCF(GeneticsObj *_this, const char *filename)
+{
+    Variant_Delete(_this);
+    if (_this->dnaInput || _this->dnaView || _this->readCount || _this->dnaSize == 0)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: load a fasta sequence before the vcf file");
+        return 0;
+    }
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_VARIANT);
+    GeneticsVariants *v = Mem_Alloc(_this, sizeof(GeneticsVariants));
+    memset(v, 0, sizeof(GeneticsVariants));
+    v->refDna = _this->dna;
+    v->refSize = _this->dnaSize;
+    v->refInputFileOffset = _this->inputFileOffset;
+    _this->variants = v;
+    size_t records = 0;
+    if (LoadVCF(_this, filename, v))
+    {
+        records = v->recordCount;
+        if (v->outside || v->mismatched || v->skipped)
+            Obj_Error(_this, GENETICS_LEVEL_WARNING, 0,
+                      "Warning vcf file '%s' : %lu records outside the loaded sequence, %lu with a different REF, "
+                      "%lu malformed lines skipped", filename, v->outside, v->mismatched, v->skipped);
+    }
+    else
+        Variant_Delete(_this);
+    STATS_END();
+    return records;
+}
+
+/**
+ * @brief Number of samples of the loaded VCF file
+ *
+ * @param _this genetics object
+ * @return size_t samples (0 if no VCF file is loaded or it has no genotypes)
+ */
+size_t Genetics_VCFSamples(GeneticsObj *_this)
+{
+    return _this->variants ? _this->variants->sampleCount : 0;
+}
+
+/**
+ * @brief Name of a sample of the loaded VCF file
+ *
+ * @param _this  genetics object
+ * @param sample sample index (0 based)
+ * @return const char* name or NULL if sample is out of range
+ */
+const char *Genetics_VCFSampleName(GeneticsObj *_this, size_t sample)
+{
+    const GeneticsVariants *v = _this->variants;
+    if (!v || sample >= v->sampleCount)
+        return NULL;
+    return v->names + v->nameOffsets[sample];
+}
+
+/**
+ * @brief Select a haplotype of a VCF sample; all operations (print, find_start, scan...) work on the
+ *        alternate sequence until Genetics_SelectReference() or the next selection.
+ *        The haplotype is a piece table over the shared reference and the sample edits: if the window
+ *        has no edit dna points in the reference, otherwise the pieces are gathered in one buffer
+ *        reused by every selection, so samples can be walked without a copy of the reference each.
+ *        File offsets of the haplotype start at the window begin; splice data set with Genetics_Splice()
+ *        stays in reference offsets and is mapped, as is codon_start. Overlapping edits are skipped.
+ *
+ * @param _this     genetics object
+ * @param sample    sample index (0 based) or GENETICS_SAMPLE_ALT for the first alternate allele of every record
+ * @param haplotype 1 or 2 (first or second GT allele, a haploid GT is used for both)
+ * @param begin     window first base reference file offset (1 based), 0 and 0 for the whole sequence
+ * @param end       window last base (inclusive)
+ * @param variants  filled with the number of variants applied (can be NULL)
+ * @return false if no VCF file is loaded or the sample or window is invalid
+ */
+bool Genetics_SelectHaplotype(GeneticsObj *_this, size_t sample, int haplotype, size_t begin, size_t end,
+                              size_t *variants)
+{
+    GeneticsVariants *v = _this->variants;
+    if (!v)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: no vcf file loaded");
+        return false;
+    }
+    if (sample != GENETICS_SAMPLE_ALT && sample >= v->sampleCount)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: sample %lu not found (%lu samples)", sample, v->sampleCount);
+        return false;
+    }
+    if (haplotype != 1 && haplotype != 2)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: haplotype must be 1 or 2");
+        return false;
+    }
+    size_t first = v->refInputFileOffset + 1, last = v->refInputFileOffset + v->refSize;
+    if (begin == 0 && end == 0)
+    {
+        begin = first;
+        end = last;
+    }
+    if (begin > end || begin > last || end < first)
+    {
+        Obj_Error(_this, GENETICS_LEVEL_ERROR, 0, "ERROR: haplotype window %lu-%lu is outside the loaded sequence %lu-%lu",
+                  begin, end, first, last);
+        return false;
+    }
+    STATS_BEGIN(&_this->stats, GENETICS_STAT_VARIANT);
+    if (!_this->haplotype)
+    {
+        v->refStartCodon = _this->start_codon;
+        SaveSplice(_this, v);
+    }
+    v->windowBegin = (begin < first ? first : begin) - first;
+    v->windowEnd = (end > last ? last : end) - first + 1;
+
+    size_t n = 0, row = 2 * v->sampleCount, column = 2 * sample + haplotype - 1;
+    bool sorted = true;
+    v->applied = Reserve(_this, v->applied, &v->appliedAlloc, v->recordCount, sizeof(VariantEdit *));
+    for (size_t r = 0; r < v->recordCount; r++)
+    {
+        unsigned allele = sample == GENETICS_SAMPLE_ALT ? 1 : v->genotypes[r * row + column];
+        if (allele == 0 || allele > v->records[r].alleles)
+            continue; // reference or missing
+        const VariantEdit *e = &v->edits[v->records[r].edit + allele - 1];
+        if ((e->refLength == 0 && e->length == 0) || e->pos < v->windowBegin || e->pos + e->refLength > v->windowEnd ||
+            (e->pos == v->windowEnd && v->windowEnd < v->refSize))
+            continue;
+        if (n && CompareEdits(&v->applied[n - 1], &e) > 0)
+            sorted = false;
+        v->applied[n++] = e;
+    }
+    if (!sorted)
+        qsort(v->applied, n, sizeof(VariantEdit *), CompareEdits);
+    size_t conflicts = 0, applied = BuildPieces(_this, v, n, &conflicts);
+
+    _this->dna = Gather(_this, v);
+    _this->dnaSize = v->hapSize;
+    _this->inputFileOffset = v->refInputFileOffset + v->windowBegin;
+    size_t start = v->refStartCodon - 1;
+    _this->start_codon = 1;
+    if (start >= v->windowBegin && start < v->windowEnd && RefToHap(v, start) < v->hapSize)
+        _this->start_codon = RefToHap(v, start) + 1;
+    _this->haplotype = true;
+    MapSplice(_this, v);
+    Scan_Reset(_this);
+    Index_Delete(_this);
+    if (conflicts)
+        Obj_Error(_this, GENETICS_LEVEL_WARNING, 0, "Warning haplotype: %lu overlapping variants skipped", conflicts);
+    if (variants)
+        *variants = applied;
+    STATS_END();
+    return true;
+}
+
+/**
+ * @brief Back to the reference sequence after Genetics_SelectHaplotype(); codon_start and
+ *        splice data are the reference ones
+ *
+ * @param _this genetics object
+ */
+void Genetics_SelectReference(GeneticsObj *_this)
+{
+    Haplotype_Leave(_this);
+}
+
+/**
+ * @brief Reference file offset of a base of the selected haplotype
+ *
+ * @param _this  genetics object
+ * @param offset haplotype file offset (1 based)
+ * @return size_t reference file offset, 0 for an inserted base or an offset outside the haplotype
+ *         (offset if no haplotype is selected)
+ */
+size_t Genetics_HaplotypeToReference(GeneticsObj *_this, size_t offset)
+{
+    if (!_this->haplotype)
+        return offset;
+    const GeneticsVariants *v = _this->variants;
+    size_t first = _this->inputFileOffset + 1;
+    if (offset < first || offset - first >= v->hapSize)
+        return 0;
+    size_t r = HapToRef(v, offset - first);
+    return r == SIZE_MAX ? 0 : v->refInputFileOffset + 1 + r;
+}
+
+/**
+ * @brief Haplotype file offset of a reference base; a deleted base maps to the next haplotype base
+ *
+ * @param _this  genetics object
+ * @param offset reference file offset (1 based)
+ * @return size_t haplotype file offset, 0 outside the haplotype window (offset if no haplotype is selected)
+ */
+size_t Genetics_ReferenceToHaplotype(GeneticsObj *_this, size_t offset)
+{
+    if (!_this->haplotype)
+        return offset;
+    const GeneticsVariants *v = _this->variants;
+    size_t first = v->refInputFileOffset + 1 + v->windowBegin;
+    if (offset < first || offset - first >= v->windowEnd - v->windowBegin)
+        return 0;
+    size_t h = RefToHap(v, offset - v->refInputFileOffset - 1);
+    return h < v->hapSize ? _this->inputFileOffset + 1 + h : 0;
+}
+
+/**
+ * @brief new splice data (reference file offsets) while a haplotype is selected: keep it and map it
+ */
+void Variant_Splice(GeneticsObj *_this)
+{
+    GeneticsVariants *v = _this->variants;
+    SaveSplice(_this, v);
+    MapSplice(_this, v);
+}
+
+/**
+ * @brief back to the reference and drop the VCF variants
+ */
+void Variant_Delete(GeneticsObj *_this)
+{
+    GeneticsVariants *v = _this->variants;
+    if (!v)
+        return;
+    Haplotype_Leave(_this);
+    Mem_Free(_this, v->records, v->recordAlloc * sizeof(VariantRecord));
+    Mem_Free(_this, v->edits, v->editAlloc * sizeof(VariantEdit));
+    Mem_Free(_this, v->bases, v->basesAlloc);
+    Mem_Free(_this, v->genotypes, v->genotypesAlloc);
+    Mem_Free(_this, v->names, v->namesAlloc);
+    Mem_Free(_this, v->nameOffsets, v->sampleAlloc * sizeof(size_t));
+    Mem_Free(_this, v->refSplice, v->refSpliceAlloc * sizeof(size_t));
+    Mem_Free(_this, v->applied, v->appliedAlloc * sizeof(VariantEdit *));
+    Mem_Free(_this, v->pieces, v->pieceAlloc * sizeof(HaplotypePiece));
+    Mem_Free(_this, v->buffer, v->bufferAlloc);
+    Mem_Free(_this, v, sizeof(GeneticsVariants));
+    _this->variants = NULL;
+}
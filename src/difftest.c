@@ -0,0 +1,932 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "tests.h"
+
+#include "lib/genetics/genetics.h"
+
+/**
+ * @brief differential test: one case (sequence, direction, genetic code, splice set, codon_start) is
+ *        set up in two objects, every optimized path runs on one and the reference path on the other,
+ *        and the outputs must be byte identical:
+ *          print (all flag combinations and formats) against DNA_PRINT_GENERIC,
+ *          find_start against DNA_PRINT_GENERIC (no incremental scan),
+ *          spliced text print and translation against the exon based FASTA and JSON formats,
+ *          incremental scan of random appends against one scan of the whole sequence,
+ *          FASTA file load against Genetics_AddDNA(),
+ *          score only (SIMD) alignment against the full matrix,
+ *          FM-index counts against a naive search,
+ *          N block and soft-mask intervals against a naive scan of the text,
+ *          repeat intervals (1 and several threads) against a naive scan, the repeat mask skipped by the above,
+ *          the kernels of every instruction set of the cpu against the scalar ones.
+ *        The case is decoded from bytes so the same code runs under a fuzzer (see fuzz.c);
+ *        DiffTest_Repros() runs fixed cases of past differences.
+ */
+#define DIFFTEST_MAX_SPLICE 4       // splice pairs
+#define DIFFTEST_ALIGN_MAX  768     // bases, larger cases skip the alignment check
+#define DIFFTEST_PATTERNS   4       // index patterns per case
+
+static const DNA_PRINT_FlAGS PRINT_FLAGS[] = {
+    DNA_PRINT_REVERSE, DNA_PRINT_COMPLEMENT, DNA_PRINT_RNA,
+    DNA_PRINT_TRANSLATE, DNA_PRINT_TRANSLATE_LONG, DNA_PRINT_TRANSLATE_CORRELATE,
+};
+#define PRINT_FLAGS_COUNT (sizeof(PRINT_FLAGS) / sizeof(PRINT_FLAGS[0]))
+static const DNA_PRINT_FlAGS PRINT_FORMATS[] = {
+    DNA_PRINT_FORMAT_TEXT, DNA_PRINT_FORMAT_FASTA, DNA_PRINT_FORMAT_BINARY,
+    DNA_PRINT_FORMAT_JSON, DNA_PRINT_FORMAT_TSV,
+};
+static const int TABLES[] = {1, 2, 4, 11};
+static const DNA_PRINT_FlAGS CPU_FLAGS[] = {
+    DNA_PRINT_FORMAT_FASTA, DNA_PRINT_FORMAT_BINARY, DNA_PRINT_FORMAT_FASTA | DNA_PRINT_TRANSLATE,
+    DNA_PRINT_FORMAT_FASTA | DNA_PRINT_TRANSLATE | DNA_PRINT_COMPLEMENT,
+    DNA_PRINT_FORMAT_FASTA | DNA_PRINT_TRANSLATE | DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT,
+    DNA_PRINT_FORMAT_JSON | DNA_PRINT_TRANSLATE,
+};
+
+typedef struct _DiffInput
+{
+    const uint8_t *data;
+    size_t size;
+} DiffInput;
+
+/**
+ * @brief next input byte modulo n (0 once the input is used up)
+ */
+static unsigned Take(DiffInput *in, unsigned n)
+{
+    if (in->size == 0)
+        return 0;
+    in->size--;
+    return *in->data++ % n;
+}
+
+static unsigned Take16(DiffInput *in, unsigned n)
+{
+    unsigned v = Take(in, 256) << 8;
+    return (v | Take(in, 256)) % n;
+}
+
+typedef struct _DiffCase
+{
+    DNA_DIR dir;
+    int table;
+    size_t codonStart;
+    size_t splice[2 * DIFFTEST_MAX_SPLICE];
+    int spliceSize;
+    size_t width;           // FASTA file line width
+    unsigned chunkSeed;     // append sizes of the incremental scan
+    GENETICS_MASK maskSkip;
+    bool nBlocks;           // bases has N runs
+    bool repeats;           // tandem copies in bases, repeat mask found and skipped
+    unsigned dustLevel;
+    size_t repeatLength;
+    char bases[DIFFTEST_MAX_BASES + 1];
+    size_t size;
+} DiffCase;
+
+static void DecodeCase(const uint8_t *data, size_t size, DiffCase *c)
+{
+    static const char BASES[8] = {'T', 'C', 'A', 'G', 't', 'c', 'a', 'g'};
+    DiffInput in = {data, size};
+    unsigned options = Take(&in, 256);
+    c->dir = options & 1 ? DNA_DIR_3_TO_5 : DNA_DIR_5_TO_3;
+    c->table = TABLES[(options >> 1) & 3];
+    unsigned start = Take16(&in, 65536);
+    c->spliceSize = 2 * Take(&in, DIFFTEST_MAX_SPLICE + 1);
+    unsigned splice[2 * DIFFTEST_MAX_SPLICE];
+    for (int k = 0; k < c->spliceSize; k++)
+        splice[k] = Take16(&in, 65536);
+    c->width = Take(&in, 81);
+    c->chunkSeed = Take(&in, 256);
+    c->maskSkip = (options >> 3) & (GENETICS_MASK_N | GENETICS_MASK_SOFT);
+    c->nBlocks = false;
+    c->repeats = options & 0x40;
+    size_t period = 0;
+    if (c->repeats)
+    {
+        c->maskSkip |= GENETICS_MASK_REPEAT;
+        c->dustLevel = Take(&in, 24);
+        c->repeatLength = Take(&in, 24);
+        period = 1 + Take(&in, GENETICS_REPEAT_MAX_PERIOD + 1);
+    }
+    c->size = in.size < DIFFTEST_MAX_BASES ? in.size : DIFFTEST_MAX_BASES;
+    for (size_t i = 0; i < c->size; i++)
+    {
+        c->bases[i] = BASES[in.data[i] & 7];
+        if ((options & 0x20) && (in.data[i] & 0xF0) == 0xF0)
+        { // N runs in 1 of 16 bases
+            c->bases[i] = in.data[i] & 4 ? 'n' : 'N';
+            c->nBlocks = true;
+        }
+        else if (period && i >= period && (in.data[i] & 0x0C))
+            c->bases[i] = c->bases[i - period]; // tandem copies, 3 bases of 4
+    }
+    c->bases[c->size] = 0;
+    // codon_start 1..3 most of the time, anywhere otherwise; splice points around the sequence,
+    // one in five past its end
+    c->codonStart = options & 0x80 ? 1 + start % (c->size + 1) : 1 + start % 3;
+    for (int k = 0; k < c->spliceSize; k++)
+        c->splice[k] = 1 + splice[k] % (c->size + c->size / 4 + 8);
+}
+
+typedef struct _DiffSide
+{
+    GeneticsObj *obj;
+    FILE *out;
+    char *buffer;
+    size_t size;
+} DiffSide;
+
+static void DiffError(void *ctx, GENETICS_LEVEL level, const char *message)
+{
+    fprintf(ctx, "%s\n", message);
+}
+
+static bool OpenSide(DiffSide *side)
+{
+    memset(side, 0, sizeof(DiffSide));
+    if (!(side->out = open_memstream(&side->buffer, &side->size)))
+        return false;
+    side->obj = Genetics_New();
+    Genetics_SetOutput(side->obj, side->out);
+    Genetics_SetErrorCallback(side->obj, DiffError, side->out);
+    return true;
+}
+
+static void CloseSide(DiffSide *side)
+{
+    if (side->obj)
+        Genetics_Delete(side->obj);
+    if (side->out)
+        fclose(side->out);
+    free(side->buffer);
+}
+
+/**
+ * @brief genetic code, splice set and codon_start of the case on a loaded object; output so far is dropped
+ */
+static void ApplyCase(DiffSide *side, const DiffCase *c)
+{
+    Genetics_SetTranslationTable(side->obj, c->table);
+    Genetics_Splice(side->obj, c->spliceSize, (size_t *)c->splice);
+    Genetics_SetCodonStart(side->obj, c->codonStart);
+    if (c->repeats)
+        Genetics_MaskRepeats(side->obj, c->dustLevel, c->repeatLength);
+    Genetics_SetMaskSkip(side->obj, c->maskSkip);
+    Genetics_SetFastaWidth(side->obj, FASTA_DEFAULT_WIDTH);
+    fflush(side->out);
+    rewind(side->out);
+}
+
+static void LoadCase(DiffSide *side, const DiffCase *c)
+{
+    Genetics_StartDNA(side->obj, c->dir, "");
+    Genetics_AddDNA(side->obj, c->bases);
+    Genetics_StopDNA(side->obj);
+    ApplyCase(side, c);
+}
+
+/**
+ * @brief compare the outputs since the last call and start over
+ *
+ * @return 1 if they differ
+ */
+static int Compare(DiffSide *fast, DiffSide *ref, const char *what, DNA_PRINT_FlAGS flags, FILE *err)
+{
+    fflush(fast->out);
+    fflush(ref->out);
+    size_t i = 0, n = fast->size < ref->size ? fast->size : ref->size;
+    while (i < n && fast->buffer[i] == ref->buffer[i])
+        i++;
+    int differs = i < n || fast->size != ref->size;
+    if (differs)
+        fprintf(err, "difftest: %s flags 0x%x: outputs differ at byte %lu (%lu / %lu bytes)\n", what, flags, i,
+                fast->size, ref->size);
+    rewind(fast->out);
+    rewind(ref->out);
+    return differs;
+}
+
+static int CheckPrint(DiffSide *fast, DiffSide *ref, FILE *err)
+{
+    int differences = 0;
+    for (size_t format = 0; format < sizeof(PRINT_FORMATS) / sizeof(PRINT_FORMATS[0]); format++)
+    {
+        for (unsigned combination = 0; combination < 1u << PRINT_FLAGS_COUNT; combination++)
+        {
+            DNA_PRINT_FlAGS flags = PRINT_FORMATS[format];
+            for (size_t k = 0; k < PRINT_FLAGS_COUNT; k++)
+                if (combination & (1u << k))
+                    flags |= PRINT_FLAGS[k];
+            Genetics_PrintDNA(fast->obj, flags);
+            Genetics_PrintDNA(ref->obj, flags | DNA_PRINT_GENERIC);
+            differences += Compare(fast, ref, "print", flags, err);
+        }
+    }
+    return differences;
+}
+
+static int CheckFindStart(DiffSide *fast, DiffSide *ref, FILE *err)
+{
+    int differences = 0;
+    for (DNA_PRINT_FlAGS flags = 0; flags <= (DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT); flags++)
+    {
+        Genetics_FindStart(fast->obj, flags | DNA_PRINT_FORMAT_JSON);
+        Genetics_FindStart(ref->obj, flags | DNA_PRINT_FORMAT_JSON | DNA_PRINT_GENERIC);
+        differences += Compare(fast, ref, "find_start", flags, err);
+        // codon_start set by find_start is used by the next print
+        Genetics_PrintDNA(fast->obj, DNA_PRINT_TRANSLATE | flags);
+        Genetics_PrintDNA(ref->obj, DNA_PRINT_TRANSLATE | flags | DNA_PRINT_GENERIC);
+        differences += Compare(fast, ref, "find_start print", flags, err);
+    }
+    return differences;
+}
+
+/**
+ * @brief true if line is a text print line starting with a position (START_LINE_FMT)
+ */
+static bool PositionLine(const char *line, size_t n)
+{
+    return n > 10 && isdigit((unsigned char)line[8]) && line[9] == ' ';
+}
+
+/**
+ * @brief letters of the position lines of a text print, upper case
+ */
+static void TextBases(const char *text, char *bases)
+{
+    for (const char *line = text; *line;)
+    {
+        size_t n = strcspn(line, "\n");
+        for (size_t k = 10; PositionLine(line, n) && k < n; k++)
+            if (isalpha((unsigned char)line[k]))
+                *bases++ = toupper((unsigned char)line[k]);
+        line += line[n] ? n + 1 : n;
+    }
+    *bases = 0;
+}
+
+/**
+ * @brief letters of a FASTA record, upper case
+ */
+static void FastaBases(const char *text, char *bases)
+{
+    for (const char *line = text; *line;)
+    {
+        size_t n = strcspn(line, "\n");
+        for (size_t k = 0; line[0] != '>' && k < n; k++)
+            if (isalpha((unsigned char)line[k]))
+                *bases++ = toupper((unsigned char)line[k]);
+        line += line[n] ? n + 1 : n;
+    }
+    *bases = 0;
+}
+
+/**
+ * @brief open reading frames of a text translation as "begin:protein" lines,
+ *        a frame goes on over the lines ending with "..."
+ */
+static void TextORFs(const char *text, char *orfs)
+{
+    bool open = false;
+    for (const char *line = text; *line;)
+    {
+        size_t n = strcspn(line, "\n");
+        if (PositionLine(line, n))
+        {
+            if (!open)
+                orfs += sprintf(orfs, "%lu:", strtoul(line, NULL, 10));
+            for (size_t k = 10; k < n; k++)
+                if (isalpha((unsigned char)line[k]))
+                    *orfs++ = line[k];
+            open = !strncmp(line + n - 3, "...", 3);
+            if (!open)
+                *orfs++ = '\n';
+        }
+        line += line[n] ? n + 1 : n;
+    }
+    *orfs = 0;
+}
+
+/**
+ * @brief open reading frames of a JSON translation as "begin:protein" lines
+ */
+static void JsonORFs(const char *text, char *orfs)
+{
+    for (const char *p = text; (p = strstr(p, "\"begin\":"));)
+    {
+        unsigned long begin = strtoul(p + 8, NULL, 10);
+        const char *protein = strstr(p, "\"protein\":\"");
+        if (!protein)
+            break;
+        protein += 11;
+        size_t n = strcspn(protein, "\"");
+        orfs += sprintf(orfs, "%lu:%.*s\n", begin, (int)n, protein);
+        p = protein + n;
+    }
+    *orfs = 0;
+}
+
+/**
+ * @brief output since the last call read by parse (the result is never longer than the output), then start over
+ */
+static char *Parse(DiffSide *side, void (*parse)(const char *, char *))
+{
+    fflush(side->out);
+    char *text = malloc(side->size + 1), *parsed = malloc(side->size + 1);
+    if (text && parsed)
+    {
+        memcpy(text, side->buffer, side->size);
+        text[side->size] = 0;
+        parse(text, parsed);
+    }
+    else
+    {
+        free(parsed);
+        parsed = NULL;
+    }
+    free(text);
+    rewind(side->out);
+    return parsed;
+}
+
+/**
+ * @brief codon_start of the case and around every splice point (in and next to the introns)
+ */
+static size_t SpliceStarts(const DiffCase *c, size_t *starts)
+{
+    size_t n = 0;
+    starts[n++] = c->codonStart;
+    for (int k = 0; k < c->spliceSize; k++)
+        for (size_t s = c->splice[k] - 1; s <= c->splice[k] + 1; s++)
+            if (s >= 1 && s < c->size)
+                starts[n++] = s;
+    return n;
+}
+
+/**
+ * @brief spliced text print (generic loop, indexes the splice points) against the exon based formats
+ *        (Splice_Exons(), as peptide and codon usage): the bases against FASTA, the reading frames of
+ *        the translation against JSON; every strand and codon_start next to a splice point.
+ *        codon_start is left changed.
+ */
+static int CheckSpliced(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    size_t starts[1 + 6 * DIFFTEST_MAX_SPLICE], count = SpliceStarts(c, starts);
+    int differences = 0;
+    for (size_t k = 0; k < count && !differences; k++)
+    {
+        Genetics_SetCodonStart(ref->obj, starts[k]);
+        for (DNA_PRINT_FlAGS flags = 0; flags <= (DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT | DNA_PRINT_RNA); flags++)
+        {
+            if (flags & ~(DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT | DNA_PRINT_RNA))
+                continue;
+            Genetics_PrintDNA(ref->obj, flags | DNA_PRINT_GENERIC);
+            char *text = Parse(ref, TextBases);
+            Genetics_PrintDNA(ref->obj, flags | DNA_PRINT_FORMAT_FASTA);
+            char *fasta = Parse(ref, FastaBases);
+            size_t n = text ? strlen(text) : 0, m = fasta ? strlen(fasta) : 0;
+            if (text && fasta && (n != m / 3 * 3 || strncmp(text, fasta, n)))
+            {
+                fprintf(err, "difftest: spliced print flags 0x%x codon_start %lu: %lu bases, FASTA %lu\n", flags,
+                        starts[k], n, m);
+                differences++;
+            }
+            free(text);
+            free(fasta);
+            if (flags & DNA_PRINT_RNA)
+                continue;
+            Genetics_PrintDNA(ref->obj, flags | DNA_PRINT_TRANSLATE | DNA_PRINT_GENERIC);
+            text = Parse(ref, TextORFs);
+            Genetics_PrintDNA(ref->obj, flags | DNA_PRINT_TRANSLATE | DNA_PRINT_FORMAT_JSON);
+            char *json = Parse(ref, JsonORFs);
+            if (text && json && strcmp(text, json))
+            {
+                fprintf(err, "difftest: spliced translation flags 0x%x codon_start %lu: reading frames differ from "
+                        "JSON\n%s--\n%s", flags, starts[k], text, json);
+                differences++;
+            }
+            free(text);
+            free(json);
+        }
+    }
+    return differences;
+}
+
+static bool SameScan(const GeneticsScan *a, const GeneticsScan *b)
+{
+    if (a->bases != b->bases || a->start != b->start || a->orfCount != b->orfCount ||
+        memcmp(a->codons, b->codons, sizeof(a->codons)) || memcmp(a->composition, b->composition, sizeof(a->composition)))
+        return false;
+    for (int f = 0; f < 3; f++)
+        if (a->open[f].begin != b->open[f].begin || (a->open[f].begin && a->open[f].end != b->open[f].end))
+            return false;
+    for (size_t i = 0; i < a->orfCount; i++)
+        if (a->orfs[i].begin != b->orfs[i].begin || a->orfs[i].end != b->orfs[i].end ||
+            a->orfs[i].frame != b->orfs[i].frame)
+            return false;
+    return true;
+}
+
+/**
+ * @brief scan after every append of random size against one scan of the whole sequence
+ */
+static int CheckScan(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    DiffSide stream;
+    if (!OpenSide(&stream))
+        return 0;
+    Genetics_StartDNA(stream.obj, c->dir, "");
+    Genetics_SetTranslationTable(stream.obj, c->table);
+    Genetics_SetMaskSkip(stream.obj, c->maskSkip);
+    char chunk[128];
+    unsigned seed = c->chunkSeed;
+    for (size_t i = 0; i < c->size;)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t n = 1 + (seed >> 16) % (sizeof(chunk) - 1);
+        if (n > c->size - i)
+            n = c->size - i;
+        memcpy(chunk, c->bases + i, n);
+        chunk[n] = 0;
+        Genetics_AddDNA(stream.obj, chunk);
+        Genetics_Scan(stream.obj);
+        i += n;
+    }
+    Genetics_StopDNA(stream.obj);
+    Genetics_SetMaskSkip(ref->obj, c->maskSkip & ~GENETICS_MASK_REPEAT); // repeats are found on whole sequences
+    Genetics_ResetScan(ref->obj);
+    const GeneticsScan *whole = Genetics_Scan(ref->obj), *streamed = Genetics_Scan(stream.obj);
+    int differs = whole && streamed && !SameScan(whole, streamed);
+    if (differs)
+        fprintf(err, "difftest: scan: incremental scan (%lu bases, %lu orfs) differs from the whole sequence scan "
+                "(%lu bases, %lu orfs)\n", streamed->bases, streamed->orfCount, whole->bases, whole->orfCount);
+    Genetics_SetMaskSkip(ref->obj, c->maskSkip);
+    CloseSide(&stream);
+    return differs;
+}
+
+/**
+ * @brief the case written as a FASTA file and loaded against the sequence added with Genetics_AddDNA()
+ */
+static int CheckLoad(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    char path[] = "/tmp/difftest-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return 0;
+    // two records with a comment between: the parallel loader must stitch them at any split point
+    FILE *f = fdopen(fd, "w");
+    fputs(">difftest case\n", f);
+    size_t width = c->width ? c->width : c->size, half = width ? c->size / width / 2 * width : 0;
+    for (size_t i = 0; i < c->size; i += width)
+    {
+        if (i == half && i > 0)
+            fputs(";difftest comment\n>difftest second record\n", f);
+        fprintf(f, "%.*s\n", (int)width, c->bases + i);
+    }
+    fclose(f);
+    // sequential, threads, reference cache (loaded twice: new entry then shared)
+    DiffSide sides[3];
+    int differences = 0;
+    memset(sides, 0, sizeof(sides));
+    if (OpenSide(&sides[0]) && OpenSide(&sides[1]) && OpenSide(&sides[2]))
+    {
+        Genetics_SetLoadThreads(sides[0].obj, 1);
+        Genetics_SetLoadThreads(sides[1].obj, 2 + c->chunkSeed % 6);
+        Genetics_SetReferenceCache(sides[2].obj, true);
+        Genetics_LoadFASTA(sides[0].obj, 0, 0, path, "");
+        Genetics_LoadFASTA(sides[1].obj, 0, 0, path, "");
+        differences += Compare(&sides[1], &sides[0], "load_fasta threads", 0, err);
+        for (int load = 0; load < 2; load++)
+        {
+            Genetics_LoadFASTA(sides[0].obj, 0, 0, path, "");
+            Genetics_LoadFASTA(sides[2].obj, 0, 0, path, "");
+            differences += Compare(&sides[2], &sides[0], "load_fasta refcache", 0, err);
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            DiffSide *file = &sides[k];
+            ApplyCase(file, c);
+            Genetics_PrintDNA(file->obj, DNA_PRINT_FORMAT_FASTA);
+            Genetics_PrintDNA(ref->obj, DNA_PRINT_FORMAT_FASTA);
+            differences += Compare(file, ref, "load_fasta", DNA_PRINT_FORMAT_FASTA, err);
+            Genetics_PrintDNA(file->obj, DNA_PRINT_TRANSLATE);
+            Genetics_PrintDNA(ref->obj, DNA_PRINT_TRANSLATE);
+            differences += Compare(file, ref, "load_fasta", DNA_PRINT_TRANSLATE, err);
+            Genetics_PrintMasks(file->obj, GENETICS_MASK_N | GENETICS_MASK_SOFT, DNA_PRINT_FORMAT_TSV);
+            Genetics_PrintMasks(ref->obj, GENETICS_MASK_N | GENETICS_MASK_SOFT, DNA_PRINT_FORMAT_TSV);
+            differences += Compare(file, ref, "load_fasta masks", DNA_PRINT_FORMAT_TSV, err);
+        }
+    }
+    for (int k = 0; k < 3; k++)
+        CloseSide(&sides[k]);
+    Genetics_ClearReferenceCache();
+    unlink(path);
+    return differences;
+}
+
+/**
+ * @brief score only alignment (striped SIMD) against the full matrix, a part of the sequence as query
+ */
+static int CheckAlign(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    DiffSide query;
+    if (c->size < 8 || c->size > DIFFTEST_ALIGN_MAX || !OpenSide(&query))
+        return 0;
+    size_t begin = c->chunkSeed % (c->size / 2), size = c->size / 4 + 1;
+    char bases[DIFFTEST_ALIGN_MAX + 1];
+    memcpy(bases, c->bases + begin, size);
+    bases[size] = 0;
+    for (size_t i = c->chunkSeed % 7; i < size; i += 11)
+        bases[i] = bases[(i * 5) % size]; // a few substitutions
+    Genetics_StartDNA(query.obj, DNA_DIR_5_TO_3, bases);
+    Genetics_StopDNA(query.obj);
+    int differences = 0;
+    for (int mode = GENETICS_ALIGN_GLOBAL; mode <= GENETICS_ALIGN_SEMI_GLOBAL; mode++)
+    {
+        for (int reverse = 0; reverse < 2; reverse++)
+        {
+            GeneticsAlignParams p = GeneticsAlignDefaults;
+            GeneticsAlignment full, score;
+            p.mode = mode;
+            p.reverse = reverse;
+            bool ok = Genetics_Align(query.obj, ref->obj, &p, &full);
+            p.scoreOnly = true;
+            if (ok != Genetics_Align(query.obj, ref->obj, &p, &score) || (ok && full.score != score.score))
+            {
+                fprintf(err, "difftest: align mode %d%s: score only %d, full matrix %d\n", mode,
+                        reverse ? " rev" : "", score.score, full.score);
+                differences++;
+            }
+        }
+    }
+    CloseSide(&query);
+    return differences;
+}
+
+static size_t NaiveCount(const char *text, size_t size, const char *pattern, size_t m)
+{
+    size_t n = 0;
+    for (size_t i = 0; i + m <= size; i++)
+        n += !strncasecmp(text + i, pattern, m);
+    return n;
+}
+
+/**
+ * @brief FM-index counts on both strands against a naive search of the pattern and its reverse complement
+ */
+static int CheckIndex(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    if (c->size == 0 || !Genetics_BuildIndex(ref->obj))
+        return 0;
+    int differences = 0;
+    unsigned seed = c->chunkSeed;
+    for (int k = 0; k < DIFFTEST_PATTERNS; k++)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t m = 1 + (seed >> 16) % 12;
+        if (m > c->size)
+            m = c->size;
+        size_t at = (seed >> 8) % (c->size - m + 1);
+        char pattern[16], rc[16];
+        for (size_t i = 0; i < m; i++)
+        {
+            pattern[i] = toupper((unsigned char)c->bases[at + i]);
+            rc[m - 1 - i] = pattern[i] == 'A' ? 'T' : pattern[i] == 'T' ? 'A' : pattern[i] == 'C' ? 'G' : 'C';
+        }
+        pattern[m] = rc[m] = 0;
+        size_t expected = NaiveCount(c->bases, c->size, pattern, m) + NaiveCount(c->bases, c->size, rc, m);
+        size_t counts[2], n = Genetics_IndexCount(ref->obj, pattern, counts);
+        if (n != expected)
+        {
+            fprintf(err, "difftest: index count %s: %lu, naive search %lu\n", pattern, n, expected);
+            differences++;
+        }
+    }
+    return differences;
+}
+
+/**
+ * @brief intervals of a mask against the runs of the text characters selected by the mask,
+ *        leading N's excluded (they only move the file offsets)
+ */
+static bool InMask(char b, GENETICS_MASK mask)
+{
+    return mask == GENETICS_MASK_N ? toupper((unsigned char)b) == 'N' : islower((unsigned char)b);
+}
+
+static int CheckMask(DiffSide *ref, const DiffCase *c, GENETICS_MASK mask, FILE *err)
+{
+    size_t i = 0, n = 0, count = Genetics_MaskCount(ref->obj, mask);
+    while (i < c->size && toupper((unsigned char)c->bases[i]) == 'N')
+        i++;
+    for (;;)
+    {
+        while (i < c->size && !InMask(c->bases[i], mask))
+            i++;
+        if (i == c->size)
+            break;
+        size_t begin = i + 1;
+        while (i < c->size && InMask(c->bases[i], mask))
+            i++;
+        GeneticsInterval interval;
+        if (!Genetics_MaskInterval(ref->obj, mask, n++, &interval) || interval.begin != begin || interval.end != i)
+        {
+            fprintf(err, "difftest: mask 0x%x interval %lu: expected %lu-%lu\n", mask, n - 1, begin, i);
+            return 1;
+        }
+    }
+    if (n != count)
+    {
+        fprintf(err, "difftest: mask 0x%x: %lu intervals, naive scan %lu\n", mask, count, n);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief base of the text as encoded (N placeholders excluded by the callers)
+ */
+static int Code(char b)
+{
+    switch (toupper((unsigned char)b))
+    {
+    case 'C':
+        return 1;
+    case 'A':
+        return 2;
+    case 'G':
+        return 3;
+    }
+    return 0;
+}
+
+/**
+ * @brief true if no base of text[i, i + n) is an N
+ */
+static bool NoN(const DiffCase *c, size_t i, size_t n)
+{
+    while (n > 0 && toupper((unsigned char)c->bases[i]) != 'N')
+        i++, n--;
+    return n == 0;
+}
+
+/**
+ * @brief repeat mask of the case against a naive scan: every window counted from scratch, tandem runs
+ *        measured backwards; with 1 and 3 threads
+ */
+static int CheckRepeats(DiffSide *ref, const DiffCase *c, FILE *err)
+{
+    static bool marks[DIFFTEST_MAX_BASES];
+    static size_t runs[DIFFTEST_MAX_BASES + 1];
+    size_t lead = 0;
+    while (lead < c->size && toupper((unsigned char)c->bases[lead]) == 'N')
+        lead++;
+    memset(marks, 0, sizeof(marks));
+    for (size_t i = lead; c->dustLevel && i + GENETICS_DUST_WINDOW <= c->size; i++)
+    {
+        if (!NoN(c, i, GENETICS_DUST_WINDOW))
+            continue;
+        unsigned counts[64] = {0}, score = 0;
+        for (size_t k = i; k + 2 < i + GENETICS_DUST_WINDOW; k++)
+            counts[Code(c->bases[k]) << 4 | Code(c->bases[k + 1]) << 2 | Code(c->bases[k + 2])]++;
+        for (int t = 0; t < 64; t++)
+            score += counts[t] * (counts[t] - 1) / 2;
+        if (score > c->dustLevel * (GENETICS_DUST_WINDOW - 3))
+            memset(marks + i, 1, GENETICS_DUST_WINDOW);
+    }
+    for (size_t p = 1; c->repeatLength && p <= GENETICS_REPEAT_MAX_PERIOD; p++)
+    {
+        size_t min = c->repeatLength > 3 * p ? c->repeatLength : 3 * p;
+        runs[c->size] = 0;
+        for (size_t k = c->size; k-- > lead;)
+            runs[k] = k + p < c->size && NoN(c, k, 1) && NoN(c, k + p, 1) && Code(c->bases[k]) == Code(c->bases[k + p])
+                    ? runs[k + 1] + 1 : 0;
+        for (size_t k = lead; k < c->size; k++)
+            if (runs[k] && (k == lead || !runs[k - 1]) && runs[k] + p >= min)
+                memset(marks + k, 1, runs[k] + p);
+    }
+    int differences = 0;
+    for (int threads = 1; threads <= 3; threads += 2)
+    {
+        Genetics_SetLoadThreads(ref->obj, threads);
+        size_t count = Genetics_MaskRepeats(ref->obj, c->dustLevel, c->repeatLength), n = 0;
+        for (size_t i = 0; i < c->size;)
+        {
+            if (!marks[i])
+            {
+                i++;
+                continue;
+            }
+            size_t begin = i + 1;
+            while (i < c->size && marks[i])
+                i++;
+            GeneticsInterval interval;
+            if (!Genetics_MaskInterval(ref->obj, GENETICS_MASK_REPEAT, n++, &interval) || interval.begin != begin ||
+                interval.end != i)
+            {
+                fprintf(err, "difftest: repeat interval %lu (%d threads): expected %lu-%lu\n", n - 1, threads, begin, i);
+                differences++;
+                break;
+            }
+        }
+        if (!differences && n != count)
+        {
+            fprintf(err, "difftest: repeats (%d threads): %lu intervals, naive scan %lu\n", threads, count, n);
+            differences++;
+        }
+    }
+    Genetics_SetLoadThreads(ref->obj, 0);
+    return differences;
+}
+
+/**
+ * @brief the case text with N runs, U bases and carriage returns, so the encoders see every character class
+ */
+static char *NoisyText(const DiffCase *c)
+{
+    char *text = malloc(3 * c->size + 4), *t = text;
+    if (!text)
+        return NULL;
+    *t++ = 'n';
+    *t++ = 'N';
+    for (size_t i = 0; i < c->size; i++)
+    {
+        if (i % 29 == c->chunkSeed % 29)
+            *t++ = 'N';
+        if (i % 41 == 3)
+            *t++ = '\r';
+        char b = c->bases[i];
+        *t++ = i % 23 == 5 && (b == 'T' || b == 't') ? b + 1 : b; // T -> U
+    }
+    *t = 0;
+    return text;
+}
+
+static void LoadText(DiffSide *side, const DiffCase *c, const char *text)
+{
+    Genetics_StartDNA(side->obj, c->dir, "");
+    Genetics_AddDNA(side->obj, text);
+    Genetics_StopDNA(side->obj);
+    ApplyCase(side, c);
+}
+
+/**
+ * @brief encoding, translation, scan and alignment with every instruction set of the cpu
+ *        against the scalar kernels
+ */
+static int CheckCpu(const DiffCase *c, FILE *err)
+{
+    DiffSide scalar;
+    char *text = NoisyText(c);
+    int differences = 0;
+    if (!text || !OpenSide(&scalar))
+    {
+        free(text);
+        return 0;
+    }
+    Genetics_SetCpu(scalar.obj, GENETICS_CPU_SCALAR);
+    LoadText(&scalar, c, text);
+    for (GENETICS_CPU level = GENETICS_CPU_SCALAR + 1; level <= Genetics_CpuSupported(); level++)
+    {
+        DiffSide simd;
+        if (!OpenSide(&simd))
+            break;
+        char what[32];
+        snprintf(what, sizeof(what), "cpu %s", Genetics_CpuName(level));
+        Genetics_SetCpu(simd.obj, level);
+        LoadText(&simd, c, text);
+        for (size_t k = 0; k < sizeof(CPU_FLAGS) / sizeof(CPU_FLAGS[0]); k++)
+        {
+            Genetics_PrintDNA(simd.obj, CPU_FLAGS[k]);
+            Genetics_PrintDNA(scalar.obj, CPU_FLAGS[k]);
+            differences += Compare(&simd, &scalar, what, CPU_FLAGS[k], err);
+        }
+        Genetics_SearchPeptide(simd.obj, "MX", 0, DNA_PRINT_FORMAT_TSV, NULL, NULL);
+        Genetics_SearchPeptide(scalar.obj, "MX", 0, DNA_PRINT_FORMAT_TSV, NULL, NULL);
+        differences += Compare(&simd, &scalar, what, DNA_PRINT_FORMAT_TSV, err);
+        Genetics_ResetScan(scalar.obj);
+        const GeneticsScan *a = Genetics_Scan(simd.obj), *b = Genetics_Scan(scalar.obj);
+        if (a && b && !SameScan(a, b))
+        {
+            fprintf(err, "difftest: %s: scan differs from the scalar scan\n", what);
+            differences++;
+        }
+        if (c->size <= DIFFTEST_ALIGN_MAX)
+        {
+            GeneticsAlignParams p = GeneticsAlignDefaults;
+            GeneticsAlignment x, y;
+            p.mode = GENETICS_ALIGN_LOCAL;
+            p.reverse = true;
+            bool ok = Genetics_Align(simd.obj, simd.obj, &p, &x);
+            if (ok != Genetics_Align(scalar.obj, scalar.obj, &p, &y) || (ok && (x.score != y.score ||
+                x.queryBegin != y.queryBegin || x.targetEnd != y.targetEnd)))
+            {
+                fprintf(err, "difftest: %s: reverse complement alignment differs from the scalar one\n", what);
+                differences++;
+            }
+        }
+        CloseSide(&simd);
+    }
+    CloseSide(&scalar);
+    free(text);
+    return differences;
+}
+
+static int RunCase(const DiffCase *c, FILE *err)
+{
+    DiffSide fast, ref;
+    int differences = 0;
+    if (OpenSide(&fast) && OpenSide(&ref))
+    {
+        LoadCase(&fast, c);
+        LoadCase(&ref, c);
+        differences += CheckPrint(&fast, &ref, err);
+        differences += CheckFindStart(&fast, &ref, err);
+        differences += CheckSpliced(&ref, c, err);
+        LoadCase(&ref, c);
+        differences += CheckScan(&ref, c, err);
+        if (c->dir == DNA_DIR_5_TO_3)
+            differences += CheckLoad(&ref, c, err);
+        differences += CheckAlign(&ref, c, err);
+        if (!c->nBlocks) // the index reads the N placeholders as bases
+            differences += CheckIndex(&ref, c, err);
+        differences += CheckMask(&ref, c, GENETICS_MASK_N, err);
+        differences += CheckMask(&ref, c, GENETICS_MASK_SOFT, err);
+        if (c->repeats)
+            differences += CheckRepeats(&ref, c, err);
+        differences += CheckCpu(c, err);
+    }
+    CloseSide(&fast);
+    CloseSide(&ref);
+    return differences;
+}
+
+/**
+ * @brief Decode a case from data and compare the optimized paths with the reference paths
+ *
+ * @param data case bytes (any content, e.g. fuzzer input)
+ * @param size data size
+ * @param err  differences are described here
+ * @return int number of differences
+ */
+int DiffTest_Run(const uint8_t *data, size_t size, FILE *err)
+{
+    DiffCase *c = malloc(sizeof(DiffCase)); // too large for small thread stacks
+    int differences = 0;
+    if (c)
+    {
+        DecodeCase(data, size, c);
+        differences = RunCase(c, err);
+    }
+    free(c);
+    return differences;
+}
+
+/**
+ * @brief splice sets that printed intron bases in the text print: reading from the last exon below the
+ *        top intron (splice points past the end), and from inside the top intron
+ */
+static const struct
+{
+    const char *bases;
+    size_t splice[4];
+} SPLICE_REPROS[] = {
+    {"gttaaatggcagaaaactggcagggctttt", {10, 20, 30, 40}},
+    {"gttaaatggcagaaaactggcagggctttt", {10, 20, 25, 40}},
+};
+
+/**
+ * @brief Compare the paths on the fixed cases of past differences, in both directions
+ *
+ * @param err differences are described here
+ * @return int number of differences
+ */
+int DiffTest_Repros(FILE *err)
+{
+    DiffCase *c = malloc(sizeof(DiffCase));
+    int differences = 0;
+    for (size_t k = 0; c && k < 2 * sizeof(SPLICE_REPROS) / sizeof(SPLICE_REPROS[0]); k++)
+    {
+        memset(c, 0, sizeof(DiffCase));
+        c->dir = k % 2 ? DNA_DIR_3_TO_5 : DNA_DIR_5_TO_3;
+        c->table = 1;
+        c->codonStart = 1;
+        c->spliceSize = 4;
+        memcpy(c->splice, SPLICE_REPROS[k / 2].splice, sizeof(SPLICE_REPROS[k / 2].splice));
+        c->size = strlen(SPLICE_REPROS[k / 2].bases);
+        memcpy(c->bases, SPLICE_REPROS[k / 2].bases, c->size + 1);
+        differences += RunCase(c, err);
+    }
+    free(c);
+    return differences;
+}
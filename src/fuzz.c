@@ -0,0 +1,52 @@
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tests.h"
+
+/**
+ * @brief fuzz target: the input is a differential test case, a difference aborts so the fuzzer keeps the input
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (DiffTest_Run(data, size, stderr))
+        abort();
+    return 0;
+}
+
+#ifndef GENETICS_LIBFUZZER
+/**
+ * @brief run one file as a case (AFL: fuzz_genetics @@, or the case on stdin)
+ */
+static int RunFile(const char *filename)
+{
+    FILE *f = filename ? fopen(filename, "rb") : stdin;
+    if (!f)
+    {
+        perror(filename);
+        return 1;
+    }
+    static uint8_t data[DIFFTEST_MAX_BASES + 64];
+    size_t size = fread(data, 1, sizeof(data), f);
+    if (f != stdin)
+        fclose(f);
+    return LLVMFuzzerTestOneInput(data, size);
+}
+
+/**
+ * @brief standalone driver without libFuzzer: run the cases given as files (replay a corpus or a crash)
+ */
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    if (argc < 2)
+        return RunFile(NULL);
+    for (int i = 1; i < argc; i++)
+        ret |= RunFile(argv[i]);
+    return ret;
+}
+#endif
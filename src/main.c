@@ -6,6 +6,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <strings.h>
 #include <getopt.h>
@@ -13,18 +14,17 @@
 
 #include "tests.h"
 
-typedef void *(*TFunc)(void *user_data, const char *line, size_t size, FILE* out);
 struct test_menu
 {
     const char *command;
     TFunc controler;
-    void *user_data;
+    TShare share;
 };
 
-static struct test_menu test_menus[] = {
-    {"genetics", test_genetics},
+static const struct test_menu test_menus[] = {
+    {"genetics", test_genetics, test_genetics_share},
     {}};
-static int menu_index = -1;
+bool StatsReport = false;
 
 
 #define PROMPT_MAIN COLOR_BLUE "test" COLOR_OFF "$"
@@ -44,13 +44,32 @@ menu_help_item MenuGlobal[] =
     {}
 };
 
-bool ProcessNewInput(int line_no, bool fromFile, char *input, size_t insize,FILE** pout)
+void Session_Init(TestSession *session, FILE *out, FILE *err, const TestSession *shared)
+{
+    memset(session, 0, sizeof(TestSession));
+    session->menu_index = -1;
+    session->out = out;
+    session->err = err;
+    session->shared = shared;
+}
+
+void Session_Cleanup(TestSession *session)
+{
+    for (int i = 0; test_menus[i].command; i++)
+    {
+        if (session->user_data[i])
+            session->user_data[i] = test_menus[i].controler(session->user_data[i], NULL, 0, session->out, session->err);
+    }
+}
+
+bool ProcessNewInput(TestSession *session, int line_no, bool fromFile, char *input, size_t insize)
 {
     size_t term = insize - 1;
-    while (isspace(input[term]))
+    while (insize > 0 && isspace(input[term]))
     {
         input[term] = 0;
-        term--;
+        if (term-- == 0)
+            break;
     }
     term++;
     char *line = input;
@@ -68,20 +87,25 @@ bool ProcessNewInput(int line_no, bool fromFile, char *input, size_t insize,FILE
     {
         char *filename, *params;
         ParseParams((char *)line + 6, 2, &filename, &params);
+        if (session->shared)
+        {
+            fputs("ERROR: output is not available in server mode\n", session->err);
+            return true;
+        }
         if (!strcmp(filename, "stdout"))
         {
         }
         FILE *nout = fopen(filename, *params ? params : "w");
         if (nout)
         {
-            if (*pout != stdout)
-                fclose(*pout);
-            *pout = nout;
+            if (session->out != stdout)
+                fclose(session->out);
+            session->out = nout;
             
         }
         else
         {
-            fprintf(stderr, "Error fopening fasta file '%s' : %s\n", filename, strerror(errno));
+            fprintf(session->err, "Error fopening fasta file '%s' : %s\n", filename, strerror(errno));
         }
         return true;
     }
@@ -90,8 +114,8 @@ bool ProcessNewInput(int line_no, bool fromFile, char *input, size_t insize,FILE
         line += 4;
         while (isspace(*line))
             line++;
-        fputs(line,*pout);
-        fputc('\n',*pout);
+        fputs(line,session->out);
+        fputc('\n',session->out);
         if (!fromFile)
             fputs(PROMPT_MAIN, stdout);
         return true;
@@ -104,55 +128,56 @@ bool ProcessNewInput(int line_no, bool fromFile, char *input, size_t insize,FILE
     }
     
 
-    if (menu_index != -1)
+    if (session->menu_index != -1)
     {
         if (!strncasecmp(line, "back", 4))
         {
-            menu_index = -1;
+            session->menu_index = -1;
             if (!fromFile)
                 fputs(PROMPT_MAIN, stdout);
             return true;
         }
     }
  
-    if (menu_index == -1)
+    if (session->menu_index == -1)
     {  
         if (!strncasecmp(line, "help", 4))
         {
             for (int i = 0; test_menus[i].command; i++)
-                printf(COLOR_RED "%s" COLOR_OFF " enter menu %s\n",test_menus[i].command,test_menus[i].command);
-            puts("-------");
-            PrintHelp(MenuGlobal);
+                fprintf(session->out, COLOR_RED "%s" COLOR_OFF " enter menu %s\n",test_menus[i].command,test_menus[i].command);
+            fputs("-------\n", session->out);
+            PrintHelp(MenuGlobal, session->out);
             return true;
         }
         for (int i = 0; test_menus[i].command; i++)
         {
             if (!strcasecmp(line, test_menus[i].command))
             {
-                menu_index = i;
+                session->menu_index = i;
                 break;
             }
         }
     }
 
-    if (menu_index == -1)
+    if (session->menu_index == -1)
     {
         if (fromFile)
-            printf("Unknown menu:%d: %s\n", line_no, line);
+            fprintf(session->out, "Unknown menu:%d: %s\n", line_no, line);
         else
             puts("Unknown menu" PROMPT_MAIN);
         return true;
     }
 
-    if (fromFile)
-    {
-        test_menus[menu_index].user_data = test_menus[menu_index].controler(test_menus[menu_index].user_data, line, term, *pout);
-    }
-    else
-    {
-        test_menus[menu_index].user_data = test_menus[menu_index].controler(test_menus[menu_index].user_data, line, term, *pout);
-        printf(PROMPT_CMD, test_menus[menu_index].command);
+    int i = session->menu_index;
+    if (!session->user_data[i] && session->shared && session->shared->user_data[i] && test_menus[i].share)
+    { // new server session: start from the data loaded before serving
+        session->user_data[i] = test_menus[i].share(session->shared->user_data[i], session->err);
+        if (!strcasecmp(line, test_menus[i].command))
+            return true;
     }
+    session->user_data[i] = test_menus[i].controler(session->user_data[i], line, term, session->out, session->err);
+    if (!fromFile)
+        printf(PROMPT_CMD, test_menus[i].command);
 
     return true;
 }
@@ -161,14 +186,22 @@ int main(int argc, char **argv)
 {
 
     const char *UsagePrint = "Usage: "
-                             "[ -f | --filename INPUTFILE ]\n";
+                             "[ -f | --filename INPUTFILE ] [ -s | --stats ] [ -S | --server SOCKET [ -w | --workers N ] ]\n"
+                             "  --stats : print JSON counters report to stderr at exit\n"
+                             "  --server : run INPUTFILE (e.g. load references), then serve the commands on a unix socket\n"
+                             "  --workers : server worker threads (default " SERVER_WORKERS_DEFAULT_STR ")\n";
     static struct option long_options[] = {
         {"help", no_argument, 0, 'h'},
         {"filename", required_argument, 0, 'f'},
+        {"stats", no_argument, 0, 's'},
+        {"server", required_argument, 0, 'S'},
+        {"workers", required_argument, 0, 'w'},
         {}};
     int opt;
     FILE *fInput = NULL;
-    while (-1 != (opt = getopt_long(argc, argv, "hf:", long_options, NULL)))
+    const char *serverPath = NULL;
+    int workers = SERVER_WORKERS_DEFAULT;
+    while (-1 != (opt = getopt_long(argc, argv, "hf:sS:w:", long_options, NULL)))
     {
         switch (opt)
         {
@@ -186,6 +219,15 @@ int main(int argc, char **argv)
                 fprintf(stderr, "Error fopening input file '%s' : %s\n", optarg, strerror(errno));
         }
         break;
+        case 's':
+            StatsReport = true;
+            break;
+        case 'S':
+            serverPath = optarg;
+            break;
+        case 'w':
+            workers = atoi(optarg);
+            break;
         case '?':
             break;
         }
@@ -196,12 +238,13 @@ int main(int argc, char **argv)
     ssize_t insize;
     int line_no = 1;
     bool quit = false;
-    FILE *out = stdout;
+    TestSession session;
+    Session_Init(&session, stdout, stderr, NULL);
     if (fInput)
     {
         while (-1 != (insize = getline(&input, &len, fInput)))
         {
-            if (!ProcessNewInput(line_no++, true, input, insize, &out))
+            if (!ProcessNewInput(&session, line_no++, true, input, insize))
             {
                 quit = true;
                 break;
@@ -209,16 +252,22 @@ int main(int argc, char **argv)
         }
         fclose(fInput);
     }
-    if (!quit)
+    int ret = 0;
+    if (serverPath)
+    {
+        fflush(session.out);
+        ret = RunServer(serverPath, workers, &session) ? 0 : 1;
+    }
+    else if (!quit)
     {
-        if (menu_index == -1)
+        if (session.menu_index == -1)
             fputs(PROMPT_MAIN, stdout);
         else
-            printf(PROMPT_CMD, test_menus[menu_index].command);
+            printf(PROMPT_CMD, test_menus[session.menu_index].command);
 
         while (-1 != (insize = getline(&input, &len, stdin)))
         {
-            if (!ProcessNewInput(line_no++, false, input, insize, &out))
+            if (!ProcessNewInput(&session, line_no++, false, input, insize))
             {
                 quit = true;
                 break;
@@ -228,12 +277,8 @@ int main(int argc, char **argv)
 
     
     free(input);
-    for (int i = 0; test_menus[i].command; i++)
-    {
-        if (test_menus[menu_index].user_data)
-            test_menus[menu_index].controler(test_menus[menu_index].user_data, NULL,0, out);
-    }
-    if(out != stdout)
-        fclose(out);
-    return 0;
+    Session_Cleanup(&session);
+    if(session.out != stdout)
+        fclose(session.out);
+    return ret;
 }
@@ -0,0 +1,444 @@
+#include <config.h>
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+#include "tests.h"
+
+/**
+ * @brief Server mode: the command language over a unix socket.
+ *        One event loop thread (epoll) accepts connections and reads their input, a pool of
+ *        workers runs the complete lines. A connection is handled by one worker at a time so
+ *        its commands run in order on its own session; sessions start from the data loaded
+ *        before serving, shared read only.
+ *        Every input line gets one reply: the output length in decimal, a new line, then
+ *        the output (command output and errors).
+ */
+#define SERVER_MAX_EVENTS     64
+#define SERVER_READ_SIZE      (64 * 1024)
+#define SERVER_MAX_LINE       (1024 * 1024)
+#define SERVER_SEND_TIMEOUT   30000     // ms a worker waits for a client reading its replies
+#define SERVER_MAX_WORKERS    256
+
+typedef struct _Connection
+{
+    int fd;
+    TestSession session;
+    char *reply;            // session output stream buffer
+    size_t replySize;
+    char *in;               // received bytes not processed yet
+    size_t inSize;
+    size_t inAlloc;
+    int line_no;
+    bool queued;            // waiting in the queue or run by a worker
+    bool eof;               // input closed, removed from epoll
+    bool quit;              // quit command or error, drop the rest of the input
+    struct _Connection *next; // work queue
+    struct _Connection *prevOpen; // open connections, closed when the server stops
+    struct _Connection *nextOpen;
+} Connection;
+
+typedef struct _Server
+{
+    int epoll;
+    int listen;
+    int signal;
+    const TestSession *shared;
+    pthread_mutex_t lock;   // connection input, flags and the queue
+    pthread_cond_t ready;
+    Connection *head;       // connections with lines to run
+    Connection *tail;
+    bool stop;
+    Connection *open;
+    size_t connections;
+} Server;
+
+static void Connection_Delete(Server *server, Connection *c)
+{
+    Session_Cleanup(&c->session);
+    fclose(c->session.out);
+    free(c->reply);
+    free(c->in);
+    close(c->fd);
+    pthread_mutex_lock(&server->lock);
+    if (c->prevOpen)
+        c->prevOpen->nextOpen = c->nextOpen;
+    else
+        server->open = c->nextOpen;
+    if (c->nextOpen)
+        c->nextOpen->prevOpen = c->prevOpen;
+    server->connections--;
+    pthread_mutex_unlock(&server->lock);
+    free(c);
+}
+
+/**
+ * @brief a line to run: complete, or the rest of the input after end of file
+ */
+static bool HasLine(const Connection *c)
+{
+    return !c->quit && c->inSize > 0 && (c->eof || memchr(c->in, '\n', c->inSize));
+}
+
+/**
+ * @brief called with the lock held
+ */
+static void Enqueue(Server *server, Connection *c)
+{
+    c->queued = true;
+    c->next = NULL;
+    if (server->tail)
+        server->tail->next = c;
+    else
+        server->head = c;
+    server->tail = c;
+    pthread_cond_signal(&server->ready);
+}
+
+/**
+ * @brief write all, waiting for a slow reader at most SERVER_SEND_TIMEOUT
+ */
+static bool SendAll(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n > 0)
+        {
+            data += n;
+            size -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd p = {fd, POLLOUT, 0};
+            if (poll(&p, 1, SERVER_SEND_TIMEOUT) > 0)
+                continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief run one line of the connection session and send the reply
+ * @return false to close the connection
+ */
+static bool RunLine(Connection *c, char *line, size_t size)
+{
+    FILE *out = c->session.out;
+    bool keep = ProcessNewInput(&c->session, c->line_no++, true, line, size);
+    fflush(out);
+    char header[32];
+    int n = snprintf(header, sizeof(header), "%lu\n", c->replySize);
+    bool sent = SendAll(c->fd, header, n) && SendAll(c->fd, c->reply, c->replySize);
+    rewind(out); // next reply overwrites the buffer
+    return keep && sent;
+}
+
+/**
+ * @brief run the lines of a connection until none is left
+ */
+static void RunConnection(Server *server, Connection *c)
+{
+    char *line = NULL;
+    size_t lineAlloc = 0;
+    for (;;)
+    {
+        pthread_mutex_lock(&server->lock);
+        if (!HasLine(c))
+        {
+            bool drop = c->eof;
+            c->queued = false;
+            pthread_mutex_unlock(&server->lock);
+            if (drop)
+                Connection_Delete(server, c);
+            break;
+        }
+        char *eol = memchr(c->in, '\n', c->inSize);
+        size_t size = eol ? (size_t)(eol - c->in) + 1 : c->inSize;
+        if (lineAlloc < size + 1)
+        {
+            lineAlloc = size + 1;
+            line = realloc(line, lineAlloc);
+        }
+        memcpy(line, c->in, size);
+        line[size] = 0;
+        c->inSize -= size;
+        memmove(c->in, c->in + size, c->inSize);
+        pthread_mutex_unlock(&server->lock);
+
+        if (!RunLine(c, line, size))
+        {
+            pthread_mutex_lock(&server->lock);
+            c->quit = true;
+            c->inSize = 0;
+            pthread_mutex_unlock(&server->lock);
+            shutdown(c->fd, SHUT_RDWR); // the event loop sees the end of file
+        }
+    }
+    free(line);
+}
+
+static void *WorkerMain(void *arg)
+{
+    Server *server = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&server->lock);
+        while (!server->head && !server->stop)
+            pthread_cond_wait(&server->ready, &server->lock);
+        if (server->stop)
+        {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+        Connection *c = server->head;
+        server->head = c->next;
+        if (!server->head)
+            server->tail = NULL;
+        pthread_mutex_unlock(&server->lock);
+        RunConnection(server, c);
+    }
+}
+
+static void Accept(Server *server)
+{
+    for (;;)
+    {
+        int fd = accept(server->listen, NULL, NULL);
+        if (fd >= 0 && (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0))
+        {
+            close(fd);
+            fd = -1;
+        }
+        if (fd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+                fprintf(stderr, "Error accepting connection : %s\n", strerror(errno));
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+        Connection *c = calloc(1, sizeof(Connection));
+        FILE *out = c ? open_memstream(&c->reply, &c->replySize) : NULL;
+        if (!out)
+        {
+            fprintf(stderr, "Error creating session output : %s\n", strerror(errno));
+            free(c);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->line_no = 1;
+        Session_Init(&c->session, out, out, server->shared);
+        struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP, .data.ptr = c};
+        if (epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            fprintf(stderr, "Error adding connection : %s\n", strerror(errno));
+            fclose(out);
+            free(c->reply);
+            free(c);
+            close(fd);
+            continue;
+        }
+        pthread_mutex_lock(&server->lock);
+        c->nextOpen = server->open;
+        if (server->open)
+            server->open->prevOpen = c;
+        server->open = c;
+        server->connections++;
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+
+/**
+ * @brief read what is available, queue the connection if it has lines to run
+ */
+static void Receive(Server *server, Connection *c, uint32_t events)
+{
+    char buffer[SERVER_READ_SIZE];
+    bool eof = (events & EPOLLERR) != 0;
+    while (!eof)
+    {
+        ssize_t n = read(c->fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+        {
+            eof = true;
+            break;
+        }
+        pthread_mutex_lock(&server->lock);
+        if (!c->quit)
+        {
+            if (c->inSize + n > c->inAlloc)
+            {
+                c->inAlloc = 2 * (c->inSize + n);
+                c->in = realloc(c->in, c->inAlloc);
+            }
+            memcpy(c->in + c->inSize, buffer, n);
+            c->inSize += n;
+            if (c->inSize > SERVER_MAX_LINE && !memchr(c->in, '\n', c->inSize))
+            {
+                fprintf(stderr, "Connection closed : line longer than %d bytes\n", SERVER_MAX_LINE);
+                c->quit = true;
+                eof = true;
+            }
+        }
+        pthread_mutex_unlock(&server->lock);
+    }
+
+    pthread_mutex_lock(&server->lock);
+    bool drop = false;
+    if (eof)
+    {
+        c->eof = true;
+        epoll_ctl(server->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    }
+    if (!c->queued)
+    {
+        if (HasLine(c))
+            Enqueue(server, c);
+        else
+            drop = c->eof;
+    }
+    pthread_mutex_unlock(&server->lock);
+    if (drop)
+        Connection_Delete(server, c);
+}
+
+static int Listen(const char *path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error server socket path '%s' is too long\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path); // left by a previous server
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        fprintf(stderr, "Error listening on '%s' : %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Serve the command language on a unix socket until SIGINT or SIGTERM
+ *
+ * @param path    socket file, replaced if it exists
+ * @param workers worker threads running the commands
+ * @param shared  session with the data loaded before serving (read only while serving)
+ * @return false if the server could not start
+ */
+bool RunServer(const char *path, int workers, const TestSession *shared)
+{
+    if (workers < 1)
+        workers = 1;
+    if (workers > SERVER_MAX_WORKERS)
+        workers = SERVER_MAX_WORKERS;
+    Server server = {.shared = shared};
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+
+    // signals are read from a signalfd by the event loop, blocked before the workers start
+    sigset_t mask, oldMask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &oldMask);
+    server.signal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    server.epoll = epoll_create1(EPOLL_CLOEXEC);
+    server.listen = Listen(path);
+    struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+    bool ok = server.signal >= 0 && server.epoll >= 0 && server.listen >= 0 &&
+              epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.listen, &ev) == 0;
+    ev.data.ptr = &server;
+    ok = ok && epoll_ctl(server.epoll, EPOLL_CTL_ADD, server.signal, &ev) == 0;
+    if (!ok && server.listen >= 0)
+        fprintf(stderr, "Error starting server : %s\n", strerror(errno));
+
+    pthread_t threads[SERVER_MAX_WORKERS];
+    int started = 0;
+    for (; ok && started < workers; started++)
+    {
+        if (pthread_create(&threads[started], NULL, WorkerMain, &server))
+            break;
+    }
+    if (ok)
+        fprintf(stderr, "server listening on '%s' with %d workers\n", path, started);
+
+    bool running = ok;
+    while (running)
+    {
+        struct epoll_event events[SERVER_MAX_EVENTS];
+        int n = epoll_wait(server.epoll, events, SERVER_MAX_EVENTS, -1);
+        if (n < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "Error waiting for events : %s\n", strerror(errno));
+            running = false;
+            n = 0;
+        }
+        for (int i = 0; i < n; i++)
+        {
+            if (events[i].data.ptr == NULL)
+                Accept(&server);
+            else if (events[i].data.ptr == &server)
+                running = false;
+            else
+                Receive(&server, events[i].data.ptr, events[i].events);
+        }
+    }
+
+    // stop the workers after the commands running now, then close the idle connections
+    pthread_mutex_lock(&server.lock);
+    server.stop = true;
+    pthread_cond_broadcast(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    if (server.connections)
+        fprintf(stderr, "server stopped, %lu connections closed\n", server.connections);
+    while (server.open)
+        Connection_Delete(&server, server.open);
+    if (server.listen >= 0)
+    {
+        close(server.listen);
+        unlink(path);
+    }
+    if (server.epoll >= 0)
+        close(server.epoll);
+    if (server.signal >= 0)
+        close(server.signal);
+    pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+    pthread_cond_destroy(&server.ready);
+    pthread_mutex_destroy(&server.lock);
+    return ok;
+}
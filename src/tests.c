@@ -11,6 +11,8 @@
 #include <strings.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "tests.h"
 
@@ -30,9 +32,188 @@ DNA_PRINT_FlAGS GetPrintFlag(char *sp)
         return DNA_PRINT_RNA;
     if (!strcasecmp("cor", sp))
         return DNA_PRINT_TRANSLATE_CORRELATE;  
+    if (!strcasecmp("generic", sp))
+        return DNA_PRINT_GENERIC;
+    if (!strcasecmp("fasta", sp))
+        return DNA_PRINT_FORMAT_FASTA;
+    if (!strcasecmp("binary", sp))
+        return DNA_PRINT_FORMAT_BINARY;
+    if (!strcasecmp("json", sp))
+        return DNA_PRINT_FORMAT_JSON;
+    if (!strcasecmp("tsv", sp))
+        return DNA_PRINT_FORMAT_TSV;
     return 0;
 }
 
+#define STRESS_BASES 30000
+#define STRESS_CHUNK 997
+
+typedef struct _StressThread
+{
+    pthread_t thread;
+    const char *dna;
+    int iterations;
+    uint64_t expected;
+    int mismatches;
+    int errors;
+} StressThread;
+
+static void StressError(void *ctx, GENETICS_LEVEL level, const char *message)
+{
+    (*(int *)ctx)++;
+}
+
+/**
+ * @brief run a fixed set of commands on a new object, return a hash of the output and results
+ */
+static uint64_t StressRun(const char *dna, GeneticsArena *arena, int *errors)
+{
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&buffer, &size);
+    if (!out)
+        return 0;
+    GeneticsObj *obj;
+    if (arena)
+    {
+        GeneticsAllocator allocator = Genetics_ArenaAllocator(arena);
+        obj = Genetics_NewWithAllocator(&allocator);
+    }
+    else
+        obj = Genetics_New();
+    Genetics_SetErrorCallback(obj, StressError, errors);
+    Genetics_SetOutput(obj, out);
+    Genetics_StartDNA(obj, DNA_DIR_5_TO_3, "");
+    char chunk[STRESS_CHUNK + 1];
+    size_t scanned = 0;
+    for (size_t i = 0; i < STRESS_BASES; i += STRESS_CHUNK)
+    {
+        size_t n = STRESS_BASES - i < STRESS_CHUNK ? STRESS_BASES - i : STRESS_CHUNK;
+        memcpy(chunk, dna + i, n);
+        chunk[n] = 0;
+        Genetics_AddDNA(obj, chunk);
+        scanned += Genetics_Scan(obj)->orfCount;
+    }
+    Genetics_StopDNA(obj);
+    fprintf(out, "%lu %d\n", scanned, Genetics_FindStart(obj, 0));
+    Genetics_FindStart(obj, DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT | DNA_PRINT_FORMAT_JSON);
+    Genetics_PrintDNA(obj, DNA_PRINT_TRANSLATE);
+    Genetics_PrintDNA(obj, DNA_PRINT_FORMAT_FASTA | DNA_PRINT_REVERSE | DNA_PRINT_COMPLEMENT);
+    Genetics_PrintDNA(obj, DNA_PRINT_FORMAT_TSV | DNA_PRINT_TRANSLATE);
+    GeneticsCodonUsage cu;
+    Genetics_CodonUsage(obj, 0, &cu);
+    Genetics_PrintCodonUsage(obj, &cu);
+    Genetics_PrintRegion(obj, 2 * STRESS_BASES, 3 * STRESS_BASES, 0); // reported through the callback
+    Genetics_Delete(obj);
+    if (arena)
+        Genetics_ArenaReset(arena);
+    fclose(out);
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ (uint8_t)buffer[i]) * 1099511628211ULL;
+    free(buffer);
+    return hash;
+}
+
+static void *StressThreadMain(void *arg)
+{
+    StressThread *t = arg;
+    GeneticsArena *arena = Genetics_ArenaNew(0);
+    for (int i = 0; i < t->iterations; i++)
+    {
+        int errors = 0;
+        if (StressRun(t->dna, i % 2 ? arena : NULL, &errors) != t->expected || errors != 1)
+            t->mismatches++;
+        t->errors += errors;
+    }
+    Genetics_ArenaDelete(arena);
+    return NULL;
+}
+
+/**
+ * @brief run independent objects on many threads and compare their results with a single thread run
+ */
+static void Stress(FILE *out, int threads, int iterations)
+{
+    if (threads < 1)
+        threads = 4;
+    if (iterations < 1)
+        iterations = 20;
+    static const char BASES[4] = {'t', 'c', 'a', 'g'};
+    char *dna = malloc(STRESS_BASES);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < STRESS_BASES; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        dna[i] = BASES[(seed >> 16) & 0x3];
+    }
+    int errors = 0;
+    uint64_t expected = StressRun(dna, NULL, &errors);
+    StressThread *t = calloc(threads, sizeof(StressThread));
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    int started = 0;
+    for (; started < threads; started++)
+    {
+        t[started].dna = dna;
+        t[started].iterations = iterations;
+        t[started].expected = expected;
+        if (pthread_create(&t[started].thread, NULL, StressThreadMain, &t[started]))
+            break;
+    }
+    int mismatches = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(t[i].thread, NULL);
+        mismatches += t[i].mismatches;
+        errors += t[i].errors;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+    fprintf(out, "stress: %d threads x %d runs, %d mismatches, %d errors reported, %.1f ms, hash %016lx\n",
+            started, iterations, mismatches, errors, ms, expected);
+    free(t);
+    free(dna);
+}
+
+/**
+ * @brief differential test of generated cases, see DiffTest_Run(); run k uses seed + k alone
+ */
+static void SelfTest(FILE *out, FILE *err, int runs, uint32_t seed)
+{
+    if (runs < 1)
+        runs = 200;
+    uint8_t *data = malloc(SELFTEST_CASE_MAX);
+    int failed = 0;
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    if (DiffTest_Repros(err))
+    {
+        fprintf(err, "selftest: fixed cases differ\n");
+        failed++;
+    }
+    for (int run = 0; run < runs; run++)
+    {
+        uint32_t s = seed + run;
+        s = s * 1103515245 + 12345;
+        size_t size = 1 + (s >> 8) % SELFTEST_CASE_MAX;
+        for (size_t i = 0; i < size; i++)
+        {
+            s = s * 1103515245 + 12345;
+            data[i] = s >> 16;
+        }
+        if (DiffTest_Run(data, size, err))
+        {
+            fprintf(err, "selftest: run %d differs, replay with 'selftest 1 %u'\n", run, seed + run);
+            failed++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - begin.tv_sec) * 1e3 + (end.tv_nsec - begin.tv_nsec) / 1e6;
+    fprintf(out, "selftest: %d runs, %d with differences, %.1f ms\n", runs, failed, ms);
+    free(data);
+}
+
 menu_help_item MenuGenetics[] =
 {
     { "5' | 3'", "[...]" , "start/end dna sequence."
@@ -41,12 +222,22 @@ menu_help_item MenuGenetics[] =
     { "load_fasta", "start stop filename [search]" , "load fasta file from start to stop offset."
             HELP_START_LINE "Use 0 for start/stop to load all."
             HELP_START_LINE "Option <search> option will search for fasta > lines and if found will start from next line."},
+    { "load_threads", "[n]", "print or set the threads loading whole fasta files (start and stop 0)"
+            HELP_START_LINE "0: one per 16 MB of file up to the cpu count, 1: sequential reader, n: n threads (max 16)"},
+    { "refcache", "[on|off|clear]", "print the shared reference cache, or use it for the next fasta loads of this object"
+            HELP_START_LINE "objects loading the same file, search and region share one read only sequence"
+            HELP_START_LINE "clear frees the references no object uses; server sessions use the cache"},
+    { "load_fastq", "filename [trim_q] [min_mean_q] [min_len]" , "load fastq file reads."
+            HELP_START_LINE "Reads are trimmed at both ends while phred quality < trim_q,"
+            HELP_START_LINE "then dropped if mean quality < min_mean_q or length < min_len."},
+    { "read", "n" , "select fastq read n (0 based). Next commands work on this read."},
     { "splice", "[s1 s2 s3 s4 ...]" , "splice dna sequence based on exons boundaries"
             HELP_START_LINE "exons are [start s1] [s2 s3] ... [sN stop]"
             HELP_START_LINE "introns are [s1+1 s2-1] [s3+1 s4-1] ..."},
     { "codon_start", "s" , "set codon start where operations print operations will start"},
-    { "find_start", "[rev]", "find codon start and set codon_start accordingly"
-            HELP_START_LINE "use rev to find start on the reverse strand"},
+    { "find_start", "[rev] [json|tsv|binary]", "find codon start and set codon_start accordingly"
+            HELP_START_LINE "use rev to find start on the reverse strand, generic to search without the incremental scan"
+            HELP_START_LINE "use json, tsv or binary to print the result record"},
     { "print", "[print flags]", "print dna sequence. Flags are:"
             HELP_START_LINE "\t translate : translate to proteins (single letters)"
             HELP_START_LINE "\t translate_long : translate to proteins (3 letters)"
@@ -55,22 +246,157 @@ menu_help_item MenuGenetics[] =
             HELP_START_LINE "\t rev : reverse dna sequence. Use with 'compl' and translate for reverse strand translation."
             HELP_START_LINE "\t cor : use with translate to show dna sequence and translation correlated. Does not work with splice."
             HELP_START_LINE "\t rna : print rna instead of dna (T becomes U)"
+            HELP_START_LINE "\t generic : use the generic print loop (reference for the specialized loops)"
+            HELP_START_LINE "\t fasta : FASTA output, width=n sets bases per line (0 one line)"
+            HELP_START_LINE "\t binary : binary record, 2 bits per base or protein letters"
+            HELP_START_LINE "\t json | tsv : sequence, or open reading frames with translate"
             },
+    { "region", "begin end [print flags]", "print the loaded sequence from file offset begin to end (1 based, inclusive)"
+            HELP_START_LINE "use find_start to find the first start codon of the region instead (codon_start is kept)"},
+    { "bed", "filename [find_start] [print flags]", "print (or find start codon in) every region of a BED file"
+            HELP_START_LINE "regions of other chromosomes than the loaded fasta sequence are ignored"},
+    { "gtf", "filename", "translate every transcript of a GTF or GFF3 file on the loaded sequence, FASTA output"
+            HELP_START_LINE "CDS features by transcript_id (or Parent), exons from their first start codon without CDS"
+            HELP_START_LINE "transcripts are sorted by position and translated with load_threads threads"},
+    { "scan", "[orfs]", "incremental analysis: only bases added since the last scan are scanned"
+            HELP_START_LINE "print first start codon, base composition and open reading frames count"
+            HELP_START_LINE "use orfs to list the open reading frames"},
+    { "masks", "[n|soft|repeat] [json|tsv] | skip [n|soft|repeat|both|none]", "print the N blocks, soft-masked (lower case) and repeat intervals"
+            HELP_START_LINE "interior N runs keep their place, leading N's only move the file offsets"
+            HELP_START_LINE "skip selects the masks the scans step over (default n): find_start, scan, translations (X) and peptide"},
+    { "repeats", "[dust_level] [min_length]", "find tandem repeats and low complexity regions, kept as the repeat mask"
+            HELP_START_LINE "DUST score above dust_level (default 20, 0 none) on 64 base windows, repeats of units of 1 to 6"
+            HELP_START_LINE "bases with 3 copies and min_length bases (default 12, 0 none); 'masks skip n repeat' steps over them"},
+    { "peptide", "query [mismatches] [json|tsv]", "search a peptide in the six frame translation (frames start at codon_start)"
+            HELP_START_LINE "hits with up to mismatches amino acid substitutions, X in the query matches any amino acid"},
+    { "align", "global|local|semi filename [search] [options]", "align the sequence against a fasta file sequence"
+            HELP_START_LINE "affine gaps, both sequences from codon_start with spliced introns removed"
+            HELP_START_LINE "semi: whole sequence inside the fasta sequence, local: best matching parts"
+            HELP_START_LINE "options: match=2 mismatch=-3 open=5 extend=2 band=n (diagonals kept, 0 full)"
+            HELP_START_LINE "score (score and end only, SIMD), rev (reverse complement of the sequence)"},
+    { "index", "build | save [file] | load [file] | count pattern | locate pattern [max] [json|tsv]",
+            "full-text index (FM-index) of the sequence for fast repeated lookups on both strands"
+            HELP_START_LINE "build with SA-IS, save/load default file is the fasta file name + .fmi"
+            HELP_START_LINE "count and locate search in O(pattern length), locate prints at most max hits (0 all)"},
+    { "vcf", "filename", "load the SNVs and indels of a vcf file for the loaded fasta sequence"
+            HELP_START_LINE "records of other chromosomes are ignored, REF must match the loaded sequence"},
+    { "haplotype", "sample|alt [1|2] [begin end] | ref | to_ref offset | to_hap offset",
+            "select a haplotype of a vcf sample (alt: all first alternate alleles), next commands work on it"
+            HELP_START_LINE "begin end: reference window (1 based, inclusive), file offsets start at begin"
+            HELP_START_LINE "splice and codon_start are mapped from the reference, ref goes back to the reference"
+            HELP_START_LINE "to_ref / to_hap map a file offset between the haplotype and the reference (0 if none)"},
+    { "codon_usage", "[rev] [ref]", "codon counts in all frames, RSCU, amino acids composition and CAI"
+            HELP_START_LINE "frames start at codon_start, spliced introns are skipped"
+            HELP_START_LINE "use rev for the reverse strand as primary frame"
+            HELP_START_LINE "use ref to set this sequence primary frame as CAI reference"},
+    { "stress", "[threads] [runs]", "run independent genetics objects on threads (default 4 threads x 20 runs)"
+            HELP_START_LINE "each run feeds a generated sequence, scans, translates, prints and counts codons"
+            HELP_START_LINE "and must give the same output as a single thread run; build with -fsanitize=thread to check races"},
+    { "selftest", "[runs] [seed]", "differential test of generated cases (default 200 runs, seed 1)"
+            HELP_START_LINE "random sequences, splice sets, codon starts, genetic codes and all print flags:"
+            HELP_START_LINE "specialized kernels, incremental scan, fasta loader, SIMD alignment and index"
+            HELP_START_LINE "must give the same output as the generic reference paths"},
+    { "cpu", "[scalar|sse4.2|avx2|avx512]", "print or select the instruction set of the kernels of this object"
+            HELP_START_LINE "encoding, reverse complement, translation and scan; levels above the cpu one are lowered"
+            HELP_START_LINE "new objects use the best level of the cpu or the GENETICS_CPU environment variable"},
+    { "stats", "[reset|latency [on|off]]", "print per command counters (time, bytes, bases, codons, output, allocations) in JSON"
+            HELP_START_LINE "use reset to clear all counters, latency to record per call latency histograms"
+            HELP_START_LINE "(min, percentiles and max of every command in the report)"},
+    { "trace", "[on|off]", "print the begin and end (with the duration) of every command on stderr"},
     {}
 };
 
-void *test_genetics(void *user_data, const char *line, size_t size, FILE* out)
+static void PrintError(void *ctx, GENETICS_LEVEL level, const char *message)
+{
+    fprintf(ctx, "%s\n", message);
+}
+
+static void PrintTrace(void *ctx, GENETICS_STAT cmd, bool begin, uint64_t ns)
+{
+    if (begin)
+        fprintf(stderr, "trace: begin %s\n", Genetics_StatName(cmd));
+    else
+        fprintf(stderr, "trace: end %s %lu ns\n", Genetics_StatName(cmd), ns);
+}
+
+/**
+ * @brief align the current sequence against a sequence loaded from a FASTA file in a second object
+ */
+static void Align(GeneticsObj *query, char *line, FILE *out, FILE *err)
+{
+    static const char *MODES[] = {"global", "local", "semi"};
+    char *params[16];
+    int n = ParseAllParams(line, sizeof(params) / sizeof(char *), params);
+    GeneticsAlignParams p = GeneticsAlignDefaults;
+    for (p.mode = 0; n > 0 && p.mode < 3 && strcasecmp(MODES[p.mode], params[0]); p.mode++)
+        ;
+    if (n < 2 || p.mode == 3)
+    {
+        fputs("ERROR: align global|local|semi filename [search] [options]\n", err);
+        return;
+    }
+    const char *search = "";
+    for (int i = 2; i < n; i++)
+    {
+        if (!strncasecmp("band=", params[i], 5))
+            p.band = strtoul(params[i] + 5, NULL, 10);
+        else if (!strncasecmp("match=", params[i], 6))
+            p.match = atoi(params[i] + 6);
+        else if (!strncasecmp("mismatch=", params[i], 9))
+            p.mismatch = atoi(params[i] + 9);
+        else if (!strncasecmp("open=", params[i], 5))
+            p.gapOpen = atoi(params[i] + 5);
+        else if (!strncasecmp("extend=", params[i], 7))
+            p.gapExtend = atoi(params[i] + 7);
+        else if (!strcasecmp("score", params[i]))
+            p.scoreOnly = true;
+        else if (!strcasecmp("rev", params[i]))
+            p.reverse = true;
+        else
+            search = params[i];
+    }
+    GeneticsObj *target = Genetics_New();
+    Genetics_SetErrorCallback(target, PrintError, err);
+    Genetics_SetOutput(target, out);
+    Genetics_LoadFASTA(target, 0, 0, params[1], search);
+    GeneticsAlignment a;
+    if (Genetics_Align(query, target, &p, &a))
+        fprintf(out, "align %s score %d query %lu-%lu target %lu-%lu matches %lu mismatches %lu gaps %lu cigar %s\n",
+                MODES[p.mode], a.score, a.queryBegin, a.queryEnd, a.targetBegin, a.targetEnd, a.matches,
+                a.mismatches, a.gaps, a.cigar && *a.cigar ? a.cigar : "*");
+    Genetics_Delete(target);
+}
+
+/**
+ * @brief server session object working on the sequence loaded before serving
+ */
+void *test_genetics_share(void *shared_data, FILE *err)
+{
+    GeneticsObj *obj = Genetics_New();
+    if (!Genetics_ShareDNA(obj, shared_data))
+        Genetics_ClearError(obj); // nothing loaded before serving, start empty
+    Genetics_SetErrorCallback(obj, PrintError, err);
+    Genetics_SetReferenceCache(obj, true); // sessions loading the same genome share it
+    return obj;
+}
+
+void *test_genetics(void *user_data, const char *line, size_t size, FILE *out, FILE *err)
 {
     if (!user_data)
     { //init
-        return Genetics_New();
+        GeneticsObj *obj = Genetics_New();
+        Genetics_SetErrorCallback(obj, PrintError, err);
+        return obj;
     }
     if (line == NULL)
     { //cleanup
+        if (StatsReport)
+            Genetics_PrintStats(user_data, stderr);
         Genetics_Delete(user_data);
         return NULL;
     }
     Genetics_SetOutput(user_data, out);
+    Genetics_SetErrorCallback(user_data, PrintError, err);
     if (!strncasecmp("splice", line, 6))
     {
         char* params[100];
@@ -91,6 +417,45 @@ void *test_genetics(void *user_data, const char *line, size_t size, FILE* out)
         Genetics_LoadFASTA(user_data, strtoul(start,NULL,10), strtoul(stop,NULL,10), filename, search);
         return user_data;
     }
+    if (!strncasecmp("load_threads", line, 12))
+    {
+        char *threads;
+        ParseParams((char *)line + 12, 1, &threads);
+        if (*threads)
+            Genetics_SetLoadThreads(user_data, atoi(threads));
+        fprintf(out, "load threads: %d\n", Genetics_GetLoadThreads(user_data));
+        return user_data;
+    }
+    if (!strncasecmp("refcache", line, 8))
+    {
+        char *action;
+        ParseParams((char *)line + 8, 1, &action);
+        if (!strcasecmp("on", action) || !strcasecmp("off", action))
+            Genetics_SetReferenceCache(user_data, !strcasecmp("on", action));
+        else if (!strcasecmp("clear", action))
+            Genetics_ClearReferenceCache();
+        else if (*action)
+            fprintf(err, "ERROR: unknown refcache action %s\n", action);
+        fprintf(out, "refcache: %s\n", Genetics_GetReferenceCache(user_data) ? "on" : "off");
+        Genetics_PrintReferenceCache(user_data);
+        return user_data;
+    }
+    if (!strncasecmp("load_fastq", line, 10))
+    {
+        char *filename, *trim, *mean, *len;
+        ParseParams((char *)line + 10, 4, &filename, &trim, &mean, &len);
+        GeneticsFastqFilter filter = {atoi(trim), atoi(mean), strtoul(len, NULL, 10)};
+        Genetics_LoadFASTQ(user_data, filename, &filter);
+        return user_data;
+    }
+    if (!strncasecmp("read", line, 4) && isspace(line[4]))
+    {
+        char *n;
+        ParseParams((char *)line + 4, 1, &n);
+        if (!Genetics_SelectRead(user_data, strtoul(n, NULL, 10)))
+            fprintf(err, "ERROR: read %s not found (%lu reads loaded)\n", n, Genetics_ReadCount(user_data));
+        return user_data;
+    }
     if (!strncasecmp("find_start", line, 10))
     {
         DNA_PRINT_FlAGS flags = 0;
@@ -112,7 +477,10 @@ void *test_genetics(void *user_data, const char *line, size_t size, FILE* out)
         int n = ParseAllParams((char *)line + 5, psize, params);
         for(int i = 0;i<n; i++)
         {
-            flags |= GetPrintFlag(params[i]);
+            if (!strncasecmp("width=", params[i], 6))
+                Genetics_SetFastaWidth(user_data, strtoul(params[i] + 6, NULL, 10));
+            else
+                flags |= GetPrintFlag(params[i]);
         }
         Genetics_PrintDNA(user_data, flags);
         return user_data;
@@ -149,10 +517,285 @@ void *test_genetics(void *user_data, const char *line, size_t size, FILE* out)
     {
         char *codon_start;
         ParseParams((char *)line + 11, 1, &codon_start);
-        Genetics_SetCodonStart(user_data, atoi(codon_start));
+        Genetics_SetCodonStart(user_data, strtoul(codon_start, NULL, 10));
+        return user_data;
+    }
+    if (!strncasecmp("region", line, 6))
+    {
+        DNA_PRINT_FlAGS flags = 0;
+        bool findStart = false;
+        char* params[100];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 6, psize, params);
+        if (n < 2)
+        {
+            PrintMenuHelp("help region", MenuGenetics, out);
+            return user_data;
+        }
+        for(int i = 2;i<n; i++)
+        {
+            if (!strcasecmp("find_start", params[i]))
+                findStart = true;
+            else
+                flags |= GetPrintFlag(params[i]);
+        }
+        size_t begin = strtoul(params[0], NULL, 10), end = strtoul(params[1], NULL, 10), offset;
+        if (!findStart)
+            Genetics_PrintRegion(user_data, begin, end, flags);
+        else if (Genetics_FindStartInRegion(user_data, begin, end, flags, &offset) && !(flags & DNA_PRINT_FORMAT_MASK))
+            fprintf(out, "start %lu\n", offset);
+        return user_data;
+    }
+    if (!strncasecmp("bed", line, 3))
+    {
+        DNA_PRINT_FlAGS flags = 0;
+        GENETICS_REGION_OP op = GENETICS_REGION_PRINT;
+        char* params[100];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 3, psize, params);
+        for(int i = 1;i<n; i++)
+        {
+            if (!strcasecmp("find_start", params[i]))
+                op = GENETICS_REGION_FIND_START;
+            else
+                flags |= GetPrintFlag(params[i]);
+        }
+        if (n > 0)
+            Genetics_RegionsBED(user_data, params[0], op, flags);
+        return user_data;
+    }
+    if (!strncasecmp("gtf", line, 3))
+    {
+        char *filename;
+        ParseParams((char *)line + 3, 1, &filename);
+        fprintf(out, "gtf: %lu transcripts translated\n", Genetics_TranslateGTF(user_data, filename));
+        return user_data;
+    }
+    if (!strncasecmp("scan", line, 4))
+    {
+        char *orfs;
+        ParseParams((char *)line + 4, 1, &orfs);
+        const GeneticsScan *scan = Genetics_Scan(user_data);
+        if (!scan)
+        {
+            fputs("scan is not available on a fastq read\n", out);
+            return user_data;
+        }
+        fprintf(out, "scanned %lu bp, start %lu, T %lu C %lu A %lu G %lu, orfs %lu",
+                scan->bases, scan->start, scan->composition[0], scan->composition[1],
+                scan->composition[2], scan->composition[3], scan->orfCount);
+        for (int f = 0; f < 3; f++)
+            if (scan->open[f].begin)
+                fprintf(out, ", frame %d open at %lu", f, scan->open[f].begin);
+        fputc('\n', out);
+        if (!strcasecmp("orfs", orfs))
+        {
+            for (size_t i = 0; i < scan->orfCount; i++)
+                fprintf(out, "%lu\t%lu\t%d\n", scan->orfs[i].begin, scan->orfs[i].end, scan->orfs[i].frame);
+        }
+        return user_data;
+    }
+    if (!strncasecmp("masks", line, 5))
+    {
+        char* params[4];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 5, psize, params);
+        GENETICS_MASK masks = 0;
+        DNA_PRINT_FlAGS flags = 0;
+        bool skip = n > 0 && !strcasecmp("skip", params[0]);
+        for (int i = skip ? 1 : 0; i < n; i++)
+        {
+            if (!strcasecmp("n", params[i]))
+                masks |= GENETICS_MASK_N;
+            else if (!strcasecmp("soft", params[i]))
+                masks |= GENETICS_MASK_SOFT;
+            else if (!strcasecmp("repeat", params[i]))
+                masks |= GENETICS_MASK_REPEAT;
+            else if (!strcasecmp("both", params[i]))
+                masks |= GENETICS_MASK_N | GENETICS_MASK_SOFT;
+            else if (strcasecmp("none", params[i]))
+                flags |= GetPrintFlag(params[i]);
+        }
+        if (!skip)
+        {
+            Genetics_PrintMasks(user_data, masks ? masks : GENETICS_MASK_N | GENETICS_MASK_SOFT, flags);
+            return user_data;
+        }
+        if (n > 1)
+            Genetics_SetMaskSkip(user_data, masks);
+        masks = Genetics_GetMaskSkip(user_data);
+        fprintf(out, "mask skip:%s%s%s%s\n", (masks & GENETICS_MASK_N) ? " n" : "",
+                (masks & GENETICS_MASK_SOFT) ? " soft" : "", (masks & GENETICS_MASK_REPEAT) ? " repeat" : "",
+                masks ? "" : " none");
+        return user_data;
+    }
+    if (!strncasecmp("repeats", line, 7))
+    {
+        char* params[2];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 7, psize, params);
+        unsigned dustLevel = n > 0 ? strtoul(params[0], NULL, 10) : GENETICS_DUST_LEVEL;
+        size_t minLength = n > 1 ? strtoul(params[1], NULL, 10) : GENETICS_REPEAT_MIN_LENGTH;
+        fprintf(out, "repeats: %lu intervals\n", Genetics_MaskRepeats(user_data, dustLevel, minLength));
+        return user_data;
+    }
+    if (!strncasecmp("codon_usage", line, 11))
+    {
+        DNA_PRINT_FlAGS flags = 0;
+        bool ref = false;
+        char* params[100];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 11, psize, params);
+        for(int i = 0;i<n; i++)
+        {
+            if (!strcasecmp("ref", params[i]))
+                ref = true;
+            else
+                flags |= GetPrintFlag(params[i]);
+        }
+        GeneticsCodonUsage cu;
+        if (Genetics_CodonUsage(user_data, flags, &cu))
+        {
+            if (ref)
+                Genetics_SetCodonReference(user_data, cu.counts[cu.frame]);
+            else
+                Genetics_PrintCodonUsage(user_data, &cu);
+        }
+        return user_data;
+    }
+    if (!strncasecmp("peptide", line, 7))
+    {
+        char *query, *mismatches, *format;
+        ParseParams((char *)line + 7, 3, &query, &mismatches, &format);
+        if (isdigit(*mismatches))
+            Genetics_SearchPeptide(user_data, query, atoi(mismatches), GetPrintFlag(format), NULL, NULL);
+        else
+            Genetics_SearchPeptide(user_data, query, 0, GetPrintFlag(mismatches), NULL, NULL);
+        return user_data;
+    }
+    if (!strncasecmp("index", line, 5))
+    {
+        char *cmd, *arg, *max, *format;
+        ParseParams((char *)line + 5, 4, &cmd, &arg, &max, &format);
+        if (!strcasecmp("build", cmd))
+            Genetics_BuildIndex(user_data);
+        else if (!strcasecmp("save", cmd))
+            Genetics_SaveIndex(user_data, arg);
+        else if (!strcasecmp("load", cmd))
+            Genetics_LoadIndex(user_data, arg);
+        else if (!strcasecmp("count", cmd))
+        {
+            size_t counts[2];
+            size_t n = Genetics_IndexCount(user_data, arg, counts);
+            fprintf(out, "index %s: %lu (+ %lu, - %lu)\n", arg, n, counts[0], counts[1]);
+        }
+        else if (!strcasecmp("locate", cmd))
+        {
+            if (isdigit(*max))
+                Genetics_IndexLocate(user_data, arg, strtoul(max, NULL, 10), GetPrintFlag(format), NULL, NULL);
+            else
+                Genetics_IndexLocate(user_data, arg, 0, GetPrintFlag(max), NULL, NULL);
+        }
+        else
+            PrintMenuHelp("help index", MenuGenetics, out);
+        return user_data;
+    }
+    if (!strncasecmp("vcf", line, 3))
+    {
+        char *filename;
+        ParseParams((char *)line + 3, 1, &filename);
+        size_t n = Genetics_LoadVCF(user_data, filename);
+        fprintf(out, "vcf: %lu variants, %lu samples\n", n, Genetics_VCFSamples(user_data));
+        return user_data;
+    }
+    if (!strncasecmp("haplotype", line, 9))
+    {
+        char* params[5];
+        static const int psize = sizeof(params)/sizeof(char*);
+        int n = ParseAllParams((char *)line + 9, psize, params);
+        if (n == 0)
+            PrintMenuHelp("help haplotype", MenuGenetics, out);
+        else if (!strcasecmp("ref", params[0]))
+            Genetics_SelectReference(user_data);
+        else if (!strcasecmp("to_ref", params[0]) && n > 1)
+            fprintf(out, "reference %lu\n", Genetics_HaplotypeToReference(user_data, strtoul(params[1], NULL, 10)));
+        else if (!strcasecmp("to_hap", params[0]) && n > 1)
+            fprintf(out, "haplotype %lu\n", Genetics_ReferenceToHaplotype(user_data, strtoul(params[1], NULL, 10)));
+        else
+        {
+            size_t sample = GENETICS_SAMPLE_ALT, samples = Genetics_VCFSamples(user_data), variants;
+            if (strcasecmp("alt", params[0]))
+                for (sample = 0; sample < samples && strcmp(params[0], Genetics_VCFSampleName(user_data, sample)); sample++)
+                    ;
+            int haplotype = n > 1 ? atoi(params[1]) : 1;
+            size_t begin = n > 3 ? strtoul(params[2], NULL, 10) : 0, end = n > 3 ? strtoul(params[3], NULL, 10) : 0;
+            if (sample == samples)
+                fprintf(err, "ERROR: sample %s not found (%lu samples)\n", params[0], samples);
+            else if (Genetics_SelectHaplotype(user_data, sample, haplotype, begin, end, &variants))
+                fprintf(out, "haplotype %s:%d: %lu variants\n", params[0], haplotype, variants);
+        }
+        return user_data;
+    }
+    if (!strncasecmp("align", line, 5))
+    {
+        Align(user_data, (char *)line + 5, out, err);
+        return user_data;
+    }
+    if (!strncasecmp("stress", line, 6))
+    {
+        char *threads, *runs;
+        ParseParams((char *)line + 6, 2, &threads, &runs);
+        Stress(out, atoi(threads), atoi(runs));
+        return user_data;
+    }
+    if (!strncasecmp("selftest", line, 8))
+    {
+        char *runs, *seed;
+        ParseParams((char *)line + 8, 2, &runs, &seed);
+        SelfTest(out, err, atoi(runs), *seed ? strtoul(seed, NULL, 10) : 1);
+        return user_data;
+    }
+    if (!strncasecmp("cpu", line, 3))
+    {
+        char *name;
+        ParseParams((char *)line + 3, 1, &name);
+        if (*name)
+        {
+            GENETICS_CPU level = 0;
+            while (level < GENETICS_CPU_COUNT && strcasecmp(name, Genetics_CpuName(level)))
+                level++;
+            if (level == GENETICS_CPU_COUNT)
+                fprintf(err, "ERROR: unknown instruction set %s\n", name);
+            else
+                Genetics_SetCpu(user_data, level);
+        }
+        fprintf(out, "cpu: %s (supported %s)\n", Genetics_CpuName(Genetics_GetCpu(user_data)),
+                Genetics_CpuName(Genetics_CpuSupported()));
+        return user_data;
+    }
+    if (!strncasecmp("stats", line, 5))
+    {
+        char *action, *mode;
+        ParseParams((char *)line + 5, 2, &action, &mode);
+        if (!strcasecmp("reset", action))
+            Genetics_ResetStats(user_data);
+        else if (!strcasecmp("latency", action))
+        {
+            if (!Genetics_SetLatencyHistograms(user_data, strcasecmp("off", mode) != 0))
+                fputs("ERROR: latency histograms need a build with stats\n", err);
+        }
+        else
+            Genetics_PrintStats(user_data, out);
+        return user_data;
+    }
+    if (!strncasecmp("trace", line, 5))
+    {
+        char *mode;
+        ParseParams((char *)line + 5, 1, &mode);
+        Genetics_SetTraceCallback(user_data, strcasecmp("off", mode) ? PrintTrace : NULL, NULL);
         return user_data;
     }
-    if(PrintMenuHelp(line,MenuGenetics)) return user_data;
+    if(PrintMenuHelp(line,MenuGenetics,out)) return user_data;
 
     int dir;
     if (DNA_DIR_NONE != (dir = Genetics_DNAInput(user_data)))
@@ -217,23 +860,23 @@ int ParseAllParams(char* input, int argc, char** argv)
     return n;
 }
 
-void PrintHelp(menu_help_item* menu)
+void PrintHelp(menu_help_item* menu, FILE *out)
 {
     while(menu->command)
     {
-        printf(COLOR_HIGHLIGHT "%s" COLOR_OFF " %s" HELP_START_LINE "%s\n",menu->command, menu->params, menu->description);
+        fprintf(out, COLOR_HIGHLIGHT "%s" COLOR_OFF " %s" HELP_START_LINE "%s\n",menu->command, menu->params, menu->description);
         menu++;
     }
 }
 
-bool PrintMenuHelp(const char* line, menu_help_item* menu_help)
+bool PrintMenuHelp(const char* line, menu_help_item* menu_help, FILE *out)
 {
     if (!strncasecmp(line, "help", 4))
     {
-        PrintHelp(menu_help);
-        puts("-------");
-        PrintHelp(MenuShared);
-        PrintHelp(MenuGlobal);
+        PrintHelp(menu_help, out);
+        fputs("-------\n", out);
+        PrintHelp(MenuShared, out);
+        PrintHelp(MenuGlobal, out);
         return true;
     }
 
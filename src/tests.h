@@ -1,6 +1,41 @@
 #pragma once
 
-void *test_genetics(void *user_data, const char *line, size_t size,FILE* out);
+/**
+ * @brief menu controller: init with user_data NULL, cleanup with line NULL.
+ *        Command output goes to out, errors to err.
+ */
+typedef void *(*TFunc)(void *user_data, const char *line, size_t size, FILE *out, FILE *err);
+/**
+ * @brief new menu data working on the data of another session (read only, see server mode)
+ */
+typedef void *(*TShare)(void *shared_data, FILE *err);
+
+void *test_genetics(void *user_data, const char *line, size_t size, FILE *out, FILE *err);
+void *test_genetics_share(void *shared_data, FILE *err);
+extern bool StatsReport;
+
+#define TEST_MENUS_MAX 8
+typedef struct _TestSession
+{
+    int menu_index;                     // -1 in the main menu
+    void *user_data[TEST_MENUS_MAX];    // per menu data
+    FILE *out;
+    FILE *err;
+    const struct _TestSession *shared;  // server mode: session that loaded the shared data
+} TestSession;
+
+void Session_Init(TestSession *session, FILE *out, FILE *err, const TestSession *shared);
+void Session_Cleanup(TestSession *session);
+bool ProcessNewInput(TestSession *session, int line_no, bool fromFile, char *input, size_t insize);
+
+#define SERVER_WORKERS_DEFAULT 4
+#define SERVER_WORKERS_DEFAULT_STR "4"
+bool RunServer(const char *path, int workers, const TestSession *shared);
+#define DIFFTEST_MAX_BASES 4096  // longer inputs are cut
+#define SELFTEST_CASE_MAX  2048  // bytes of a generated case
+int DiffTest_Run(const uint8_t *data, size_t size, FILE *err);
+int DiffTest_Repros(FILE *err);
+
 void ParseParams(char *input, int n, ...);
 int ParseAllParams(char* input, int argc, char** argv);
 
@@ -21,5 +56,5 @@ typedef struct _menu_item {
 }menu_help_item;
 extern menu_help_item MenuShared[];
 extern menu_help_item MenuGlobal[];
-void PrintHelp(menu_help_item* menu);
-bool PrintMenuHelp(const char* line, menu_help_item* menu_help);
+void PrintHelp(menu_help_item* menu, FILE *out);
+bool PrintMenuHelp(const char* line, menu_help_item* menu_help, FILE *out);